@@ -0,0 +1,260 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/census_loader.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population.pb.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/port/mapped_file.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+
+namespace abesim {
+namespace {
+
+absl::Status CorruptError(absl::string_view path, const int64 record,
+                          absl::string_view reason) {
+  return absl::Status(absl::StatusCode::kDataLoss,
+                      absl::StrCat("Corrupt census file ", path, " at record ",
+                                   record, ": ", reason));
+}
+
+// PUMS codes fields that do not apply, such as the place of work of persons
+// who do not work, as blanks.
+bool IsBlank(absl::string_view value) {
+  return std::all_of(value.begin(), value.end(),
+                     [](const char c) { return c == 'b' || c == ' '; });
+}
+
+// A batch of consecutive records of one file and the households parsed from
+// them.
+struct Batch {
+  int64 first_record = 0;
+  std::vector<absl::string_view> records;
+  std::vector<Household> households;
+  // Records that failed to parse, per parsing task.
+  std::vector<int64> failed_records;
+};
+
+// Maps parsed households to locations and agents in order.
+class CensusMapper {
+ public:
+  CensusMapper(const CensusLoaderOptions& options,
+               const UuidGenerator& uuid_generator,
+               HealthStateSampler* const health_state_sampler,
+               CensusPopulationSink* const sink, CensusLoadStats* const stats)
+      : options_(options),
+        uuid_generator_(uuid_generator),
+        health_state_sampler_(health_state_sampler),
+        sink_(sink),
+        stats_(stats) {}
+
+  void Map(const Household& household) {
+    LocationProto home;
+    home.set_uuid(uuid_generator_.GenerateUuid());
+    home.set_type(LocationProto::HOUSEHOLD);
+    home.set_size(household.person_size());
+    sink_->AddLocation(home);
+    ++stats_->households;
+    for (const Person& person : household.person()) {
+      AgentProto agent;
+      agent.set_uuid(uuid_generator_.GenerateUuid());
+      agent.set_population_profile_id(options_.population_profile_id);
+      agent.set_initial_health_state(
+          health_state_sampler_ == nullptr
+              ? HealthState::SUSCEPTIBLE
+              : health_state_sampler_->Sample().state());
+      LocationProto* membership = agent.add_locations();
+      membership->set_uuid(home.uuid());
+      membership->set_type(LocationProto::HOUSEHOLD);
+      if (!IsBlank(person.pums_powpuma())) {
+        membership = agent.add_locations();
+        membership->set_uuid(
+            NextWorkplace(absl::StrCat(person.pums_powsp(), "/",
+                                       person.pums_powpuma())));
+        membership->set_type(LocationProto::BUSINESS);
+      }
+      sink_->AddAgent(agent);
+      ++stats_->persons;
+    }
+  }
+
+  // Adds the workplaces that are not yet full, in order of place of work.
+  void Finish() {
+    std::vector<std::pair<std::string, LocationProto>> open(
+        std::make_move_iterator(workplaces_.begin()),
+        std::make_move_iterator(workplaces_.end()));
+    workplaces_.clear();
+    std::sort(open.begin(), open.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& [place_of_work, workplace] : open) {
+      AddWorkplace(workplace);
+    }
+  }
+
+ private:
+  // Returns the uuid of the workplace that the next worker at place_of_work
+  // joins.
+  int64 NextWorkplace(std::string place_of_work) {
+    auto [iter, inserted] =
+        workplaces_.try_emplace(std::move(place_of_work), LocationProto());
+    LocationProto& workplace = iter->second;
+    if (inserted) {
+      workplace.set_uuid(uuid_generator_.GenerateUuid());
+      workplace.set_type(LocationProto::BUSINESS);
+    }
+    const int64 uuid = workplace.uuid();
+    workplace.set_size(workplace.size() + 1);
+    if (workplace.size() >= options_.workplace_size) {
+      AddWorkplace(workplace);
+      workplaces_.erase(iter);
+    }
+    return uuid;
+  }
+
+  void AddWorkplace(const LocationProto& workplace) {
+    sink_->AddLocation(workplace);
+    ++stats_->workplaces;
+  }
+
+  const CensusLoaderOptions& options_;
+  const UuidGenerator& uuid_generator_;
+  HealthStateSampler* const health_state_sampler_;
+  CensusPopulationSink* const sink_;
+  CensusLoadStats* const stats_;
+  // The workplace being filled for each place of work.  Only these are kept
+  // in memory, so memory use grows with the number of places of work rather
+  // than with the number of workers.
+  absl::flat_hash_map<std::string, LocationProto> workplaces_;
+};
+
+// Splits the next batch of records from the front of contents.
+absl::Status NextBatch(absl::string_view path, const int64 batch_bytes,
+                       absl::string_view* contents, Batch* batch) {
+  batch->first_record += batch->records.size();
+  batch->records.clear();
+  int64 bytes = 0;
+  while (!contents->empty() && bytes < batch_bytes) {
+    const int64 record = batch->first_record + batch->records.size();
+    const size_t remaining = contents->size();
+    uint64 length;
+    if (!GetVarint64(contents, &length)) {
+      return CorruptError(path, record, "truncated length");
+    }
+    if (length > contents->size()) {
+      return CorruptError(path, record, "truncated household");
+    }
+    batch->records.push_back(contents->substr(0, length));
+    contents->remove_prefix(length);
+    bytes += remaining - contents->size();
+  }
+  return absl::OkStatus();
+}
+
+// Parses the records of batch into its households on execution.
+void ParseBatch(const int num_tasks, Batch* const batch,
+                Execution* const execution) {
+  const int64 num_records = batch->records.size();
+  batch->households.resize(num_records);
+  batch->failed_records.assign(num_tasks, -1);
+  for (int task = 0; task < num_tasks; ++task) {
+    execution->Add([batch, task, num_tasks, num_records]() {
+      const int64 end = num_records * (task + 1) / num_tasks;
+      for (int64 i = num_records * task / num_tasks; i < end; ++i) {
+        const absl::string_view record = batch->records[i];
+        if (!batch->households[i].ParseFromArray(record.data(),
+                                                 record.size())) {
+          batch->failed_records[task] = batch->first_record + i;
+          return;
+        }
+      }
+    });
+  }
+}
+
+absl::Status CheckParsed(absl::string_view path, const Batch& batch) {
+  for (const int64 record : batch.failed_records) {
+    if (record >= 0) return CorruptError(path, record, "invalid household");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+StatusOr<CensusLoadStats> LoadCensusPopulation(
+    absl::Span<const std::string> paths, const CensusLoaderOptions& options,
+    const UuidGenerator& uuid_generator,
+    HealthStateSampler* const health_state_sampler,
+    CensusPopulationSink* const sink) {
+  const absl::Time start = absl::Now();
+  CensusLoadStats stats;
+  CensusMapper mapper(options, uuid_generator, health_state_sampler, sink,
+                      &stats);
+  const int num_workers = std::max(1, options.num_workers);
+  auto executor = NewExecutor(num_workers);
+  // Households are mapped on this thread while the next batch is parsed, so
+  // that mapping, which must be sequential, overlaps with parsing.
+  Batch parsing, mapping;
+  for (const std::string& path : paths) {
+    auto file = file::MappedFile::Open(path);
+    if (!file.ok()) return file.status();
+    absl::string_view contents = file.value()->contents();
+    parsing.first_record = 0;
+    parsing.records.clear();
+    while (!contents.empty()) {
+      absl::Status status =
+          NextBatch(path, options.batch_bytes, &contents, &parsing);
+      if (!status.ok()) return status;
+      auto execution = executor->NewExecution();
+      ParseBatch(num_workers, &parsing, execution.get());
+      for (const Household& household : mapping.households) {
+        mapper.Map(household);
+      }
+      execution->Wait();
+      status = CheckParsed(path, parsing);
+      if (!status.ok()) return status;
+      std::swap(parsing.households, mapping.households);
+    }
+    ++stats.files;
+    stats.bytes += file.value()->contents().size();
+    stats.elapsed = absl::Now() - start;
+    LOG(INFO) << "Loaded " << path << ": " << stats.persons << " persons in "
+              << stats.households << " households so far, "
+              << stats.persons_per_second() << " persons/s, "
+              << stats.megabytes_per_second() << " MB/s";
+  }
+  for (const Household& household : mapping.households) {
+    mapper.Map(household);
+  }
+  mapper.Finish();
+  stats.elapsed = absl::Now() - start;
+  LOG(INFO) << "Loaded " << stats.persons << " persons, "
+            << stats.households << " households and " << stats.workplaces
+            << " workplaces from " << stats.files << " files in "
+            << stats.elapsed << " (" << stats.persons_per_second()
+            << " persons/s, " << stats.megabytes_per_second() << " MB/s)";
+  return stats;
+}
+
+}  // namespace abesim
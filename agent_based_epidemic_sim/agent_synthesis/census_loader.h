@@ -0,0 +1,92 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_CENSUS_LOADER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_CENSUS_LOADER_H_
+
+#include <string>
+
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/agent_synthesis/agent_sampler.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/uuid_generator.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+// Loads a census-derived population from files of Household records, see
+// agent_synthesis/population.proto.  Each file holds a sequence of records,
+// each a varint byte length followed by a serialized Household.
+//
+// Every household becomes a HOUSEHOLD location and every person an agent
+// belonging to it.  Persons with a place of work (pums_powsp and
+// pums_powpuma) are also assigned a BUSINESS location.  Workers with the same
+// place of work fill workplaces of a bounded size one after the other, in the
+// order they are read.
+
+namespace abesim {
+
+struct CensusLoaderOptions {
+  // The number of threads parsing records.
+  int num_workers = 1;
+  // Records are parsed in batches of roughly this many bytes.  At most two
+  // batches of parsed households are held at a time, which bounds the memory
+  // used regardless of the size of the population.
+  int64 batch_bytes = 16 << 20;
+  // The maximum number of agents sharing a workplace.
+  int32 workplace_size = 50;
+  // The population profile of all agents.
+  int64 population_profile_id = 0;
+};
+
+struct CensusLoadStats {
+  int64 files = 0;
+  int64 bytes = 0;
+  int64 households = 0;
+  int64 persons = 0;
+  int64 workplaces = 0;
+  absl::Duration elapsed;
+
+  double persons_per_second() const {
+    return persons / absl::ToDoubleSeconds(elapsed);
+  }
+  double megabytes_per_second() const {
+    return bytes / absl::ToDoubleSeconds(elapsed) / (1 << 20);
+  }
+};
+
+// Receives the locations and agents of a population as they are loaded.
+// A household is added before its members.  A workplace is added once it is
+// full, or at the end of the load, and so usually after its members.
+class CensusPopulationSink {
+ public:
+  virtual void AddLocation(const LocationProto& location) = 0;
+  virtual void AddAgent(const AgentProto& agent) = 0;
+  virtual ~CensusPopulationSink() = default;
+};
+
+// Loads the households of the given files in order.  Uuids of locations and
+// agents are taken from uuid_generator.  The initial health state of each
+// agent is sampled from health_state_sampler, or is SUSCEPTIBLE if it is
+// null.  Progress and the ingest throughput are logged per file.
+StatusOr<CensusLoadStats> LoadCensusPopulation(
+    absl::Span<const std::string> paths, const CensusLoaderOptions& options,
+    const UuidGenerator& uuid_generator,
+    HealthStateSampler* health_state_sampler, CensusPopulationSink* sink);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_CENSUS_LOADER_H_
@@ -0,0 +1,165 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/census_loader.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population.pb.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+class FakeSink : public CensusPopulationSink {
+ public:
+  void AddLocation(const LocationProto& location) override {
+    locations.push_back(location);
+  }
+  void AddAgent(const AgentProto& agent) override { agents.push_back(agent); }
+
+  std::vector<LocationProto> locations;
+  std::vector<AgentProto> agents;
+};
+
+Household MakeHousehold(const std::vector<std::string>& powpumas) {
+  Household household;
+  household.set_type(Household::HOUSEHOLD);
+  for (const std::string& powpuma : powpumas) {
+    Person* person = household.add_person();
+    person->set_pums_powsp("006");
+    person->set_pums_powpuma(powpuma);
+  }
+  return household;
+}
+
+void WriteHouseholds(const std::string& path,
+                     const std::vector<Household>& households) {
+  std::string contents;
+  for (const Household& household : households) {
+    const std::string record = household.SerializeAsString();
+    PutVarint64(record.size(), &contents);
+    contents.append(record);
+  }
+  auto file = file::OpenOrDie(path);
+  PANDEMIC_ASSERT_OK(file->WriteString(contents));
+  PANDEMIC_ASSERT_OK(file->Close());
+}
+
+TEST(CensusLoaderTest, MapsHouseholdsToAgentsAndLocations) {
+  std::vector<std::string> paths = {TestPath("census_0"),
+                                    TestPath("census_1")};
+  std::vector<Household> households;
+  for (int i = 0; i < 20; ++i) {
+    households.push_back(MakeHousehold({"00100", "bbbbb", "00200"}));
+  }
+  WriteHouseholds(paths[0], households);
+  WriteHouseholds(paths[1], {MakeHousehold({"00100"}), MakeHousehold({})});
+
+  std::vector<FakeSink> sinks(2);
+  for (int i = 0; i < sinks.size(); ++i) {
+    CensusLoaderOptions options;
+    // Small batches and several workers exercise the parsing pipeline.
+    options.num_workers = i == 0 ? 1 : 3;
+    options.batch_bytes = 40;
+    options.workplace_size = 8;
+    options.population_profile_id = 2;
+    ShardedSequentialUuidGenerator uuid_generator(0);
+    auto stats = LoadCensusPopulation(paths, options, uuid_generator,
+                                      /*health_state_sampler=*/nullptr,
+                                      &sinks[i]);
+    PANDEMIC_ASSERT_OK(stats.status());
+    EXPECT_EQ(stats.value().files, 2);
+    EXPECT_EQ(stats.value().households, 22);
+    EXPECT_EQ(stats.value().persons, 61);
+    // 21 workers at 00100 and 20 at 00200, in workplaces of up to 8.
+    EXPECT_EQ(stats.value().workplaces, 3 + 3);
+  }
+
+  const FakeSink& sink = sinks[0];
+  absl::flat_hash_map<int64, LocationProto> locations;
+  for (const LocationProto& location : sink.locations) {
+    EXPECT_TRUE(locations.emplace(location.uuid(), location).second);
+  }
+  EXPECT_EQ(locations.size(), 22 + 6);
+  ASSERT_EQ(sink.agents.size(), 61);
+  absl::flat_hash_map<int64, int> members;
+  int workers = 0;
+  for (const AgentProto& agent : sink.agents) {
+    EXPECT_EQ(agent.population_profile_id(), 2);
+    EXPECT_EQ(agent.initial_health_state(), HealthState::SUSCEPTIBLE);
+    ASSERT_GE(agent.locations_size(), 1);
+    EXPECT_EQ(agent.locations(0).type(), LocationProto::HOUSEHOLD);
+    for (const LocationProto& membership : agent.locations()) {
+      ASSERT_TRUE(locations.contains(membership.uuid()));
+      EXPECT_EQ(locations[membership.uuid()].type(), membership.type());
+      ++members[membership.uuid()];
+    }
+    if (agent.locations_size() == 2) ++workers;
+  }
+  EXPECT_EQ(workers, 41);
+  for (const auto& [uuid, location] : locations) {
+    EXPECT_EQ(location.size(), members[uuid]);
+    EXPECT_LE(location.size(), 8);
+  }
+
+  // The population does not depend on the number of workers.
+  ASSERT_EQ(sinks[1].locations.size(), sink.locations.size());
+  for (int i = 0; i < sink.locations.size(); ++i) {
+    EXPECT_EQ(sinks[1].locations[i].DebugString(),
+              sink.locations[i].DebugString());
+  }
+  for (int i = 0; i < sink.agents.size(); ++i) {
+    EXPECT_EQ(sinks[1].agents[i].DebugString(), sink.agents[i].DebugString());
+  }
+}
+
+TEST(CensusLoaderTest, RejectsCorruptFiles) {
+  const std::string path = TestPath("census_corrupt");
+  std::string contents;
+  PutVarint64(100, &contents);
+  contents.append("too short");
+  auto file = file::OpenOrDie(path);
+  PANDEMIC_ASSERT_OK(file->WriteString(contents));
+  PANDEMIC_ASSERT_OK(file->Close());
+
+  FakeSink sink;
+  ShardedSequentialUuidGenerator uuid_generator(0);
+  const std::vector<std::string> paths = {path};
+  EXPECT_EQ(LoadCensusPopulation(paths, CensusLoaderOptions(), uuid_generator,
+                                 /*health_state_sampler=*/nullptr, &sink)
+                .status()
+                .code(),
+            absl::StatusCode::kDataLoss);
+  const std::vector<std::string> missing = {TestPath("census_missing")};
+  EXPECT_FALSE(LoadCensusPopulation(missing, CensusLoaderOptions(),
+                                    uuid_generator,
+                                    /*health_state_sampler=*/nullptr, &sink)
+                   .ok());
+}
+
+}  // namespace
+}  // namespace abesim
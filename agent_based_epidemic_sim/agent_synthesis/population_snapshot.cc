@@ -0,0 +1,232 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/population_snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace abesim {
+namespace {
+
+constexpr absl::string_view kMagic = "ABESPOP1";
+// Staged agents and memberships are copied into the snapshot in chunks of this
+// size.
+constexpr size_t kCopyChunkSize = 1 << 20;
+
+struct SnapshotFooter {
+  int64 num_locations;
+  int64 num_agents;
+  int64 num_memberships;
+  int64 population_profiles_size;
+};
+
+template <typename T>
+absl::string_view AsBytes(const T& record) {
+  return absl::string_view(reinterpret_cast<const char*>(&record),
+                           sizeof(record));
+}
+
+// Returns a span over num records of type T starting at offset in contents.
+template <typename T>
+absl::Span<const T> RecordsAt(absl::string_view contents, const int64 offset,
+                              const int64 num) {
+  return absl::MakeConstSpan(
+      reinterpret_cast<const T*>(contents.data() + offset), num);
+}
+
+absl::Status CorruptError(absl::string_view path, absl::string_view reason) {
+  return absl::Status(
+      absl::StatusCode::kDataLoss,
+      absl::StrCat("Corrupt population snapshot ", path, ": ", reason));
+}
+
+}  // namespace
+
+PopulationSnapshotWriter::PopulationSnapshotWriter(
+    absl::string_view path, const PopulationProfiles& population_profiles)
+    : path_(path),
+      agents_path_(absl::StrCat(path, ".agents")),
+      memberships_path_(absl::StrCat(path, ".memberships")),
+      population_profiles_(population_profiles.SerializeAsString()),
+      file_(file::OpenAsyncOrDie(path_)),
+      agents_file_(file::OpenAsyncOrDie(agents_path_)),
+      memberships_file_(file::OpenAsyncOrDie(memberships_path_)) {
+  status_.Update(file_->WriteString(kMagic));
+}
+
+PopulationSnapshotWriter::PopulationSnapshotWriter(
+    absl::string_view path, absl::Span<const LocationProto> locations,
+    const PopulationProfiles& population_profiles)
+    : PopulationSnapshotWriter(path, population_profiles) {
+  for (const LocationProto& location : locations) {
+    status_.Update(AddLocation(location));
+  }
+}
+
+absl::Status PopulationSnapshotWriter::AddLocation(
+    const LocationProto& location) {
+  const SnapshotLocation record = {.uuid = location.uuid(),
+                                   .type = location.type(),
+                                   .size = location.size()};
+  ++num_locations_;
+  return file_->WriteString(AsBytes(record));
+}
+
+absl::Status PopulationSnapshotWriter::AddAgent(const AgentProto& agent) {
+  const SnapshotAgent record = {
+      .uuid = agent.uuid(),
+      .population_profile_id = agent.population_profile_id(),
+      .initial_health_state = agent.initial_health_state(),
+      .num_memberships = agent.locations_size(),
+      .first_membership = num_memberships_};
+  absl::Status status = agents_file_->WriteString(AsBytes(record));
+  for (const LocationProto& location : agent.locations()) {
+    const SnapshotMembership membership = {.location_uuid = location.uuid(),
+                                           .type = location.type(),
+                                           .reserved = 0};
+    status.Update(memberships_file_->WriteString(AsBytes(membership)));
+  }
+  ++num_agents_;
+  num_memberships_ += agent.locations_size();
+  return status;
+}
+
+void PopulationSnapshotWriter::CopyStagedFile(const std::string& path) {
+  if (status_.ok()) {
+    // The staged records are copied through a mapping rather than read into
+    // memory.
+    auto staged = file::MappedFile::Open(path);
+    status_.Update(staged.status());
+    if (staged.ok()) {
+      // Chunked so that the writer's bounded buffers apply backpressure
+      // instead of buffering the whole file.
+      absl::string_view contents = staged.value()->contents();
+      while (!contents.empty() && status_.ok()) {
+        const size_t chunk = std::min(contents.size(), kCopyChunkSize);
+        status_.Update(file_->WriteString(contents.substr(0, chunk)));
+        contents.remove_prefix(chunk);
+      }
+    }
+  }
+  std::remove(path.c_str());
+}
+
+absl::Status PopulationSnapshotWriter::Close() {
+  status_.Update(agents_file_->Close());
+  status_.Update(memberships_file_->Close());
+  CopyStagedFile(agents_path_);
+  CopyStagedFile(memberships_path_);
+  status_.Update(file_->WriteString(population_profiles_));
+  const SnapshotFooter footer = {
+      .num_locations = num_locations_,
+      .num_agents = num_agents_,
+      .num_memberships = num_memberships_,
+      .population_profiles_size =
+          static_cast<int64>(population_profiles_.size())};
+  status_.Update(file_->WriteString(AsBytes(footer)));
+  status_.Update(file_->WriteString(kMagic));
+  status_.Update(file_->Close());
+  return status_;
+}
+
+StatusOr<std::unique_ptr<PopulationSnapshot>> PopulationSnapshot::Open(
+    absl::string_view path) {
+  auto file = file::MappedFile::Open(path);
+  if (!file.ok()) return file.status();
+  const absl::string_view contents = file.value()->contents();
+  const int64 min_size = 2 * kMagic.size() + sizeof(SnapshotFooter);
+  if (contents.size() < min_size ||
+      contents.substr(0, kMagic.size()) != kMagic ||
+      contents.substr(contents.size() - kMagic.size()) != kMagic) {
+    return CorruptError(path, "missing magic");
+  }
+  SnapshotFooter footer;
+  std::memcpy(&footer,
+              contents.data() + contents.size() - kMagic.size() -
+                  sizeof(SnapshotFooter),
+              sizeof(SnapshotFooter));
+  for (const int64 count :
+       {footer.num_locations, footer.num_agents, footer.num_memberships,
+        footer.population_profiles_size}) {
+    if (count < 0 || count > contents.size()) {
+      return CorruptError(path, "invalid footer");
+    }
+  }
+  const int64 locations_offset = kMagic.size();
+  const int64 agents_offset =
+      locations_offset + footer.num_locations * sizeof(SnapshotLocation);
+  const int64 memberships_offset =
+      agents_offset + footer.num_agents * sizeof(SnapshotAgent);
+  const int64 population_profiles_offset =
+      memberships_offset + footer.num_memberships * sizeof(SnapshotMembership);
+  if (population_profiles_offset + footer.population_profiles_size +
+          sizeof(SnapshotFooter) + kMagic.size() !=
+      contents.size()) {
+    return CorruptError(path, "size does not match footer");
+  }
+  auto snapshot =
+      absl::WrapUnique(new PopulationSnapshot(std::move(file).value()));
+  snapshot->locations_ = RecordsAt<SnapshotLocation>(
+      contents, locations_offset, footer.num_locations);
+  snapshot->agents_ =
+      RecordsAt<SnapshotAgent>(contents, agents_offset, footer.num_agents);
+  snapshot->memberships_ = RecordsAt<SnapshotMembership>(
+      contents, memberships_offset, footer.num_memberships);
+  for (const SnapshotAgent& agent : snapshot->agents_) {
+    if (agent.num_memberships < 0 || agent.first_membership < 0 ||
+        agent.first_membership >
+            footer.num_memberships - agent.num_memberships) {
+      return CorruptError(path, absl::StrCat("invalid memberships of agent ",
+                                             agent.uuid));
+    }
+  }
+  if (!snapshot->population_profiles_.ParseFromArray(
+          contents.data() + population_profiles_offset,
+          footer.population_profiles_size)) {
+    return CorruptError(path, "invalid population profiles");
+  }
+  return snapshot;
+}
+
+LocationProto PopulationSnapshot::GetLocation(const int64 index) const {
+  const SnapshotLocation& record = locations_[index];
+  LocationProto location;
+  location.set_uuid(record.uuid);
+  location.set_type(static_cast<LocationProto::Type>(record.type));
+  location.set_size(record.size);
+  return location;
+}
+
+AgentProto PopulationSnapshot::GetAgent(const int64 index) const {
+  const SnapshotAgent& record = agents_[index];
+  AgentProto agent;
+  agent.set_uuid(record.uuid);
+  agent.set_population_profile_id(record.population_profile_id);
+  agent.set_initial_health_state(
+      static_cast<HealthState::State>(record.initial_health_state));
+  for (const SnapshotMembership& membership : memberships(record)) {
+    LocationProto* location = agent.add_locations();
+    location->set_uuid(membership.location_uuid);
+    location->set_type(static_cast<LocationProto::Type>(membership.type));
+  }
+  return agent;
+}
+
+}  // namespace abesim
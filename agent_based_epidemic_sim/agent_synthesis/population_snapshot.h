@@ -0,0 +1,164 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_POPULATION_SNAPSHOT_H_
+#define AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_POPULATION_SNAPSHOT_H_
+
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/agent_synthesis/agent_sampler.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/mapped_file.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+// A population snapshot stores the locations, agents and population profiles
+// of a synthesized population in a single binary file that is used in place
+// through a memory mapping, so that loading it costs no parsing.
+//
+// Layout:
+//   "ABESPOP1"
+//   locations: SnapshotLocation[num_locations]
+//   agents: SnapshotAgent[num_agents]
+//   memberships: SnapshotMembership[num_memberships]
+//   population profiles: serialized PopulationProfiles
+//   footer: SnapshotFooter
+//   "ABESPOP1"
+// The agent and location memberships hold the same data as AgentProto and
+// LocationProto.  The memberships of an agent are contiguous and ordered as
+// in its AgentProto.  All records are in host byte order, so snapshots are
+// only portable between hosts of the same endianness.
+
+namespace abesim {
+
+struct SnapshotLocation {
+  int64 uuid;
+  int32 type;
+  int32 size;
+};
+
+struct SnapshotAgent {
+  int64 uuid;
+  int64 population_profile_id;
+  int32 initial_health_state;
+  int32 num_memberships;
+  int64 first_membership;
+};
+
+struct SnapshotMembership {
+  int64 location_uuid;
+  int32 type;
+  int32 reserved;
+};
+
+static_assert(sizeof(SnapshotLocation) == 16 &&
+                  std::is_trivially_copyable<SnapshotLocation>::value,
+              "SnapshotLocation must have a fixed layout.");
+static_assert(sizeof(SnapshotAgent) == 32 &&
+                  std::is_trivially_copyable<SnapshotAgent>::value,
+              "SnapshotAgent must have a fixed layout.");
+static_assert(sizeof(SnapshotMembership) == 16 &&
+                  std::is_trivially_copyable<SnapshotMembership>::value,
+              "SnapshotMembership must have a fixed layout.");
+
+// Writes a population snapshot.  Locations and agents are added one at a time,
+// in any order, and the agents and their memberships are staged in temporary
+// files next to the snapshot, so that memory use does not grow with the
+// population.
+class PopulationSnapshotWriter {
+ public:
+  // Crashes if the file already exists.
+  PopulationSnapshotWriter(absl::string_view path,
+                           const PopulationProfiles& population_profiles);
+  PopulationSnapshotWriter(absl::string_view path,
+                           absl::Span<const LocationProto> locations,
+                           const PopulationProfiles& population_profiles);
+
+  absl::Status AddLocation(const LocationProto& location);
+  absl::Status AddAgent(const AgentProto& agent);
+  // Completes the snapshot.  Must be called before destroying the object.
+  absl::Status Close();
+
+ private:
+  // Appends the staged file at path to the snapshot and removes it.
+  void CopyStagedFile(const std::string& path);
+
+  const std::string path_;
+  const std::string agents_path_;
+  const std::string memberships_path_;
+  const std::string population_profiles_;
+  std::unique_ptr<file::FileWriter> file_;
+  std::unique_ptr<file::FileWriter> agents_file_;
+  std::unique_ptr<file::FileWriter> memberships_file_;
+  absl::Status status_;
+  int64 num_locations_ = 0;
+  int64 num_agents_ = 0;
+  int64 num_memberships_ = 0;
+};
+
+// A read-only view of a population snapshot file.
+class PopulationSnapshot {
+ public:
+  static StatusOr<std::unique_ptr<PopulationSnapshot>> Open(
+      absl::string_view path);
+
+  absl::Span<const SnapshotLocation> locations() const { return locations_; }
+  absl::Span<const SnapshotAgent> agents() const { return agents_; }
+  absl::Span<const SnapshotMembership> memberships(
+      const SnapshotAgent& agent) const {
+    return memberships_.subspan(agent.first_membership, agent.num_memberships);
+  }
+  const PopulationProfiles& population_profiles() const {
+    return population_profiles_;
+  }
+
+  LocationProto GetLocation(int64 index) const;
+  AgentProto GetAgent(int64 index) const;
+
+ private:
+  explicit PopulationSnapshot(std::unique_ptr<file::MappedFile> file)
+      : file_(std::move(file)) {}
+
+  const std::unique_ptr<file::MappedFile> file_;
+  absl::Span<const SnapshotLocation> locations_;
+  absl::Span<const SnapshotAgent> agents_;
+  absl::Span<const SnapshotMembership> memberships_;
+  PopulationProfiles population_profiles_;
+};
+
+// Returns the agents of a snapshot in order, starting at index begin.
+class SnapshotAgentSampler : public AgentSampler {
+ public:
+  SnapshotAgentSampler(std::shared_ptr<const PopulationSnapshot> snapshot,
+                       int64 begin)
+      : snapshot_(std::move(snapshot)), next_(begin) {}
+
+  AgentProto Next() override { return snapshot_->GetAgent(next_++); }
+
+ private:
+  const std::shared_ptr<const PopulationSnapshot> snapshot_;
+  int64 next_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_POPULATION_SNAPSHOT_H_
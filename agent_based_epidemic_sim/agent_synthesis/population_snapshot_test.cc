@@ -0,0 +1,154 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/population_snapshot.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+LocationProto MakeLocation(const int64 uuid, const LocationProto::Type type,
+                           const int32 size) {
+  LocationProto location;
+  location.set_uuid(uuid);
+  location.set_type(type);
+  location.set_size(size);
+  return location;
+}
+
+AgentProto MakeAgent(const int64 uuid, const HealthState::State health_state,
+                     const std::vector<LocationProto>& locations) {
+  AgentProto agent;
+  agent.set_uuid(uuid);
+  agent.set_population_profile_id(3);
+  agent.set_initial_health_state(health_state);
+  for (const LocationProto& location : locations) {
+    LocationProto* membership = agent.add_locations();
+    membership->set_uuid(location.uuid());
+    membership->set_type(location.type());
+  }
+  return agent;
+}
+
+TEST(PopulationSnapshotTest, RoundTrips) {
+  const std::vector<LocationProto> locations = {
+      MakeLocation(10, LocationProto::HOUSEHOLD, 2),
+      MakeLocation(11, LocationProto::BUSINESS, 3)};
+  const std::vector<AgentProto> agents = {
+      MakeAgent(1, HealthState::SUSCEPTIBLE, locations),
+      MakeAgent(2, HealthState::INFECTIOUS, {locations[1]}),
+      MakeAgent(3, HealthState::SUSCEPTIBLE, {})};
+  PopulationProfiles population_profiles;
+  population_profiles.add_population_profiles()->set_id(3);
+
+  const std::string path = TestPath("round_trip.population");
+  PopulationSnapshotWriter writer(path, locations, population_profiles);
+  for (const AgentProto& agent : agents) {
+    PANDEMIC_ASSERT_OK(writer.AddAgent(agent));
+  }
+  PANDEMIC_ASSERT_OK(writer.Close());
+
+  auto snapshot = PopulationSnapshot::Open(path);
+  PANDEMIC_ASSERT_OK(snapshot.status());
+  ASSERT_EQ(snapshot.value()->locations().size(), locations.size());
+  for (int i = 0; i < locations.size(); ++i) {
+    EXPECT_EQ(snapshot.value()->GetLocation(i).DebugString(),
+              locations[i].DebugString());
+  }
+  ASSERT_EQ(snapshot.value()->agents().size(), agents.size());
+  for (int i = 0; i < agents.size(); ++i) {
+    EXPECT_EQ(snapshot.value()->GetAgent(i).DebugString(),
+              agents[i].DebugString());
+  }
+  EXPECT_EQ(snapshot.value()->population_profiles().DebugString(),
+            population_profiles.DebugString());
+
+  SnapshotAgentSampler sampler(std::move(snapshot).value(), /*begin=*/1);
+  EXPECT_EQ(sampler.Next().uuid(), 2);
+  EXPECT_EQ(sampler.Next().uuid(), 3);
+}
+
+TEST(PopulationSnapshotTest, AddsLocationsAfterAgents) {
+  const LocationProto household = MakeLocation(10, LocationProto::HOUSEHOLD, 1);
+  const LocationProto business = MakeLocation(11, LocationProto::BUSINESS, 1);
+  const AgentProto agent =
+      MakeAgent(1, HealthState::SUSCEPTIBLE, {household, business});
+
+  const std::string path = TestPath("incremental.population");
+  PopulationSnapshotWriter writer(path, PopulationProfiles());
+  PANDEMIC_ASSERT_OK(writer.AddLocation(household));
+  PANDEMIC_ASSERT_OK(writer.AddAgent(agent));
+  PANDEMIC_ASSERT_OK(writer.AddLocation(business));
+  PANDEMIC_ASSERT_OK(writer.Close());
+
+  auto snapshot = PopulationSnapshot::Open(path);
+  PANDEMIC_ASSERT_OK(snapshot.status());
+  ASSERT_EQ(snapshot.value()->locations().size(), 2);
+  EXPECT_EQ(snapshot.value()->GetLocation(1).DebugString(),
+            business.DebugString());
+  ASSERT_EQ(snapshot.value()->agents().size(), 1);
+  EXPECT_EQ(snapshot.value()->GetAgent(0).DebugString(), agent.DebugString());
+}
+
+TEST(PopulationSnapshotTest, RejectsCorruptFiles) {
+  const std::string path = TestPath("corrupt.population");
+  auto file = file::OpenOrDie(path);
+  PANDEMIC_ASSERT_OK(file->WriteString("ABESPOP1 not a snapshot ABESPOP1"));
+  PANDEMIC_ASSERT_OK(file->Close());
+  EXPECT_EQ(PopulationSnapshot::Open(path).status().code(),
+            absl::StatusCode::kDataLoss);
+  EXPECT_FALSE(PopulationSnapshot::Open(TestPath("missing")).ok());
+}
+
+TEST(PopulationSnapshotTest, RejectsOutOfRangeMemberships) {
+  const std::vector<LocationProto> locations = {
+      MakeLocation(10, LocationProto::HOUSEHOLD, 2)};
+  const std::string path = TestPath("out_of_range.population");
+  PopulationSnapshotWriter writer(path, locations, PopulationProfiles());
+  PANDEMIC_ASSERT_OK(
+      writer.AddAgent(MakeAgent(1, HealthState::SUSCEPTIBLE, locations)));
+  PANDEMIC_ASSERT_OK(writer.Close());
+
+  // Points the only agent past the end of the memberships.
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(path, &contents));
+  const int64 first_membership = 1;
+  std::memcpy(&contents[8 + sizeof(SnapshotLocation) +
+                        offsetof(SnapshotAgent, first_membership)],
+              &first_membership, sizeof(first_membership));
+  const std::string corrupt_path = TestPath("out_of_range_corrupt.population");
+  auto file = file::OpenOrDie(corrupt_path);
+  PANDEMIC_ASSERT_OK(file->WriteString(contents));
+  PANDEMIC_ASSERT_OK(file->Close());
+  EXPECT_EQ(PopulationSnapshot::Open(corrupt_path).status().code(),
+            absl::StatusCode::kDataLoss);
+}
+
+}  // namespace
+}  // namespace abesim
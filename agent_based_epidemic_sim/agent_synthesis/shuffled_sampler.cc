@@ -14,67 +14,169 @@
 
 #include "agent_based_epidemic_sim/agent_synthesis/shuffled_sampler.h"
 
+#include <algorithm>
+#include <random>
+#include <utility>
+
+#include "absl/random/random.h"
 #include "agent_based_epidemic_sim/core/distribution_sampler.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
 
 ShuffledSampler::ShuffledSampler(
-    const absl::flat_hash_map<int64, int>& uuids_to_sizes) {
-  for (auto key_val : uuids_to_sizes) {
-    for (int i = 0; i < key_val.second; ++i) {
-      slots_.push_back(key_val.first);
+    const absl::flat_hash_map<int64, int>& uuids_to_sizes)
+    : ShuffledSampler(uuids_to_sizes, std::mt19937_64(absl::BitGen()())) {}
+
+ShuffledSampler::ShuffledSampler(
+    const absl::flat_hash_map<int64, int>& uuids_to_sizes, const uint64 seed)
+    : ShuffledSampler(uuids_to_sizes, std::mt19937_64(seed)) {}
+
+ShuffledSampler::ShuffledSampler(
+    const absl::flat_hash_map<int64, int>& uuids_to_sizes,
+    std::mt19937_64 gen)
+    : gen_(std::move(gen)) {
+  // The iteration order of the map is not deterministic, so locations are
+  // ordered by uuid.
+  std::vector<std::pair<int64, int>> sorted_uuids_to_sizes;
+  sorted_uuids_to_sizes.reserve(uuids_to_sizes.size());
+  for (const auto& [uuid, size] : uuids_to_sizes) {
+    if (size > 0) sorted_uuids_to_sizes.emplace_back(uuid, size);
+  }
+  std::sort(sorted_uuids_to_sizes.begin(), sorted_uuids_to_sizes.end());
+  uuids_.reserve(sorted_uuids_to_sizes.size());
+  tree_.assign(sorted_uuids_to_sizes.size() + 1, 0);
+  for (int64 i = 0; i < sorted_uuids_to_sizes.size(); ++i) {
+    uuids_.push_back(sorted_uuids_to_sizes[i].first);
+    tree_[i + 1] = sorted_uuids_to_sizes[i].second;
+    remaining_ += sorted_uuids_to_sizes[i].second;
+  }
+  // Builds the tree in place by pushing each partial sum to its parent.
+  for (int64 i = 1; i < tree_.size(); ++i) {
+    const int64 parent = i + (i & -i);
+    if (parent < tree_.size()) tree_[parent] += tree_[i];
+  }
+}
+
+int64 ShuffledSampler::TakeSlot(int64 slot) {
+  // Descends the tree to find the location whose remaining capacities, summed
+  // in order, first exceed slot.
+  int64 index = 0;
+  int64 step = 1;
+  while (step * 2 < tree_.size()) step *= 2;
+  for (; step > 0; step /= 2) {
+    const int64 next = index + step;
+    if (next < tree_.size() && tree_[next] <= slot) {
+      index = next;
+      slot -= tree_[next];
     }
   }
-  std::shuffle(slots_.begin(), slots_.end(), absl::BitGen());
+  for (int64 i = index + 1; i < tree_.size(); i += i & -i) {
+    --tree_[i];
+  }
+  --remaining_;
+  return index;
 }
 
 int64 ShuffledSampler::Next() {
-  DCHECK(i_ < slots_.size());
-  return slots_[i_++];
+  absl::MutexLock l(&mu_);
+  DCHECK_GT(remaining_, 0);
+  const int64 slot =
+      std::uniform_int_distribution<int64>(0, remaining_ - 1)(gen_);
+  return uuids_[TakeSlot(slot)];
 }
 
-std::unique_ptr<ShuffledSampler> MakeBusinessSampler(
+std::vector<int> SampleBusinessSizes(
     const GammaDistribution& business_distribution, const int64 population_size,
-    const UuidGenerator& uuid_generator,
-    std::vector<LocationProto>* locations) {
+    const absl::optional<uint64> seed) {
   auto business_size_distribution = std::gamma_distribution<float>(
       business_distribution.alpha(), business_distribution.beta());
   std::mt19937 rng;
-  absl::flat_hash_map<int64, int> uuid_to_sizes;
+  if (seed.has_value()) rng.seed(*seed);
+  std::vector<int> sizes;
   for (int population = 0; population < population_size;) {
-    LocationProto location;
-    location.set_uuid(uuid_generator.GenerateUuid());
-    location.set_type(LocationProto::BUSINESS);
     const int size =
         std::min(static_cast<int64>(business_size_distribution(rng)),
                  population_size - population);
-    location.set_size(size);
-    locations->push_back(location);
-    uuid_to_sizes.insert(std::make_pair(locations->back().uuid(), size));
+    sizes.push_back(size);
     population += size;
   }
-  return absl::make_unique<ShuffledSampler>(uuid_to_sizes);
+  return sizes;
 }
 
-std::unique_ptr<ShuffledSampler> MakeHouseholdSampler(
+std::vector<int> SampleHouseholdSizes(
     const DiscreteDistribution& household_distribution,
-    const int64 population_size, const UuidGenerator& uuid_generator,
-    std::vector<LocationProto>* locations) {
+    const int64 population_size, const absl::optional<uint64> seed) {
   auto household_size_sampler =
       DiscreteDistributionSampler<int64>::FromProto(household_distribution);
-  absl::flat_hash_map<int64, int> uuid_to_sizes;
+  if (seed.has_value()) household_size_sampler->Seed(*seed);
+  std::vector<int> sizes;
   for (int population = 0; population < population_size;) {
-    LocationProto location;
-    location.set_uuid(uuid_generator.GenerateUuid());
-    location.set_type(LocationProto::HOUSEHOLD);
-    locations->push_back(location);
     const int size = std::min(household_size_sampler->Sample(),
                               population_size - population);
-    uuid_to_sizes.insert(std::make_pair(locations->back().uuid(), size));
+    sizes.push_back(size);
     population += size;
   }
+  return sizes;
+}
+
+namespace {
+
+// Only businesses record their size in their LocationProto.
+std::unique_ptr<ShuffledSampler> MakeLocationSampler(
+    const LocationProto::Type type, const absl::Span<const int> sizes,
+    const UuidGenerator& uuid_generator, std::vector<LocationProto>* locations,
+    const absl::optional<uint64> shuffle_seed) {
+  absl::flat_hash_map<int64, int> uuid_to_sizes;
+  uuid_to_sizes.reserve(sizes.size());
+  for (const int size : sizes) {
+    LocationProto location;
+    location.set_uuid(uuid_generator.GenerateUuid());
+    location.set_type(type);
+    if (type == LocationProto::BUSINESS) location.set_size(size);
+    uuid_to_sizes.insert(std::make_pair(location.uuid(), size));
+    locations->push_back(std::move(location));
+  }
+  if (shuffle_seed.has_value()) {
+    return absl::make_unique<ShuffledSampler>(uuid_to_sizes, *shuffle_seed);
+  }
   return absl::make_unique<ShuffledSampler>(uuid_to_sizes);
 }
 
+}  // namespace
+
+std::unique_ptr<ShuffledSampler> MakeBusinessSampler(
+    const absl::Span<const int> sizes, const UuidGenerator& uuid_generator,
+    std::vector<LocationProto>* const locations,
+    const absl::optional<uint64> shuffle_seed) {
+  return MakeLocationSampler(LocationProto::BUSINESS, sizes, uuid_generator,
+                             locations, shuffle_seed);
+}
+
+std::unique_ptr<ShuffledSampler> MakeHouseholdSampler(
+    const absl::Span<const int> sizes, const UuidGenerator& uuid_generator,
+    std::vector<LocationProto>* const locations,
+    const absl::optional<uint64> shuffle_seed) {
+  return MakeLocationSampler(LocationProto::HOUSEHOLD, sizes, uuid_generator,
+                             locations, shuffle_seed);
+}
+
+std::unique_ptr<ShuffledSampler> MakeBusinessSampler(
+    const GammaDistribution& business_distribution, const int64 population_size,
+    const UuidGenerator& uuid_generator,
+    std::vector<LocationProto>* locations) {
+  return MakeBusinessSampler(
+      SampleBusinessSizes(business_distribution, population_size),
+      uuid_generator, locations);
+}
+
+std::unique_ptr<ShuffledSampler> MakeHouseholdSampler(
+    const DiscreteDistribution& household_distribution,
+    const int64 population_size, const UuidGenerator& uuid_generator,
+    std::vector<LocationProto>* locations) {
+  return MakeHouseholdSampler(
+      SampleHouseholdSizes(household_distribution, population_size),
+      uuid_generator, locations);
+}
+
 }  // namespace abesim
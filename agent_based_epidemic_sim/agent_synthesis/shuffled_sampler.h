@@ -17,8 +17,15 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_SHUFFLED_SAMPLER_H_
 #define AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_SHUFFLED_SAMPLER_H_
 
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_map.h"
-#include "absl/random/random.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "agent_based_epidemic_sim/core/enum_indexed_array.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
@@ -27,26 +34,68 @@
 
 namespace abesim {
 
+// Samples location uuids without replacement, where each location is drawn as
+// many times as its size.  This is equivalent to shuffling one slot per unit
+// of size and walking the slots, but only keeps the remaining capacity of
+// each location, in a Fenwick tree, so that memory grows with the number of
+// locations rather than with their total size.  Next is thread safe.
 class ShuffledSampler {
  public:
   explicit ShuffledSampler(
       const absl::flat_hash_map<int64, int>& uuids_to_sizes);
+  // Samples deterministically for a given seed, as long as Next is not called
+  // concurrently.
+  ShuffledSampler(const absl::flat_hash_map<int64, int>& uuids_to_sizes,
+                  uint64 seed);
 
-  int64 Next();
+  int64 Next() ABSL_LOCKS_EXCLUDED(mu_);
 
  private:
-  std::vector<int64> slots_;
-  int i_ = 0;
+  ShuffledSampler(const absl::flat_hash_map<int64, int>& uuids_to_sizes,
+                  std::mt19937_64 gen);
+
+  // Returns the index of the location holding the given slot, counting only
+  // remaining slots, and removes that slot.
+  int64 TakeSlot(int64 slot) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  std::vector<int64> uuids_;
+  absl::Mutex mu_;
+  std::mt19937_64 gen_ ABSL_GUARDED_BY(mu_);
+  // 1-based Fenwick tree over the remaining capacities of uuids_.
+  std::vector<int64> tree_ ABSL_GUARDED_BY(mu_);
+  int64 remaining_ ABSL_GUARDED_BY(mu_) = 0;
 };
 
-// Constructs a distribution over business types.
-// Samples businesses from the distribution until the total number of business
-// "slots" exceeds the population size.
-// Constructs a normalized size-weighted categorical distribution over
-// businesses.
+// Samples the sizes of businesses from a gamma distribution until their total
+// reaches population_size.  If a seed is given, the sizes only depend on it.
+std::vector<int> SampleBusinessSizes(
+    const GammaDistribution& business_distribution, int64 population_size,
+    absl::optional<uint64> seed = absl::nullopt);
+
+// Samples the sizes of households until their total reaches population_size.
+// If a seed is given, the sizes only depend on it.
+std::vector<int> SampleHouseholdSizes(
+    const DiscreteDistribution& household_distribution,
+    int64 population_size, absl::optional<uint64> seed = absl::nullopt);
+
+// Adds one business or household of each of the given sizes to locations, in
+// order and with uuids from uuid_generator, and returns a sampler drawing
+// each as many times as its size.  If a shuffle_seed is given, the order of
+// draws only depends on it and the uuids generated.
+std::unique_ptr<ShuffledSampler> MakeBusinessSampler(
+    absl::Span<const int> sizes, const UuidGenerator& uuid_generator,
+    std::vector<LocationProto>* locations,
+    absl::optional<uint64> shuffle_seed = absl::nullopt);
+std::unique_ptr<ShuffledSampler> MakeHouseholdSampler(
+    absl::Span<const int> sizes, const UuidGenerator& uuid_generator,
+    std::vector<LocationProto>* locations,
+    absl::optional<uint64> shuffle_seed = absl::nullopt);
+
+// Samples businesses and returns a size-weighted sampler over them, as above.
 std::unique_ptr<ShuffledSampler> MakeBusinessSampler(
     const GammaDistribution& business_distribution, const int64 population_size,
-    const UuidGenerator& uuid_generator, std::vector<LocationProto>* locations);
+    const UuidGenerator& uuid_generator,
+    std::vector<LocationProto>* locations);
 
 std::unique_ptr<ShuffledSampler> MakeHouseholdSampler(
     const DiscreteDistribution& household_distribution,
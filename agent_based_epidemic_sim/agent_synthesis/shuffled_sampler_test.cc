@@ -0,0 +1,106 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/shuffled_sampler.h"
+
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::UnorderedElementsAreArray;
+
+const absl::flat_hash_map<int64, int>& UuidsToSizes() {
+  static const auto* const kUuidsToSizes =
+      new absl::flat_hash_map<int64, int>(
+          {{3, 1}, {5, 0}, {8, 4}, {13, 2}, {21, 7}, {34, 3}, {55, 1}});
+  return *kUuidsToSizes;
+}
+
+std::vector<int64> ExpectedSlots() {
+  std::vector<int64> slots;
+  for (const auto& [uuid, size] : UuidsToSizes()) {
+    slots.insert(slots.end(), size, uuid);
+  }
+  return slots;
+}
+
+TEST(ShuffledSamplerTest, DrawsEachLocationAsOftenAsItsSize) {
+  ShuffledSampler sampler(UuidsToSizes());
+  std::vector<int64> slots;
+  for (int i = 0; i < ExpectedSlots().size(); ++i) {
+    slots.push_back(sampler.Next());
+  }
+  EXPECT_THAT(slots, UnorderedElementsAreArray(ExpectedSlots()));
+}
+
+TEST(ShuffledSamplerTest, IsDeterministicForASeed) {
+  ShuffledSampler first(UuidsToSizes(), /*seed=*/17);
+  ShuffledSampler second(UuidsToSizes(), /*seed=*/17);
+  std::vector<int64> first_slots, second_slots;
+  for (int i = 0; i < ExpectedSlots().size(); ++i) {
+    first_slots.push_back(first.Next());
+    second_slots.push_back(second.Next());
+  }
+  EXPECT_EQ(first_slots, second_slots);
+  EXPECT_THAT(first_slots, UnorderedElementsAreArray(ExpectedSlots()));
+}
+
+TEST(ShuffledSamplerTest, DrawsUniformlyFromRemainingSlots) {
+  // The first draw picks a location with probability proportional to its size.
+  absl::flat_hash_map<int64, int> firsts;
+  constexpr int kTrials = 21000;
+  for (int i = 0; i < kTrials; ++i) {
+    ShuffledSampler sampler(UuidsToSizes(), /*seed=*/i);
+    ++firsts[sampler.Next()];
+  }
+  EXPECT_EQ(firsts[5], 0);
+  EXPECT_NEAR(firsts[21], kTrials * 7 / 18, kTrials / 50);
+  EXPECT_NEAR(firsts[3], kTrials / 18, kTrials / 50);
+}
+
+TEST(ShuffledSamplerTest, CanBeSharedByThreads) {
+  absl::flat_hash_map<int64, int> uuids_to_sizes;
+  std::vector<int64> expected;
+  for (int64 uuid = 0; uuid < 100; ++uuid) {
+    uuids_to_sizes[uuid] = uuid % 7;
+    expected.insert(expected.end(), uuid % 7, uuid);
+  }
+  ShuffledSampler sampler(uuids_to_sizes);
+  constexpr int kThreads = 4;
+  std::vector<std::vector<int64>> slots(kThreads);
+  auto executor = NewExecutor(kThreads);
+  auto execution = executor->NewExecution();
+  for (int thread = 0; thread < kThreads; ++thread) {
+    execution->Add([&sampler, &slots, &expected, thread]() {
+      for (int i = thread; i < expected.size(); i += kThreads) {
+        slots[thread].push_back(sampler.Next());
+      }
+    });
+  }
+  execution->Wait();
+  std::vector<int64> all;
+  for (const std::vector<int64>& thread_slots : slots) {
+    all.insert(all.end(), thread_slots.begin(), thread_slots.end());
+  }
+  EXPECT_THAT(all, UnorderedElementsAreArray(expected));
+}
+
+}  // namespace
+}  // namespace abesim
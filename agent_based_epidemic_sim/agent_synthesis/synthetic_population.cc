@@ -0,0 +1,423 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/synthetic_population.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/random/bernoulli_distribution.h"
+#include "absl/random/discrete_distribution.h"
+#include "absl/random/zipf_distribution.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/agent_synthesis/shuffled_sampler.h"
+#include "agent_based_epidemic_sim/core/distribution_sampler.h"
+#include "agent_based_epidemic_sim/core/stream_seed.h"
+#include "agent_based_epidemic_sim/core/uuid_generator.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// The random streams of each region, which are seeded independently so that
+// the choices of one part of the population do not shift those of another.
+enum Stream {
+  kMembershipStream = 0,
+  kHouseholdStream = 1,
+  kBusinessStream = 2,
+  kSocialGroupStream = 3,
+  kHealthStateStream = 4,
+  kHouseholdSlotStream = 5,
+  kBusinessSlotStream = 6,
+  kSocialGroupSlotStream = 7,
+};
+
+absl::Status ValidateSizeDistribution(const LocationSizeDistribution& proto,
+                                      absl::string_view name) {
+  switch (proto.distribution_case()) {
+    case LocationSizeDistribution::kGamma:
+      if (proto.gamma().alpha() > 0 && proto.gamma().beta() > 0) {
+        return absl::OkStatus();
+      }
+      break;
+    case LocationSizeDistribution::kPowerLaw:
+      if (proto.power_law().exponent() > 1 &&
+          proto.power_law().min_size() >= 1 &&
+          proto.power_law().max_size() >= proto.power_law().min_size()) {
+        return absl::OkStatus();
+      }
+      break;
+    case LocationSizeDistribution::kDiscrete:
+      if (proto.discrete().buckets_size() > 0) return absl::OkStatus();
+      break;
+    case LocationSizeDistribution::DISTRIBUTION_NOT_SET:
+      break;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Invalid ", name, ": ", proto.ShortDebugString()));
+}
+
+// Samples the sizes of a type of location.
+class LocationSizeSampler {
+ public:
+  LocationSizeSampler(const LocationSizeDistribution& proto, const uint64 seed)
+      : proto_(proto), gen_(seed) {
+    switch (proto.distribution_case()) {
+      case LocationSizeDistribution::kGamma:
+        gamma_ = std::gamma_distribution<float>(proto.gamma().alpha(),
+                                                proto.gamma().beta());
+        break;
+      case LocationSizeDistribution::kPowerLaw:
+        // zipf_distribution samples k in [0, max - min] with probability
+        // proportional to (min + k)^-exponent.
+        if (proto.power_law().max_size() > proto.power_law().min_size()) {
+          zipf_ = absl::zipf_distribution<int64>(
+              proto.power_law().max_size() - proto.power_law().min_size(),
+              proto.power_law().exponent(), proto.power_law().min_size());
+        }
+        break;
+      case LocationSizeDistribution::kDiscrete:
+        discrete_ = DiscreteDistributionSampler<int64>::FromProto(
+            proto.discrete());
+        discrete_->Seed(seed);
+        break;
+      case LocationSizeDistribution::DISTRIBUTION_NOT_SET:
+        break;
+    }
+  }
+
+  int64 Sample() {
+    switch (proto_.distribution_case()) {
+      case LocationSizeDistribution::kGamma:
+        return std::max<int64>(1, gamma_(gen_));
+      case LocationSizeDistribution::kPowerLaw:
+        return proto_.power_law().min_size() +
+               (proto_.power_law().max_size() > proto_.power_law().min_size()
+                    ? zipf_(gen_)
+                    : 0);
+      case LocationSizeDistribution::kDiscrete:
+        return std::max<int64>(1, discrete_->Sample());
+      case LocationSizeDistribution::DISTRIBUTION_NOT_SET:
+        break;
+    }
+    return 1;
+  }
+
+ private:
+  const LocationSizeDistribution& proto_;
+  std::mt19937_64 gen_;
+  std::gamma_distribution<float> gamma_;
+  absl::zipf_distribution<int64> zipf_;
+  std::unique_ptr<DiscreteDistributionSampler<int64>> discrete_;
+};
+
+// Decides where the agents of a region work and whether they join a social
+// group.  The decisions are made twice from the same seed: once to size the
+// businesses and social groups of each region, and once to sample the agents.
+class MembershipSampler {
+ public:
+  struct Membership {
+    int workplace_region;
+    bool social;
+  };
+
+  MembershipSampler(const SyntheticPopulationConfig& config,
+                    const absl::discrete_distribution<int>& regions,
+                    const int region)
+      : other_regions_(OtherRegions(regions, region)),
+        commuter_fraction_(HasOtherRegions(regions, region)
+                               ? config.commuter_fraction()
+                               : 0),
+        region_(region),
+        social_group_fraction_(config.social_group_fraction()),
+        gen_(StreamSeed(config.seed(), region, kMembershipStream)) {}
+
+  Membership Next() {
+    Membership membership = {.workplace_region = region_, .social = false};
+    if (absl::Bernoulli(gen_, commuter_fraction_)) {
+      membership.workplace_region = other_regions_(gen_);
+    }
+    membership.social = absl::Bernoulli(gen_, social_group_fraction_);
+    return membership;
+  }
+
+ private:
+  // Returns whether agents of region can commute to any other region.
+  static bool HasOtherRegions(const absl::discrete_distribution<int>& regions,
+                              const int region) {
+    const std::vector<double> probabilities = regions.probabilities();
+    for (int i = 0; i < probabilities.size(); ++i) {
+      if (i != region && probabilities[i] > 0) return true;
+    }
+    return false;
+  }
+
+  // Returns the distribution of regions without region, from which commuters
+  // draw their workplace region.
+  static absl::discrete_distribution<int> OtherRegions(
+      const absl::discrete_distribution<int>& regions, const int region) {
+    std::vector<double> weights = regions.probabilities();
+    // Without other regions the distribution is never sampled, but it still
+    // needs a positive weight.
+    weights[region] = HasOtherRegions(regions, region) ? 0 : 1;
+    return absl::discrete_distribution<int>(weights.begin(), weights.end());
+  }
+
+  absl::discrete_distribution<int> other_regions_;
+  const double commuter_fraction_;
+  const int region_;
+  const double social_group_fraction_;
+  std::mt19937_64 gen_;
+};
+
+struct RegionSamplers {
+  std::unique_ptr<ShuffledSampler> households;
+  std::unique_ptr<ShuffledSampler> businesses;
+  std::unique_ptr<ShuffledSampler> social_groups;
+};
+
+class LocationBuilder {
+ public:
+  LocationBuilder(const UuidGenerator& uuid_generator,
+                  std::vector<LocationProto>* locations)
+      : uuid_generator_(uuid_generator), locations_(locations) {}
+
+  void Add(const LocationProto::Type type, const int64 size) {
+    LocationProto location;
+    location.set_uuid(uuid_generator_.GenerateUuid());
+    location.set_type(type);
+    location.set_size(size);
+    locations_->push_back(location);
+    uuids_to_sizes_[location.uuid()] = size;
+  }
+
+  // Adds locations with sizes from sampler until they hold capacity members,
+  // truncating the last one.
+  void AddSampled(const LocationProto::Type type, const int64 capacity,
+                  LocationSizeSampler* const sampler) {
+    for (int64 members = 0; members < capacity;) {
+      const int64 size = std::min(sampler->Sample(), capacity - members);
+      Add(type, size);
+      members += size;
+    }
+  }
+
+  // Returns a sampler of the slots of the locations added so far, and starts
+  // over.
+  std::unique_ptr<ShuffledSampler> Finish(const uint64 seed) {
+    auto sampler = absl::make_unique<ShuffledSampler>(uuids_to_sizes_, seed);
+    uuids_to_sizes_.clear();
+    return sampler;
+  }
+
+ private:
+  const UuidGenerator& uuid_generator_;
+  std::vector<LocationProto>* const locations_;
+  absl::flat_hash_map<int64, int> uuids_to_sizes_;
+};
+
+class SyntheticAgentSampler : public AgentSampler {
+ public:
+  SyntheticAgentSampler(const SyntheticPopulationConfig& config,
+                        absl::discrete_distribution<int> regions,
+                        std::vector<int64> region_agents,
+                        std::vector<RegionSamplers> region_samplers,
+                        std::unique_ptr<UuidGenerator> uuid_generator)
+      : config_(config),
+        regions_(std::move(regions)),
+        region_agents_(std::move(region_agents)),
+        region_samplers_(std::move(region_samplers)),
+        uuid_generator_(std::move(uuid_generator)),
+        health_states_(HealthStateSampler::FromProto(
+            config.initial_health_state_distribution())) {}
+
+  AgentProto Next() override {
+    while (membership_ == nullptr || next_ == region_agents_[region_]) {
+      if (membership_ != nullptr) ++region_;
+      CHECK_LT(region_, region_agents_.size()) << "No agents left.";
+      next_ = 0;
+      membership_ =
+          absl::make_unique<MembershipSampler>(config_, regions_, region_);
+      health_states_->Seed(
+          StreamSeed(config_.seed(), region_, kHealthStateStream));
+    }
+    ++next_;
+    const MembershipSampler::Membership membership = membership_->Next();
+    AgentProto agent;
+    agent.set_uuid(uuid_generator_->GenerateUuid());
+    agent.set_population_profile_id(config_.population_profile_id());
+    agent.set_initial_health_state(health_states_->Sample().state());
+    auto add_location = [&agent](const LocationProto::Type type,
+                                 ShuffledSampler* const sampler) {
+      LocationProto* const location = agent.add_locations();
+      location->set_uuid(sampler->Next());
+      location->set_type(type);
+    };
+    add_location(LocationProto::HOUSEHOLD,
+                 region_samplers_[region_].households.get());
+    add_location(
+        LocationProto::BUSINESS,
+        region_samplers_[membership.workplace_region].businesses.get());
+    if (membership.social) {
+      add_location(LocationProto::SOCIAL,
+                   region_samplers_[region_].social_groups.get());
+    }
+    return agent;
+  }
+
+ private:
+  const SyntheticPopulationConfig config_;
+  const absl::discrete_distribution<int> regions_;
+  const std::vector<int64> region_agents_;
+  std::vector<RegionSamplers> region_samplers_;
+  std::unique_ptr<UuidGenerator> uuid_generator_;
+  std::unique_ptr<HealthStateSampler> health_states_;
+  std::unique_ptr<MembershipSampler> membership_;
+  int region_ = 0;
+  int64 next_ = 0;
+};
+
+}  // namespace
+
+StatusOr<SyntheticPopulation> GenerateSyntheticPopulation(
+    const SyntheticPopulationConfig& config) {
+  if (config.population_size() < 0) {
+    return absl::InvalidArgumentError("population_size must not be negative.");
+  }
+  if (config.initial_health_state_distribution().buckets_size() == 0) {
+    return absl::InvalidArgumentError(
+        "initial_health_state_distribution must not be empty.");
+  }
+  for (const float fraction :
+       {config.giant_employer_fraction(), config.commuter_fraction(),
+        config.social_group_fraction()}) {
+    if (fraction < 0 || fraction > 1) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Fractions must be in [0, 1]: ", fraction));
+    }
+  }
+  absl::Status status = ValidateSizeDistribution(
+      config.household_size_distribution(), "household_size_distribution");
+  if (config.giant_employer_fraction() < 1 ||
+      config.giant_employers_per_region() <= 0) {
+    status.Update(ValidateSizeDistribution(config.business_size_distribution(),
+                                           "business_size_distribution"));
+  }
+  if (config.social_group_fraction() > 0) {
+    status.Update(
+        ValidateSizeDistribution(config.social_group_size_distribution(),
+                                 "social_group_size_distribution"));
+  }
+  if (!status.ok()) return status;
+
+  SyntheticPopulation population;
+  population.num_agents = config.population_size();
+  const int num_regions = std::max(1, config.num_regions());
+  std::vector<double> weights(num_regions);
+  for (int region = 0; region < num_regions; ++region) {
+    weights[region] = std::pow(region + 1.0, -config.region_size_skew());
+  }
+  // Splits the population at the rounded cumulative weights, so that the
+  // regions add up to the population exactly.
+  const double total_weight =
+      std::accumulate(weights.begin(), weights.end(), 0.0);
+  double cumulative_weight = 0;
+  int64 assigned = 0;
+  for (int region = 0; region < num_regions; ++region) {
+    cumulative_weight += weights[region];
+    const int64 end = region + 1 == num_regions
+                          ? config.population_size()
+                          : std::min<int64>(
+                                config.population_size(),
+                                std::llround(config.population_size() *
+                                             cumulative_weight / total_weight));
+    population.region_agents.push_back(end - assigned);
+    assigned = end;
+  }
+
+  // Counts the workers and social group members of each region.
+  const absl::discrete_distribution<int> regions(weights.begin(),
+                                                 weights.end());
+  std::vector<int64> workers(num_regions);
+  std::vector<int64> social_members(num_regions);
+  for (int region = 0; region < num_regions; ++region) {
+    MembershipSampler memberships(config, regions, region);
+    for (int64 i = 0; i < population.region_agents[region]; ++i) {
+      const MembershipSampler::Membership membership = memberships.Next();
+      ++workers[membership.workplace_region];
+      if (membership.social) ++social_members[region];
+    }
+  }
+
+  auto uuid_generator = absl::make_unique<ShardedSequentialUuidGenerator>(0);
+  LocationBuilder builder(*uuid_generator, &population.locations);
+  std::vector<RegionSamplers> region_samplers(num_regions);
+  for (int region = 0; region < num_regions; ++region) {
+    const int64 first_location = population.locations.size();
+    RegionSamplers& samplers = region_samplers[region];
+
+    LocationSizeSampler household_sizes(
+        config.household_size_distribution(),
+        StreamSeed(config.seed(), region, kHouseholdStream));
+    builder.AddSampled(LocationProto::HOUSEHOLD,
+                       population.region_agents[region], &household_sizes);
+    samplers.households =
+        builder.Finish(StreamSeed(config.seed(), region, kHouseholdSlotStream));
+
+    int64 giant_workers = 0;
+    if (config.giant_employers_per_region() > 0) {
+      giant_workers = std::llround(workers[region] *
+                                   config.giant_employer_fraction());
+      const int giants = config.giant_employers_per_region();
+      for (int giant = 0; giant < giants; ++giant) {
+        const int64 size =
+            giant_workers / giants + (giant < giant_workers % giants ? 1 : 0);
+        if (size > 0) builder.Add(LocationProto::BUSINESS, size);
+      }
+    }
+    LocationSizeSampler business_sizes(
+        config.business_size_distribution(),
+        StreamSeed(config.seed(), region, kBusinessStream));
+    builder.AddSampled(LocationProto::BUSINESS,
+                       workers[region] - giant_workers, &business_sizes);
+    samplers.businesses =
+        builder.Finish(StreamSeed(config.seed(), region, kBusinessSlotStream));
+
+    LocationSizeSampler social_group_sizes(
+        config.social_group_size_distribution(),
+        StreamSeed(config.seed(), region, kSocialGroupStream));
+    builder.AddSampled(LocationProto::SOCIAL, social_members[region],
+                       &social_group_sizes);
+    samplers.social_groups = builder.Finish(
+        StreamSeed(config.seed(), region, kSocialGroupSlotStream));
+
+    population.region_locations.push_back(population.locations.size() -
+                                          first_location);
+  }
+  population.agents = absl::make_unique<SyntheticAgentSampler>(
+      config, regions, population.region_agents, std::move(region_samplers),
+      std::move(uuid_generator));
+  return population;
+}
+
+}  // namespace abesim
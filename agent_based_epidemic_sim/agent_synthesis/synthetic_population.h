@@ -0,0 +1,55 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_SYNTHETIC_POPULATION_H_
+#define AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_SYNTHETIC_POPULATION_H_
+
+#include <memory>
+#include <vector>
+
+#include "agent_based_epidemic_sim/agent_synthesis/agent_sampler.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/agent_synthesis/synthetic_population.pb.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+namespace abesim {
+
+// A synthetic population of households, businesses and social groups spread
+// over regions.  The locations are materialized, while the agents are sampled
+// one at a time, so that populations of tens of millions of agents can be
+// streamed to a population snapshot or a simulation.
+struct SyntheticPopulation {
+  // The locations of each region are consecutive, and ordered by region.
+  std::vector<LocationProto> locations;
+  // Samples the agents in order of region.  Each agent is a member of a
+  // household of its region, of a business and possibly of a social group of
+  // its region.
+  std::unique_ptr<AgentSampler> agents;
+  int64 num_agents = 0;
+  // The number of agents and of locations of each region.
+  std::vector<int64> region_agents;
+  std::vector<int64> region_locations;
+};
+
+// Generates the population described by config.  The uuids of locations and
+// agents are drawn from ShardedSequentialUuidGenerator(0), locations first.
+StatusOr<SyntheticPopulation> GenerateSyntheticPopulation(
+    const SyntheticPopulationConfig& config);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_SYNTHETIC_POPULATION_H_
@@ -0,0 +1,199 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/synthetic_population.h"
+
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+SyntheticPopulationConfig TestConfig() {
+  return ParseTextProtoOrDie<SyntheticPopulationConfig>(R"(
+    population_size: 10000
+    seed: 7
+    num_regions: 4
+    region_size_skew: 1
+    household_size_distribution {
+      discrete {
+        buckets { int_value: 1 count: 1 }
+        buckets { int_value: 4 count: 1 }
+      }
+    }
+    business_size_distribution {
+      power_law { exponent: 2 min_size: 1 max_size: 1000 }
+    }
+    giant_employer_fraction: 0.2
+    giant_employers_per_region: 2
+    commuter_fraction: 0.1
+    social_group_fraction: 0.5
+    social_group_size_distribution { gamma { alpha: 2 beta: 10 } }
+    initial_health_state_distribution {
+      buckets {
+        proto_value {
+          [type.googleapis.com/abesim.HealthState] { state: SUSCEPTIBLE }
+        }
+        count: 0.9
+      }
+      buckets {
+        proto_value {
+          [type.googleapis.com/abesim.HealthState] { state: INFECTIOUS }
+        }
+        count: 0.1
+      }
+    }
+  )");
+}
+
+std::vector<AgentProto> SampleAgents(SyntheticPopulation* population) {
+  std::vector<AgentProto> agents;
+  for (int64 i = 0; i < population->num_agents; ++i) {
+    agents.push_back(population->agents->Next());
+  }
+  return agents;
+}
+
+// Returns the region of each location uuid.
+absl::flat_hash_map<int64, int> LocationRegions(
+    const SyntheticPopulation& population) {
+  absl::flat_hash_map<int64, int> regions;
+  int64 index = 0;
+  for (int region = 0; region < population.region_locations.size();
+       ++region) {
+    for (int64 i = 0; i < population.region_locations[region]; ++i) {
+      regions[population.locations[index++].uuid()] = region;
+    }
+  }
+  return regions;
+}
+
+TEST(SyntheticPopulationTest, FillsEveryLocationToItsSize) {
+  auto population = GenerateSyntheticPopulation(TestConfig());
+  PANDEMIC_ASSERT_OK(population.status());
+  EXPECT_EQ(population->num_agents, 10000);
+  absl::flat_hash_map<int64, int64> members;
+  for (const AgentProto& agent : SampleAgents(&*population)) {
+    ASSERT_GE(agent.locations_size(), 2);
+    EXPECT_EQ(agent.locations(0).type(), LocationProto::HOUSEHOLD);
+    EXPECT_EQ(agent.locations(1).type(), LocationProto::BUSINESS);
+    for (const LocationProto& location : agent.locations()) {
+      ++members[location.uuid()];
+    }
+  }
+  absl::flat_hash_map<LocationProto::Type, int64> capacities;
+  for (const LocationProto& location : population->locations) {
+    EXPECT_GT(location.size(), 0);
+    EXPECT_EQ(members[location.uuid()], location.size());
+    capacities[location.type()] += location.size();
+  }
+  EXPECT_EQ(capacities[LocationProto::HOUSEHOLD], 10000);
+  EXPECT_EQ(capacities[LocationProto::BUSINESS], 10000);
+  EXPECT_NEAR(capacities[LocationProto::SOCIAL], 5000, 300);
+}
+
+TEST(SyntheticPopulationTest, SkewsRegionsAndKeepsResidentsHome) {
+  auto population = GenerateSyntheticPopulation(TestConfig());
+  PANDEMIC_ASSERT_OK(population.status());
+  // Regions are proportional to 1, 1/2, 1/3 and 1/4.
+  EXPECT_THAT(population->region_agents,
+              testing::ElementsAre(4800, 2400, 1600, 1200));
+  const absl::flat_hash_map<int64, int> regions = LocationRegions(*population);
+  int64 commuters = 0;
+  int64 index = 0;
+  int region = 0;
+  for (const AgentProto& agent : SampleAgents(&*population)) {
+    while (index == population->region_agents[region]) {
+      ++region;
+      index = 0;
+    }
+    ++index;
+    EXPECT_EQ(regions.at(agent.locations(0).uuid()), region);
+    if (regions.at(agent.locations(1).uuid()) != region) ++commuters;
+    if (agent.locations_size() > 2) {
+      EXPECT_EQ(regions.at(agent.locations(2).uuid()), region);
+    }
+  }
+  EXPECT_NEAR(commuters, 1000, 150);
+}
+
+TEST(SyntheticPopulationTest, CommutersWorkInOtherRegions) {
+  SyntheticPopulationConfig config = TestConfig();
+  config.set_commuter_fraction(1);
+  // Almost every agent lives in the first region, which commuters must still
+  // leave.
+  config.set_region_size_skew(8);
+  auto population = GenerateSyntheticPopulation(config);
+  PANDEMIC_ASSERT_OK(population.status());
+  const absl::flat_hash_map<int64, int> regions = LocationRegions(*population);
+  for (const AgentProto& agent : SampleAgents(&*population)) {
+    EXPECT_NE(regions.at(agent.locations(0).uuid()),
+              regions.at(agent.locations(1).uuid()));
+  }
+}
+
+TEST(SyntheticPopulationTest, AddsGiantEmployers) {
+  auto population = GenerateSyntheticPopulation(TestConfig());
+  PANDEMIC_ASSERT_OK(population.status());
+  // The first businesses of the largest region employ 20% of its ~4800
+  // workers.
+  std::vector<int> sizes;
+  for (const LocationProto& location : population->locations) {
+    if (location.type() == LocationProto::BUSINESS) {
+      sizes.push_back(location.size());
+      if (sizes.size() == 2) break;
+    }
+  }
+  EXPECT_THAT(sizes, testing::Each(testing::AllOf(testing::Gt(400),
+                                                  testing::Lt(560))));
+}
+
+TEST(SyntheticPopulationTest, IsDeterministicForASeed) {
+  auto first = GenerateSyntheticPopulation(TestConfig());
+  auto second = GenerateSyntheticPopulation(TestConfig());
+  PANDEMIC_ASSERT_OK(first.status());
+  PANDEMIC_ASSERT_OK(second.status());
+  ASSERT_EQ(first->locations.size(), second->locations.size());
+  for (int64 i = 0; i < first->locations.size(); ++i) {
+    EXPECT_EQ(first->locations[i].DebugString(),
+              second->locations[i].DebugString());
+  }
+  const std::vector<AgentProto> first_agents = SampleAgents(&*first);
+  const std::vector<AgentProto> second_agents = SampleAgents(&*second);
+  for (int64 i = 0; i < first_agents.size(); ++i) {
+    EXPECT_EQ(first_agents[i].DebugString(), second_agents[i].DebugString());
+  }
+}
+
+TEST(SyntheticPopulationTest, RejectsInvalidConfigs) {
+  SyntheticPopulationConfig config = TestConfig();
+  config.mutable_business_size_distribution()
+      ->mutable_power_law()
+      ->set_exponent(1);
+  EXPECT_FALSE(GenerateSyntheticPopulation(config).ok());
+  config = TestConfig();
+  config.set_commuter_fraction(1.5);
+  EXPECT_FALSE(GenerateSyntheticPopulation(config).ok());
+  config = TestConfig();
+  config.clear_household_size_distribution();
+  EXPECT_FALSE(GenerateSyntheticPopulation(config).ok());
+}
+
+}  // namespace
+}  // namespace abesim
@@ -47,7 +47,7 @@ void RunSimulation(absl::string_view output_file_path,
   auto context = GetSimulationContext(config.home_work_config());
   RunSimulation(output_file_path, learning_output_base,
                 config.home_work_config(), get_policy_generator, num_workers,
-                context);
+                &context);
 }
 
 }  // namespace abesim
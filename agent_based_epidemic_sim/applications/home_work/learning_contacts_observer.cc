@@ -1,5 +1,7 @@
 #include "agent_based_epidemic_sim/applications/home_work/learning_contacts_observer.h"
 
+#include <algorithm>
+
 #include "absl/strings/str_cat.h"
 #include "absl/strings/substitute.h"
 #include "absl/types/span.h"
@@ -8,8 +10,32 @@
 #include "agent_based_epidemic_sim/core/health_state.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/util/columnar_file.h"
 
 namespace abesim {
+namespace {
+
+// Contacts are handed to the writer in buffers of about this many bytes.
+constexpr size_t kBufferSize = 1 << 20;
+
+// The columns of the columnar contacts output.  The location column of the CSV
+// output is always "unknown" and is omitted.
+enum ContactColumn {
+  kSourceUuid,
+  kSinkUuid,
+  kStartTime,
+  kDuration,
+  kInfectivity,
+};
+std::vector<ColumnSpec> ContactColumns() {
+  return {{"source_uuid", ColumnType::kInt64},
+          {"sink_uuid", ColumnType::kInt64},
+          {"start_time", ColumnType::kTime},
+          {"duration", ColumnType::kDuration},
+          {"infectivity", ColumnType::kFloat}};
+}
+
+}  // namespace
 
 LearningContactsObserver::LearningContactsObserver() {}
 
@@ -29,28 +55,112 @@ void LearningContactsObserver::Observe(
 }
 
 LearningContactsObserverFactory::LearningContactsObserverFactory(
-    absl::string_view output_pattern)
-    : output_pattern_(output_pattern) {}
+    absl::string_view output_pattern, const LearningOutputFormat format,
+    const int parts)
+    : output_pattern_(output_pattern),
+      format_(format),
+      striped_(parts > 0),
+      parts_(std::max(1, parts)) {}
+
+std::string LearningContactsObserverFactory::ContactsPath(
+    const Timestep& timestep) const {
+  return absl::StrCat(
+      output_pattern_, "_", absl::FormatTime(timestep.start_time()),
+      format_ == LEARNING_OUTPUT_COLUMNAR ? "_contacts.columnar"
+                                          : "_contacts.csv");
+}
+
+void LearningContactsObserverFactory::WritePart(
+    const Timestep& timestep, const int part_index,
+    absl::Span<std::unique_ptr<LearningContactsObserver> const> observers) {
+  Part& part = parts_[part_index];
+  if (part.writer != nullptr) {
+    part.status.Update(part.writer->Close());
+    part.writer.reset();
+  }
+  const std::string path = ContactsPath(timestep);
+  part.writer = file::OpenAsyncOrDie(
+      striped_ ? LearningOutputPartPath(path, part_index) : path);
+  file::FileWriter* const writer = part.writer.get();
+  part.status.Update(format_ == LEARNING_OUTPUT_COLUMNAR
+                         ? WriteColumnar(part_index, observers, writer)
+                         : WriteCsv(part_index, observers, writer));
+}
+
+void LearningContactsObserverFactory::AggregatePartition(
+    const Timestep& timestep, const int partition,
+    absl::Span<std::unique_ptr<LearningContactsObserver> const> observers) {
+  WritePart(timestep, partition, observers);
+}
 
 void LearningContactsObserverFactory::Aggregate(
     const Timestep& timestep,
     absl::Span<std::unique_ptr<LearningContactsObserver> const> observers) {
-  const std::string csv_path_base = absl::StrCat(
-      output_pattern_, "_", absl::FormatTime(timestep.start_time()));
-  auto contacts_writer =
-      file::OpenOrDie(absl::StrCat(csv_path_base, "_contacts.csv"));
-  status_.Update(contacts_writer->WriteString(
-      "source_uuid,sink_uuid,start_time,duration,location,infectivity\n"));
-  for (const auto& observer : observers) {
-    for (const auto& outcome : observer->outcomes_) {
-      const std::string contact_line = absl::Substitute(
-          "$0,$1,$2,$3,$4,$5\n", outcome.source_uuid, outcome.agent_uuid,
-          absl::FormatTime(outcome.exposure.start_time),
+  if (!striped_) WritePart(timestep, 0, observers);
+  for (Part& part : parts_) {
+    status_.Update(part.status);
+    part.status = absl::OkStatus();
+  }
+  if (striped_) {
+    status_.Update(
+        WriteLearningOutputManifest(ContactsPath(timestep), parts_.size()));
+  }
+}
+
+absl::Status LearningContactsObserverFactory::WriteCsv(
+    const int part,
+    absl::Span<std::unique_ptr<LearningContactsObserver> const> observers,
+    file::FileWriter* const writer) const {
+  absl::Status status;
+  std::string buffer =
+      "source_uuid,sink_uuid,start_time,duration,location,infectivity\n";
+  for (int i = part; i < observers.size(); i += parts_.size()) {
+    for (const auto& outcome : observers[i]->outcomes_) {
+      absl::SubstituteAndAppend(
+          &buffer, "$0,$1,$2,$3,$4,$5\n", outcome.source_uuid,
+          outcome.agent_uuid, absl::FormatTime(outcome.exposure.start_time),
           absl::FormatDuration(outcome.exposure.duration), "unknown",
           outcome.exposure.infectivity);
-      status_.Update(contacts_writer->WriteString(contact_line));
+      if (buffer.size() >= kBufferSize) {
+        status.Update(writer->WriteBuffer(std::move(buffer)));
+        buffer.clear();
+      }
+    }
+  }
+  status.Update(writer->WriteBuffer(std::move(buffer)));
+  return status;
+}
+
+absl::Status LearningContactsObserverFactory::WriteColumnar(
+    const int part,
+    absl::Span<std::unique_ptr<LearningContactsObserver> const> observers,
+    file::FileWriter* const writer) const {
+  absl::Status status;
+  ColumnarWriter columnar(writer, ContactColumns());
+  for (int i = part; i < observers.size(); i += parts_.size()) {
+    for (const auto& outcome : observers[i]->outcomes_) {
+      columnar.AppendInt64(kSourceUuid, outcome.source_uuid);
+      columnar.AppendInt64(kSinkUuid, outcome.agent_uuid);
+      columnar.AppendTime(kStartTime, outcome.exposure.start_time);
+      columnar.AppendDuration(kDuration, outcome.exposure.duration);
+      columnar.AppendFloat(kInfectivity, outcome.exposure.infectivity);
+      status.Update(columnar.EndRow());
+    }
+  }
+  status.Update(columnar.Finish());
+  return status;
+}
+
+absl::Status LearningContactsObserverFactory::Close() {
+  for (Part& part : parts_) {
+    if (part.writer != nullptr) {
+      part.status.Update(part.writer->Close());
+      part.writer.reset();
     }
+    status_.Update(part.status);
+    part.status = absl::OkStatus();
   }
+  return status_;
 }
 
 std::unique_ptr<LearningContactsObserver>
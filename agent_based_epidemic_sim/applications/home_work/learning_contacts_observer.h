@@ -3,12 +3,16 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/types/span.h"
+#include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+#include "agent_based_epidemic_sim/applications/home_work/learning_output.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
 
 namespace abesim {
 
@@ -21,27 +25,77 @@ class LearningContactsObserver : public AgentInfectionObserver {
   void Observe(const Agent& agent,
                absl::Span<const InfectionOutcome> outcomes) override;
 
+  // Discards all observations, keeping allocated capacity for reuse.
+  void Reset() { outcomes_.clear(); }
+
  private:
   friend class LearningContactsObserverFactory;
 
-  std::list<InfectionOutcome> outcomes_;
+  std::vector<InfectionOutcome> outcomes_;
 };
 
 class LearningContactsObserverFactory
     : public ObserverFactory<LearningContactsObserver> {
  public:
-  explicit LearningContactsObserverFactory(absl::string_view output_pattern);
+  // If parts is positive, the contacts of each timestep are striped over that
+  // many part files which are written in parallel, see learning_output.h.
+  // Otherwise they are written to a single file.
+  explicit LearningContactsObserverFactory(
+      absl::string_view output_pattern,
+      LearningOutputFormat format = LEARNING_OUTPUT_CSV, int parts = 0);
 
+  int AggregationPartitions() const override {
+    return striped_ ? parts_.size() : 0;
+  }
+  void AggregatePartition(
+      const Timestep& timestep, int partition,
+      absl::Span<std::unique_ptr<LearningContactsObserver> const> observers)
+      override;
   void Aggregate(const Timestep& timestep,
                  absl::Span<std::unique_ptr<LearningContactsObserver> const>
                      observers) override;
   std::unique_ptr<LearningContactsObserver> MakeObserver() const override;
+  bool ResetObserver(LearningContactsObserver* observer) const override {
+    observer->Reset();
+    return true;
+  }
+
+  // Waits for the contacts of the last timestep to be written and closes the
+  // files.  Returns the status of all writes.
+  absl::Status Close();
 
   absl::Status status() const { return status_; }
 
  private:
+  struct Part {
+    // The contacts of the previous timestep are written in the background
+    // while the next timestep runs.
+    std::unique_ptr<file::FileWriter> writer;
+    absl::Status status;
+  };
+
+  std::string ContactsPath(const Timestep& timestep) const;
+  // Closes the file of the previous timestep of a part and writes the contacts
+  // of its observers to a new one.
+  void WritePart(
+      const Timestep& timestep, int part,
+      absl::Span<std::unique_ptr<LearningContactsObserver> const> observers);
+  // Writes the contacts of the observers of a single part.
+  absl::Status WriteCsv(
+      int part,
+      absl::Span<std::unique_ptr<LearningContactsObserver> const> observers,
+      file::FileWriter* writer) const;
+  absl::Status WriteColumnar(
+      int part,
+      absl::Span<std::unique_ptr<LearningContactsObserver> const> observers,
+      file::FileWriter* writer) const;
+
   absl::Status status_;
   std::string output_pattern_;
+  const LearningOutputFormat format_;
+  const bool striped_;
+  // A single part unless striped.
+  std::vector<Part> parts_;
 };
 
 }  // namespace abesim
@@ -1,5 +1,8 @@
 #include "agent_based_epidemic_sim/applications/home_work/learning_history_and_testing_observer.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/substitute.h"
@@ -10,64 +13,254 @@
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/util/columnar_file.h"
 
 namespace abesim {
+namespace {
+
+// Lines are handed to the writers in buffers of about this many bytes.
+constexpr size_t kBufferSize = 1 << 20;
 
-LearningHistoryAndTestingObserver::LearningHistoryAndTestingObserver() {}
+// The columnar output has one row per health transition and test result,
+// rather than one line per agent.
+enum HistoryColumn { kHistoryAgentUuid, kHealthState, kTransitionTime };
+std::vector<ColumnSpec> HistoryColumns() {
+  return {{"agent_uuid", ColumnType::kInt64},
+          {"health_state", ColumnType::kInt64},
+          {"time", ColumnType::kTime}};
+}
+enum TestColumn { kTestAgentUuid, kProbability, kTimeReceived };
+std::vector<ColumnSpec> TestColumns() {
+  return {{"agent_uuid", ColumnType::kInt64},
+          {"probability", ColumnType::kFloat},
+          {"time_received", ColumnType::kTime}};
+}
+
+}  // namespace
+
+LearningHistoryAndTestingObserver::LearningHistoryAndTestingObserver(
+    const absl::flat_hash_map<int64, HealthTransition>* const last_written,
+    const bool* const write_tests)
+    : last_written_(last_written), write_tests_(write_tests) {}
 
 void LearningHistoryAndTestingObserver::Observe(
     const Agent& agent, absl::Span<const InfectionOutcome> outcomes) {
-  HealthTransitionsAndTestResults output;
-  output.agent_uuid = agent.uuid();
-  for (const auto& health_transition : agent.HealthTransitions()) {
-    output.health_transitions.push_back(health_transition);
+  const absl::Span<const HealthTransition> health_transitions =
+      agent.HealthTransitions();
+  // Transitions are appended to the history in the order they are processed,
+  // which is not necessarily the order of their times, so the new ones are
+  // those after the last one written.  That one is found by scanning back from
+  // the end.  If it has been compacted out of the history, all the retained
+  // transitions came after it.
+  size_t first = 0;
+  HealthState::State last_state = HealthState::SUSCEPTIBLE;
+  const auto last = last_written_->find(agent.uuid());
+  if (last != last_written_->end()) {
+    last_state = last->second.health_state;
+    for (size_t i = health_transitions.size(); i > 0; --i) {
+      if (health_transitions[i - 1] == last->second) {
+        first = i;
+        break;
+      }
+    }
+  }
+  for (size_t i = first; i < health_transitions.size(); ++i) {
+    if (health_transitions[i].health_state == last_state) continue;
+    health_transitions_.emplace_back(agent.uuid(), health_transitions[i]);
+    last_state = health_transitions[i].health_state;
+  }
+  if (*write_tests_) {
+    test_results_.emplace_back(agent.uuid(), agent.CurrentTestResult());
   }
-  output.test_results.push_back(agent.CurrentTestResult());
-  history_and_tests_.push_back(output);
 }
 
 LearningHistoryAndTestingObserverFactory::
-    LearningHistoryAndTestingObserverFactory(absl::string_view output_pattern)
-    : output_pattern_(output_pattern) {}
+    LearningHistoryAndTestingObserverFactory(absl::string_view output_pattern,
+                                             const LearningOutputFormat format,
+                                             const int parts)
+    : output_pattern_(output_pattern),
+      format_(format),
+      striped_(parts > 0),
+      parts_(std::max(1, parts)) {}
+
+std::string LearningHistoryAndTestingObserverFactory::OutputPath(
+    absl::string_view table) const {
+  return absl::StrCat(
+      output_pattern_, "_", table,
+      format_ == LEARNING_OUTPUT_COLUMNAR ? ".columnar" : ".csv");
+}
+
+std::string LearningHistoryAndTestingObserverFactory::PartPath(
+    absl::string_view table, const int part) const {
+  return striped_ ? LearningOutputPartPath(OutputPath(table), part)
+                  : OutputPath(table);
+}
+
+absl::Status LearningHistoryAndTestingObserverFactory::ClosePart(Part& part) {
+  if (part.history_columns != nullptr) {
+    part.status.Update(part.history_columns->Finish());
+    part.history_columns.reset();
+  }
+  if (part.history_writer != nullptr) {
+    part.status.Update(part.history_writer->Close());
+    part.history_writer.reset();
+  }
+  if (part.tests_columns != nullptr) {
+    part.status.Update(part.tests_columns->Finish());
+    part.tests_columns.reset();
+  }
+  if (part.tests_writer != nullptr) {
+    part.status.Update(part.tests_writer->Close());
+    part.tests_writer.reset();
+  }
+  return std::exchange(part.status, absl::OkStatus());
+}
+
+void LearningHistoryAndTestingObserverFactory::WritePart(
+    const int part_index,
+    absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+        observers) {
+  Part& part = parts_[part_index];
+  // The files stay open across timesteps, so that each part keeps a single
+  // background writer for the whole run.
+  if (part.history_writer == nullptr) {
+    part.history_writer =
+        file::OpenAsyncOrDie(PartPath("history", part_index));
+    if (format_ == LEARNING_OUTPUT_COLUMNAR) {
+      part.history_columns = absl::make_unique<ColumnarWriter>(
+          part.history_writer.get(), HistoryColumns());
+    }
+  }
+  if (write_tests_ && part.tests_writer == nullptr) {
+    part.tests_writer = file::OpenAsyncOrDie(PartPath("tests", part_index));
+    if (format_ == LEARNING_OUTPUT_COLUMNAR) {
+      part.tests_columns = absl::make_unique<ColumnarWriter>(
+          part.tests_writer.get(), TestColumns());
+    }
+  }
+  part.status.Update(format_ == LEARNING_OUTPUT_COLUMNAR
+                         ? WriteColumnar(part_index, observers, &part)
+                         : WriteCsv(part_index, observers, &part));
+}
+
+void LearningHistoryAndTestingObserverFactory::AggregatePartition(
+    const Timestep& timestep, const int partition,
+    absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+        observers) {
+  WritePart(partition, observers);
+}
 
 void LearningHistoryAndTestingObserverFactory::Aggregate(
     const Timestep& timestep,
     absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
         observers) {
-  auto history_writer =
-      file::OpenOrDie(absl::StrCat(output_pattern_, "_history.csv"));
-  auto tests_writer =
-      file::OpenOrDie(absl::StrCat(output_pattern_, "_tests.csv"));
+  if (!striped_) WritePart(0, observers);
+  for (Part& part : parts_) {
+    status_.Update(std::exchange(part.status, absl::OkStatus()));
+  }
+  // The transitions of each agent are in order, so the last one recorded is
+  // the last one written.
   for (const auto& observer : observers) {
-    for (const auto& history_and_tests : observer->history_and_tests_) {
-      const auto agent_uuid = history_and_tests.agent_uuid;
-      std::string history_line = absl::StrCat(agent_uuid);
-      std::string test_line = absl::StrCat(agent_uuid);
-      HealthState::State last_state = HealthState::SUSCEPTIBLE;
-      for (const auto& health_transition :
-           history_and_tests.health_transitions) {
-        if (health_transition.health_state == last_state) {
-          continue;
-        }
-        absl::StrAppend(&history_line, ",", health_transition.health_state, ",",
-                        absl::FormatTime(health_transition.time));
-        last_state = health_transition.health_state;
+    for (const auto& [agent_uuid, health_transition] :
+         observer->health_transitions_) {
+      last_written_[agent_uuid] = health_transition;
+    }
+  }
+}
+
+absl::Status LearningHistoryAndTestingObserverFactory::WriteCsv(
+    const int part,
+    absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+        observers,
+    Part* const files) const {
+  absl::Status status;
+  std::string buffer;
+  // Writes one line per agent with its new transitions.
+  for (int i = part; i < observers.size(); i += parts_.size()) {
+    const auto& health_transitions = observers[i]->health_transitions_;
+    for (int j = 0; j < health_transitions.size(); ++j) {
+      const auto& [agent_uuid, health_transition] = health_transitions[j];
+      if (j == 0 || health_transitions[j - 1].first != agent_uuid) {
+        if (j > 0) absl::StrAppend(&buffer, "\n");
+        absl::StrAppend(&buffer, agent_uuid);
+      }
+      absl::StrAppend(&buffer, ",", health_transition.health_state, ",",
+                      absl::FormatTime(health_transition.time));
+      if (buffer.size() >= kBufferSize) {
+        status.Update(files->history_writer->WriteBuffer(std::move(buffer)));
+        buffer.clear();
       }
-      for (const auto& test_result : history_and_tests.test_results) {
-        absl::StrAppend(&test_line, ",", test_result.probability, ",",
-                        absl::FormatTime(test_result.time_received));
+    }
+    if (!health_transitions.empty()) absl::StrAppend(&buffer, "\n");
+  }
+  status.Update(files->history_writer->WriteBuffer(std::move(buffer)));
+  if (!write_tests_) return status;
+  buffer.clear();
+  for (int i = part; i < observers.size(); i += parts_.size()) {
+    for (const auto& [agent_uuid, test_result] : observers[i]->test_results_) {
+      absl::StrAppend(&buffer, agent_uuid, ",", test_result.probability, ",",
+                      absl::FormatTime(test_result.time_received), "\n");
+      if (buffer.size() >= kBufferSize) {
+        status.Update(files->tests_writer->WriteBuffer(std::move(buffer)));
+        buffer.clear();
       }
-      absl::StrAppend(&history_line, "\n");
-      absl::StrAppend(&test_line, "\n");
-      status_.Update(history_writer->WriteString(history_line));
-      status_.Update(tests_writer->WriteString(test_line));
     }
   }
+  status.Update(files->tests_writer->WriteBuffer(std::move(buffer)));
+  return status;
+}
+
+absl::Status LearningHistoryAndTestingObserverFactory::WriteColumnar(
+    const int part,
+    absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+        observers,
+    Part* const files) const {
+  absl::Status status;
+  ColumnarWriter* const history = files->history_columns.get();
+  for (int i = part; i < observers.size(); i += parts_.size()) {
+    for (const auto& [agent_uuid, health_transition] :
+         observers[i]->health_transitions_) {
+      history->AppendInt64(kHistoryAgentUuid, agent_uuid);
+      history->AppendInt64(kHealthState, health_transition.health_state);
+      history->AppendTime(kTransitionTime, health_transition.time);
+      status.Update(history->EndRow());
+    }
+  }
+  if (!write_tests_) return status;
+  ColumnarWriter* const tests = files->tests_columns.get();
+  for (int i = part; i < observers.size(); i += parts_.size()) {
+    for (const auto& [agent_uuid, test_result] : observers[i]->test_results_) {
+      tests->AppendInt64(kTestAgentUuid, agent_uuid);
+      tests->AppendFloat(kProbability, test_result.probability);
+      tests->AppendTime(kTimeReceived, test_result.time_received);
+      status.Update(tests->EndRow());
+    }
+  }
+  return status;
+}
+
+absl::Status LearningHistoryAndTestingObserverFactory::Close() {
+  // Tests are only written in the timesteps that set write_tests.
+  const bool wrote_tests = parts_[0].tests_writer != nullptr;
+  const bool wrote_history = parts_[0].history_writer != nullptr;
+  for (Part& part : parts_) {
+    status_.Update(ClosePart(part));
+  }
+  if (striped_ && wrote_history) {
+    status_.Update(
+        WriteLearningOutputManifest(OutputPath("history"), parts_.size()));
+  }
+  if (striped_ && wrote_tests) {
+    status_.Update(
+        WriteLearningOutputManifest(OutputPath("tests"), parts_.size()));
+  }
+  return status_;
 }
 
 std::unique_ptr<LearningHistoryAndTestingObserver>
 LearningHistoryAndTestingObserverFactory::MakeObserver() const {
-  return absl::make_unique<LearningHistoryAndTestingObserver>();
+  return absl::make_unique<LearningHistoryAndTestingObserver>(&last_written_,
+                                                             &write_tests_);
 }
 
 }  // namespace abesim
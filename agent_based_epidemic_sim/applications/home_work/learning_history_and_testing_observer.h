@@ -6,53 +6,141 @@
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/types/span.h"
+#include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+#include "agent_based_epidemic_sim/applications/home_work/learning_output.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/util/columnar_file.h"
 
 namespace abesim {
 
-struct HealthTransitionsAndTestResults {
-  int64 agent_uuid;
-  std::vector<HealthTransition> health_transitions;
-  std::vector<TestResult> test_results;
-};
-
-// This is an observer for writing out contacts between agents in a format
-// compliant with the documentation in (broken link).
+// This is an observer for writing out the health history and test results of
+// agents in a format compliant with the documentation in (broken link).
+//
+// The history is written incrementally: each timestep only records the health
+// transitions that an agent appended to its history after the last one that
+// was written, skipping transitions that do not change its health state.  The
+// full history of an agent is the concatenation of its records in the order
+// they were written.
 class LearningHistoryAndTestingObserver : public AgentInfectionObserver {
  public:
-  explicit LearningHistoryAndTestingObserver();
+  // last_written holds the last transition written for each agent.  Test
+  // results are only recorded while *write_tests is true.  Both are owned by
+  // the factory.
+  LearningHistoryAndTestingObserver(
+      const absl::flat_hash_map<int64, HealthTransition>* last_written,
+      const bool* write_tests);
 
   void Observe(const Agent& agent,
                absl::Span<const InfectionOutcome> outcomes) override;
 
+  // Discards all observations, keeping allocated capacity for reuse.
+  void Reset() {
+    health_transitions_.clear();
+    test_results_.clear();
+  }
+
  private:
   friend class LearningHistoryAndTestingObserverFactory;
 
-  std::vector<HealthTransitionsAndTestResults> history_and_tests_;
+  const absl::flat_hash_map<int64, HealthTransition>* const last_written_;
+  const bool* const write_tests_;
+  // Observations keyed by agent uuid, in the order the agents were observed.
+  std::vector<std::pair<int64, HealthTransition>> health_transitions_;
+  std::vector<std::pair<int64, TestResult>> test_results_;
 };
 
 class LearningHistoryAndTestingObserverFactory
     : public ObserverFactory<LearningHistoryAndTestingObserver> {
  public:
+  // If parts is positive, the history and tests are striped over that many
+  // part files which are written in parallel, see learning_output.h.
+  // Otherwise each is written to a single file.  The files are appended to in
+  // every timestep and completed by Close(), which also writes the manifests
+  // of striped output.
   explicit LearningHistoryAndTestingObserverFactory(
-      absl::string_view output_pattern);
+      absl::string_view output_pattern,
+      LearningOutputFormat format = LEARNING_OUTPUT_CSV, int parts = 0);
 
+  int AggregationPartitions() const override {
+    return striped_ ? parts_.size() : 0;
+  }
+  void AggregatePartition(
+      const Timestep& timestep, int partition,
+      absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+          observers) override;
   void Aggregate(
       const Timestep& timestep,
       absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
           observers) override;
   std::unique_ptr<LearningHistoryAndTestingObserver> MakeObserver()
       const override;
+  bool ResetObserver(
+      LearningHistoryAndTestingObserver* observer) const override {
+    observer->Reset();
+    return true;
+  }
+
+  // Waits for the history and tests to be written and closes the files.
+  // Returns the status of all writes.
+  absl::Status Close();
 
   absl::Status status() const { return status_; }
 
+  // Whether the test results of all agents are appended to the tests file in
+  // the following timesteps.  Defaults to true.
+  bool write_tests() const { return write_tests_; }
+  void set_write_tests(bool write_tests) { write_tests_ = write_tests; }
+
  private:
+  struct Part {
+    std::unique_ptr<file::FileWriter> history_writer;
+    // Only set for columnar output.
+    std::unique_ptr<ColumnarWriter> history_columns;
+    std::unique_ptr<file::FileWriter> tests_writer;
+    std::unique_ptr<ColumnarWriter> tests_columns;
+    absl::Status status;
+  };
+
+  std::string OutputPath(absl::string_view table) const;
+  std::string PartPath(absl::string_view table, int part) const;
+  // Closes the files of a part and returns the status of all its writes.
+  static absl::Status ClosePart(Part& part);
+  // Opens the files of a part on first use and writes the history and tests
+  // of its observers.
+  void WritePart(
+      int part,
+      absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+          observers);
+  // Writes the history and tests of the observers of a single part.  The tests
+  // are only written if write_tests_ is set.
+  absl::Status WriteCsv(
+      int part,
+      absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+          observers,
+      Part* files) const;
+  absl::Status WriteColumnar(
+      int part,
+      absl::Span<std::unique_ptr<LearningHistoryAndTestingObserver> const>
+          observers,
+      Part* files) const;
+
   absl::Status status_;
   std::string output_pattern_;
+  const LearningOutputFormat format_;
+  // The last health transition written for each agent.  Only agents that
+  // left their initial SUSCEPTIBLE state have an entry.
+  absl::flat_hash_map<int64, HealthTransition> last_written_;
+  bool write_tests_ = true;
+  const bool striped_;
+  // A single part unless striped.
+  std::vector<Part> parts_;
 };
 
 }  // namespace abesim
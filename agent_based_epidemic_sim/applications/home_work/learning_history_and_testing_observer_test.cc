@@ -0,0 +1,151 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/home_work/learning_history_and_testing_observer.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(std::getenv("TEST_TMPDIR"), "/", name);
+}
+
+// An agent whose health history is set directly by the test.
+class FakeAgent : public Agent {
+ public:
+  explicit FakeAgent(const int64 uuid) : uuid_(uuid) {
+    health_transitions_.push_back({.time = absl::InfinitePast(),
+                                   .health_state = HealthState::SUSCEPTIBLE});
+  }
+
+  int64 uuid() const override { return uuid_; }
+  void ComputeVisits(const Timestep& timestep,
+                     Broker<Visit>* visit_broker) const override {}
+  void ProcessInfectionOutcomes(
+      const Timestep& timestep,
+      absl::Span<const InfectionOutcome> infection_outcomes) override {}
+  void UpdateContactReports(absl::Span<const ContactReport> contact_reports,
+                            Broker<ContactReport>* broker) override {}
+  HealthState::State CurrentHealthState() const override {
+    return health_transitions_.back().health_state;
+  }
+  TestResult CurrentTestResult() const override { return TestResult(); }
+  absl::Span<const HealthTransition> HealthTransitions() const override {
+    return health_transitions_;
+  }
+
+  void AddTransition(const absl::Time time, const HealthState::State state) {
+    health_transitions_.push_back({.time = time, .health_state = state});
+  }
+
+ private:
+  const int64 uuid_;
+  std::vector<HealthTransition> health_transitions_;
+};
+
+// Observes the agent in a timestep and aggregates the observations the same
+// way ObserverManager does.
+void ObserveStep(LearningHistoryAndTestingObserverFactory& factory,
+                 const Timestep& timestep, const Agent& agent) {
+  std::vector<std::unique_ptr<LearningHistoryAndTestingObserver>> observers;
+  observers.push_back(factory.MakeObserver());
+  observers[0]->Observe(agent, {});
+  for (int i = 0; i < factory.AggregationPartitions(); ++i) {
+    factory.AggregatePartition(timestep, i, observers);
+  }
+  factory.Aggregate(timestep, observers);
+}
+
+TEST(LearningHistoryAndTestingObserverTest, WritesLateTransitionsOnce) {
+  const std::string output_pattern = TestPath("late_transitions");
+  LearningHistoryAndTestingObserverFactory factory(output_pattern);
+  factory.set_write_tests(false);
+  FakeAgent agent(7);
+  const absl::Time start = absl::UnixEpoch();
+  const absl::Duration step = absl::Hours(24);
+  auto timestep = [&](const int i) { return Timestep(start + i * step, step); };
+
+  ObserveStep(factory, timestep(0), agent);
+  // Agents are observed before processing the outcomes of a step, and the
+  // exposure of step 0 is only processed in step 1, as in the distributed
+  // path.  It is therefore first observed in step 2.
+  ObserveStep(factory, timestep(1), agent);
+  agent.AddTransition(start + absl::Hours(12), HealthState::EXPOSED);
+  // The next transition is already known, and dated in the future.
+  agent.AddTransition(start + 4 * step, HealthState::INFECTIOUS);
+  for (int i = 2; i < 6; ++i) {
+    ObserveStep(factory, timestep(i), agent);
+  }
+  PANDEMIC_ASSERT_OK(factory.Close());
+
+  std::string history;
+  PANDEMIC_ASSERT_OK(file::GetContents(
+      absl::StrCat(output_pattern, "_history.csv"), &history));
+  EXPECT_EQ(history,
+            absl::StrCat("7,", HealthState::EXPOSED, ",",
+                         absl::FormatTime(start + absl::Hours(12)), ",",
+                         HealthState::INFECTIOUS, ",",
+                         absl::FormatTime(start + 4 * step), "\n"));
+}
+
+TEST(LearningHistoryAndTestingObserverTest, WritesEachTransitionOnce) {
+  const std::string output_pattern = TestPath("each_transition");
+  LearningHistoryAndTestingObserverFactory factory(output_pattern);
+  factory.set_write_tests(false);
+  FakeAgent agent(3);
+  const absl::Time start = absl::UnixEpoch();
+  const absl::Duration step = absl::Hours(24);
+  auto timestep = [&](const int i) { return Timestep(start + i * step, step); };
+
+  ObserveStep(factory, timestep(0), agent);
+  agent.AddTransition(start + absl::Hours(1), HealthState::EXPOSED);
+  ObserveStep(factory, timestep(1), agent);
+  ObserveStep(factory, timestep(2), agent);
+  agent.AddTransition(start + 2 * step, HealthState::INFECTIOUS);
+  ObserveStep(factory, timestep(3), agent);
+  PANDEMIC_ASSERT_OK(factory.Close());
+
+  std::string history;
+  PANDEMIC_ASSERT_OK(file::GetContents(
+      absl::StrCat(output_pattern, "_history.csv"), &history));
+  const std::vector<std::string> lines =
+      absl::StrSplit(history, '\n', absl::SkipEmpty());
+  EXPECT_THAT(
+      lines,
+      testing::ElementsAre(
+          absl::StrCat("3,", HealthState::EXPOSED, ",",
+                       absl::FormatTime(start + absl::Hours(1))),
+          absl::StrCat("3,", HealthState::INFECTIOUS, ",",
+                       absl::FormatTime(start + 2 * step))));
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,72 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/home_work/learning_output.h"
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+
+namespace abesim {
+namespace {
+
+std::string ManifestPath(absl::string_view path) {
+  return absl::StrCat(path, ".manifest");
+}
+
+// Splits path into its directory, including the trailing slash, and its file
+// name.
+std::pair<absl::string_view, absl::string_view> SplitPath(
+    absl::string_view path) {
+  const size_t slash = path.rfind('/');
+  if (slash == absl::string_view::npos) return {"", path};
+  return {path.substr(0, slash + 1), path.substr(slash + 1)};
+}
+
+}  // namespace
+
+std::string LearningOutputPartPath(absl::string_view path, const int part) {
+  return absl::StrFormat("%s.part-%05d", path, part);
+}
+
+absl::Status WriteLearningOutputManifest(absl::string_view path,
+                                         const int parts) {
+  std::string manifest;
+  for (int part = 0; part < parts; ++part) {
+    absl::StrAppend(&manifest,
+                    SplitPath(LearningOutputPartPath(path, part)).second,
+                    "\n");
+  }
+  auto writer = file::OpenOrDie(ManifestPath(path));
+  absl::Status status = writer->WriteString(manifest);
+  status.Update(writer->Close());
+  return status;
+}
+
+StatusOr<std::vector<std::string>> ReadLearningOutputManifest(
+    absl::string_view path) {
+  std::string manifest;
+  absl::Status status = file::GetContents(ManifestPath(path), &manifest);
+  if (!status.ok()) return status;
+  const absl::string_view directory = SplitPath(path).first;
+  std::vector<std::string> parts;
+  for (absl::string_view part :
+       absl::StrSplit(manifest, '\n', absl::SkipEmpty())) {
+    parts.push_back(absl::StrCat(directory, part));
+  }
+  return parts;
+}
+
+}  // namespace abesim
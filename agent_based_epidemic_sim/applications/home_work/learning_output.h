@@ -0,0 +1,52 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_LEARNING_OUTPUT_H_
+#define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_LEARNING_OUTPUT_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+// By default each learning output table is written to a single file.  When
+// striping is enabled, tables are instead written as a set of part files plus
+// a manifest so that the parts can be written concurrently.  Observer shard i
+// is written to part i % parts by the aggregation partition of that part, so
+// the part count is best matched to the number of workers.  Each part is a
+// complete CSV or columnar file on its own.  The manifest at
+// "<path>.manifest" lists the file names of the parts in order, one per line,
+// relative to the directory of the manifest.
+
+namespace abesim {
+
+// Returns the path of the given part of the output file at path.
+std::string LearningOutputPartPath(absl::string_view path, int part);
+
+// Writes the manifest of the output file at path, listing its first `parts`
+// parts.
+absl::Status WriteLearningOutputManifest(absl::string_view path, int parts);
+
+// Reads the manifest of the output file at path and returns the paths of all
+// its parts.
+StatusOr<std::vector<std::string>> ReadLearningOutputManifest(
+    absl::string_view path);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_LEARNING_OUTPUT_H_
@@ -0,0 +1,72 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/home_work/location_type.h"
+
+#include <algorithm>
+
+#include "absl/memory/memory.h"
+
+namespace abesim {
+namespace {
+
+// Offset indexing is used as long as the uuid range is at most this many times
+// larger than the number of locations.
+constexpr int64 kMaxDenseSparsity = 2;
+
+LocationAttributes ToAttributes(const LocationProto& location) {
+  return {.type = location.type() == LocationProto::BUSINESS
+                      ? LocationType::kWork
+                      : LocationType::kHome,
+          .size = location.size()};
+}
+
+}  // namespace
+
+std::shared_ptr<const LocationAttributeTable> LocationAttributeTable::Build(
+    const absl::Span<const LocationProto> locations) {
+  auto table = absl::WrapUnique(new LocationAttributeTable());
+  if (locations.empty()) return table;
+
+  const auto [min_location, max_location] = std::minmax_element(
+      locations.begin(), locations.end(),
+      [](const LocationProto& a, const LocationProto& b) {
+        return a.uuid() < b.uuid();
+      });
+  const uint64 span =
+      static_cast<uint64>(max_location->uuid() - min_location->uuid()) + 1;
+  if (span <= kMaxDenseSparsity * locations.size()) {
+    table->base_uuid_ = min_location->uuid();
+    table->attributes_.resize(span);
+    for (const LocationProto& location : locations) {
+      table->attributes_[location.uuid() - table->base_uuid_] =
+          ToAttributes(location);
+    }
+  } else {
+    table->attributes_.reserve(locations.size());
+    table->index_.reserve(locations.size());
+    for (const LocationProto& location : locations) {
+      auto [iter, inserted] =
+          table->index_.try_emplace(location.uuid(), table->attributes_.size());
+      if (inserted) {
+        table->attributes_.push_back(ToAttributes(location));
+      } else {
+        table->attributes_[iter->second] = ToAttributes(location);
+      }
+    }
+  }
+  return table;
+}
+
+}  // namespace abesim
@@ -19,7 +19,13 @@
 
 #include <functional>
 #include <initializer_list>
+#include <memory>
+#include <type_traits>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 
 namespace abesim {
@@ -29,7 +35,87 @@ enum class LocationType : uint8 { kHome, kWork };
 constexpr std::initializer_list<LocationType> kAllLocationTypes = {
     LocationType::kHome, LocationType::kWork};
 
-using LocationTypeFn = std::function<LocationType(int64 uuid)>;
+// Static attributes of a single location.  Kept small so that a table of them
+// for every location in the simulation stays cache friendly.
+struct LocationAttributes {
+  LocationType type = LocationType::kHome;
+  int32 size = 0;
+};
+
+// LocationAttributeTable is a compact read-only store of LocationAttributes
+// for every location in a simulation.  Attributes are stored in a flat array
+// indexed by dense location index.  When location uuids form a (nearly)
+// contiguous range, as produced by ShardedGlobalIdUuidGenerator, the dense
+// index is simply the offset from the smallest uuid and lookups are a single
+// bounds check and array access.  Otherwise an auxiliary uuid to index map is
+// used.
+// The table is immutable once built, and so may be shared by all threads.
+class LocationAttributeTable {
+ public:
+  // Builds a table from the given locations.  Locations of unknown type are
+  // treated as homes.
+  static std::shared_ptr<const LocationAttributeTable> Build(
+      absl::Span<const LocationProto> locations);
+
+  // Returns the dense index of the given location or -1 if the location is not
+  // present in the table.
+  int64 Index(int64 uuid) const {
+    if (index_.empty()) {
+      const uint64 offset = static_cast<uint64>(uuid - base_uuid_);
+      return offset < attributes_.size() ? static_cast<int64>(offset) : -1;
+    }
+    auto iter = index_.find(uuid);
+    return iter == index_.end() ? -1 : iter->second;
+  }
+
+  // Returns the attributes of the given location.  Locations not present in
+  // the table have default attributes.
+  const LocationAttributes& Get(int64 uuid) const {
+    const int64 index = Index(uuid);
+    return index < 0 ? kDefaultAttributes : attributes_[index];
+  }
+
+  LocationType type(int64 uuid) const { return Get(uuid).type; }
+  int32 size(int64 uuid) const { return Get(uuid).size; }
+
+  // The number of dense slots in the table.
+  size_t slots() const { return attributes_.size(); }
+
+ private:
+  static constexpr LocationAttributes kDefaultAttributes = {};
+
+  LocationAttributeTable() = default;
+
+  int64 base_uuid_ = 0;
+  std::vector<LocationAttributes> attributes_;
+  // Only populated when location uuids are too sparse for offset indexing.
+  absl::flat_hash_map<int64, int64> index_;
+};
+
+// LocationTypeFn classifies a location uuid as a LocationType.  When backed by
+// a LocationAttributeTable the lookup is an inlined table access; arbitrary
+// callables are also accepted for tests and ad hoc classifications.
+class LocationTypeFn {
+ public:
+  LocationTypeFn() = default;
+  explicit LocationTypeFn(std::shared_ptr<const LocationAttributeTable> table)
+      : table_(std::move(table)) {}
+  template <typename Fn,
+            typename = std::enable_if_t<
+                !std::is_same_v<std::decay_t<Fn>, LocationTypeFn> &&
+                std::is_invocable_r_v<LocationType, Fn, int64>>>
+  LocationTypeFn(Fn fn)  // NOLINT: Implicit conversion from callables.
+      : fn_(std::move(fn)) {}
+
+  LocationType operator()(const int64 uuid) const {
+    if (table_ != nullptr) return table_->type(uuid);
+    return fn_(uuid);
+  }
+
+ private:
+  std::shared_ptr<const LocationAttributeTable> table_;
+  std::function<LocationType(int64)> fn_;
+};
 
 }  // namespace abesim
 
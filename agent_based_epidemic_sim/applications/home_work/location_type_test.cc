@@ -0,0 +1,91 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/home_work/location_type.h"
+
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+LocationProto MakeLocation(const int64 uuid, const LocationProto::Type type,
+                           const int32 size) {
+  LocationProto location;
+  location.set_uuid(uuid);
+  location.set_type(type);
+  location.set_size(size);
+  return location;
+}
+
+TEST(LocationAttributeTableTest, ContiguousUuids) {
+  std::vector<LocationProto> locations = {
+      MakeLocation(12, LocationProto::BUSINESS, 7),
+      MakeLocation(10, LocationProto::HOUSEHOLD, 3),
+      MakeLocation(11, LocationProto::UNKNOWN, 0),
+  };
+  auto table = LocationAttributeTable::Build(locations);
+  EXPECT_EQ(table->slots(), 3);
+  EXPECT_EQ(table->Index(10), 0);
+  EXPECT_EQ(table->Index(12), 2);
+  EXPECT_EQ(table->type(12), LocationType::kWork);
+  EXPECT_EQ(table->size(12), 7);
+  EXPECT_EQ(table->type(10), LocationType::kHome);
+  EXPECT_EQ(table->size(10), 3);
+  EXPECT_EQ(table->type(11), LocationType::kHome);
+}
+
+TEST(LocationAttributeTableTest, SparseUuids) {
+  std::vector<LocationProto> locations = {
+      MakeLocation(1LL << 48, LocationProto::BUSINESS, 20),
+      MakeLocation(5, LocationProto::HOUSEHOLD, 2),
+  };
+  auto table = LocationAttributeTable::Build(locations);
+  EXPECT_EQ(table->slots(), 2);
+  EXPECT_EQ(table->type(1LL << 48), LocationType::kWork);
+  EXPECT_EQ(table->size(1LL << 48), 20);
+  EXPECT_EQ(table->type(5), LocationType::kHome);
+  EXPECT_EQ(table->Index(6), -1);
+}
+
+TEST(LocationAttributeTableTest, UnknownUuidsHaveDefaultAttributes) {
+  std::vector<LocationProto> locations = {
+      MakeLocation(3, LocationProto::BUSINESS, 4),
+  };
+  auto table = LocationAttributeTable::Build(locations);
+  for (const int64 uuid : {-1LL, 2LL, 4LL, 1LL << 40}) {
+    EXPECT_EQ(table->Index(uuid), -1);
+    EXPECT_EQ(table->type(uuid), LocationType::kHome);
+    EXPECT_EQ(table->size(uuid), 0);
+  }
+  EXPECT_EQ(LocationAttributeTable::Build({})->Index(0), -1);
+}
+
+TEST(LocationTypeFnTest, TableAndCallableAgree) {
+  std::vector<LocationProto> locations = {
+      MakeLocation(0, LocationProto::HOUSEHOLD, 1),
+      MakeLocation(1, LocationProto::BUSINESS, 1),
+  };
+  LocationTypeFn from_table(LocationAttributeTable::Build(locations));
+  LocationTypeFn from_callable([](int64 uuid) {
+    return uuid == 1 ? LocationType::kWork : LocationType::kHome;
+  });
+  for (const int64 uuid : {0, 1, 2}) {
+    EXPECT_EQ(from_table(uuid), from_callable(uuid));
+  }
+}
+
+}  // namespace
+}  // namespace abesim
@@ -12,11 +12,18 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
+#include "absl/memory/memory.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
 #include "agent_based_epidemic_sim/applications/home_work/simulation.h"
 #include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/core/partition.h"
+#include "agent_based_epidemic_sim/core/socket_distributed_manager.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
@@ -27,6 +34,20 @@ ABSL_FLAG(std::string, output_file_path, "", "The output file path.");
 ABSL_FLAG(std::string, learning_output_base, "",
           "The base path for the three learning output files. See "
           "(broken link) for further details.");
+ABSL_FLAG(std::vector<std::string>, node_addresses, {},
+          "The addresses of all nodes of a distributed simulation, either "
+          "host:port or unix:path.  Each node must be given its own output "
+          "paths.  Runs in a single process if empty.");
+ABSL_FLAG(int, node, 0,
+          "The node of a distributed simulation run by this process, an index "
+          "into --node_addresses.");
+ABSL_FLAG(bool, compress_messages, false,
+          "Whether the nodes of a distributed simulation compress the "
+          "messages they send, which saves bandwidth at some CPU cost.");
+ABSL_FLAG(double, max_imbalance, 0,
+          "Moves agents and locations between the nodes of a distributed "
+          "simulation once the busiest node's load exceeds the mean load by "
+          "this factor, e.g. 1.25.  Disabled if 0.");
 
 namespace abesim {
 
@@ -37,9 +58,40 @@ int Main(int argc, char** argv) {
                              &contents));
   const HomeWorkSimulationConfig config =
       ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  const std::vector<std::string> addresses =
+      absl::GetFlag(FLAGS_node_addresses);
+  if (addresses.empty()) {
+    RunSimulation(absl::GetFlag(FLAGS_output_file_path),
+                  absl::GetFlag(FLAGS_learning_output_base), config,
+                  absl::GetFlag(FLAGS_num_workers));
+    return 0;
+  }
+  auto partition = GetLocalityPartition(config, addresses.size());
+  CHECK_EQ(absl::OkStatus(), partition.status());
+  const Partition* node_partition = partition->get();
+  std::unique_ptr<RoutingTable> routing_table;
+  const double max_imbalance = absl::GetFlag(FLAGS_max_imbalance);
+  if (max_imbalance > 0) {
+    routing_table = absl::make_unique<RoutingTable>(partition->get());
+    node_partition = routing_table.get();
+  }
+  auto manager = NewSocketDistributedManager(
+      {.node = absl::GetFlag(FLAGS_node),
+       .addresses = addresses,
+       .message_encoding = absl::GetFlag(FLAGS_compress_messages)
+                               ? MessageEncoding::kCompressed
+                               : MessageEncoding::kCompact},
+      node_partition);
+  CHECK_EQ(absl::OkStatus(), manager.status());
+  const DistributedNode distributed = {
+      .node = absl::GetFlag(FLAGS_node),
+      .partition = node_partition,
+      .manager = manager->get(),
+      .routing_table = routing_table.get(),
+      .max_imbalance = static_cast<float>(max_imbalance)};
   RunSimulation(absl::GetFlag(FLAGS_output_file_path),
                 absl::GetFlag(FLAGS_learning_output_base), config,
-                absl::GetFlag(FLAGS_num_workers));
+                absl::GetFlag(FLAGS_num_workers), &distributed);
   return 0;
 }
 
@@ -14,6 +14,7 @@
 
 #include "agent_based_epidemic_sim/applications/home_work/observer.h"
 
+#include <algorithm>
 #include <initializer_list>
 
 #include "absl/strings/str_format.h"
@@ -23,58 +24,72 @@
 #include "agent_based_epidemic_sim/port/proto_enum_utils.h"
 
 namespace abesim {
-
 namespace {
 
-// Very simple histogram class with powers of two bucket sizes.
-template <typename T, int Size>
-class Histogram {
- public:
-  explicit Histogram() { buckets_.fill(0); }
-
-  void Add(T value, T scale) {
-    const size_t n = static_cast<size_t>(value / scale);
-    const size_t index = n == 0 ? 0 : 1 + std::floor(std::log2(n));
-    const size_t bucket = std::min(index, buckets_.size() - 1);
-    buckets_[bucket]++;
-  }
+// Zeroes the durations of every agent in map, keeping the agents.  Mostly the
+// same agents are observed in every step, so observing them again neither
+// allocates nor rehashes, whereas clear() would free the table.  Agents whose
+// durations are all zero are skipped when aggregating.
+template <typename Map>
+void ZeroDurations(Map& map) {
+  for (auto& [uuid, durations] : map) durations.fill(absl::ZeroDuration());
+}
 
-  void AppendValuesToString(std::string* dst) const {
-    for (int bucket : buckets_) {
-      absl::StrAppendFormat(dst, ",%d", bucket);
-    }
+bool AllZero(const LocationArray<absl::Duration>& durations) {
+  for (const absl::Duration duration : durations) {
+    if (duration != absl::ZeroDuration()) return false;
   }
-
- private:
-  std::array<size_t, Size> buckets_;
-};
-
-const int kDurationBuckets = 6;
-const int kContactBuckets = 10;
+  return true;
+}
 
 }  // namespace
 
 HomeWorkSimulationObserver::HomeWorkSimulationObserver(
-    LocationTypeFn location_type)
-    : location_type_(std::move(location_type)) {
+    LocationTypeFn location_type, const int partitions)
+    : location_type_(std::move(location_type)), partitions_(partitions) {
   health_state_counts_.fill(0);
 }
 
+void HomeWorkSimulationObserver::Reset() {
+  health_state_counts_.fill(0);
+  contact_histogram_ = {};
+  for (Partition& partition : partitions_) {
+    ZeroDurations(partition.agent_location_type_durations);
+  }
+}
+
+size_t HomeWorkSimulationObserver::DurationCapacity() const {
+  size_t capacity = 0;
+  for (const Partition& partition : partitions_) {
+    capacity += partition.agent_location_type_durations.capacity();
+  }
+  return capacity;
+}
+
 void HomeWorkSimulationObserver::Observe(
     const Agent& agent, absl::Span<const InfectionOutcome> outcomes) {
   health_state_counts_[agent.CurrentHealthState()]++;
-  auto& visitor_contacts = contacts_[agent.uuid()];
-  for (const InfectionOutcome outcome : outcomes) {
+  contact_scratch_.clear();
+  for (const InfectionOutcome& outcome : outcomes) {
     if (outcome.exposure_type == InfectionOutcomeProto::CONTACT) {
-      visitor_contacts.insert(outcome.source_uuid);
+      contact_scratch_.push_back(outcome.source_uuid);
     }
   }
+  if (contact_scratch_.empty()) return;
+  std::sort(contact_scratch_.begin(), contact_scratch_.end());
+  const size_t unique_contacts =
+      std::unique(contact_scratch_.begin(), contact_scratch_.end()) -
+      contact_scratch_.begin();
+  contact_histogram_.Add(unique_contacts - 1, 1);
 }
 void HomeWorkSimulationObserver::Observe(const Location& location,
                                          const absl::Span<const Visit> visits) {
+  if (visits.empty()) return;
+  // All visits passed to a single call are to the same location.
+  const LocationType location_type = location_type_(visits[0].location_uuid);
   for (const Visit& visit : visits) {
-    agent_location_type_durations_[visit.agent_uuid]
-                                  [location_type_(visit.location_uuid)] +=
+    PartitionFor(visit.agent_uuid)
+        .agent_location_type_durations[visit.agent_uuid][location_type] +=
         visit.end_time - visit.start_time;
   }
 }
@@ -92,42 +107,59 @@ HomeWorkSimulationObserverFactory::HomeWorkSimulationObserverFactory(
   }
   headers += "timestep_end,agents,susceptible,exposed,infectious,recovered";
   for (const char* location_type : {"home", "work"}) {
-    for (int i = 0; i < kDurationBuckets; ++i) {
+    for (int i = 0; i < DurationHistogram::kBuckets; ++i) {
       absl::StrAppendFormat(
           &headers, ",%s_%s", location_type,
           FormatDuration(absl::Hours(i == 0 ? 0 : 1 << (i - 1))));
     }
   }
-  for (int i = 0; i < kContactBuckets; ++i) {
+  for (int i = 0; i < ContactHistogram::kBuckets; ++i) {
     absl::StrAppendFormat(&headers, ",contact_%d", 1 << i);
   }
   headers += "\n";
   status_.Update(output_->WriteString(headers));
 }
 
+void HomeWorkSimulationObserverFactory::AggregatePartition(
+    const Timestep& timestep, const int partition,
+    absl::Span<std::unique_ptr<HomeWorkSimulationObserver> const> observers) {
+  PartitionAggregate& aggregate = partitions_[partition];
+  ZeroDurations(aggregate.agent_location_type_durations);
+  for (auto& observer : observers) {
+    const HomeWorkSimulationObserver::Partition& observed =
+        observer->partitions_[partition];
+    for (const auto& iter : observed.agent_location_type_durations) {
+      if (AllZero(iter.second)) continue;
+      for (LocationType location_type : kAllLocationTypes) {
+        aggregate.agent_location_type_durations[iter.first][location_type] +=
+            iter.second[location_type];
+      }
+    }
+  }
+
+  aggregate.location_histograms = {};
+  for (const auto& iter : aggregate.agent_location_type_durations) {
+    if (AllZero(iter.second)) continue;
+    for (LocationType i : kAllLocationTypes) {
+      if (iter.second[i] == absl::ZeroDuration()) continue;
+      aggregate.location_histograms[i].Add(iter.second[i], absl::Hours(1));
+    }
+  }
+}
+
 void HomeWorkSimulationObserverFactory::Aggregate(
     const Timestep& timestep,
     absl::Span<std::unique_ptr<HomeWorkSimulationObserver> const> observers) {
   health_state_counts_.fill(0);
-  agent_location_type_durations_.clear();
-  contacts_.clear();
   int agents = 0;
-
+  ContactHistogram contact_histogram;
   for (auto& observer : observers) {
+    contact_histogram.Merge(observer->contact_histogram_);
     for (HealthState::State state : EnumerateEnumValues<HealthState::State>()) {
       int n = observer->health_state_counts_[state];
       health_state_counts_[state] += n;
       agents += n;
     }
-    for (auto iter : observer->agent_location_type_durations_) {
-      for (LocationType location_type : kAllLocationTypes) {
-        agent_location_type_durations_[iter.first][location_type] +=
-            iter.second[location_type];
-      }
-    }
-    for (auto iter : observer->contacts_) {
-      contacts_[iter.first].insert(iter.second.begin(), iter.second.end());
-    }
   }
 
   std::string line = data_prefix_;
@@ -137,21 +169,14 @@ void HomeWorkSimulationObserverFactory::Aggregate(
     absl::StrAppendFormat(&line, ",%d", health_state_counts_[state]);
   }
 
-  LocationArray<Histogram<absl::Duration, kDurationBuckets>> location_histogram;
-  for (const auto iter : agent_location_type_durations_) {
+  LocationArray<DurationHistogram> location_histograms;
+  for (const PartitionAggregate& aggregate : partitions_) {
     for (LocationType i : kAllLocationTypes) {
-      if (iter.second[i] == absl::ZeroDuration()) continue;
-      location_histogram[i].Add(iter.second[i], absl::Hours(1));
+      location_histograms[i].Merge(aggregate.location_histograms[i]);
     }
   }
-  for (const auto& location_type : location_histogram) {
-    location_type.AppendValuesToString(&line);
-  }
-
-  Histogram<size_t, kContactBuckets> contact_histogram;
-  for (const auto& iter : contacts_) {
-    if (iter.second.empty()) continue;
-    contact_histogram.Add(iter.second.size() - 1, 1);
+  for (const auto& location_histogram : location_histograms) {
+    location_histogram.AppendValuesToString(&line);
   }
   contact_histogram.AppendValuesToString(&line);
 
@@ -161,7 +186,8 @@ void HomeWorkSimulationObserverFactory::Aggregate(
 
 std::unique_ptr<HomeWorkSimulationObserver>
 HomeWorkSimulationObserverFactory::MakeObserver() const {
-  return absl::make_unique<HomeWorkSimulationObserver>(location_type_);
+  return absl::make_unique<HomeWorkSimulationObserver>(location_type_,
+                                                      kPartitions);
 }
 
 }  // namespace abesim
@@ -17,8 +17,14 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_OBSERVER_H_
 #define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_OBSERVER_H_
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
-#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_format.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/applications/home_work/location_type.h"
 #include "agent_based_epidemic_sim/core/enum_indexed_array.h"
@@ -35,27 +41,83 @@ template <typename T>
 using LocationArray =
     EnumIndexedArray<T, LocationType, kAllLocationTypes.size()>;
 
+// Very simple histogram class with powers of two bucket sizes.
+template <typename T, int Size>
+class PowerOfTwoHistogram {
+ public:
+  static constexpr int kBuckets = Size;
+
+  PowerOfTwoHistogram() { buckets_.fill(0); }
+
+  void Add(T value, T scale) {
+    const size_t n = static_cast<size_t>(value / scale);
+    const size_t index = n == 0 ? 0 : 1 + std::floor(std::log2(n));
+    const size_t bucket = std::min(index, buckets_.size() - 1);
+    buckets_[bucket]++;
+  }
+  void Merge(const PowerOfTwoHistogram& other) {
+    for (int i = 0; i < Size; ++i) {
+      buckets_[i] += other.buckets_[i];
+    }
+  }
+  void AppendValuesToString(std::string* dst) const {
+    for (int bucket : buckets_) {
+      absl::StrAppendFormat(dst, ",%d", bucket);
+    }
+  }
+
+ private:
+  std::array<size_t, Size> buckets_;
+};
+
+// Histogram of time spent at a location type, in hours.
+using DurationHistogram = PowerOfTwoHistogram<absl::Duration, 6>;
+// Histogram of unique contacts per agent, offset by one.
+using ContactHistogram = PowerOfTwoHistogram<size_t, 10>;
+
+// Records per timestep health state counts, per agent time spent at each type
+// of location, and a histogram of per agent unique contacts.  Per agent
+// durations are split into partitions by agent uuid so they can be aggregated
+// in parallel.  Every agent is observed exactly once per timestep, so unique
+// contacts are counted directly in Observe and only the histogram is kept.
 class HomeWorkSimulationObserver : public AgentInfectionObserver,
                                    public LocationVisitObserver {
  public:
-  explicit HomeWorkSimulationObserver(LocationTypeFn location_type);
+  HomeWorkSimulationObserver(LocationTypeFn location_type, int partitions);
 
   void Observe(const Agent& agent,
                absl::Span<const InfectionOutcome> outcomes) override;
   void Observe(const Location& location,
                absl::Span<const Visit> visits) override;
 
+  // Discards all observations, keeping allocated capacity for reuse in the
+  // next timestep.
+  void Reset();
+
+  // Returns the number of agents whose durations can be recorded without
+  // allocating.
+  size_t DurationCapacity() const;
+
  private:
   friend class HomeWorkSimulationObserverFactory;
 
+  struct Partition {
+    absl::flat_hash_map<int64, LocationArray<absl::Duration>>
+        agent_location_type_durations;
+  };
+
+  Partition& PartitionFor(int64 agent_uuid) {
+    return partitions_[static_cast<uint64>(agent_uuid) % partitions_.size()];
+  }
+
   const LocationTypeFn location_type_;
   HealthArray<int> health_state_counts_;
-  absl::flat_hash_map<int64, LocationArray<absl::Duration>>
-      agent_location_type_durations_;
-  absl::flat_hash_map<int64, absl::flat_hash_set<int64>> contacts_;
+  ContactHistogram contact_histogram_;
+  std::vector<Partition> partitions_;
+  // Scratch space for deduplicating the contacts of a single agent.
+  std::vector<int64> contact_scratch_;
 };
 
-// This aggregator assumes single node execution.
 class HomeWorkSimulationObserverFactory
     : public ObserverFactory<HomeWorkSimulationObserver> {
  public:
@@ -65,28 +127,43 @@ class HomeWorkSimulationObserverFactory
   // Use pass_through_fields to append a set of field values to every line
   // of the csv output, each entry is a pair of {field_name, field_value}.
   explicit HomeWorkSimulationObserverFactory(
-      file::FileWriter* output,
-      std::function<LocationType(int64)> location_type,
+      file::FileWriter* output, LocationTypeFn location_type,
       const std::vector<std::pair<std::string, std::string>>&
           pass_through_fields);
 
+  int AggregationPartitions() const override { return kPartitions; }
+  void AggregatePartition(
+      const Timestep& timestep, int partition,
+      absl::Span<std::unique_ptr<HomeWorkSimulationObserver> const> observers)
+      override;
   void Aggregate(const Timestep& timestep,
                  absl::Span<std::unique_ptr<HomeWorkSimulationObserver> const>
                      observers) override;
   std::unique_ptr<HomeWorkSimulationObserver> MakeObserver() const override;
+  bool ResetObserver(HomeWorkSimulationObserver* observer) const override {
+    observer->Reset();
+    return true;
+  }
 
   absl::Status status() const { return status_; }
 
  private:
+  static constexpr int kPartitions = 16;
+
+  // The aggregated observations and histograms of a single partition.
+  struct PartitionAggregate {
+    absl::flat_hash_map<int64, LocationArray<absl::Duration>>
+        agent_location_type_durations;
+    LocationArray<DurationHistogram> location_histograms;
+  };
+
   file::FileWriter* const output_;
   const LocationTypeFn location_type_;
   std::string data_prefix_;
 
   absl::Status status_;
   HealthArray<int> health_state_counts_;
-  absl::flat_hash_map<int64, LocationArray<absl::Duration>>
-      agent_location_type_durations_;
-  absl::flat_hash_map<int64, absl::flat_hash_set<int64>> contacts_;
+  std::array<PartitionAggregate, kPartitions> partitions_;
 };
 
 }  // namespace abesim
@@ -101,6 +101,16 @@ std::unique_ptr<MockLocation> MakeLocation(int64 uuid) {
   return location;
 }
 
+// Aggregates observers the same way ObserverManager does, partitions first.
+void AggregateObservers(
+    HomeWorkSimulationObserverFactory& factory, const Timestep& timestep,
+    absl::Span<std::unique_ptr<HomeWorkSimulationObserver> const> observers) {
+  for (int i = 0; i < factory.AggregationPartitions(); ++i) {
+    factory.AggregatePartition(timestep, i, observers);
+  }
+  factory.Aggregate(timestep, observers);
+}
+
 absl::Time TestHour(int hours) {
   return absl::UnixEpoch() + absl::Hours(hours);
 }
@@ -121,7 +131,7 @@ TEST(HomeWorkSimulationObserverTest, ZerosReturnedForNoObservations) {
     std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
     observers.push_back(observer_factory.MakeObserver());
     observers.push_back(observer_factory.MakeObserver());
-    observer_factory.Aggregate(t, observers);
+    AggregateObservers(observer_factory, t, observers);
 
     std::string expected = kExpectedHeaders;
     expected +=
@@ -151,7 +161,7 @@ TEST(HomeWorkSimulationObserverTest, PassthroughFields) {
     std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
     observers.push_back(observer_factory.MakeObserver());
     observers.push_back(observer_factory.MakeObserver());
-    observer_factory.Aggregate(t, observers);
+    AggregateObservers(observer_factory, t, observers);
 
     std::string expected = std::string("k1,k2,") + kExpectedHeaders;
     expected +=
@@ -267,7 +277,7 @@ TEST(HomeWorkSimulationObserverTest, CorrectValuesForObservations) {
     observers[0]->Observe(*home, home_visits);
     observers[1]->Observe(*work, work_visits);
 
-    observer_factory.Aggregate(t, observers);
+    AggregateObservers(observer_factory, t, observers);
     std::string expected = kExpectedHeaders;
     expected +=
         "86400,10,4,3,2,1,0,0,0,0,0,0,0,0,0,0,0,"
@@ -280,5 +290,140 @@ TEST(HomeWorkSimulationObserverTest, CorrectValuesForObservations) {
   PANDEMIC_ASSERT_OK(file->Close());
 }
 
+TEST(HomeWorkSimulationObserverTest, RepeatedContactsAreCountedOnce) {
+  Timestep t(absl::UnixEpoch(), absl::Hours(24));
+
+  std::string output;
+  auto file = absl::make_unique<MemFileWriterImpl>(&output);
+
+  {
+    HomeWorkSimulationObserverFactory observer_factory(
+        file.get(),
+        [](int64 uuid) {
+          return uuid == 0 ? LocationType::kHome : LocationType::kWork;
+        },
+        {});
+    std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
+    observers.push_back(observer_factory.MakeObserver());
+
+    std::vector<InfectionOutcome> outcomes;
+    for (const int64 source_uuid : {3, 1, 2, 1, 3, 3}) {
+      outcomes.push_back({
+          .agent_uuid = 0,
+          .exposure_type = InfectionOutcomeProto::CONTACT,
+          .source_uuid = source_uuid,
+      });
+    }
+    outcomes.push_back({
+        .agent_uuid = 0,
+        .exposure_type = InfectionOutcomeProto::LOCATION,
+        .source_uuid = 4,
+    });
+    observers[0]->Observe(*MakeAgent(0, HealthState::SUSCEPTIBLE), outcomes);
+    AggregateObservers(observer_factory, t, observers);
+
+    // Three unique contacts fall in the third contact bucket.
+    std::string expected = kExpectedHeaders;
+    expected +=
+        "86400,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,"
+        "0,1,0,0,0,0,0,0,0\n";
+    EXPECT_EQ(output, expected);
+  }
+
+  PANDEMIC_ASSERT_OK(file->Close());
+}
+
+TEST(HomeWorkSimulationObserverTest, ResetDiscardsObservations) {
+  Timestep t(absl::UnixEpoch(), absl::Hours(24));
+
+  std::string output;
+  auto file = absl::make_unique<MemFileWriterImpl>(&output);
+
+  {
+    HomeWorkSimulationObserverFactory observer_factory(
+        file.get(),
+        [](int64 uuid) {
+          return uuid == 0 ? LocationType::kHome : LocationType::kWork;
+        },
+        {});
+    std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
+    observers.push_back(observer_factory.MakeObserver());
+
+    auto home = MakeLocation(0);
+    std::vector<InfectionOutcome> outcomes = {{
+        .agent_uuid = 0,
+        .exposure_type = InfectionOutcomeProto::CONTACT,
+        .source_uuid = 1,
+    }};
+    observers[0]->Observe(*MakeAgent(0, HealthState::SUSCEPTIBLE), outcomes);
+    observers[0]->Observe(*home, {{
+                                     .location_uuid = 0,
+                                     .agent_uuid = 0,
+                                     .start_time = TestHour(0),
+                                     .end_time = TestHour(2),
+                                 }});
+    AggregateObservers(observer_factory, t, observers);
+    EXPECT_TRUE(observer_factory.ResetObserver(observers[0].get()));
+    output.clear();
+    AggregateObservers(observer_factory, t, observers);
+
+    std::string expected =
+        "86400,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,"
+        "0,0,0,0,0,0,0,0,0\n";
+    EXPECT_EQ(output, expected);
+  }
+
+  PANDEMIC_ASSERT_OK(file->Close());
+}
+
+TEST(HomeWorkSimulationObserverTest, ResetKeepsCapacity) {
+  Timestep t(absl::UnixEpoch(), absl::Hours(24));
+
+  std::string output;
+  auto file = absl::make_unique<MemFileWriterImpl>(&output);
+
+  {
+    HomeWorkSimulationObserverFactory observer_factory(
+        file.get(),
+        [](int64 uuid) {
+          return uuid == 0 ? LocationType::kHome : LocationType::kWork;
+        },
+        {});
+    std::vector<std::unique_ptr<HomeWorkSimulationObserver>> observers;
+    observers.push_back(observer_factory.MakeObserver());
+
+    // Enough agents that each partition's table exceeds the size that
+    // clear() keeps allocated.
+    auto home = MakeLocation(0);
+    std::vector<Visit> visits;
+    for (int64 uuid = 0; uuid < 16 * 256; ++uuid) {
+      visits.push_back({
+          .location_uuid = 0,
+          .agent_uuid = uuid,
+          .start_time = TestHour(0),
+          .end_time = TestHour(2),
+      });
+    }
+    observers[0]->Observe(*home, visits);
+    AggregateObservers(observer_factory, t, observers);
+    const size_t capacity = observers[0]->DurationCapacity();
+    EXPECT_GE(capacity, visits.size());
+
+    EXPECT_TRUE(observer_factory.ResetObserver(observers[0].get()));
+    EXPECT_EQ(observers[0]->DurationCapacity(), capacity);
+    // Agents that were not observed again are not counted.
+    output.clear();
+    AggregateObservers(observer_factory, t, observers);
+    EXPECT_EQ(output,
+              "86400,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,"
+              "0,0,0,0,0,0,0,0,0\n");
+
+    observers[0]->Observe(*home, visits);
+    EXPECT_EQ(observers[0]->DurationCapacity(), capacity);
+  }
+
+  PANDEMIC_ASSERT_OK(file->Close());
+}
+
 }  // namespace
 }  // namespace abesim
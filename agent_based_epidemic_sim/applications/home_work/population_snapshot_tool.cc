@@ -0,0 +1,52 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Synthesizes the population of a home-work simulation config and writes it
+// to a population snapshot, which simulations then load through
+// HomeWorkSimulationConfig.population_snapshot_path.
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+#include "agent_based_epidemic_sim/applications/home_work/simulation.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+ABSL_FLAG(std::string, simulation_config_pbtxt_path, "",
+          "Path to SimulationConfig pbtxt file.");
+ABSL_FLAG(std::string, output_path, "", "The population snapshot path.");
+
+namespace abesim {
+
+int Main(int argc, char** argv) {
+  std::string contents;
+  CHECK_EQ(absl::OkStatus(),
+           file::GetContents(absl::GetFlag(FLAGS_simulation_config_pbtxt_path),
+                             &contents));
+  const HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  SimulationContext context = GetSimulationContext(config);
+  CHECK_EQ(absl::OkStatus(),
+           WritePopulationSnapshot(absl::GetFlag(FLAGS_output_path), &context));
+  return 0;
+}
+
+}  // namespace abesim
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+  return abesim::Main(argc, argv);
+}
@@ -113,6 +113,19 @@ const PublicPolicy* TogglePolicyGenerator::GetPolicy(
   return iter->policy.get();
 }
 
+int TogglePolicyGenerator::PolicyTier(const PublicPolicy* const policy) const {
+  for (int i = 0; i < tiers_.size(); ++i) {
+    if (tiers_[i].policy.get() == policy) return i + 1;
+  }
+  return 0;
+}
+
+const PublicPolicy* TogglePolicyGenerator::TierPolicy(const int tier) {
+  if (tier == 0) return noop_policy_.get();
+  if (tier < 0 || tier > tiers_.size()) return nullptr;
+  return tiers_[tier - 1].policy.get();
+}
+
 TogglePolicyGenerator::TogglePolicyGenerator(std::vector<Tier> tiers)
     : noop_policy_(NewNoOpPolicy()), tiers_(std::move(tiers)) {}
 
@@ -27,7 +27,11 @@ namespace abesim {
 
 class TogglePolicyGenerator : public PolicyGenerator {
  public:
-  const PublicPolicy* NextPolicy();
+  const PublicPolicy* NextPolicy() override;
+  // Tier 0 is the policy of the most essential workers, who always work, and
+  // tier i > 0 that of tiers_[i - 1].
+  int PolicyTier(const PublicPolicy* policy) const override;
+  const PublicPolicy* TierPolicy(int tier) override;
   // Get a policy for a worker with a given 'essentialness'.  Essentialness
   // measures the fraction of the population more essential than the given
   // worker, so a score of .2 means 20% of workers are more essential, and 80%
@@ -128,5 +128,24 @@ TEST(PublicPolicyTest, ZeroStagePolicy) {
   }
 }
 
+TEST(PublicPolicyTest, TiersIdentifyPolicies) {
+  DistancingPolicy config = BuildPolicy({{10, .6}, {3, .2}});
+  auto generator_or = NewPolicyGenerator(config, [](const int64 location_uuid) {
+    return location_uuid == 0 ? LocationType::kWork : LocationType::kHome;
+  });
+  PANDEMIC_ASSERT_OK(generator_or);
+  TogglePolicyGenerator* gen = generator_or->get();
+  for (const float essentialness : {0.0f, 0.1f, 0.3f, 0.9f}) {
+    const PublicPolicy* const policy = gen->GetPolicy(essentialness);
+    EXPECT_EQ(gen->TierPolicy(gen->PolicyTier(policy)), policy)
+        << essentialness;
+  }
+  EXPECT_EQ(gen->PolicyTier(gen->GetPolicy(0.0f)), 0);
+  EXPECT_NE(gen->PolicyTier(gen->GetPolicy(0.3f)),
+            gen->PolicyTier(gen->GetPolicy(0.9f)));
+  EXPECT_EQ(gen->TierPolicy(3), nullptr);
+  EXPECT_EQ(gen->TierPolicy(-1), nullptr);
+}
+
 }  // namespace
 }  // namespace abesim
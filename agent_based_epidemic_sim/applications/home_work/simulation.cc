@@ -14,13 +14,28 @@
 
 #include "agent_based_epidemic_sim/applications/home_work/simulation.h"
 
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iterator>
 #include <queue>
 #include <string>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/agent_synthesis/agent_sampler.h"
+#include "agent_based_epidemic_sim/agent_synthesis/census_loader.h"
 #include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_snapshot.h"
 #include "agent_based_epidemic_sim/agent_synthesis/shuffled_sampler.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
 #include "agent_based_epidemic_sim/applications/home_work/learning_contacts_observer.h"
@@ -30,17 +45,27 @@
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
 #include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
+#include "agent_based_epidemic_sim/core/load_balancing.h"
 #include "agent_based_epidemic_sim/core/location.h"
 #include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/locality_partition.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/core/ptts_transition_model.h"
 #include "agent_based_epidemic_sim/core/public_policy.h"
+#include "agent_based_epidemic_sim/core/raw_coding.h"
 #include "agent_based_epidemic_sim/core/seir_agent.h"
 #include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/core/stream_seed.h"
+#include "agent_based_epidemic_sim/core/step_metrics.h"
 #include "agent_based_epidemic_sim/core/uuid_generator.h"
 #include "agent_based_epidemic_sim/core/wrapped_transition_model.h"
+#include "agent_based_epidemic_sim/port/executor.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
 #include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
 #include "agent_based_epidemic_sim/port/time_proto_util.h"
+#include "agent_based_epidemic_sim/port/trace.h"
+#include "agent_based_epidemic_sim/util/csv_writer.h"
 
 namespace abesim {
 namespace {
@@ -68,16 +93,29 @@ int64 GetLocationUuidForTypeOrDie(const AgentProto& agent,
   LOG(FATAL) << "Location not found for type: " << type;
 }
 
+bool HasLocationOfType(const AgentProto& agent,
+                       const LocationProto::Type type) {
+  return std::any_of(agent.locations().begin(), agent.locations().end(),
+                     [type](const LocationProto& location) {
+                       return location.type() == type;
+                     });
+}
+
 std::vector<LocationDuration> GetLocationDurations(
     absl::BitGen* gen, const AgentProto& agent,
     const PopulationProfile& population_profile) {
   std::vector<LocationDuration> durations;
   durations.reserve(population_profile.visit_durations_size());
+  // Agents without a workplace, such as census persons who do not work, stay
+  // home instead.
+  const bool has_business = HasLocationOfType(agent, LocationProto::BUSINESS);
   for (const VisitDuration& visit_duration :
        population_profile.visit_durations()) {
+    const LocationProto::Type type = has_business
+                                         ? visit_duration.location_type()
+                                         : LocationProto::HOUSEHOLD;
     durations.push_back(
-        {.location_uuid =
-             GetLocationUuidForTypeOrDie(agent, visit_duration.location_type()),
+        {.location_uuid = GetLocationUuidForTypeOrDie(agent, type),
          .sample_duration =
              [gen, mean = visit_duration.gaussian_distribution().mean(),
               stddev = visit_duration.gaussian_distribution().stddev()](
@@ -157,41 +195,199 @@ void AddVisitDurationDistribution(const VisitDurationDistribution& distribution,
       distribution.stddev());
 }
 
+// Moves home-work agents and locations between nodes.  Each node keeps the
+// AgentProtos of its own agents, which travel along with their SEIRAgent
+// state and policy tier so that the receiving node can build them with the
+// same public policy.
+class HomeWorkMigrator : public Migrator {
+ public:
+  using AgentBuilder = std::function<std::unique_ptr<SEIRAgent>(
+      const AgentProto&, const PublicPolicy*)>;
+
+  // policy_generator must not be used concurrently with migrations.
+  HomeWorkMigrator(AgentBuilder build_agent,
+                   PolicyGenerator* const policy_generator)
+      : build_agent_(std::move(build_agent)),
+        policy_generator_(policy_generator) {}
+
+  // Adds an agent built on the local node.  May be called concurrently.
+  void AddAgent(const AgentProto& agent) {
+    LocalAgent local = {.population_profile_id =
+                            agent.population_profile_id()};
+    for (const LocationProto& location : agent.locations()) {
+      local.memberships.push_back(
+          {.uuid = location.uuid(), .type = location.type()});
+    }
+    absl::MutexLock l(&mu_);
+    agents_[agent.uuid()] = std::move(local);
+  }
+
+  std::string SaveAgent(const Agent& agent) override {
+    AgentProto agent_proto;
+    agent_proto.set_uuid(agent.uuid());
+    {
+      absl::MutexLock l(&mu_);
+      auto iter = agents_.find(agent.uuid());
+      CHECK(iter != agents_.end()) << "Unknown agent " << agent.uuid();
+      agent_proto.set_population_profile_id(
+          iter->second.population_profile_id);
+      for (const LocalAgent::Membership& membership :
+           iter->second.memberships) {
+        LocationProto* const location = agent_proto.add_locations();
+        location->set_uuid(membership.uuid);
+        location->set_type(membership.type);
+      }
+      agents_.erase(iter);
+    }
+    // The initial health state is not saved, as the restored agent takes its
+    // health transitions from the saved SEIR state.
+    const std::string proto = agent_proto.SerializeAsString();
+    const SEIRAgent& seir_agent = static_cast<const SEIRAgent&>(agent);
+    std::string seir_state;
+    seir_agent.SaveState(&seir_state);
+    std::string state;
+    AppendRawString(proto, &state);
+    AppendRaw<int32>(policy_generator_->PolicyTier(seir_agent.public_policy()),
+                     &state);
+    AppendRawString(seir_state, &state);
+    return state;
+  }
+
+  std::string SaveLocation(const Location& location) override { return ""; }
+
+  StatusOr<std::unique_ptr<Agent>> RestoreAgent(
+      const int64 uuid, const absl::string_view state) override {
+    RawReader reader(state);
+    absl::string_view proto;
+    int32 policy_tier;
+    absl::string_view seir_state;
+    AgentProto agent_proto;
+    if (!reader.ReadString(&proto) || !reader.Read(&policy_tier) ||
+        !reader.ReadString(&seir_state) || !reader.empty() ||
+        !agent_proto.ParseFromArray(proto.data(), proto.size()) ||
+        agent_proto.uuid() != uuid) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid state of agent ", uuid));
+    }
+    const PublicPolicy* const policy =
+        policy_generator_->TierPolicy(policy_tier);
+    if (policy == nullptr) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Unknown policy tier ", policy_tier, " of agent ", uuid));
+    }
+    std::unique_ptr<SEIRAgent> agent = build_agent_(agent_proto, policy);
+    absl::Status status = agent->RestoreState(seir_state);
+    if (!status.ok()) return status;
+    AddAgent(agent_proto);
+    return std::unique_ptr<Agent>(std::move(agent));
+  }
+
+  StatusOr<std::unique_ptr<Location>> RestoreLocation(
+      const int64 uuid, const absl::string_view state) override {
+    return std::unique_ptr<Location>(
+        absl::make_unique<LocationDiscreteEventSimulator>(uuid));
+  }
+
+ private:
+  // What is needed to rebuild a local agent on another node, kept in place of
+  // its AgentProto.
+  struct LocalAgent {
+    struct Membership {
+      int64 uuid;
+      LocationProto::Type type;
+    };
+    int64 population_profile_id;
+    absl::InlinedVector<Membership, 3> memberships;
+  };
+
+  const AgentBuilder build_agent_;
+  PolicyGenerator* const policy_generator_;
+  absl::Mutex mu_;
+  absl::flat_hash_map<int64, LocalAgent> agents_ ABSL_GUARDED_BY(mu_);
+};
+
+// Writes the health transitions dropped by agents as CSV.
+class CsvHealthTransitionLog : public HealthTransitionLog {
+ public:
+  explicit CsvHealthTransitionLog(std::unique_ptr<file::FileWriter> file)
+      : csv_(std::move(file), "agent_uuid,time,health_state") {}
+
+  void Append(
+      const int64 uuid,
+      const absl::Span<const HealthTransition> health_transitions) override {
+    std::string lines;
+    for (const HealthTransition& health_transition : health_transitions) {
+      absl::StrAppend(&lines, uuid, ",",
+                      absl::FormatTime(health_transition.time), ",",
+                      HealthState::State_Name(health_transition.health_state),
+                      "\n");
+    }
+    absl::MutexLock l(&mu_);
+    csv_.Write(lines).IgnoreError();
+  }
+
+  absl::Status Close() {
+    absl::MutexLock l(&mu_);
+    return csv_.Close();
+  }
+
+ private:
+  absl::Mutex mu_;
+  CsvWriter csv_ ABSL_GUARDED_BY(mu_);
+};
+
+// Collects a census population into a simulation context.
+class ContextCensusSink : public CensusPopulationSink {
+ public:
+  explicit ContextCensusSink(SimulationContext* const context)
+      : context_(context) {}
+
+  void AddLocation(const LocationProto& location) override {
+    context_->locations.push_back(location);
+  }
+  void AddAgent(const AgentProto& agent) override {
+    context_->agents.push_back(agent);
+  }
+
+ private:
+  SimulationContext* const context_;
+};
+
+// Writes a census population into a population snapshot as it is read, so
+// that it is never held in memory as protos.
+class SnapshotCensusSink : public CensusPopulationSink {
+ public:
+  explicit SnapshotCensusSink(PopulationSnapshotWriter* const writer)
+      : writer_(writer) {}
+
+  void AddLocation(const LocationProto& location) override {
+    status_.Update(writer_->AddLocation(location));
+  }
+  void AddAgent(const AgentProto& agent) override {
+    status_.Update(writer_->AddAgent(agent));
+  }
+
+  const absl::Status& status() const { return status_; }
+
+ private:
+  PopulationSnapshotWriter* const writer_;
+  absl::Status status_;
+};
+
+// Creates a new directory for the temporary files of this process, so that
+// simulations sharing a temporary directory do not collide.
+std::string MakeTempDirectory() {
+  std::string path =
+      (std::filesystem::temp_directory_path() / "abesim.XXXXXX").string();
+  CHECK(mkdtemp(path.data()) != nullptr) << "Cannot create " << path;
+  return path;
+}
+
 }  // namespace
 
-// Next steps:
-// 1. (Improve) Mapping of uuid to location properties.
-// 2. (Improve) Mapping of uuid to index-in-array.
-// 3. Injection of other infection outcomes (noise) per step.
-// 4. Other visit types, sample from random.
-// 5. Seasonality of business, transmissibility by location.
-// 6. Population class-structured attributes.
-// Also:
-// 7. Distributed initialization.
-SimulationContext GetSimulationContext(const HomeWorkSimulationConfig& config) {
-  LOG(INFO) << "Building agents and locations from config: "
-            << config.DebugString();
-  // Samples the locations and agents.
-  const int64 kUuidShard = 0LL;
-  SimulationContext context;
-  std::vector<LocationProto>& locations = context.locations;
-  auto uuid_generator =
-      absl::make_unique<ShardedGlobalIdUuidGenerator>(kUuidShard);
-  auto business_sampler = MakeBusinessSampler(
-      config.location_distributions().business_distribution(),
-      config.population_size(), *uuid_generator, &locations);
-  auto household_sampler = MakeHouseholdSampler(
-      config.location_distributions().household_size_distribution(),
-      config.population_size(), *uuid_generator, &locations);
-  auto health_state_sampler = HealthStateSampler::FromProto(
-      config.agent_properties().initial_health_state_distribution());
-  auto samplers = absl::WrapUnique(
-      new Samplers({{absl::optional<std::unique_ptr<ShuffledSampler>>(),
-                     absl::optional<std::unique_ptr<ShuffledSampler>>(
-                         std::move(household_sampler)),
-                     absl::optional<std::unique_ptr<ShuffledSampler>>(
-                         std::move(business_sampler))}}));
-  PopulationProfiles& population_profiles = context.population_profiles;
+PopulationProfiles GetPopulationProfiles(
+    const HomeWorkSimulationConfig& config) {
+  PopulationProfiles population_profiles;
   auto population_profile = population_profiles.add_population_profiles();
   population_profile->set_id(kPopulationProfileId);
   *population_profile->mutable_transition_model() =
@@ -206,34 +402,240 @@ SimulationContext GetSimulationContext(const HomeWorkSimulationConfig& config) {
       LocationProto::BUSINESS, population_profile);
   AddVisitDurationDistribution(config.agent_properties().arrival_distribution(),
                                LocationProto::HOUSEHOLD, population_profile);
-  ShuffledLocationAgentSampler sampler(std::move(samplers),
-                                       std::move(uuid_generator),
-                                       std::move(health_state_sampler));
-  context.agents.reserve(config.population_size());
-  for (int i = 0; i < config.population_size(); ++i) {
-    context.agents.push_back(sampler.Next());
-  }
-  absl::flat_hash_set<int64> business_uuids;
-  std::for_each(context.locations.begin(), context.locations.end(),
-                [&business_uuids](const auto& location) {
-                  if (location.type() == LocationProto::BUSINESS) {
-                    business_uuids.insert(location.uuid());
-                  }
-                });
-  context.location_type = [business_uuids =
-                               std::move(business_uuids)](int64 uuid) {
-    return business_uuids.contains(uuid) ? LocationType::kWork
-                                         : LocationType::kHome;
+  return population_profiles;
+}
+
+// Next steps:
+// 1. (Improve) Mapping of uuid to location properties.
+// 2. (Improve) Mapping of uuid to index-in-array.
+// 3. Injection of other infection outcomes (noise) per step.
+// 4. Other visit types, sample from random.
+// 5. Seasonality of business, transmissibility by location.
+// 6. Population class-structured attributes.
+// Also:
+// 7. Distributed initialization.
+SimulationContext GetSimulationContext(const HomeWorkSimulationConfig& config,
+                                       const bool materialize_agents,
+                                       const int num_workers) {
+  LOG(INFO) << "Building agents and locations from config: "
+            << config.DebugString();
+  // Samples the locations and agents.
+  SimulationContext context;
+  if (config.census_paths_size() > 0) {
+    auto health_state_sampler = HealthStateSampler::FromProto(
+        config.agent_properties().initial_health_state_distribution());
+    health_state_sampler->Seed(config.synthesis_seed());
+    const std::vector<std::string> paths(config.census_paths().begin(),
+                                         config.census_paths().end());
+    ShardedSequentialUuidGenerator uuid_generator(0);
+    const CensusLoaderOptions options = {
+        .num_workers = num_workers,
+        .population_profile_id = kPopulationProfileId};
+    if (materialize_agents) {
+      ContextCensusSink sink(&context);
+      auto stats = LoadCensusPopulation(paths, options, uuid_generator,
+                                        health_state_sampler.get(), &sink);
+      CHECK_EQ(absl::OkStatus(), stats.status());
+      context.population_profiles = GetPopulationProfiles(config);
+      context.location_attributes =
+          LocationAttributeTable::Build(context.locations);
+      context.location_type = LocationTypeFn(context.location_attributes);
+      return context;
+    }
+    // Census populations are read in one pass, and a household's workplaces
+    // are only known once all of its members have been read, so the
+    // population is written to a temporary snapshot and streamed from its
+    // mapping.  The mapping outlives the removed file.
+    const std::string directory = MakeTempDirectory();
+    const std::string path = absl::StrCat(directory, "/census_population");
+    PopulationSnapshotWriter writer(path, GetPopulationProfiles(config));
+    SnapshotCensusSink sink(&writer);
+    auto stats = LoadCensusPopulation(paths, options, uuid_generator,
+                                      health_state_sampler.get(), &sink);
+    CHECK_EQ(absl::OkStatus(), stats.status());
+    CHECK_EQ(absl::OkStatus(), sink.status());
+    CHECK_EQ(absl::OkStatus(), writer.Close());
+    auto context_or = LoadSimulationContext(path, std::max(1, num_workers));
+    std::remove(path.c_str());
+    std::remove(directory.c_str());
+    CHECK_EQ(absl::OkStatus(), context_or.status());
+    return std::move(context_or).value();
+  }
+  const bool seeded = config.synthesis_partitions() > 0;
+  const int partitions = std::max(1, config.synthesis_partitions());
+  auto partition_population = [&config, partitions](const int partition) {
+    return config.population_size() / partitions +
+           (partition < config.population_size() % partitions ? 1 : 0);
   };
+  // Each use of randomness within a partition draws from its own stream.
+  enum SeedStream {
+    kBusinessSizes = 0,
+    kHouseholdSizes = 1,
+    kHealthStates = 2,
+    kBusinessShuffle = 3,
+    kHouseholdShuffle = 4,
+  };
+  auto seed = [&config, seeded](const int partition,
+                                const int stream) -> absl::optional<uint64> {
+    return seeded ? absl::make_optional(StreamSeed(config.synthesis_seed(),
+                                                   partition, stream))
+                  : absl::nullopt;
+  };
+  auto for_each_partition = [seeded,
+                             partitions](std::function<void(int)> fn) {
+    if (!seeded) {
+      fn(0);
+      return;
+    }
+    auto executor = NewExecutor(partitions);
+    auto execution = executor->NewExecution();
+    for (int partition = 0; partition < partitions; ++partition) {
+      execution->Add([&fn, partition]() { fn(partition); });
+    }
+    execution->Wait();
+  };
+
+  std::vector<std::vector<int>> business_sizes(partitions);
+  std::vector<std::vector<int>> household_sizes(partitions);
+  for_each_partition([&](const int partition) {
+    const int64 population_size = partition_population(partition);
+    business_sizes[partition] = SampleBusinessSizes(
+        config.location_distributions().business_distribution(),
+        population_size, seed(partition, kBusinessSizes));
+    household_sizes[partition] = SampleHouseholdSizes(
+        config.location_distributions().household_size_distribution(),
+        population_size, seed(partition, kHouseholdSizes));
+  });
+
+  // Seeded partitions take contiguous uuid ranges, the locations of all
+  // partitions first and then their agents, so that uuids stay dense.
+  std::vector<int64> location_uuid_offsets(partitions);
+  std::vector<int64> agent_uuid_offsets(partitions);
+  int64 next_uuid = 0;
+  for (int partition = 0; partition < partitions; ++partition) {
+    location_uuid_offsets[partition] = next_uuid;
+    next_uuid += business_sizes[partition].size() +
+                 household_sizes[partition].size();
+  }
+  for (int partition = 0; partition < partitions; ++partition) {
+    agent_uuid_offsets[partition] = next_uuid;
+    next_uuid += partition_population(partition);
+  }
+
+  std::vector<std::vector<LocationProto>> partition_locations(partitions);
+  context.agent_sources.resize(partitions);
+  for_each_partition([&](const int partition) {
+    std::vector<LocationProto>& locations = partition_locations[partition];
+    std::unique_ptr<UuidGenerator> uuid_generator;
+    std::unique_ptr<UuidGenerator> location_uuid_generator;
+    if (seeded) {
+      location_uuid_generator = absl::make_unique<SequentialUuidGenerator>(
+          location_uuid_offsets[partition]);
+      uuid_generator = absl::make_unique<SequentialUuidGenerator>(
+          agent_uuid_offsets[partition]);
+    } else {
+      const int64 kUuidShard = 0LL;
+      uuid_generator =
+          absl::make_unique<ShardedGlobalIdUuidGenerator>(kUuidShard);
+    }
+    const UuidGenerator& location_uuids =
+        seeded ? *location_uuid_generator : *uuid_generator;
+    auto business_sampler =
+        MakeBusinessSampler(business_sizes[partition], location_uuids,
+                            &locations, seed(partition, kBusinessShuffle));
+    auto household_sampler =
+        MakeHouseholdSampler(household_sizes[partition], location_uuids,
+                             &locations, seed(partition, kHouseholdShuffle));
+    auto health_state_sampler = HealthStateSampler::FromProto(
+        config.agent_properties().initial_health_state_distribution());
+    if (seeded) {
+      health_state_sampler->Seed(*seed(partition, kHealthStates));
+    }
+    auto samplers = absl::WrapUnique(
+        new Samplers({{absl::optional<std::unique_ptr<ShuffledSampler>>(),
+                       absl::optional<std::unique_ptr<ShuffledSampler>>(
+                           std::move(household_sampler)),
+                       absl::optional<std::unique_ptr<ShuffledSampler>>(
+                           std::move(business_sampler))}}));
+    context.agent_sources[partition] = {
+        .sampler = absl::make_unique<ShuffledLocationAgentSampler>(
+            std::move(samplers), std::move(uuid_generator),
+            std::move(health_state_sampler)),
+        .num_agents = partition_population(partition)};
+  });
+  for (std::vector<LocationProto>& locations : partition_locations) {
+    std::move(locations.begin(), locations.end(),
+              std::back_inserter(context.locations));
+  }
+  context.population_profiles = GetPopulationProfiles(config);
+  if (materialize_agents) {
+    context.agents.reserve(config.population_size());
+    for (AgentSource& source : context.agent_sources) {
+      for (int64 i = 0; i < source.num_agents; ++i) {
+        context.agents.push_back(source.sampler->Next());
+      }
+    }
+    context.agent_sources.clear();
+  }
+  context.location_attributes =
+      LocationAttributeTable::Build(context.locations);
+  context.location_type = LocationTypeFn(context.location_attributes);
+  return context;
+}
+
+StatusOr<SimulationContext> LoadSimulationContext(absl::string_view path,
+                                                  const int num_sources) {
+  auto snapshot = PopulationSnapshot::Open(path);
+  if (!snapshot.ok()) return snapshot.status();
+  std::shared_ptr<const PopulationSnapshot> shared_snapshot =
+      std::move(snapshot).value();
+  SimulationContext context;
+  context.population_profiles = shared_snapshot->population_profiles();
+  context.locations.reserve(shared_snapshot->locations().size());
+  for (int64 i = 0; i < shared_snapshot->locations().size(); ++i) {
+    context.locations.push_back(shared_snapshot->GetLocation(i));
+  }
+  const int64 num_agents = shared_snapshot->agents().size();
+  int64 begin = 0;
+  for (int i = 0; i < num_sources; ++i) {
+    const int64 end = num_agents * (i + 1) / num_sources;
+    context.agent_sources.push_back(
+        {.sampler =
+             absl::make_unique<SnapshotAgentSampler>(shared_snapshot, begin),
+         .num_agents = end - begin});
+    begin = end;
+  }
+  context.location_attributes =
+      LocationAttributeTable::Build(context.locations);
+  context.location_type = LocationTypeFn(context.location_attributes);
   return context;
 }
 
+absl::Status WritePopulationSnapshot(absl::string_view path,
+                                     SimulationContext* const context) {
+  PopulationSnapshotWriter writer(path, context->locations,
+                                  context->population_profiles);
+  absl::Status status;
+  for (const AgentProto& agent : context->agents) {
+    status.Update(writer.AddAgent(agent));
+  }
+  for (AgentSource& source : context->agent_sources) {
+    for (int64 i = 0; i < source.num_agents; ++i) {
+      status.Update(writer.AddAgent(source.sampler->Next()));
+    }
+  }
+  context->agent_sources.clear();
+  status.Update(writer.Close());
+  return status;
+}
+
 void RunSimulation(
     absl::string_view output_file_path, absl::string_view learning_output_base,
     const HomeWorkSimulationConfig& config,
     const std::function<std::unique_ptr<PolicyGenerator>(LocationTypeFn)>&
         get_policy_generator,
-    const int num_workers, const SimulationContext& context) {
+    const int num_workers, SimulationContext* const context,
+    const DistributedNode* const distributed) {
   LOG(INFO) << "Writing output to file: " << output_file_path;
 
   auto time_or = DecodeGoogleApiProto(config.init_time());
@@ -246,17 +648,29 @@ void RunSimulation(
   auto transmission_model =
       absl::make_unique<AggregatedTransmissionModel>(config.transmissibility());
   absl::FixedArray<std::unique_ptr<TransitionModel>> transition_models(
-      context.population_profiles.population_profiles_size());
+      context->population_profiles.population_profiles_size());
   for (int i = 0; i < transition_models.size(); ++i) {
     transition_models[i] = PTTSTransitionModel::CreateFromProto(
-        context.population_profiles.population_profiles(i).transition_model());
+        context->population_profiles.population_profiles(i).transition_model());
+  }
+  auto policy_generator = get_policy_generator(context->location_type);
+  int64 num_agents = context->agents.size();
+  for (const AgentSource& source : context->agent_sources) {
+    num_agents += source.num_agents;
+  }
+  std::vector<std::unique_ptr<Agent>> seir_agents(num_agents);
+  // Declared before the simulation, whose agents write to it.
+  std::unique_ptr<CsvHealthTransitionLog> health_transition_log;
+  if (!config.health_transition_log_path().empty()) {
+    health_transition_log = absl::make_unique<CsvHealthTransitionLog>(
+        file::OpenAsyncOrDie(config.health_transition_log_path()));
   }
-  auto policy_generator = get_policy_generator(context.location_type);
-  std::vector<std::unique_ptr<Agent>> seir_agents;
-  seir_agents.reserve(context.agents.size());
   absl::BitGen gen;
-  for (const auto& agent : context.agents) {
-    seir_agents.push_back(SEIRAgent::Create(
+  // Migrated agents are built the same way, including their health transition
+  // log, but keep the policy they had on their previous node.
+  auto make_agent = [&](const AgentProto& agent,
+                        const PublicPolicy* const policy) {
+    std::unique_ptr<SEIRAgent> seir_agent = SEIRAgent::Create(
         agent.uuid(),
         {.time = init_time, .health_state = agent.initial_health_state()},
         transmission_model.get(),
@@ -264,60 +678,223 @@ void RunSimulation(
             transition_models[agent.population_profile_id()].get()),
         absl::make_unique<DurationSpecifiedVisitGenerator>(GetLocationDurations(
             &gen, agent,
-            context.population_profiles.population_profiles(
+            context->population_profiles.population_profiles(
                 agent.population_profile_id()))),
-        policy_generator->NextPolicy()));
+        policy);
+    seir_agent->set_health_transition_log(health_transition_log.get());
+    return seir_agent;
+  };
+  std::unique_ptr<HomeWorkMigrator> migrator;
+  if (distributed != nullptr && distributed->routing_table != nullptr) {
+    migrator =
+        absl::make_unique<HomeWorkMigrator>(make_agent, policy_generator.get());
+  }
+  // Other nodes' agents are skipped, leaving null entries that are removed
+  // once all agents are built.
+  auto is_local = [distributed](const AgentProto& agent) {
+    return distributed == nullptr || distributed->partition->AgentNode(
+                                         agent.uuid()) == distributed->node;
+  };
+  absl::Mutex policy_mu;
+  auto make_local_agent = [&](const AgentProto& agent) {
+    if (migrator != nullptr) migrator->AddAgent(agent);
+    const PublicPolicy* policy;
+    {
+      absl::MutexLock l(&policy_mu);
+      policy = policy_generator->NextPolicy();
+    }
+    return make_agent(agent, policy);
+  };
+  int64 offset = 0;
+  for (const auto& agent : context->agents) {
+    if (is_local(agent)) seir_agents[offset] = make_local_agent(agent);
+    ++offset;
+  }
+  // The agents of each source are built concurrently into their own range, and
+  // only one sampled AgentProto per source is alive at a time.
+  auto executor = NewExecutor(std::max<int>(1, context->agent_sources.size()));
+  auto execution = executor->NewExecution();
+  for (AgentSource& source : context->agent_sources) {
+    execution->Add([&make_local_agent, &is_local, &seir_agents, &source,
+                    offset]() {
+      for (int64 i = 0; i < source.num_agents; ++i) {
+        const AgentProto agent = source.sampler->Next();
+        if (is_local(agent)) seir_agents[offset + i] = make_local_agent(agent);
+      }
+      source.sampler.reset();
+    });
+    offset += source.num_agents;
+  }
+  execution->Wait();
+  context->agent_sources.clear();
+  if (distributed != nullptr) {
+    seir_agents.erase(std::remove(seir_agents.begin(), seir_agents.end(),
+                                  nullptr),
+                      seir_agents.end());
   }
   std::vector<std::unique_ptr<Location>> location_des;
-  location_des.reserve(context.locations.size());
-  for (const auto& location : context.locations) {
+  location_des.reserve(context->locations.size());
+  for (const auto& location : context->locations) {
+    if (distributed != nullptr &&
+        distributed->partition->LocationNode(location.uuid()) !=
+            distributed->node) {
+      continue;
+    }
     location_des.push_back(
         absl::make_unique<LocationDiscreteEventSimulator>(location.uuid()));
   }
   // Initializes Simulation.
-  auto sim = num_workers > 1
-                 ? ParallelSimulation(init_time, std::move(seir_agents),
-                                      std::move(location_des), num_workers)
-                 : SerialSimulation(init_time, std::move(seir_agents),
-                                    std::move(location_des));
+  std::unique_ptr<Simulation> sim;
+  if (distributed != nullptr) {
+    LOG(INFO) << "Simulating " << seir_agents.size() << " agents and "
+              << location_des.size() << " locations on node "
+              << distributed->node;
+    sim = ParallelDistributedSimulation(
+        init_time, std::move(seir_agents), std::move(location_des),
+        std::max(1, num_workers), distributed->manager,
+        {.migrator = migrator.get(),
+         .routing_table = distributed->routing_table,
+         .max_imbalance = distributed->max_imbalance});
+  } else if (num_workers > 1) {
+    sim = ParallelSimulation(init_time, std::move(seir_agents),
+                             std::move(location_des), num_workers);
+  } else {
+    sim = SerialSimulation(init_time, std::move(seir_agents),
+                           std::move(location_des));
+  }
 
   std::vector<std::pair<std::string, std::string>> passthrough =
-      GetHomeWorkPassthrough(config, context.locations);
+      GetHomeWorkPassthrough(config, context->locations);
   // TODO: Check if file exists.
   std::unique_ptr<file::FileWriter> output_file =
-      file::OpenOrDie(output_file_path);
+      file::OpenAsyncOrDie(output_file_path);
   HomeWorkSimulationObserverFactory observer_factory(
-      output_file.get(), context.location_type, passthrough);
+      output_file.get(), context->location_type, passthrough);
   sim->AddObserverFactory(&observer_factory);
+  // Observer shards are pinned to workers, so striped output has one part per
+  // worker.
+  const int learning_output_parts =
+      config.learning_output_striped() ? std::max(1, num_workers) : 0;
   LearningContactsObserverFactory learning_contacts_observer_factory(
-      learning_output_base);
-  if (!learning_output_base.empty()) {
-    sim->AddObserverFactory(&learning_contacts_observer_factory);
-  }
-  sim->Step(config.num_steps() - 1, step_size);
-  // Do the last step to get agent history and tests.
+      learning_output_base, config.learning_output_format(),
+      learning_output_parts);
+  // The agent history is written incrementally in every step, but the tests
+  // only in the last step.
   LearningHistoryAndTestingObserverFactory hist_and_test_observer_factory(
-      learning_output_base);
+      learning_output_base, config.learning_output_format(),
+      learning_output_parts);
+  hist_and_test_observer_factory.set_write_tests(false);
   if (!learning_output_base.empty()) {
+    sim->AddObserverFactory(&learning_contacts_observer_factory);
     sim->AddObserverFactory(&hist_and_test_observer_factory);
   }
+  std::unique_ptr<StepMetricsWriter> step_metrics;
+  if (!config.step_metrics_path().empty()) {
+    step_metrics = absl::make_unique<StepMetricsWriter>(
+        file::OpenOrDie(config.step_metrics_path()));
+    sim->SetStepMetricsCallback([&step_metrics](const StepMetrics& metrics) {
+      step_metrics->Write(metrics).IgnoreError();
+    });
+  }
+  std::unique_ptr<MemoryUsageWriter> memory_usage;
+  if (!config.memory_usage_path().empty()) {
+    memory_usage = absl::make_unique<MemoryUsageWriter>(
+        file::OpenOrDie(config.memory_usage_path()));
+    sim->SetMemoryUsageCallback(
+        config.memory_usage_interval(),
+        [&memory_usage](const MemoryUsage& usage) {
+          LOG(INFO) << "Memory usage at step " << usage.step << ": "
+                    << usage.Total() << " bytes";
+          memory_usage->Write(usage).IgnoreError();
+        });
+  }
+  std::unique_ptr<Tracer> tracer;
+  if (!config.trace_path().empty()) {
+    tracer = absl::make_unique<Tracer>();
+    sim->SetTracer(tracer.get());
+  }
+  sim->Step(config.num_steps() - 1, step_size);
+  hist_and_test_observer_factory.set_write_tests(true);
   sim->Step(1, step_size);
   LOG(INFO) << observer_factory.status();
-  LOG(INFO) << learning_contacts_observer_factory.status();
-  LOG(INFO) << hist_and_test_observer_factory.status();
+  LOG(INFO) << learning_contacts_observer_factory.Close();
+  LOG(INFO) << hist_and_test_observer_factory.Close();
+  if (step_metrics != nullptr) LOG(INFO) << step_metrics->Close();
+  if (memory_usage != nullptr) LOG(INFO) << memory_usage->Close();
+  if (health_transition_log != nullptr) {
+    LOG(INFO) << health_transition_log->Close();
+  }
+  if (tracer != nullptr) {
+    sim->SetTracer(nullptr);
+    std::unique_ptr<file::FileWriter> trace_file =
+        file::OpenOrDie(config.trace_path());
+    absl::Status status = tracer->Write(trace_file.get());
+    status.Update(trace_file->Close());
+    LOG(INFO) << status;
+  }
   CHECK_EQ(absl::OkStatus(), output_file->Close());
 }
 
+StatusOr<std::unique_ptr<Partition>> GetLocalityPartition(
+    const HomeWorkSimulationConfig& config, const int num_nodes) {
+  SimulationContext context;
+  if (!config.population_snapshot_path().empty()) {
+    auto context_or =
+        LoadSimulationContext(config.population_snapshot_path(), 1);
+    if (!context_or.ok()) return context_or.status();
+    context = std::move(context_or).value();
+  } else if (config.synthesis_partitions() > 0 ||
+             config.census_paths_size() > 0) {
+    context = GetSimulationContext(config);
+  } else {
+    return absl::FailedPreconditionError(
+        "Distributed simulations need a population snapshot, census files or "
+        "seeded synthesis");
+  }
+  // Agents are read in order so that all nodes see the same edges.
+  std::vector<AgentLocationEdge> edges;
+  auto add_edges = [&edges](const AgentProto& agent) {
+    for (const LocationProto& location : agent.locations()) {
+      edges.push_back(
+          {.agent_uuid = agent.uuid(),
+           .location_uuid = location.uuid(),
+           .colocate = location.type() == LocationProto::HOUSEHOLD});
+    }
+  };
+  for (const AgentProto& agent : context.agents) add_edges(agent);
+  for (AgentSource& source : context.agent_sources) {
+    for (int64 i = 0; i < source.num_agents; ++i) {
+      add_edges(source.sampler->Next());
+    }
+  }
+  auto partition = NewLocalityPartition(edges, {.num_nodes = num_nodes});
+  const PartitionStats stats = GetPartitionStats(*partition, edges);
+  LOG(INFO) << "Partitioned " << edges.size() << " visits across "
+            << num_nodes << " nodes: " << stats.remote_visit_fraction
+            << " remote, max load ratio " << stats.max_load_ratio;
+  return partition;
+}
+
 void RunSimulation(absl::string_view output_file_path,
                    absl::string_view mpi_learning_output_base,
                    const HomeWorkSimulationConfig& config,
-                   const int num_workers) {
+                   const int num_workers,
+                   const DistributedNode* const distributed) {
   auto get_policy_generator = [&config](LocationTypeFn location_type) {
     return *NewPolicyGenerator(config.distancing_policy(), location_type);
   };
-  auto context = GetSimulationContext(config);
+  SimulationContext context;
+  if (config.population_snapshot_path().empty()) {
+    context = GetSimulationContext(config, /*materialize_agents=*/false,
+                                   num_workers);
+  } else {
+    auto context_or = LoadSimulationContext(config.population_snapshot_path(),
+                                            std::max(1, num_workers));
+    CHECK_EQ(absl::OkStatus(), context_or.status());
+    context = std::move(context_or).value();
+  }
   RunSimulation(output_file_path, mpi_learning_output_base, config,
-                get_policy_generator, num_workers, context);
+                get_policy_generator, num_workers, &context, distributed);
 }
 
 }  // namespace abesim
@@ -17,40 +17,112 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_SIMULATION_H_
 #define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_SIMULATION_H_
 
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/agent_synthesis/agent_sampler.h"
 #include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
 #include "agent_based_epidemic_sim/applications/home_work/location_type.h"
+#include "agent_based_epidemic_sim/core/distributed.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/partition.h"
 #include "agent_based_epidemic_sim/core/public_policy.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
 
 namespace abesim {
 
 // TODO: Encapsulate policy generator and location type context here.
+// A sampler of the next num_agents agents.
+struct AgentSource {
+  std::unique_ptr<AgentSampler> sampler;
+  int64 num_agents = 0;
+};
+
 struct SimulationContext {
+  // Only populated when materialization is requested from
+  // GetSimulationContext.  Otherwise the agents are streamed from
+  // agent_sources, which RunSimulation consumes concurrently.
   std::vector<AgentProto> agents;
+  std::vector<AgentSource> agent_sources;
   std::vector<LocationProto> locations;
+  // Attributes of all locations, shared read-only by all threads.
+  std::shared_ptr<const LocationAttributeTable> location_attributes;
+  // Classifies locations by type, backed by location_attributes.
   LocationTypeFn location_type;
   PopulationProfiles population_profiles;
 };
 
-SimulationContext GetSimulationContext(const HomeWorkSimulationConfig& config);
+// The node run by this process in a distributed simulation.  Every node loads
+// the same population, so it must be deterministic, e.g. a population
+// snapshot, and simulates the agents and locations assigned to it by
+// partition.
+struct DistributedNode {
+  int node = 0;
+  const Partition* partition = nullptr;
+  DistributedManager* manager = nullptr;
+  // If set, agents and locations move between nodes as their load changes,
+  // see core/load_balancing.h, and partition must be this table.
+  RoutingTable* routing_table = nullptr;
+  float max_imbalance = 1.25f;
+};
+
+// Returns a partition of the population of config across num_nodes nodes that
+// keeps agents on the node of their household and balances the load of
+// nodes, see core/locality_partition.h.  The population must be loaded from
+// a snapshot or synthesized with a seed, so that all nodes compute the same
+// partition.
+StatusOr<std::unique_ptr<Partition>> GetLocalityPartition(
+    const HomeWorkSimulationConfig& config, int num_nodes);
+
+// Returns the population profile shared by all agents of a home-work-home
+// simulation, with id 0.
+PopulationProfiles GetPopulationProfiles(
+    const HomeWorkSimulationConfig& config);
+
+// Samples the locations of a home-work-home simulation from config.  The
+// agents are only materialized as AgentProtos if materialize_agents is set,
+// so that by default each agent is sampled and built directly into the
+// simulation.  Census populations are otherwise streamed from a temporary
+// population snapshot, split into num_workers agent sources, and num_workers
+// threads parse the census files.
+SimulationContext GetSimulationContext(const HomeWorkSimulationConfig& config,
+                                       bool materialize_agents = false,
+                                       int num_workers = 1);
+
+// Loads the locations, agents and population profiles of a simulation from a
+// population snapshot.  The agents are split into num_sources agent sources
+// that are read directly from the mapped snapshot.
+StatusOr<SimulationContext> LoadSimulationContext(absl::string_view path,
+                                                  int num_sources);
+
+// Writes the locations, agents and population profiles of context to a
+// population snapshot.  Consumes the agent sources of context.
+absl::Status WritePopulationSnapshot(absl::string_view path,
+                                     SimulationContext* context);
 
-// Runs a home-work-home simulation from config.
+// Runs a home-work-home simulation from config, or one node of it if
+// distributed is set.
 void RunSimulation(absl::string_view output_file_path,
                    absl::string_view learning_output_base,
-                   const HomeWorkSimulationConfig& config, int num_workers);
+                   const HomeWorkSimulationConfig& config, int num_workers,
+                   const DistributedNode* distributed = nullptr);
 
 // Runs a simulation for a collection of agents and locations.
 // Question: Make this more generic? Just pass non-home/work-specific objects
 // v<LocationProto>, v<AgentProto>, PopulationProfiles, generic config such as
 // timestep info, std::unique_ptr<PolicyGenerator>, and output_file_path? In
 // this scenario, location_type_fn could be managed within SimulationObjects.
+// Consumes the agent sources of context.
 void RunSimulation(
     absl::string_view output_file_path, absl::string_view learning_output_base,
     const HomeWorkSimulationConfig& config,
     const std::function<std::unique_ptr<PolicyGenerator>(LocationTypeFn)>&
         get_policy_generator,
-    int num_workers, const SimulationContext& context);
+    int num_workers, SimulationContext* context,
+    const DistributedNode* distributed = nullptr);
 
 }  // namespace abesim
 
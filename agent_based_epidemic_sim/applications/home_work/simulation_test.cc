@@ -14,14 +14,22 @@
 
 #include "agent_based_epidemic_sim/applications/home_work/simulation.h"
 
+#include <algorithm>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
 #include "absl/strings/str_split.h"
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population.pb.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+#include "agent_based_epidemic_sim/applications/home_work/learning_output.h"
 #include "agent_based_epidemic_sim/core/parse_text_proto.h"
 #include "agent_based_epidemic_sim/core/public_policy.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
 #include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/util/columnar_file.h"
+#include "agent_based_epidemic_sim/util/varint.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -64,5 +72,297 @@ TEST(SimulationTest, RunsSimulation) {
   EXPECT_EQ(kExpectedHeader, lines[0]);
 }
 
+TEST(SimulationTest, WritesHealthTransitionLog) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_population_size(200);
+  config.set_num_steps(20);
+  const std::string log_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "health_transitions.csv");
+  config.set_health_transition_log_path(log_path);
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "health_log_output.csv");
+  RunSimulation(output_file_path, "", config, /*num_workers=*/2);
+
+  std::string log;
+  PANDEMIC_ASSERT_OK(file::GetContents(log_path, &log));
+  const std::vector<std::string> lines =
+      absl::StrSplit(log, '\n', absl::SkipEmpty());
+  ASSERT_GT(lines.size(), 1);
+  EXPECT_EQ(lines[0], "agent_uuid,time,health_state");
+  const std::vector<std::string> fields = absl::StrSplit(lines[1], ',');
+  ASSERT_EQ(fields.size(), 3);
+  absl::Time time;
+  std::string error;
+  EXPECT_TRUE(absl::ParseTime(absl::RFC3339_full, fields[1], &time, &error))
+      << error;
+  HealthState::State state;
+  EXPECT_TRUE(HealthState::State_Parse(fields[2], &state));
+}
+
+TEST(SimulationTest, MaterializesAgentsOnlyWhenRequested) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  const HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+
+  SimulationContext streamed = GetSimulationContext(config);
+  EXPECT_TRUE(streamed.agents.empty());
+  ASSERT_EQ(streamed.agent_sources.size(), 1);
+  ASSERT_NE(streamed.agent_sources[0].sampler, nullptr);
+  EXPECT_EQ(streamed.agent_sources[0].num_agents, config.population_size());
+  EXPECT_FALSE(streamed.locations.empty());
+
+  SimulationContext materialized =
+      GetSimulationContext(config, /*materialize_agents=*/true);
+  EXPECT_EQ(materialized.agents.size(), config.population_size());
+  EXPECT_TRUE(materialized.agent_sources.empty());
+}
+
+TEST(SimulationTest, SynthesizesPartitionsDeterministically) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_synthesis_partitions(3);
+  config.set_synthesis_seed(7);
+
+  const SimulationContext first =
+      GetSimulationContext(config, /*materialize_agents=*/true);
+  const SimulationContext second =
+      GetSimulationContext(config, /*materialize_agents=*/true);
+  ASSERT_EQ(first.agents.size(), config.population_size());
+  ASSERT_EQ(second.agents.size(), config.population_size());
+  absl::flat_hash_set<int64> uuids;
+  for (int i = 0; i < first.agents.size(); ++i) {
+    EXPECT_EQ(first.agents[i].DebugString(), second.agents[i].DebugString());
+    EXPECT_TRUE(uuids.insert(first.agents[i].uuid()).second);
+  }
+  ASSERT_EQ(first.locations.size(), second.locations.size());
+  for (int i = 0; i < first.locations.size(); ++i) {
+    EXPECT_EQ(first.locations[i].DebugString(),
+              second.locations[i].DebugString());
+    EXPECT_TRUE(uuids.insert(first.locations[i].uuid()).second);
+  }
+
+  // Partitions take contiguous uuid ranges, so the location uuids stay dense.
+  const auto [min_location, max_location] = std::minmax_element(
+      first.locations.begin(), first.locations.end(),
+      [](const LocationProto& a, const LocationProto& b) {
+        return a.uuid() < b.uuid();
+      });
+  EXPECT_EQ(max_location->uuid() - min_location->uuid() + 1,
+            first.locations.size());
+
+  config.set_num_steps(1);
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "partitioned_output.csv");
+  RunSimulation(output_file_path, "", config, /*num_workers=*/2);
+  std::string output;
+  PANDEMIC_ASSERT_OK(file::GetContents(output_file_path, &output));
+  EXPECT_FALSE(output.empty());
+}
+
+TEST(SimulationTest, LoadsPopulationSnapshot) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_num_steps(1);
+  config.set_synthesis_partitions(2);
+  config.set_synthesis_seed(11);
+  const std::string snapshot_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "population.snapshot");
+  SimulationContext synthesized = GetSimulationContext(config);
+  PANDEMIC_ASSERT_OK(WritePopulationSnapshot(snapshot_path, &synthesized));
+
+  const SimulationContext expected =
+      GetSimulationContext(config, /*materialize_agents=*/true);
+  auto loaded = LoadSimulationContext(snapshot_path, /*num_sources=*/3);
+  PANDEMIC_ASSERT_OK(loaded.status());
+  SimulationContext& context = loaded.value();
+  ASSERT_EQ(context.locations.size(), expected.locations.size());
+  for (int i = 0; i < expected.locations.size(); ++i) {
+    EXPECT_EQ(context.locations[i].DebugString(),
+              expected.locations[i].DebugString());
+  }
+  EXPECT_EQ(context.population_profiles.DebugString(),
+            expected.population_profiles.DebugString());
+  ASSERT_EQ(context.agent_sources.size(), 3);
+  int i = 0;
+  for (AgentSource& source : context.agent_sources) {
+    for (int64 j = 0; j < source.num_agents; ++j, ++i) {
+      ASSERT_LT(i, expected.agents.size());
+      EXPECT_EQ(source.sampler->Next().DebugString(),
+                expected.agents[i].DebugString());
+    }
+  }
+  EXPECT_EQ(i, expected.agents.size());
+
+  config.set_population_snapshot_path(snapshot_path);
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "snapshot_output.csv");
+  RunSimulation(output_file_path, "", config, /*num_workers=*/2);
+  std::string output;
+  PANDEMIC_ASSERT_OK(file::GetContents(output_file_path, &output));
+  EXPECT_FALSE(output.empty());
+}
+
+TEST(SimulationTest, LoadsCensusPopulation) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_num_steps(1);
+  const std::string census_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "census");
+  std::string census;
+  for (int i = 0; i < 10; ++i) {
+    Household household;
+    household.set_type(Household::HOUSEHOLD);
+    household.add_person();
+    Person* worker = household.add_person();
+    worker->set_pums_powsp("006");
+    worker->set_pums_powpuma("00100");
+    const std::string record = household.SerializeAsString();
+    PutVarint64(record.size(), &census);
+    census.append(record);
+  }
+  auto census_file = file::OpenOrDie(census_path);
+  PANDEMIC_ASSERT_OK(census_file->WriteString(census));
+  PANDEMIC_ASSERT_OK(census_file->Close());
+  config.add_census_paths(census_path);
+
+  const SimulationContext context =
+      GetSimulationContext(config, /*materialize_agents=*/false,
+                           /*num_workers=*/2);
+  EXPECT_TRUE(context.agents.empty());
+  ASSERT_EQ(context.agent_sources.size(), 2);
+  EXPECT_EQ(context.agent_sources[0].num_agents +
+                context.agent_sources[1].num_agents,
+            20);
+  const SimulationContext materialized =
+      GetSimulationContext(config, /*materialize_agents=*/true);
+  EXPECT_EQ(materialized.agents.size(), 20);
+  EXPECT_EQ(materialized.locations.size(), context.locations.size());
+  int businesses = 0;
+  for (const LocationProto& location : context.locations) {
+    if (location.type() == LocationProto::BUSINESS) ++businesses;
+  }
+  EXPECT_EQ(context.locations.size(), 10 + businesses);
+  EXPECT_GT(businesses, 0);
+
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "census_output.csv");
+  RunSimulation(output_file_path, "", config, /*num_workers=*/2);
+  std::string output;
+  PANDEMIC_ASSERT_OK(file::GetContents(output_file_path, &output));
+  EXPECT_FALSE(output.empty());
+}
+
+TEST(SimulationTest, WritesColumnarLearningOutput) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_num_steps(2);
+  config.set_learning_output_format(LEARNING_OUTPUT_COLUMNAR);
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "columnar_output.csv");
+  const std::string learning_output_base =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "learning");
+  RunSimulation(output_file_path, learning_output_base, config,
+                /*num_workers=*/1);
+
+  auto tests = ColumnarReader::Open(
+      absl::StrCat(learning_output_base, "_tests.columnar"));
+  PANDEMIC_ASSERT_OK(tests.status());
+  EXPECT_EQ(tests.value()->num_rows(), config.population_size());
+  auto history = ColumnarReader::Open(
+      absl::StrCat(learning_output_base, "_history.columnar"));
+  PANDEMIC_ASSERT_OK(history.status());
+  ASSERT_EQ(history.value()->columns().size(), 3);
+  EXPECT_EQ(history.value()->columns()[0].name, "agent_uuid");
+}
+
+TEST(SimulationTest, WritesIncrementalHistory) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_num_steps(2);
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "history_output.csv");
+  const std::string learning_output_base =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "history");
+  RunSimulation(output_file_path, learning_output_base, config,
+                /*num_workers=*/1);
+
+  std::string output;
+  PANDEMIC_ASSERT_OK(file::GetContents(
+      absl::StrCat(learning_output_base, "_history.csv"), &output));
+  // Each line holds the new transitions of an agent in one step, so the
+  // concatenated lines of an agent must form a valid history.
+  absl::flat_hash_map<std::string, std::pair<std::string, absl::Time>> last;
+  for (absl::string_view line :
+       absl::StrSplit(output, '\n', absl::SkipEmpty())) {
+    const std::vector<std::string> fields = absl::StrSplit(line, ',');
+    ASSERT_EQ(fields.size() % 2, 1) << line;
+    auto& [last_state, last_time] =
+        last.try_emplace(fields[0], "0", absl::InfinitePast()).first->second;
+    for (int i = 1; i < fields.size(); i += 2) {
+      absl::Time time;
+      std::string error;
+      ASSERT_TRUE(absl::ParseTime(absl::RFC3339_full, fields[i + 1], &time,
+                                  &error))
+          << error;
+      EXPECT_NE(fields[i], last_state) << line;
+      EXPECT_GE(time, last_time) << line;
+      last_state = fields[i];
+      last_time = time;
+    }
+  }
+  EXPECT_LE(last.size(), config.population_size());
+}
+
+TEST(SimulationTest, WritesLearningOutputPartsInParallel) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_num_steps(1);
+  config.set_learning_output_striped(true);
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "parallel_output.csv");
+  const std::string learning_output_base =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "parallel");
+  RunSimulation(output_file_path, learning_output_base, config,
+                /*num_workers=*/3);
+
+  auto parts = ReadLearningOutputManifest(
+      absl::StrCat(learning_output_base, "_tests.csv"));
+  PANDEMIC_ASSERT_OK(parts.status());
+  ASSERT_EQ(parts.value().size(), 3);
+  int lines = 0;
+  for (const std::string& part : parts.value()) {
+    std::string output;
+    PANDEMIC_ASSERT_OK(file::GetContents(part, &output));
+    lines += std::vector<std::string>(
+                 absl::StrSplit(output, '\n', absl::SkipEmpty()))
+                 .size();
+  }
+  EXPECT_EQ(lines, config.population_size());
+}
+
 }  // namespace
 }  // namespace abesim
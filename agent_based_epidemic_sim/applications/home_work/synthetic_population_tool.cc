@@ -0,0 +1,94 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Generates a synthetic population for scaling tests, see
+// agent_synthesis/synthetic_population.proto, and writes it to a population
+// snapshot.  The agent properties and the disease model are taken from a
+// home-work simulation config, which is also written out with the population
+// snapshot in place of the synthesized population if output_config_path is
+// set.
+
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "agent_based_epidemic_sim/agent_synthesis/synthetic_population.h"
+#include "agent_based_epidemic_sim/agent_synthesis/synthetic_population.pb.h"
+#include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+#include "agent_based_epidemic_sim/applications/home_work/simulation.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "google/protobuf/text_format.h"
+
+ABSL_FLAG(std::string, synthetic_population_pbtxt_path, "",
+          "Path to SyntheticPopulationConfig pbtxt file.");
+ABSL_FLAG(std::string, simulation_config_pbtxt_path, "",
+          "Path to SimulationConfig pbtxt file.");
+ABSL_FLAG(std::string, snapshot_path, "", "The population snapshot path.");
+ABSL_FLAG(std::string, output_config_path, "",
+          "If set, the path of a SimulationConfig pbtxt file that simulates "
+          "the population snapshot.");
+
+namespace abesim {
+
+int Main() {
+  std::string contents;
+  CHECK_EQ(absl::OkStatus(),
+           file::GetContents(
+               absl::GetFlag(FLAGS_synthetic_population_pbtxt_path),
+               &contents));
+  const SyntheticPopulationConfig population_config =
+      ParseTextProtoOrDie<SyntheticPopulationConfig>(contents);
+  CHECK_EQ(absl::OkStatus(),
+           file::GetContents(absl::GetFlag(FLAGS_simulation_config_pbtxt_path),
+                             &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+
+  auto population = GenerateSyntheticPopulation(population_config);
+  CHECK_EQ(absl::OkStatus(), population.status());
+  LOG(INFO) << "Generated " << population->locations.size()
+            << " locations for " << population->num_agents << " agents.";
+  SimulationContext context;
+  context.locations = std::move(population->locations);
+  context.population_profiles = GetPopulationProfiles(config);
+  context.population_profiles.mutable_population_profiles(0)->set_id(
+      population_config.population_profile_id());
+  context.agent_sources.push_back({.sampler = std::move(population->agents),
+                                   .num_agents = population->num_agents});
+  const std::string snapshot_path = absl::GetFlag(FLAGS_snapshot_path);
+  CHECK_EQ(absl::OkStatus(), WritePopulationSnapshot(snapshot_path, &context));
+
+  const std::string output_config_path =
+      absl::GetFlag(FLAGS_output_config_path);
+  if (!output_config_path.empty()) {
+    config.set_population_size(population->num_agents);
+    config.set_population_snapshot_path(snapshot_path);
+    std::string output;
+    CHECK(google::protobuf::TextFormat::PrintToString(config, &output));
+    auto file = file::OpenOrDie(output_config_path);
+    CHECK_EQ(absl::OkStatus(), file->WriteString(output));
+    CHECK_EQ(absl::OkStatus(), file->Close());
+  }
+  return 0;
+}
+
+}  // namespace abesim
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+  return abesim::Main();
+}
@@ -0,0 +1,347 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_BENCHMARKS_BENCHMARK_H_
+#define AGENT_BASED_EPIDEMIC_SIM_BENCHMARKS_BENCHMARK_H_
+
+#include <algorithm>
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/util/json.h"
+
+// A minimal, self-contained benchmark harness for the binaries in this
+// directory.  Results are written as JSON in the layout of Google Benchmark's
+// JSON output, so runs can be compared with the usual tools.
+//
+// A benchmark times the loop over state.KeepRunning(); setup before the loop
+// is not timed:
+//
+//   void BM_Sort(benchmark::State& state) {
+//     std::vector<int> v = MakeInput(state.range(0));
+//     while (state.KeepRunning()) {
+//       state.PauseTiming();
+//       std::vector<int> copy = v;
+//       state.ResumeTiming();
+//       std::sort(copy.begin(), copy.end());
+//     }
+//     state.SetItemsProcessed(state.iterations() * v.size());
+//   }
+//
+//   int main(int argc, char** argv) {
+//     benchmark::Initialize(&argc, argv);
+//     benchmark::Register("BM_Sort", BM_Sort).Range({1 << 10, 1 << 20});
+//     return benchmark::RunRegistered();
+//   }
+//
+// Initialize consumes the following flags and leaves all others in argv:
+//   --benchmark_filter=<substring>  Only runs benchmarks whose name contains
+//                                    the substring.
+//   --benchmark_min_time=<seconds>  Minimum timed duration of each benchmark
+//                                    whose iterations are not fixed.
+//   --benchmark_out=<path>          Writes the JSON results to path instead
+//                                    of stdout, replacing any earlier results.
+//   --benchmark_seed=<seed>         Seeds the random inputs of the
+//                                    benchmarks, see Seed().
+
+namespace abesim {
+namespace benchmark {
+
+// Prevents the compiler from optimizing away the computation of value.
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class State {
+ public:
+  State(const int64 iterations, std::vector<int64> ranges)
+      : iterations_(iterations), ranges_(std::move(ranges)) {}
+
+  // Returns true while more iterations should be run.  Timing starts with the
+  // first call and stops with the last one.
+  bool KeepRunning() {
+    if (count_ == 0) ResumeTiming();
+    if (count_ < iterations_) {
+      ++count_;
+      return true;
+    }
+    PauseTiming();
+    return false;
+  }
+  // Excludes the time until ResumeTiming from the measurement.
+  void PauseTiming() {
+    real_time_ += Clock::now() - real_start_;
+    cpu_time_ += std::clock() - cpu_start_;
+  }
+  void ResumeTiming() {
+    real_start_ = Clock::now();
+    cpu_start_ = std::clock();
+  }
+
+  int64 iterations() const { return iterations_; }
+  int64 range(const int i) const { return ranges_[i]; }
+  void SetItemsProcessed(const int64 items) { items_processed_ = items; }
+  void SetBytesProcessed(const int64 bytes) { bytes_processed_ = bytes; }
+  // Reports an additional named value with the results.
+  void SetCounter(const std::string& name, const double value) {
+    counters_[name] = value;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  friend class Benchmark;
+
+  double real_seconds() const {
+    return std::chrono::duration<double>(real_time_).count();
+  }
+  double cpu_seconds() const {
+    return static_cast<double>(cpu_time_) / CLOCKS_PER_SEC;
+  }
+
+  const int64 iterations_;
+  const std::vector<int64> ranges_;
+  int64 count_ = 0;
+  Clock::time_point real_start_;
+  Clock::duration real_time_ = Clock::duration::zero();
+  std::clock_t cpu_start_ = 0;
+  std::clock_t cpu_time_ = 0;
+  int64 items_processed_ = 0;
+  int64 bytes_processed_ = 0;
+  std::map<std::string, double> counters_;
+};
+
+struct Options {
+  std::string filter;
+  double min_time = 0.5;
+  std::string out;
+  uint64 seed = 1;
+};
+
+class Benchmark {
+ public:
+  using Fn = std::function<void(State&)>;
+
+  Benchmark(std::string name, Fn fn) : name_(std::move(name)), fn_(fn) {}
+
+  // Runs the benchmark once for each of the given arguments, which are
+  // available as state.range(0) and appended to the name.
+  Benchmark& Range(const std::vector<int64>& args) {
+    for (const int64 arg : args) args_.push_back({arg});
+    return *this;
+  }
+  // Runs the benchmark once for each of the given argument tuples.
+  Benchmark& Args(std::vector<int64> args) {
+    args_.push_back(std::move(args));
+    return *this;
+  }
+  // Runs exactly this many iterations instead of calibrating the count
+  // against the minimum time.  Useful when setup is expensive.
+  Benchmark& Iterations(const int64 iterations) {
+    iterations_ = iterations;
+    return *this;
+  }
+  // As Iterations, but computed from the arguments.
+  Benchmark& Iterations(std::function<int64(const std::vector<int64>&)> fn) {
+    iterations_fn_ = std::move(fn);
+    return *this;
+  }
+
+ private:
+  friend int RunRegistered();
+
+  struct Result {
+    std::string name;
+    int64 iterations;
+    double real_seconds;
+    double cpu_seconds;
+    int64 items_processed;
+    int64 bytes_processed;
+    std::map<std::string, double> counters;
+  };
+
+  void Run(const Options& options, std::vector<Result>* results) const {
+    std::vector<std::vector<int64>> args = args_;
+    if (args.empty()) args.push_back({});
+    for (const std::vector<int64>& arg : args) {
+      std::string name = name_;
+      for (const int64 a : arg) absl::StrAppend(&name, "/", a);
+      if (!absl::StrContains(name, options.filter)) continue;
+      int64 iterations =
+          iterations_fn_ != nullptr ? iterations_fn_(arg) : iterations_;
+      const bool calibrate = iterations <= 0;
+      if (calibrate) iterations = 1;
+      while (true) {
+        State state(iterations, arg);
+        fn_(state);
+        const double seconds = state.real_seconds();
+        if (!calibrate || seconds >= options.min_time ||
+            iterations >= kMaxIterations) {
+          results->push_back({name, iterations, seconds, state.cpu_seconds(),
+                              state.items_processed_, state.bytes_processed_,
+                              state.counters_});
+          fprintf(stderr, "%-48s %12lld iterations %14.1f ns/iteration\n",
+                  name.c_str(), static_cast<long long>(iterations),
+                  seconds * 1e9 / iterations);
+          break;
+        }
+        // Predicts the iterations needed to reach the minimum time, growing
+        // by at most 10x per attempt.
+        const double scale =
+            seconds > 0 ? 1.4 * options.min_time / seconds : 10.0;
+        iterations = std::min<int64>(
+            kMaxIterations,
+            std::max<int64>(iterations + 1,
+                            iterations * std::min(10.0, scale)));
+      }
+    }
+  }
+
+  static constexpr int64 kMaxIterations = 1000000000;
+
+  const std::string name_;
+  const Fn fn_;
+  std::vector<std::vector<int64>> args_;
+  int64 iterations_ = 0;
+  std::function<int64(const std::vector<int64>&)> iterations_fn_;
+};
+
+namespace internal {
+
+inline std::vector<std::unique_ptr<Benchmark>>& Registry() {
+  static auto* const registry = new std::vector<std::unique_ptr<Benchmark>>();
+  return *registry;
+}
+
+inline Options& GlobalOptions() {
+  static auto* const options = new Options();
+  return *options;
+}
+
+}  // namespace internal
+
+// Parses and removes the --benchmark_* flags from argv.
+inline void Initialize(int* argc, char** argv) {
+  Options& options = internal::GlobalOptions();
+  int kept = 1;
+  for (int i = 1; i < *argc; ++i) {
+    absl::string_view arg = argv[i];
+    if (absl::ConsumePrefix(&arg, "--benchmark_filter=")) {
+      options.filter = std::string(arg);
+    } else if (absl::ConsumePrefix(&arg, "--benchmark_min_time=")) {
+      CHECK(absl::SimpleAtod(arg, &options.min_time)) << argv[i];
+    } else if (absl::ConsumePrefix(&arg, "--benchmark_out=")) {
+      options.out = std::string(arg);
+    } else if (absl::ConsumePrefix(&arg, "--benchmark_seed=")) {
+      CHECK(absl::SimpleAtoi(arg, &options.seed)) << argv[i];
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  *argc = kept;
+}
+
+// Returns the seed from which benchmarks draw their random inputs, so that
+// runs with the same seed time the same populations and visits.
+inline uint64 Seed() { return internal::GlobalOptions().seed; }
+
+// Registers a benchmark to be run by RunRegistered.
+inline Benchmark& Register(std::string name, Benchmark::Fn fn) {
+  internal::Registry().push_back(
+      absl::make_unique<Benchmark>(std::move(name), std::move(fn)));
+  return *internal::Registry().back();
+}
+
+// Runs all registered benchmarks and writes their results as JSON.
+inline int RunRegistered() {
+  const Options& options = internal::GlobalOptions();
+  std::vector<Benchmark::Result> results;
+  for (const auto& benchmark : internal::Registry()) {
+    benchmark->Run(options, &results);
+  }
+
+  std::string json = absl::StrCat(
+      "{\n  \"context\": {\n    \"date\": ",
+      JsonString(absl::FormatTime(absl::Now())),
+      ",\n    \"num_cpus\": ", std::thread::hardware_concurrency(),
+      ",\n    \"library_build_type\": ",
+#ifdef NDEBUG
+      "\"release\"",
+#else
+      "\"debug\"",
+#endif
+      "\n  },\n  \"benchmarks\": [");
+  for (int i = 0; i < results.size(); ++i) {
+    const Benchmark::Result& result = results[i];
+    std::vector<std::string> fields = {
+        absl::StrCat("\"name\": ", JsonString(result.name)),
+        absl::StrCat("\"iterations\": ", result.iterations),
+        absl::StrCat("\"real_time\": ",
+                     result.real_seconds * 1e9 / result.iterations),
+        absl::StrCat("\"cpu_time\": ",
+                     result.cpu_seconds * 1e9 / result.iterations),
+        "\"time_unit\": \"ns\""};
+    if (result.items_processed > 0 && result.real_seconds > 0) {
+      fields.push_back(
+          absl::StrCat("\"items_per_second\": ",
+                       result.items_processed / result.real_seconds));
+    }
+    if (result.bytes_processed > 0 && result.real_seconds > 0) {
+      fields.push_back(
+          absl::StrCat("\"bytes_per_second\": ",
+                       result.bytes_processed / result.real_seconds));
+    }
+    for (const auto& [name, value] : result.counters) {
+      fields.push_back(absl::StrCat(JsonString(name), ": ", value));
+    }
+    absl::StrAppend(&json, i == 0 ? "\n" : ",\n", "    {\n      ",
+                    absl::StrJoin(fields, ",\n      "), "\n    }");
+  }
+  absl::StrAppend(&json, "\n  ]\n}\n");
+
+  if (options.out.empty()) {
+    fputs(json.c_str(), stdout);
+    return 0;
+  }
+  CHECK_EQ(absl::OkStatus(), file::SetContents(options.out, json));
+  return 0;
+}
+
+}  // namespace benchmark
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_BENCHMARKS_BENCHMARK_H_
@@ -0,0 +1,70 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/benchmarks/benchmark_fixtures.h"
+
+#include <random>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/random/distributions.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/ptts_transition_model.h"
+#include "agent_based_epidemic_sim/core/seir_agent.h"
+#include "agent_based_epidemic_sim/core/wrapped_transition_model.h"
+
+namespace abesim {
+
+void BenchmarkPopulation::AddAgent(const int64 uuid, const absl::Time start,
+                                   const HealthState::State health_state,
+                                   std::vector<LocationDuration> durations) {
+  agents.push_back(SEIRAgent::Create(
+      uuid, {.time = start, .health_state = health_state},
+      transmission_model.get(),
+      absl::make_unique<WrappedTransitionModel>(transition_model.get()),
+      absl::make_unique<DurationSpecifiedVisitGenerator>(std::move(durations)),
+      policy.get()));
+}
+
+std::unique_ptr<BenchmarkPopulation> NewBenchmarkPopulation() {
+  auto population = absl::make_unique<BenchmarkPopulation>();
+  population->transmission_model =
+      absl::make_unique<AggregatedTransmissionModel>(0.5);
+  PTTSTransitionModel::StateTransitionDiagram diagram{{
+      {
+          {.transitions = absl::discrete_distribution<int>({1, 0, 0, 0}),
+           .rate = 1},
+          {.transitions = absl::discrete_distribution<int>({0, 0, 1, 0}),
+           .rate = .5},
+          {.transitions = absl::discrete_distribution<int>({0, 0, 0, 1}),
+           .rate = .1},
+          {.transitions = absl::discrete_distribution<int>({0, 0, 0, 1}),
+           .rate = 1},
+      },
+  }};
+  population->transition_model =
+      absl::make_unique<PTTSTransitionModel>(diagram);
+  population->policy = NewNoOpPolicy();
+  return population;
+}
+
+std::function<float(float)> HoursSampler(const float mean,
+                                         const uint64 seed) {
+  // A small generator, as populations hold a sampler per visited location.
+  return [mean, gen = std::minstd_rand(seed)](const float adjustment) mutable {
+    return absl::Gaussian<float>(gen, mean * adjustment, 1.0f);
+  };
+}
+
+}  // namespace abesim
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_BENCHMARKS_BENCHMARK_FIXTURES_H_
+#define AGENT_BASED_EPIDEMIC_SIM_BENCHMARKS_BENCHMARK_FIXTURES_H_
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/public_policy.h"
+#include "agent_based_epidemic_sim/core/transition_model.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
+
+// Populations shared by the simulation benchmarks.
+
+namespace abesim {
+
+// The agents and locations of a benchmarked population, with the models the
+// agents share.
+struct BenchmarkPopulation {
+  std::unique_ptr<TransmissionModel> transmission_model;
+  std::unique_ptr<TransitionModel> transition_model;
+  std::unique_ptr<PublicPolicy> policy;
+  std::vector<std::unique_ptr<Agent>> agents;
+  std::vector<std::unique_ptr<Location>> locations;
+
+  // Adds a SEIR agent that uses the models of the population and visits the
+  // given locations.
+  void AddAgent(int64 uuid, absl::Time start, HealthState::State health_state,
+                std::vector<LocationDuration> durations);
+};
+
+// Returns a population without agents or locations, whose agents transmit
+// through an aggregated transmission model and progress through the
+// susceptible, exposed, infectious and recovered states.
+std::unique_ptr<BenchmarkPopulation> NewBenchmarkPopulation();
+
+// Returns a sampler of visit durations in hours around mean, whose mean is
+// scaled by the adjustment of the agent's policy.  Each sampler draws from its
+// own generator seeded with seed, so that the durations do not depend on which
+// worker samples them.
+std::function<float(float)> HoursSampler(float mean, uint64 seed);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_BENCHMARKS_BENCHMARK_FIXTURES_H_
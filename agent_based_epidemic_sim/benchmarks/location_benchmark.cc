@@ -0,0 +1,124 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the processing of the visits to a location by location size.
+
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/parse.h"
+#include "absl/random/distributions.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/benchmarks/benchmark.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/graph_location.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+constexpr int64 kLocationUuid = 1;
+constexpr float kInfectiousFraction = 0.1;
+// The average number of contacts of an agent in a GraphLocation.
+constexpr int kGraphDegree = 8;
+
+class DiscardingBroker : public Broker<InfectionOutcome> {
+ public:
+  void Send(const absl::Span<const InfectionOutcome> msgs) override {
+    received_ += msgs.size();
+    benchmark::DoNotOptimize(msgs.data());
+  }
+
+ private:
+  int64 received_ = 0;
+};
+
+// Visits of the given number of agents over a day, of random start and length.
+std::vector<Visit> RandomVisits(const int64 num_visits) {
+  std::mt19937_64 gen(benchmark::Seed());
+  const absl::Time start = absl::FromUnixSeconds(0);
+  std::vector<Visit> visits(num_visits);
+  for (int64 i = 0; i < num_visits; ++i) {
+    const absl::Time visit_start =
+        start + absl::Minutes(absl::Uniform<int>(gen, 0, 16 * 60));
+    const bool infectious = absl::Bernoulli(gen, kInfectiousFraction);
+    visits[i] = {
+        .location_uuid = kLocationUuid,
+        .agent_uuid = i,
+        .start_time = visit_start,
+        .end_time =
+            visit_start + absl::Minutes(absl::Uniform<int>(gen, 1, 8 * 60)),
+        .health_state =
+            infectious ? HealthState::INFECTIOUS : HealthState::SUSCEPTIBLE,
+        .infectivity = infectious ? 1.0f : 0.0f,
+        .symptom_factor = 1.0f,
+    };
+  }
+  return visits;
+}
+
+void ProcessVisits(benchmark::State& state, Location* const location,
+                   const std::vector<Visit>& visits) {
+  DiscardingBroker broker;
+  while (state.KeepRunning()) {
+    location->ProcessVisits(visits, &broker);
+  }
+  state.SetItemsProcessed(state.iterations() * visits.size());
+}
+
+void BM_LocationDiscreteEventSimulator(benchmark::State& state) {
+  LocationDiscreteEventSimulator location(kLocationUuid);
+  ProcessVisits(state, &location, RandomVisits(state.range(0)));
+}
+
+void BM_GraphLocation(benchmark::State& state) {
+  const int64 size = state.range(0);
+  std::mt19937_64 gen(benchmark::Seed());
+  std::vector<std::pair<int64, int64>> graph;
+  for (int64 i = 0; i < size * kGraphDegree / 2; ++i) {
+    const int64 a = absl::Uniform<int64>(gen, 0, size);
+    const int64 b = absl::Uniform<int64>(gen, 0, size);
+    if (a != b) graph.emplace_back(a, b);
+  }
+  auto location =
+      NewGraphLocation(kLocationUuid, /*drop_probability=*/0.1, graph);
+  ProcessVisits(state, location.get(), RandomVisits(size));
+}
+
+}  // namespace
+
+int Main() {
+  const std::vector<int64> sizes = {2, 8, 32, 128, 512, 2048};
+  benchmark::Register("BM_LocationDiscreteEventSimulator",
+                      BM_LocationDiscreteEventSimulator)
+      .Range(sizes);
+  benchmark::Register("BM_GraphLocation", BM_GraphLocation).Range(sizes);
+  return benchmark::RunRegistered();
+}
+
+}  // namespace abesim
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  abesim::benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  return abesim::Main();
+}
@@ -0,0 +1,91 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the transmission and transition models.
+
+#include <memory>
+#include <vector>
+
+#include "absl/flags/parse.h"
+#include "absl/random/discrete_distribution.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/benchmarks/benchmark.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/ptts_transition_model.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+void BM_AggregatedTransmissionModel(benchmark::State& state) {
+  AggregatedTransmissionModel model(0.05);
+  std::vector<Exposure> exposures(state.range(0));
+  for (Exposure& exposure : exposures) {
+    exposure = {.duration = absl::Minutes(30),
+                .micro_exposure_counts = {3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+                .infectivity = 1.0f,
+                .symptom_factor = 1.0f};
+  }
+  std::vector<const Exposure*> exposure_ptrs;
+  for (const Exposure& exposure : exposures) {
+    exposure_ptrs.push_back(&exposure);
+  }
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(model.GetInfectionOutcome(exposure_ptrs));
+  }
+  state.SetItemsProcessed(state.iterations() * exposures.size());
+}
+
+void BM_PTTSTransitionModel(benchmark::State& state) {
+  PTTSTransitionModel::StateTransitionDiagram diagram{{
+      {
+          {.transitions = absl::discrete_distribution<int>({0, 1, 0, 0}),
+           .rate = 1},
+          {.transitions = absl::discrete_distribution<int>({0, 0, 0.8, 0.2}),
+           .rate = .5},
+          {.transitions = absl::discrete_distribution<int>({0, 0, 0, 1}),
+           .rate = .1},
+          {.transitions = absl::discrete_distribution<int>({1, 0, 0, 0}),
+           .rate = .01},
+      },
+  }};
+  PTTSTransitionModel model(diagram);
+  HealthTransition transition = {.time = absl::FromUnixSeconds(0),
+                                 .health_state = HealthState::SUSCEPTIBLE};
+  while (state.KeepRunning()) {
+    transition = model.GetNextHealthTransition(transition);
+  }
+  benchmark::DoNotOptimize(transition);
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace
+
+int Main() {
+  benchmark::Register("BM_AggregatedTransmissionModel",
+                      BM_AggregatedTransmissionModel)
+      .Range({1, 8, 64, 512});
+  benchmark::Register("BM_PTTSTransitionModel", BM_PTTSTransitionModel);
+  return benchmark::RunRegistered();
+}
+
+}  // namespace abesim
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  abesim::benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  return abesim::Main();
+}
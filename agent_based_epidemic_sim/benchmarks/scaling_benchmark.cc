@@ -0,0 +1,236 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the strong and weak scaling of the parallel simulation on a
+// synthetic population, see agent_synthesis/synthetic_population.h.  Strong
+// scaling steps a population of max_agents agents with an increasing number of
+// workers; weak scaling grows the population with the number of workers.
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/memory/memory.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/agent_synthesis/synthetic_population.h"
+#include "agent_based_epidemic_sim/agent_synthesis/synthetic_population.pb.h"
+#include "agent_based_epidemic_sim/benchmarks/benchmark.h"
+#include "agent_based_epidemic_sim/benchmarks/benchmark_fixtures.h"
+#include "agent_based_epidemic_sim/core/graph_location.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+ABSL_FLAG(int64, max_agents, 1000000,
+          "The population of the strong scaling benchmark, and of the weak "
+          "scaling benchmark with the most workers.");
+ABSL_FLAG(int, max_workers, 0,
+          "The most workers to scale to, or 0 for one per CPU.");
+ABSL_FLAG(std::string, synthetic_population_pbtxt_path, "",
+          "If set, a SyntheticPopulationConfig pbtxt file to use in place of "
+          "the default heavy-tailed population.  Its population_size and "
+          "seed are overridden.");
+ABSL_FLAG(int, graph_location_min_size, 100,
+          "Businesses of at least this size are simulated as graph locations, "
+          "like social groups, since the contacts of a discrete event "
+          "location grow with the square of its occupancy.");
+
+namespace abesim {
+namespace {
+
+constexpr absl::Duration kStepDuration = absl::Hours(24);
+const absl::Time kStart = absl::FromUnixSeconds(0);
+// Each member of a graph location is in contact with this many of its members.
+constexpr int kGraphDegree = 8;
+constexpr float kGraphDropProbability = 0.5;
+
+// Eight regions of decreasing size, whose agents mostly work in the region
+// they live in, at businesses with power law sizes and at giant employers.
+constexpr char kDefaultPopulation[] = R"(
+  seed: 1
+  num_regions: 8
+  region_size_skew: 1
+  household_size_distribution {
+    discrete {
+      buckets { int_value: 1 count: 0.28 }
+      buckets { int_value: 2 count: 0.35 }
+      buckets { int_value: 3 count: 0.15 }
+      buckets { int_value: 4 count: 0.13 }
+      buckets { int_value: 5 count: 0.06 }
+      buckets { int_value: 6 count: 0.03 }
+    }
+  }
+  business_size_distribution {
+    power_law { exponent: 1.8 min_size: 1 max_size: 5000 }
+  }
+  giant_employer_fraction: 0.1
+  giant_employers_per_region: 2
+  commuter_fraction: 0.05
+  social_group_fraction: 0.3
+  social_group_size_distribution { gamma { alpha: 2 beta: 15 } }
+  initial_health_state_distribution {
+    buckets {
+      proto_value {
+        [type.googleapis.com/abesim.HealthState] { state: SUSCEPTIBLE }
+      }
+      count: 0.99
+    }
+    buckets {
+      proto_value {
+        [type.googleapis.com/abesim.HealthState] { state: INFECTIOUS }
+      }
+      count: 0.01
+    }
+  }
+)";
+
+SyntheticPopulationConfig PopulationConfig(const int64 num_agents) {
+  std::string contents = kDefaultPopulation;
+  const std::string path = absl::GetFlag(FLAGS_synthetic_population_pbtxt_path);
+  if (!path.empty()) {
+    CHECK_EQ(absl::OkStatus(), file::GetContents(path, &contents));
+  }
+  auto config = ParseTextProtoOrDie<SyntheticPopulationConfig>(contents);
+  config.set_population_size(num_agents);
+  config.set_seed(benchmark::Seed());
+  return config;
+}
+
+// The agents and locations of a synthetic population.
+std::unique_ptr<BenchmarkPopulation> MakePopulation(const int64 num_agents) {
+  auto synthetic = GenerateSyntheticPopulation(PopulationConfig(num_agents));
+  CHECK_EQ(absl::OkStatus(), synthetic.status());
+  auto population = NewBenchmarkPopulation();
+
+  const int graph_location_min_size =
+      absl::GetFlag(FLAGS_graph_location_min_size);
+  auto is_graph_location = [graph_location_min_size](
+                               const LocationProto& location) {
+    return location.type() == LocationProto::SOCIAL ||
+           (location.type() == LocationProto::BUSINESS &&
+            location.size() >= graph_location_min_size);
+  };
+  absl::flat_hash_map<int64, std::vector<int64>> graph_location_members;
+  for (const LocationProto& location : synthetic->locations) {
+    if (is_graph_location(location)) {
+      graph_location_members[location.uuid()].reserve(location.size());
+    }
+  }
+  std::mt19937_64 gen(benchmark::Seed());
+  population->agents.reserve(synthetic->num_agents);
+  for (int64 i = 0; i < synthetic->num_agents; ++i) {
+    const AgentProto agent = synthetic->agents->Next();
+    std::vector<LocationDuration> durations;
+    for (const LocationProto& location : agent.locations()) {
+      switch (location.type()) {
+        case LocationProto::BUSINESS:
+          durations.push_back({location.uuid(), HoursSampler(8, gen())});
+          break;
+        case LocationProto::SOCIAL:
+          durations.push_back({location.uuid(), HoursSampler(2, gen())});
+          break;
+        default:
+          durations.push_back({location.uuid(), HoursSampler(14, gen())});
+          break;
+      }
+      auto members = graph_location_members.find(location.uuid());
+      if (members != graph_location_members.end()) {
+        members->second.push_back(agent.uuid());
+      }
+    }
+    population->AddAgent(agent.uuid(), kStart, agent.initial_health_state(),
+                         std::move(durations));
+  }
+  population->locations.reserve(synthetic->locations.size());
+  for (const LocationProto& location : synthetic->locations) {
+    if (!is_graph_location(location)) {
+      population->locations.push_back(
+          absl::make_unique<LocationDiscreteEventSimulator>(location.uuid()));
+      continue;
+    }
+    // Connects each member to the next kGraphDegree / 2 members.
+    const std::vector<int64>& members = graph_location_members[location.uuid()];
+    std::vector<std::pair<int64, int64>> graph;
+    for (int64 j = 0; j < members.size(); ++j) {
+      for (int64 k = 1; k <= kGraphDegree / 2 && k < members.size(); ++k) {
+        graph.emplace_back(members[j], members[(j + k) % members.size()]);
+      }
+    }
+    population->locations.push_back(NewGraphLocation(
+        location.uuid(), kGraphDropProbability, std::move(graph)));
+  }
+  return population;
+}
+
+// Steps a simulation of range(0) agents with range(1) workers.
+void BM_ParallelStep(benchmark::State& state) {
+  const int64 num_agents = state.range(0);
+  const int num_workers = state.range(1);
+  auto population = MakePopulation(num_agents);
+  auto simulation =
+      ParallelSimulation(kStart, std::move(population->agents),
+                         std::move(population->locations), num_workers);
+  while (state.KeepRunning()) {
+    simulation->Step(1, kStepDuration);
+  }
+  state.SetItemsProcessed(state.iterations() * num_agents);
+  state.SetCounter("workers", num_workers);
+  state.SetCounter("agents_per_worker",
+                   static_cast<double>(num_agents) / num_workers);
+}
+
+}  // namespace
+
+int Main() {
+  const int max_workers =
+      absl::GetFlag(FLAGS_max_workers) > 0
+          ? absl::GetFlag(FLAGS_max_workers)
+          : std::max<int>(1, std::thread::hardware_concurrency());
+  std::vector<int64> workers;
+  for (int64 n = 1; n < max_workers; n *= 2) workers.push_back(n);
+  workers.push_back(max_workers);
+  const int64 max_agents = absl::GetFlag(FLAGS_max_agents);
+  auto steps = [](const std::vector<int64>& args) {
+    return std::max<int64>(3, 1000000 / args[0]);
+  };
+  auto& strong = benchmark::Register("BM_StrongScaling", BM_ParallelStep);
+  auto& weak = benchmark::Register("BM_WeakScaling", BM_ParallelStep);
+  for (const int64 n : workers) {
+    strong.Args({max_agents, n});
+    weak.Args({max_agents / max_workers * n, n});
+  }
+  strong.Iterations(steps);
+  weak.Iterations(steps);
+  return benchmark::RunRegistered();
+}
+
+}  // namespace abesim
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  abesim::benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  return abesim::Main();
+}
@@ -0,0 +1,330 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks steps of the serial and parallel simulations, the routing and
+// sorting of messages between steps, and the observers.
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/memory/memory.h"
+#include "absl/random/distributions.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/benchmarks/benchmark.h"
+#include "agent_based_epidemic_sim/benchmarks/benchmark_fixtures.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+ABSL_FLAG(int64, max_agents, 1000000,
+          "The largest population to simulate.  Populations of up to 1e7 "
+          "agents are benchmarked if allowed, which needs several GB.");
+ABSL_FLAG(int, num_workers, 0,
+          "The workers of the parallel simulation, or 0 for one per CPU.");
+
+namespace abesim {
+namespace {
+
+constexpr int kHouseholdSize = 4;
+constexpr int kWorkplaceSize = 20;
+constexpr float kInitialInfectiousFraction = 0.01;
+constexpr absl::Duration kStepDuration = absl::Hours(24);
+const absl::Time kStart = absl::FromUnixSeconds(0);
+
+// A home-work population of SEIR agents.
+std::unique_ptr<BenchmarkPopulation> MakePopulation(const int64 num_agents) {
+  auto population = NewBenchmarkPopulation();
+
+  const int64 num_households =
+      (num_agents + kHouseholdSize - 1) / kHouseholdSize;
+  const int64 num_workplaces =
+      (num_agents + kWorkplaceSize - 1) / kWorkplaceSize;
+  population->locations.reserve(num_households + num_workplaces);
+  for (int64 uuid = 0; uuid < num_households + num_workplaces; ++uuid) {
+    population->locations.push_back(
+        absl::make_unique<LocationDiscreteEventSimulator>(uuid));
+  }
+  std::mt19937_64 gen(benchmark::Seed());
+  population->agents.reserve(num_agents);
+  for (int64 i = 0; i < num_agents; ++i) {
+    const int64 uuid = num_households + num_workplaces + i;
+    std::vector<LocationDuration> durations = {
+        {.location_uuid = i / kHouseholdSize,
+         .sample_duration = HoursSampler(16, gen())},
+        {.location_uuid =
+             num_households + absl::Uniform<int64>(gen, 0, num_workplaces),
+         .sample_duration = HoursSampler(8, gen())}};
+    const HealthState::State health_state =
+        absl::Bernoulli(gen, kInitialInfectiousFraction)
+            ? HealthState::INFECTIOUS
+            : HealthState::SUSCEPTIBLE;
+    population->AddAgent(uuid, kStart, health_state, std::move(durations));
+  }
+  return population;
+}
+
+int NumWorkers() {
+  const int num_workers = absl::GetFlag(FLAGS_num_workers);
+  return num_workers > 0
+             ? num_workers
+             : std::max<int>(1, std::thread::hardware_concurrency());
+}
+
+// Counts the visits per location in a histogram.
+class VisitHistogramObserver : public LocationVisitObserver {
+ public:
+  void Observe(const Location& location,
+               absl::Span<const Visit> visits) override {
+    if (histogram_.size() <= visits.size()) {
+      histogram_.resize(visits.size() + 1);
+    }
+    ++histogram_[visits.size()];
+  }
+  void Reset() { std::fill(histogram_.begin(), histogram_.end(), 0); }
+
+ private:
+  friend class VisitHistogramObserverFactory;
+  std::vector<int64> histogram_;
+};
+
+class VisitHistogramObserverFactory
+    : public ObserverFactory<VisitHistogramObserver> {
+ public:
+  std::unique_ptr<VisitHistogramObserver> MakeObserver() const override {
+    return absl::make_unique<VisitHistogramObserver>();
+  }
+  bool ResetObserver(VisitHistogramObserver* observer) const override {
+    observer->Reset();
+    return true;
+  }
+  void Aggregate(const Timestep& timestep,
+                 absl::Span<std::unique_ptr<VisitHistogramObserver> const>
+                     observers) override {
+    for (const auto& observer : observers) {
+      if (histogram_.size() < observer->histogram_.size()) {
+        histogram_.resize(observer->histogram_.size());
+      }
+      for (int i = 0; i < observer->histogram_.size(); ++i) {
+        histogram_[i] += observer->histogram_[i];
+      }
+    }
+  }
+
+ private:
+  std::vector<int64> histogram_;
+};
+
+// Counts the infection outcomes per agent.
+class OutcomeCountObserver : public AgentInfectionObserver {
+ public:
+  void Observe(const Agent& agent,
+               absl::Span<const InfectionOutcome> outcomes) override {
+    outcomes_ += outcomes.size();
+  }
+  void Reset() { outcomes_ = 0; }
+
+ private:
+  friend class OutcomeCountObserverFactory;
+  int64 outcomes_ = 0;
+};
+
+class OutcomeCountObserverFactory
+    : public ObserverFactory<OutcomeCountObserver> {
+ public:
+  std::unique_ptr<OutcomeCountObserver> MakeObserver() const override {
+    return absl::make_unique<OutcomeCountObserver>();
+  }
+  bool ResetObserver(OutcomeCountObserver* observer) const override {
+    observer->Reset();
+    return true;
+  }
+  void Aggregate(const Timestep& timestep,
+                 absl::Span<std::unique_ptr<OutcomeCountObserver> const>
+                     observers) override {
+    for (const auto& observer : observers) outcomes_ += observer->outcomes_;
+  }
+
+ private:
+  int64 outcomes_ = 0;
+};
+
+void RunSteps(benchmark::State& state, Simulation* const simulation) {
+  while (state.KeepRunning()) {
+    simulation->Step(1, kStepDuration);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_SerialStep(benchmark::State& state) {
+  auto population = MakePopulation(state.range(0));
+  auto simulation = SerialSimulation(kStart, std::move(population->agents),
+                                     std::move(population->locations));
+  RunSteps(state, simulation.get());
+}
+
+void BM_ParallelStep(benchmark::State& state) {
+  auto population = MakePopulation(state.range(0));
+  auto simulation =
+      ParallelSimulation(kStart, std::move(population->agents),
+                         std::move(population->locations), NumWorkers());
+  state.SetCounter("workers", NumWorkers());
+  RunSteps(state, simulation.get());
+}
+
+void BM_SerialStepObserved(benchmark::State& state) {
+  auto population = MakePopulation(state.range(0));
+  auto simulation = SerialSimulation(kStart, std::move(population->agents),
+                                     std::move(population->locations));
+  VisitHistogramObserverFactory visits;
+  OutcomeCountObserverFactory outcomes;
+  simulation->AddObserverFactory(&visits);
+  simulation->AddObserverFactory(&outcomes);
+  RunSteps(state, simulation.get());
+}
+
+// Observes one visit per agent at locations of kHouseholdSize agents through
+// an ObserverManager, including the aggregation at the end of the step.
+void BM_ObserverManager(benchmark::State& state) {
+  const int64 num_locations = state.range(0) / kHouseholdSize;
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int64 uuid = 0; uuid < num_locations; ++uuid) {
+    locations.push_back(
+        absl::make_unique<LocationDiscreteEventSimulator>(uuid));
+  }
+  std::vector<Visit> visits(kHouseholdSize);
+  VisitHistogramObserverFactory factory;
+  ObserverManager manager;
+  manager.AddFactory(&factory);
+  Timestep timestep(kStart, kStepDuration);
+  while (state.KeepRunning()) {
+    ObserverShard* const shard = manager.GetShard(0);
+    for (const auto& location : locations) {
+      shard->Observe(*location, visits);
+    }
+    manager.AggregateForTimestep(timestep);
+    timestep.Advance();
+  }
+  state.SetItemsProcessed(state.iterations() * num_locations);
+}
+
+std::vector<Visit> RandomVisits(const int64 num_visits,
+                                const int64 num_locations) {
+  std::mt19937_64 gen(benchmark::Seed());
+  std::vector<Visit> visits(num_visits);
+  for (int64 i = 0; i < num_visits; ++i) {
+    visits[i] = {
+        .location_uuid = absl::Uniform<int64>(gen, 0, num_locations),
+        .agent_uuid = i,
+        .start_time = kStart,
+        .end_time = kStart + kStepDuration,
+        .health_state = HealthState::SUSCEPTIBLE,
+    };
+  }
+  return visits;
+}
+
+// Sorts the visits of a step by destination, as the simulations do before
+// handing them to locations.
+void BM_SortVisits(benchmark::State& state) {
+  const std::vector<Visit> visits =
+      RandomVisits(state.range(0), state.range(0) / kHouseholdSize + 1);
+  std::vector<Visit> sorted;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    sorted = visits;
+    state.ResumeTiming();
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Visit& a, const Visit& b) {
+                return a.location_uuid < b.location_uuid;
+              });
+  }
+  state.SetItemsProcessed(state.iterations() * visits.size());
+}
+
+class DiscardingBroker : public Broker<Visit> {
+ public:
+  void Send(const absl::Span<const Visit> msgs) override {
+    received_ += msgs.size();
+    benchmark::DoNotOptimize(msgs.data());
+  }
+
+ private:
+  int64 received_ = 0;
+};
+
+// Routes the two daily visits of 1e5 agents through a BufferingBroker with the
+// given buffer size.
+void BM_BufferingBroker(benchmark::State& state) {
+  const std::vector<Visit> visits = RandomVisits(200000, 50000);
+  DiscardingBroker receiver;
+  BufferingBroker<Visit> broker(state.range(0), &receiver);
+  while (state.KeepRunning()) {
+    for (int64 i = 0; i < visits.size(); i += 2) {
+      broker.Send(absl::MakeConstSpan(&visits[i], 2));
+    }
+    broker.Flush();
+  }
+  state.SetItemsProcessed(state.iterations() * visits.size());
+}
+
+}  // namespace
+
+int Main() {
+  std::vector<int64> populations;
+  for (int64 n = 10000; n <= absl::GetFlag(FLAGS_max_agents); n *= 10) {
+    populations.push_back(n);
+  }
+  // Steps of large populations take long and are expensive to set up, so
+  // their iteration counts are fixed.
+  auto steps = [](const std::vector<int64>& args) {
+    return std::max<int64>(3, 1000000 / args[0]);
+  };
+  benchmark::Register("BM_SerialStep", BM_SerialStep)
+      .Range(populations)
+      .Iterations(steps);
+  benchmark::Register("BM_ParallelStep", BM_ParallelStep)
+      .Range(populations)
+      .Iterations(steps);
+  benchmark::Register("BM_SerialStepObserved", BM_SerialStepObserved)
+      .Range(populations)
+      .Iterations(steps);
+  benchmark::Register("BM_ObserverManager", BM_ObserverManager)
+      .Range(populations);
+  benchmark::Register("BM_SortVisits", BM_SortVisits).Range(populations);
+  benchmark::Register("BM_BufferingBroker", BM_BufferingBroker)
+      .Range({1, 64, 1024, 16384});
+  return benchmark::RunRegistered();
+}
+
+}  // namespace abesim
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  abesim::benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  return abesim::Main();
+}
@@ -22,6 +22,7 @@
 #include "agent_based_epidemic_sim/core/broker.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/core/visit.h"
@@ -83,6 +84,10 @@ class Agent {
 
   virtual absl::Span<const HealthTransition> HealthTransitions() const = 0;
 
+  // Adds the memory held by the agent to usage, under "agents/<part>".  The
+  // default adds nothing.
+  virtual void AddMemoryUsage(MemoryUsage* usage) const {}
+
   virtual ~Agent() = default;
 };
 
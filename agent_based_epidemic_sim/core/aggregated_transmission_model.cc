@@ -14,6 +14,8 @@
 
 #include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
 
+#include <algorithm>
+
 #include "absl/random/distributions.h"
 
 namespace abesim {
@@ -44,7 +46,9 @@ HealthTransition AggregatedTransmissionModel::GetInfectionOutcome(
       sum_exposures += ProbabilityExposureInfects(*exposure, transmissibility_);
     }
   }
-  const float prob_infection = 1 - std::exp(sum_exposures);
+  // kEpsilon makes sum_exposures slightly positive when no exposure carries
+  // any risk, e.g. for the zero-duration contacts of graph locations.
+  const float prob_infection = std::max(0.0f, 1 - std::exp(sum_exposures));
   HealthTransition health_transition;
   health_transition.time = latest_exposure_time;
   health_transition.health_state = absl::Bernoulli(gen_, prob_infection)
@@ -49,5 +49,19 @@ TEST(AggregatedTransmissionModelTest, GetsInfectionOutcomes) {
                                   .health_state = HealthState::SUSCEPTIBLE}));
 }
 
+TEST(AggregatedTransmissionModelTest, RiskFreeExposuresDoNotInfect) {
+  // Zero-duration exposures, such as the contacts of graph locations, make
+  // the sum of exposures slightly positive through the epsilon of the model.
+  std::vector<Exposure> exposures(
+      1000, {.duration = absl::ZeroDuration(), .infectivity = 1});
+  AggregatedTransmissionModel transmission_model(/*transmissibility=*/1);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(
+        transmission_model.GetInfectionOutcome(MakePointers(exposures))
+            .health_state,
+        HealthState::SUSCEPTIBLE);
+  }
+}
+
 }  // namespace
 }  // namespace abesim
@@ -20,6 +20,7 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 
 namespace abesim {
 
@@ -52,6 +53,8 @@ class BufferingBroker : public Broker<Msg> {
     buffer_.clear();
   }
 
+  int64 MemoryUsage() const { return buffer_.capacity() * sizeof(Msg); }
+
  private:
   const int buffer_size_;
   std::vector<Msg> buffer_;
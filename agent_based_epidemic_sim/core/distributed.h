@@ -17,10 +17,14 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_DISTRIBUTED_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_DISTRIBUTED_H_
 
+#include <algorithm>
 #include <functional>
+#include <string>
+#include <vector>
 
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 
 namespace abesim {
 
@@ -36,12 +40,41 @@ class DistributedMessenger : public Broker<Msg> {
   // remote node, false if the message should be processed locally.
   virtual bool IsMessageRemote(const Msg& msg) const = 0;
 
+  // Nodes are numbered from 0 to num_nodes() - 1, and messages destined for
+  // local_node() are processed locally.
+  virtual int num_nodes() const = 0;
+  virtual int local_node() const = 0;
+
+  // Sets nodes[i] to the node msgs[i] is destined for.  This is the batch
+  // form of IsMessageRemote, and nodes has the size of msgs.
+  virtual void DestinationNodes(absl::Span<const Msg> msgs,
+                                absl::Span<int> nodes) const = 0;
+
+  // Sends msgs, which are all destined for node, without classifying them
+  // again.  Send is for batches whose destinations are not known.
+  virtual void SendToNode(int node, absl::Span<const Msg> msgs) {
+    this->Send(msgs);
+  }
+
   // Supply a broker that should receive messages coming in from remote nodes.
+  // Must not be called while a previous phase is still awaited.
   virtual void SetReceiveBrokerForNextPhase(Broker<Msg>* broker) = 0;
 
-  // Wait for all messages from remote nodes to be sent to the ReceiveBroker
-  // and finish sending all messages destined for remote nodes.
-  virtual void FlushAndAwaitRemotes() = 0;
+  // Finish sending all messages destined for remote nodes in this phase.
+  // Messages sent afterwards belong to the next phase.
+  virtual void Flush() = 0;
+
+  // Wait for all messages from remote nodes for the oldest phase not yet
+  // awaited to be sent to the ReceiveBroker.  Remote nodes only complete a
+  // phase once they flush it, so the local node must have flushed it too.
+  // Awaiting as late as the messages are needed lets their transfer overlap
+  // with local work.
+  virtual void AwaitRemotes() = 0;
+
+  void FlushAndAwaitRemotes() {
+    Flush();
+    AwaitRemotes();
+  }
 };
 
 // A DistributedManager manages the communication infrastructure for interacting
@@ -52,43 +85,106 @@ class DistributedManager {
   virtual DistributedMessenger<ContactReport>* ContactReportMessenger() = 0;
   virtual DistributedMessenger<InfectionOutcome>* OutcomeMessenger() = 0;
 
+  // Sends outgoing[node] to each other node and returns the data each node
+  // sent to the local node, indexed by node, with the local node's own entry
+  // passed through.  This coordinates nodes between steps, so every node must
+  // make the same sequence of calls, each of which blocks until the data of
+  // all nodes arrived.
+  virtual std::vector<std::string> Exchange(
+      std::vector<std::string> outgoing) = 0;
+
   virtual ~DistributedManager() = default;
 };
 
 // DistributingBroker splits its incoming message stream, sending those destined
 // for local processing to a local Broker and the rest to a
 // DistributedMessenger.  To avoid sending many small batches to its targets,
-// this broker also buffers data up to a given size. Users can call Flush to
-// send buffered data early.
+// this broker also buffers data up to a given size per destination node, so
+// that each batch sent to the DistributedMessenger is destined for a single
+// node.  Users can call Flush to send buffered data early.
 template <typename Msg>
 class DistributingBroker : public Broker<Msg> {
  public:
   explicit DistributingBroker(const int buffer_size,
                               DistributedMessenger<Msg>* distributed_messenger,
                               Broker<Msg>* local_broker)
-      : distributed_messenger_(distributed_messenger),
-        buffering_remote_(buffer_size, distributed_messenger),
-        buffering_local_(buffer_size, local_broker) {}
+      : buffer_size_(buffer_size),
+        local_node_(distributed_messenger->local_node()),
+        distributed_messenger_(distributed_messenger),
+        local_broker_(local_broker),
+        buffers_(distributed_messenger->num_nodes()),
+        counts_(distributed_messenger->num_nodes()) {}
 
   void Send(absl::Span<const Msg> msgs) override {
-    for (const Msg& msg : msgs) {
-      if (distributed_messenger_->IsMessageRemote(msg)) {
-        buffering_remote_.Send(absl::MakeConstSpan(&msg, 1));
-      } else {
-        buffering_local_.Send(absl::MakeConstSpan(&msg, 1));
+    if (msgs.empty()) return;
+    nodes_.resize(msgs.size());
+    distributed_messenger_->DestinationNodes(msgs, absl::MakeSpan(nodes_));
+    // Messages are counted per node so that each buffer grows at most once,
+    // and batches destined for a single node are copied in bulk.
+    std::fill(counts_.begin(), counts_.end(), 0);
+    for (const int node : nodes_) ++counts_[node];
+    remote_messages_ += msgs.size() - counts_[local_node_];
+    if (counts_[nodes_[0]] == msgs.size()) {
+      std::vector<Msg>& buffer = buffers_[nodes_[0]];
+      buffer.insert(buffer.end(), msgs.begin(), msgs.end());
+    } else {
+      for (int node = 0; node < buffers_.size(); ++node) {
+        if (counts_[node] == 0) continue;
+        // counts_ now holds the index the node's next message is written to.
+        const size_t size = buffers_[node].size();
+        buffers_[node].resize(size + counts_[node]);
+        counts_[node] = size;
       }
+      for (int i = 0; i < msgs.size(); ++i) {
+        buffers_[nodes_[i]][counts_[nodes_[i]]++] = msgs[i];
+      }
+    }
+    for (int node = 0; node < buffers_.size(); ++node) {
+      if (buffers_[node].size() >= buffer_size_) Flush(node);
     }
   }
 
   void Flush() {
-    buffering_local_.Flush();
-    buffering_remote_.Flush();
+    for (int node = 0; node < buffers_.size(); ++node) {
+      if (!buffers_[node].empty()) Flush(node);
+    }
+  }
+
+  int64 MemoryUsage() const {
+    int64 bytes = nodes_.capacity() * sizeof(int);
+    for (const std::vector<Msg>& buffer : buffers_) {
+      bytes += buffer.capacity() * sizeof(Msg);
+    }
+    return bytes;
+  }
+
+  // Returns the number of messages sent to remote nodes since the last call.
+  int64 TakeRemoteMessageCount() {
+    const int64 remote_messages = remote_messages_;
+    remote_messages_ = 0;
+    return remote_messages;
   }
 
  private:
-  const DistributedMessenger<Msg>* const distributed_messenger_;
-  BufferingBroker<Msg> buffering_remote_;
-  BufferingBroker<Msg> buffering_local_;
+  void Flush(const int node) {
+    if (node == local_node_) {
+      local_broker_->Send(buffers_[node]);
+    } else {
+      distributed_messenger_->SendToNode(node, buffers_[node]);
+    }
+    buffers_[node].clear();
+  }
+
+  const int buffer_size_;
+  const int local_node_;
+  DistributedMessenger<Msg>* const distributed_messenger_;
+  Broker<Msg>* const local_broker_;
+  int64 remote_messages_ = 0;
+  // Indexed by node.
+  std::vector<std::vector<Msg>> buffers_;
+  // Scratch space for Send.
+  std::vector<int> nodes_;
+  std::vector<size_t> counts_;
 };
 
 }  // namespace abesim
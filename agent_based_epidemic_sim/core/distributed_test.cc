@@ -0,0 +1,132 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/distributed.h"
+
+#include <vector>
+
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::Each;
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::SizeIs;
+
+constexpr int kNumNodes = 3;
+constexpr int kLocalNode = 1;
+
+int Node(const Visit& visit) { return visit.location_uuid % kNumNodes; }
+
+class CollectingBroker : public Broker<Visit> {
+ public:
+  void Send(absl::Span<const Visit> visits) override {
+    batches.emplace_back(visits.begin(), visits.end());
+  }
+  std::vector<std::vector<Visit>> batches;
+};
+
+// Routes visits by location uuid, collecting the batches sent to it.
+class FakeMessenger : public DistributedMessenger<Visit> {
+ public:
+  bool IsMessageRemote(const Visit& visit) const override {
+    return Node(visit) != kLocalNode;
+  }
+  int num_nodes() const override { return kNumNodes; }
+  int local_node() const override { return kLocalNode; }
+  void DestinationNodes(absl::Span<const Visit> visits,
+                        absl::Span<int> nodes) const override {
+    for (int i = 0; i < visits.size(); ++i) nodes[i] = Node(visits[i]);
+  }
+  void SetReceiveBrokerForNextPhase(Broker<Visit>* broker) override {}
+  void Flush() override {}
+  void AwaitRemotes() override {}
+  void Send(absl::Span<const Visit> visits) override { sent.Send(visits); }
+  void SendToNode(const int node, absl::Span<const Visit> visits) override {
+    sent_nodes.push_back(node);
+    sent.Send(visits);
+  }
+
+  CollectingBroker sent;
+  // The node passed to SendToNode for each batch.
+  std::vector<int> sent_nodes;
+};
+
+std::vector<Visit> Visits(const int begin, const int end) {
+  std::vector<Visit> visits;
+  for (int i = begin; i < end; ++i) {
+    visits.push_back({.location_uuid = i, .agent_uuid = i});
+  }
+  return visits;
+}
+
+std::vector<int> Nodes(const std::vector<Visit>& batch) {
+  std::vector<int> nodes;
+  for (const Visit& visit : batch) nodes.push_back(Node(visit));
+  return nodes;
+}
+
+TEST(DistributingBrokerTest, SendsBatchesGroupedByNode) {
+  FakeMessenger messenger;
+  CollectingBroker local;
+  DistributingBroker<Visit> broker(/*buffer_size=*/4, &messenger, &local);
+
+  // 3 visits per node, below the buffer size.
+  broker.Send(Visits(0, 9));
+  EXPECT_THAT(local.batches, IsEmpty());
+  EXPECT_THAT(messenger.sent.batches, IsEmpty());
+  // Fills the buffers of nodes 0 and 1 but not 2.
+  broker.Send(Visits(9, 11));
+  ASSERT_THAT(local.batches, SizeIs(1));
+  EXPECT_THAT(Nodes(local.batches[0]), ElementsAre(1, 1, 1, 1));
+  ASSERT_THAT(messenger.sent.batches, SizeIs(1));
+  EXPECT_THAT(Nodes(messenger.sent.batches[0]), ElementsAre(0, 0, 0, 0));
+  // Messages keep their order within a node.
+  EXPECT_EQ(messenger.sent.batches[0][0].location_uuid, 0);
+  EXPECT_EQ(messenger.sent.batches[0][3].location_uuid, 9);
+
+  broker.Flush();
+  ASSERT_THAT(messenger.sent.batches, SizeIs(2));
+  EXPECT_THAT(Nodes(messenger.sent.batches[1]), Each(2));
+  EXPECT_THAT(messenger.sent.batches[1], SizeIs(3));
+  EXPECT_EQ(broker.TakeRemoteMessageCount(), 7);
+  EXPECT_EQ(broker.TakeRemoteMessageCount(), 0);
+
+  // Nothing is left to flush.
+  broker.Flush();
+  EXPECT_THAT(local.batches, SizeIs(1));
+  EXPECT_THAT(messenger.sent.batches, SizeIs(2));
+  EXPECT_THAT(messenger.sent_nodes, ElementsAre(0, 2));
+}
+
+TEST(DistributingBrokerTest, SendsSingleNodeBatchesInBulk) {
+  FakeMessenger messenger;
+  CollectingBroker local;
+  DistributingBroker<Visit> broker(/*buffer_size=*/2, &messenger, &local);
+  broker.Send({{.location_uuid = 1}, {.location_uuid = 4},
+               {.location_uuid = 7}});
+  ASSERT_THAT(local.batches, SizeIs(1));
+  EXPECT_THAT(local.batches[0], SizeIs(3));
+  EXPECT_THAT(messenger.sent.batches, IsEmpty());
+  EXPECT_EQ(broker.TakeRemoteMessageCount(), 0);
+}
+
+}  // namespace
+}  // namespace abesim
@@ -24,6 +24,7 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/random/discrete_distribution.h"
 #include "absl/random/random.h"
+#include "absl/types/optional.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/parameter_distribution.pb.h"
 #include "agent_based_epidemic_sim/port/logging.h"
@@ -37,7 +38,14 @@ template <typename T>
 class DiscreteDistributionSampler {
  public:
   // Returns a value sampled from the distribution.
-  T Sample() { return values_[distribution_(gen_)]; }
+  T Sample() {
+    return values_[seeded_gen_.has_value() ? distribution_(*seeded_gen_)
+                                           : distribution_(gen_)];
+  }
+
+  // Reseeds the random generator, making the following samples deterministic.
+  // A standard engine is used, since absl::BitGen salts its seeds per process.
+  void Seed(const uint64 seed) { seeded_gen_.emplace(seed); }
 
   // Creates a DiscreteDistributionSampler from the given distribution.
   static std::unique_ptr<DiscreteDistributionSampler<T>> FromProto(
@@ -58,6 +66,7 @@ class DiscreteDistributionSampler {
   static auto ValueGetter();
 
   absl::BitGen gen_;
+  absl::optional<std::mt19937_64> seeded_gen_;
   const std::vector<T> values_;
   absl::discrete_distribution<int> distribution_;
 };
@@ -18,6 +18,7 @@
 #include "absl/random/distributions.h"
 #include "absl/random/random.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 
 namespace abesim {
 
@@ -33,6 +34,11 @@ class GraphLocation : public Location {
 
   int64 uuid() const override { return uuid_; }
 
+  void AddMemoryUsage(MemoryUsage* const usage) const override {
+    usage->Add("locations/objects", sizeof(*this));
+    usage->Add("locations/graphs", VectorMemoryUsage(graph_));
+  }
+
   void ProcessVisits(absl::Span<const Visit> visits,
                      Broker<InfectionOutcome>* infection_broker) override {
     thread_local absl::flat_hash_map<int64, float> infectivity;
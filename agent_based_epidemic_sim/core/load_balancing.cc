@@ -0,0 +1,135 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/load_balancing.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/raw_coding.h"
+
+namespace abesim {
+namespace {
+
+// The load a node hands over or takes over.
+struct Share {
+  int node;
+  double load;
+};
+
+void SortByLoad(std::vector<Share>* const shares) {
+  std::sort(shares->begin(), shares->end(),
+            [](const Share& a, const Share& b) {
+              return a.load != b.load ? a.load > b.load : a.node < b.node;
+            });
+}
+
+void AppendEntities(const std::vector<MigrationBatch::Entity>& entities,
+                    std::string* const data) {
+  AppendRaw<uint64>(entities.size(), data);
+  for (const MigrationBatch::Entity& entity : entities) {
+    AppendRaw(entity.uuid, data);
+    AppendRawString(entity.state, data);
+  }
+}
+
+bool ReadEntities(RawReader* const reader,
+                  std::vector<MigrationBatch::Entity>* const entities) {
+  uint64 size;
+  if (!reader->Read(&size)) return false;
+  for (uint64 i = 0; i < size; ++i) {
+    MigrationBatch::Entity entity;
+    absl::string_view state;
+    if (!reader->Read(&entity.uuid) || !reader->ReadString(&state)) {
+      return false;
+    }
+    entity.state = std::string(state);
+    entities->push_back(std::move(entity));
+  }
+  return true;
+}
+
+}  // namespace
+
+std::vector<LoadTransfer> PlanLoadTransfers(
+    const absl::Span<const double> loads,
+    const LoadBalancingOptions& options) {
+  double total = 0;
+  for (const double load : loads) total += load;
+  if (loads.size() < 2 || total <= 0) return {};
+  const double mean = total / loads.size();
+  if (*std::max_element(loads.begin(), loads.end()) <=
+      mean * options.max_imbalance) {
+    return {};
+  }
+  std::vector<Share> senders;
+  std::vector<Share> receivers;
+  for (int node = 0; node < loads.size(); ++node) {
+    if (loads[node] > mean) {
+      senders.push_back(
+          {node, std::min(loads[node] - mean,
+                          loads[node] * options.max_migration_fraction)});
+    } else if (loads[node] < mean) {
+      receivers.push_back({node, mean - loads[node]});
+    }
+  }
+  SortByLoad(&senders);
+  SortByLoad(&receivers);
+  // The largest surpluses fill the largest deficits first.
+  std::vector<LoadTransfer> transfers;
+  int receiver = 0;
+  for (Share& sender : senders) {
+    while (sender.load > 0 && receiver < receivers.size()) {
+      const double load = std::min(sender.load, receivers[receiver].load);
+      transfers.push_back({.from_node = sender.node,
+                           .to_node = receivers[receiver].node,
+                           .fraction = load / loads[sender.node]});
+      sender.load -= load;
+      receivers[receiver].load -= load;
+      if (receivers[receiver].load <= 0) ++receiver;
+    }
+  }
+  return transfers;
+}
+
+std::string EncodeMigrationBatch(const MigrationBatch& batch) {
+  std::string data;
+  AppendRawSpan<MigrationBatch::Move>(batch.agent_moves, &data);
+  AppendRawSpan<MigrationBatch::Move>(batch.location_moves, &data);
+  AppendEntities(batch.agents, &data);
+  AppendEntities(batch.locations, &data);
+  AppendRawSpan<InfectionOutcome>(batch.outcomes, &data);
+  AppendRawSpan<ContactReport>(batch.reports, &data);
+  return data;
+}
+
+StatusOr<MigrationBatch> DecodeMigrationBatch(const absl::string_view data) {
+  MigrationBatch batch;
+  RawReader reader(data);
+  if (!reader.ReadVector(&batch.agent_moves) ||
+      !reader.ReadVector(&batch.location_moves) ||
+      !ReadEntities(&reader, &batch.agents) ||
+      !ReadEntities(&reader, &batch.locations) ||
+      !reader.ReadVector(&batch.outcomes) ||
+      !reader.ReadVector(&batch.reports) || !reader.empty()) {
+    return absl::InvalidArgumentError("Invalid migration batch");
+  }
+  return batch;
+}
+
+}  // namespace abesim
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_LOAD_BALANCING_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_LOAD_BALANCING_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/partition.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+namespace abesim {
+
+// Moves agents and locations between the nodes of a distributed simulation.
+// The node giving up an entity saves its state, and the node taking it over
+// rebuilds it from its uuid and that state, so every node must be able to
+// build any entity of the population.
+class Migrator {
+ public:
+  virtual ~Migrator() = default;
+
+  // Called as an entity leaves the local node, which destroys it afterwards.
+  virtual std::string SaveAgent(const Agent& agent) = 0;
+  virtual std::string SaveLocation(const Location& location) = 0;
+
+  virtual StatusOr<std::unique_ptr<Agent>> RestoreAgent(
+      int64 uuid, absl::string_view state) = 0;
+  virtual StatusOr<std::unique_ptr<Location>> RestoreLocation(
+      int64 uuid, absl::string_view state) = 0;
+};
+
+// Dynamic load balancing of a distributed simulation, see
+// ParallelDistributedSimulation.  Between steps, the nodes exchange the time
+// they spent computing their phases, excluding waits for other nodes.  When
+// the slowest node exceeds the mean by more than max_imbalance, the nodes
+// above the mean hand part of their agents and locations to the nodes below
+// it.  Every node computes the same transfers from the same loads.
+struct LoadBalancingOptions {
+  // Load balancing is disabled unless both are set.
+  Migrator* migrator = nullptr;
+  // The partition of the DistributedManager, which is updated on all nodes.
+  RoutingTable* routing_table = nullptr;
+  // The number of steps whose load is measured before each rebalancing.
+  int interval = 1;
+  float max_imbalance = 1.25f;
+  // The most of a node's load handed over at once.  Loads are estimated from
+  // past steps, so moving less at a time avoids overshooting.
+  float max_migration_fraction = 0.1f;
+};
+
+// A part of the load of one node to hand over to another.
+struct LoadTransfer {
+  int from_node;
+  int to_node;
+  // The fraction of from_node's load.
+  double fraction;
+};
+
+// Returns the transfers that move the load of nodes more than max_imbalance
+// above the mean to the nodes below it, or none if no node is.
+std::vector<LoadTransfer> PlanLoadTransfers(
+    absl::Span<const double> loads, const LoadBalancingOptions& options);
+
+// The agents and locations one node hands over to another in a rebalancing,
+// along with the messages already queued for those agents.
+struct MigrationBatch {
+  struct Move {
+    int64 uuid;
+    int node;
+  };
+  struct Entity {
+    int64 uuid;
+    std::string state;
+  };
+  // Every move made by the sending node, including those to other nodes, so
+  // that all nodes update their routing tables alike.
+  std::vector<Move> agent_moves;
+  std::vector<Move> location_moves;
+  // The entities handed to the receiving node.
+  std::vector<Entity> agents;
+  std::vector<Entity> locations;
+  std::vector<InfectionOutcome> outcomes;
+  std::vector<ContactReport> reports;
+};
+
+std::string EncodeMigrationBatch(const MigrationBatch& batch);
+StatusOr<MigrationBatch> DecodeMigrationBatch(absl::string_view data);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_LOAD_BALANCING_H_
@@ -0,0 +1,105 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/load_balancing.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::AllOf;
+using testing::DoubleNear;
+using testing::ElementsAre;
+using testing::Field;
+using testing::IsEmpty;
+
+testing::Matcher<LoadTransfer> Transfer(const int from_node, const int to_node,
+                                        const double fraction) {
+  return AllOf(Field(&LoadTransfer::from_node, from_node),
+               Field(&LoadTransfer::to_node, to_node),
+               Field(&LoadTransfer::fraction, DoubleNear(fraction, 1e-6)));
+}
+
+TEST(LoadBalancingTest, KeepsLoadsWithinImbalance) {
+  const LoadBalancingOptions options = {.max_imbalance = 1.25f};
+  EXPECT_THAT(PlanLoadTransfers({1.0, 1.2, 0.8}, options), IsEmpty());
+  EXPECT_THAT(PlanLoadTransfers({0.0, 0.0}, options), IsEmpty());
+  EXPECT_THAT(PlanLoadTransfers({5.0}, options), IsEmpty());
+}
+
+TEST(LoadBalancingTest, MovesSurplusToNodesBelowMean) {
+  const LoadBalancingOptions options = {.max_imbalance = 1.25f,
+                                        .max_migration_fraction = 1.0f};
+  // The mean is 2, node 3 has a surplus of 4 and node 1 of 1.
+  EXPECT_THAT(PlanLoadTransfers({0.5, 3.0, 0.5, 6.0, 0.0}, options),
+              ElementsAre(Transfer(3, 4, 2.0 / 6.0),
+                          Transfer(3, 0, 1.5 / 6.0),
+                          Transfer(3, 2, 0.5 / 6.0),
+                          Transfer(1, 2, 1.0 / 3.0)));
+}
+
+TEST(LoadBalancingTest, LimitsMigrationFraction) {
+  const LoadBalancingOptions options = {.max_imbalance = 1.25f,
+                                        .max_migration_fraction = 0.1f};
+  EXPECT_THAT(PlanLoadTransfers({1.0, 4.0, 1.0}, options),
+              ElementsAre(Transfer(1, 0, 0.1)));
+}
+
+TEST(LoadBalancingTest, RoundTripsMigrationBatch) {
+  MigrationBatch batch;
+  batch.agent_moves = {{.uuid = 1, .node = 2}, {.uuid = 3, .node = 0}};
+  batch.location_moves = {{.uuid = 4, .node = 2}};
+  batch.agents = {{.uuid = 1, .state = "agent state"}, {.uuid = 5}};
+  batch.locations = {{.uuid = 4, .state = std::string("\0\1", 2)}};
+  batch.outcomes = {{.agent_uuid = 1, .source_uuid = 7}};
+  batch.reports = {{.from_agent_uuid = 8, .to_agent_uuid = 1}};
+
+  const std::string data = EncodeMigrationBatch(batch);
+  auto decoded = DecodeMigrationBatch(data);
+  PANDEMIC_ASSERT_OK(decoded.status());
+  ASSERT_EQ(decoded->agent_moves.size(), 2);
+  EXPECT_EQ(decoded->agent_moves[1].uuid, 3);
+  EXPECT_EQ(decoded->agent_moves[1].node, 0);
+  ASSERT_EQ(decoded->location_moves.size(), 1);
+  EXPECT_EQ(decoded->location_moves[0].uuid, 4);
+  ASSERT_EQ(decoded->agents.size(), 2);
+  EXPECT_EQ(decoded->agents[0].uuid, 1);
+  EXPECT_EQ(decoded->agents[0].state, "agent state");
+  EXPECT_EQ(decoded->agents[1].uuid, 5);
+  EXPECT_EQ(decoded->agents[1].state, "");
+  ASSERT_EQ(decoded->locations.size(), 1);
+  EXPECT_EQ(decoded->locations[0].state, std::string("\0\1", 2));
+  ASSERT_EQ(decoded->outcomes.size(), 1);
+  EXPECT_EQ(decoded->outcomes[0].source_uuid, 7);
+  ASSERT_EQ(decoded->reports.size(), 1);
+  EXPECT_EQ(decoded->reports[0].from_agent_uuid, 8);
+
+  EXPECT_EQ(DecodeMigrationBatch(data.substr(0, data.size() - 1))
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(DecodeMigrationBatch(data + "x").status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,404 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/locality_partition.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// An undirected graph in compressed sparse row form, with each edge stored
+// once per endpoint.
+struct Graph {
+  std::vector<double> vertex_weights;
+  std::vector<int64> offsets = {0};
+  std::vector<int> neighbors;
+  std::vector<double> edge_weights;
+
+  int num_vertices() const { return vertex_weights.size(); }
+};
+
+// Contracts the vertices of graph into num_coarse vertices, where coarse[v] is
+// the coarse vertex of v.  Parallel edges are merged and edges within a coarse
+// vertex dropped.
+Graph Contract(const Graph& graph, const std::vector<int>& coarse,
+               const int num_coarse) {
+  // Groups the vertices by coarse vertex.
+  std::vector<int64> member_offsets(num_coarse + 1, 0);
+  for (const int c : coarse) ++member_offsets[c + 1];
+  std::partial_sum(member_offsets.begin(), member_offsets.end(),
+                   member_offsets.begin());
+  std::vector<int> members(graph.num_vertices());
+  {
+    std::vector<int64> next(member_offsets.begin(), member_offsets.end() - 1);
+    for (int v = 0; v < graph.num_vertices(); ++v) {
+      members[next[coarse[v]]++] = v;
+    }
+  }
+
+  Graph result;
+  result.vertex_weights.assign(num_coarse, 0);
+  result.offsets.reserve(num_coarse + 1);
+  // The position of each neighbor in the current vertex's edges, stale if
+  // before the current vertex's first edge.
+  std::vector<int64> slot(num_coarse, -1);
+  for (int c = 0; c < num_coarse; ++c) {
+    const int64 begin = result.neighbors.size();
+    for (int64 m = member_offsets[c]; m < member_offsets[c + 1]; ++m) {
+      const int v = members[m];
+      result.vertex_weights[c] += graph.vertex_weights[v];
+      for (int64 e = graph.offsets[v]; e < graph.offsets[v + 1]; ++e) {
+        const int u = coarse[graph.neighbors[e]];
+        if (u == c) continue;
+        if (slot[u] >= begin) {
+          result.edge_weights[slot[u]] += graph.edge_weights[e];
+        } else {
+          slot[u] = result.neighbors.size();
+          result.neighbors.push_back(u);
+          result.edge_weights.push_back(graph.edge_weights[e]);
+        }
+      }
+    }
+    result.offsets.push_back(result.neighbors.size());
+  }
+  return result;
+}
+
+std::vector<int> RandomOrder(const int n, std::mt19937_64& rng) {
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), rng);
+  return order;
+}
+
+// Matches each vertex with its unmatched neighbor across the heaviest edge, as
+// long as their combined weight is at most max_weight.  Sets the coarse vertex
+// of each vertex and returns the number of coarse vertices.
+int MatchHeavyEdges(const Graph& graph, const double max_weight,
+                    std::mt19937_64& rng, std::vector<int>* const coarse) {
+  coarse->assign(graph.num_vertices(), -1);
+  int num_coarse = 0;
+  for (const int v : RandomOrder(graph.num_vertices(), rng)) {
+    if ((*coarse)[v] != -1) continue;
+    int best = -1;
+    double best_weight = 0;
+    for (int64 e = graph.offsets[v]; e < graph.offsets[v + 1]; ++e) {
+      const int u = graph.neighbors[e];
+      if ((*coarse)[u] != -1 || graph.edge_weights[e] <= best_weight ||
+          graph.vertex_weights[v] + graph.vertex_weights[u] > max_weight) {
+        continue;
+      }
+      best = u;
+      best_weight = graph.edge_weights[e];
+    }
+    (*coarse)[v] = num_coarse;
+    if (best != -1) (*coarse)[best] = num_coarse;
+    ++num_coarse;
+  }
+  return num_coarse;
+}
+
+// Assigns vertices to nodes, heaviest first, preferring the node they are most
+// connected to among those with room left.
+std::vector<int> InitialPartition(const Graph& graph, const int num_nodes,
+                                  const double max_load) {
+  std::vector<int> order(graph.num_vertices());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&graph](int a, int b) {
+    return graph.vertex_weights[a] > graph.vertex_weights[b];
+  });
+  std::vector<int> part(graph.num_vertices(), -1);
+  std::vector<double> loads(num_nodes, 0);
+  std::vector<double> connection(num_nodes);
+  for (const int v : order) {
+    std::fill(connection.begin(), connection.end(), 0);
+    for (int64 e = graph.offsets[v]; e < graph.offsets[v + 1]; ++e) {
+      const int node = part[graph.neighbors[e]];
+      if (node != -1) connection[node] += graph.edge_weights[e];
+    }
+    const double weight = graph.vertex_weights[v];
+    int best = -1;
+    for (int node = 0; node < num_nodes; ++node) {
+      if (loads[node] + weight > max_load) continue;
+      if (best == -1 || connection[node] > connection[best] ||
+          (connection[node] == connection[best] && loads[node] < loads[best])) {
+        best = node;
+      }
+    }
+    if (best == -1) {
+      best = std::min_element(loads.begin(), loads.end()) - loads.begin();
+    }
+    part[v] = best;
+    loads[best] += weight;
+  }
+  return part;
+}
+
+// Greedily moves vertices to the node they are most connected to, as long as
+// it has room left.  Overloaded nodes shed vertices even at a cost, and moves
+// without a cost are made if they improve balance.
+void Refine(const Graph& graph, const int num_nodes, const double max_load,
+            const int passes, std::mt19937_64& rng,
+            std::vector<int>* const part, std::vector<double>* const loads) {
+  const std::vector<int> order = RandomOrder(graph.num_vertices(), rng);
+  std::vector<double> connection(num_nodes, 0);
+  for (int pass = 0; pass < passes; ++pass) {
+    int64 moves = 0;
+    for (const int v : order) {
+      for (int64 e = graph.offsets[v]; e < graph.offsets[v + 1]; ++e) {
+        connection[(*part)[graph.neighbors[e]]] += graph.edge_weights[e];
+      }
+      const int from = (*part)[v];
+      const double weight = graph.vertex_weights[v];
+      const bool overloaded = (*loads)[from] > max_load;
+      int best = from;
+      double best_gain = 0;
+      for (int node = 0; node < num_nodes; ++node) {
+        if (node == from || (*loads)[node] + weight > max_load) continue;
+        const double gain = connection[node] - connection[from];
+        const bool balances = (*loads)[node] + weight < (*loads)[from];
+        if (best == from) {
+          if (gain > 0 || (gain == 0 && balances) || overloaded) {
+            best = node;
+            best_gain = gain;
+          }
+        } else if (gain > best_gain ||
+                   (gain == best_gain && (*loads)[node] < (*loads)[best])) {
+          best = node;
+          best_gain = gain;
+        }
+      }
+      std::fill(connection.begin(), connection.end(), 0);
+      if (best == from) continue;
+      (*part)[v] = best;
+      (*loads)[from] -= weight;
+      (*loads)[best] += weight;
+      ++moves;
+    }
+    if (moves == 0) break;
+  }
+}
+
+std::vector<double> Loads(const Graph& graph, const std::vector<int>& part,
+                          const int num_nodes) {
+  std::vector<double> loads(num_nodes, 0);
+  for (int v = 0; v < graph.num_vertices(); ++v) {
+    loads[part[v]] += graph.vertex_weights[v];
+  }
+  return loads;
+}
+
+int Find(std::vector<int>& parents, int v) {
+  while (parents[v] != v) {
+    parents[v] = parents[parents[v]];
+    v = parents[v];
+  }
+  return v;
+}
+
+// Assigns the agents and locations it was built with to nodes, and all others
+// by uuid.
+class TablePartition : public Partition {
+ public:
+  TablePartition(const int num_nodes,
+                 absl::flat_hash_map<int64, int> agent_nodes,
+                 absl::flat_hash_map<int64, int> location_nodes)
+      : fallback_(NewUuidModuloPartition(num_nodes)),
+        agent_nodes_(std::move(agent_nodes)),
+        location_nodes_(std::move(location_nodes)) {}
+
+  int num_nodes() const override { return fallback_->num_nodes(); }
+  int AgentNode(const int64 uuid) const override {
+    auto node = agent_nodes_.find(uuid);
+    return node != agent_nodes_.end() ? node->second
+                                      : fallback_->AgentNode(uuid);
+  }
+  int LocationNode(const int64 uuid) const override {
+    auto node = location_nodes_.find(uuid);
+    return node != location_nodes_.end() ? node->second
+                                         : fallback_->LocationNode(uuid);
+  }
+
+ private:
+  const std::unique_ptr<Partition> fallback_;
+  const absl::flat_hash_map<int64, int> agent_nodes_;
+  const absl::flat_hash_map<int64, int> location_nodes_;
+};
+
+}  // namespace
+
+std::unique_ptr<Partition> NewLocalityPartition(
+    const absl::Span<const AgentLocationEdge> edges,
+    const LocalityPartitionOptions& options) {
+  const int num_nodes = options.num_nodes;
+  CHECK_GT(num_nodes, 0);
+  // Agents and locations are numbered in order of appearance.
+  absl::flat_hash_map<int64, int> agent_vertices;
+  absl::flat_hash_map<int64, int> location_vertices;
+  Graph graph;
+  std::vector<std::pair<int, int>> endpoints;
+  endpoints.reserve(edges.size());
+  for (const AgentLocationEdge& edge : edges) {
+    auto agent = agent_vertices.try_emplace(edge.agent_uuid,
+                                            graph.vertex_weights.size());
+    if (agent.second) graph.vertex_weights.push_back(1);
+    auto location = location_vertices.try_emplace(
+        edge.location_uuid, graph.vertex_weights.size());
+    if (location.second) graph.vertex_weights.push_back(0);
+    graph.vertex_weights[location.first->second] += edge.weight;
+    endpoints.emplace_back(agent.first->second, location.first->second);
+  }
+  const int num_vertices = graph.vertex_weights.size();
+  graph.offsets.assign(num_vertices + 1, 0);
+  for (const auto& endpoint : endpoints) {
+    ++graph.offsets[endpoint.first + 1];
+    ++graph.offsets[endpoint.second + 1];
+  }
+  std::partial_sum(graph.offsets.begin(), graph.offsets.end(),
+                   graph.offsets.begin());
+  graph.neighbors.resize(graph.offsets.back());
+  graph.edge_weights.resize(graph.offsets.back());
+  {
+    std::vector<int64> next(graph.offsets.begin(), graph.offsets.end() - 1);
+    for (int i = 0; i < edges.size(); ++i) {
+      const int agent = endpoints[i].first;
+      const int location = endpoints[i].second;
+      graph.neighbors[next[agent]] = location;
+      graph.edge_weights[next[agent]++] = edges[i].weight;
+      graph.neighbors[next[location]] = agent;
+      graph.edge_weights[next[location]++] = edges[i].weight;
+    }
+  }
+  endpoints = {};
+
+  // levels[i + 1] is levels[i] contracted by coarse_maps[i].
+  std::vector<Graph> levels;
+  std::vector<std::vector<int>> coarse_maps;
+  levels.push_back(std::move(graph));
+
+  // Agents are merged with the locations they must be placed with first, and
+  // the original graph is not refined so that they stay together.
+  std::vector<int> parents(num_vertices);
+  std::iota(parents.begin(), parents.end(), 0);
+  bool colocated = false;
+  for (int i = 0; i < edges.size(); ++i) {
+    if (!edges[i].colocate) continue;
+    colocated = true;
+    const int agent = Find(parents, agent_vertices[edges[i].agent_uuid]);
+    const int location =
+        Find(parents, location_vertices[edges[i].location_uuid]);
+    parents[agent] = location;
+  }
+  if (colocated) {
+    std::vector<int> coarse(num_vertices, -1);
+    std::vector<int> roots(num_vertices, -1);
+    int num_coarse = 0;
+    for (int v = 0; v < num_vertices; ++v) {
+      int& root = roots[Find(parents, v)];
+      if (root == -1) root = num_coarse++;
+      coarse[v] = root;
+    }
+    levels.push_back(Contract(levels.back(), coarse, num_coarse));
+    coarse_maps.push_back(std::move(coarse));
+  }
+  const int first_refined_level = colocated ? 1 : 0;
+
+  double total_weight = 0;
+  for (const double weight : levels[0].vertex_weights) total_weight += weight;
+  const double max_load = options.max_imbalance * total_weight / num_nodes;
+  const int64 coarsest_vertices =
+      static_cast<int64>(num_nodes) * options.coarsest_vertices_per_node;
+  // Limits coarse vertices to a fraction of a node's load so that refinement
+  // can still balance them.
+  const double max_vertex_weight =
+      std::max(1.0, 2 * total_weight / coarsest_vertices);
+  std::mt19937_64 rng(options.seed);
+  while (levels.back().num_vertices() > coarsest_vertices) {
+    std::vector<int> coarse;
+    const int num_coarse =
+        MatchHeavyEdges(levels.back(), max_vertex_weight, rng, &coarse);
+    // Stops once matching no longer shrinks the graph noticeably.
+    if (num_coarse > 0.95 * levels.back().num_vertices()) break;
+    levels.push_back(Contract(levels.back(), coarse, num_coarse));
+    coarse_maps.push_back(std::move(coarse));
+  }
+
+  std::vector<int> part = InitialPartition(levels.back(), num_nodes, max_load);
+  for (int level = levels.size() - 1; level >= 0; --level) {
+    if (level < levels.size() - 1) {
+      std::vector<int> finer(levels[level].num_vertices());
+      for (int v = 0; v < finer.size(); ++v) {
+        finer[v] = part[coarse_maps[level][v]];
+      }
+      part = std::move(finer);
+    }
+    if (level >= first_refined_level) {
+      std::vector<double> loads = Loads(levels[level], part, num_nodes);
+      Refine(levels[level], num_nodes, max_load, options.refinement_passes,
+             rng, &part, &loads);
+    }
+  }
+
+  absl::flat_hash_map<int64, int> agent_nodes;
+  agent_nodes.reserve(agent_vertices.size());
+  for (const auto& agent : agent_vertices) {
+    agent_nodes.emplace(agent.first, part[agent.second]);
+  }
+  absl::flat_hash_map<int64, int> location_nodes;
+  location_nodes.reserve(location_vertices.size());
+  for (const auto& location : location_vertices) {
+    location_nodes.emplace(location.first, part[location.second]);
+  }
+  return absl::make_unique<TablePartition>(num_nodes, std::move(agent_nodes),
+                                           std::move(location_nodes));
+}
+
+PartitionStats GetPartitionStats(
+    const Partition& partition,
+    const absl::Span<const AgentLocationEdge> edges) {
+  std::vector<double> loads(partition.num_nodes(), 0);
+  absl::flat_hash_set<int64> agents;
+  double total_weight = 0;
+  double remote_weight = 0;
+  for (const AgentLocationEdge& edge : edges) {
+    const int agent_node = partition.AgentNode(edge.agent_uuid);
+    const int location_node = partition.LocationNode(edge.location_uuid);
+    if (agents.insert(edge.agent_uuid).second) loads[agent_node] += 1;
+    loads[location_node] += edge.weight;
+    total_weight += edge.weight;
+    if (agent_node != location_node) remote_weight += edge.weight;
+  }
+  PartitionStats stats;
+  if (total_weight > 0) {
+    stats.remote_visit_fraction = remote_weight / total_weight;
+  }
+  const double total_load = std::accumulate(loads.begin(), loads.end(), 0.0);
+  if (total_load > 0) {
+    stats.max_load_ratio = *std::max_element(loads.begin(), loads.end()) *
+                           loads.size() / total_load;
+  }
+  return stats;
+}
+
+}  // namespace abesim
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_LOCALITY_PARTITION_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_LOCALITY_PARTITION_H_
+
+#include <memory>
+
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/partition.h"
+
+namespace abesim {
+
+// An edge of the bipartite graph of agents and the locations they visit.
+struct AgentLocationEdge {
+  int64 agent_uuid;
+  int64 location_uuid;
+  // The expected number of visits per step.
+  float weight = 1.0f;
+  // Whether the agent must be placed on the node of the location, e.g. its
+  // household.
+  bool colocate = false;
+};
+
+struct LocalityPartitionOptions {
+  int num_nodes = 1;
+  // The most any node may be loaded relative to the average node, unless
+  // single agents or locations are heavier than that.
+  float max_imbalance = 1.05f;
+  // Coarsening stops once there are at most this many vertices per node.
+  int coarsest_vertices_per_node = 32;
+  // The maximum number of refinement passes at each level.
+  int refinement_passes = 8;
+  // Seeds the visiting order of vertices.  The partition is deterministic
+  // given the seed and the order of edges.
+  uint64 seed = 0;
+};
+
+// Returns a partition of the agents and locations in edges that minimizes the
+// weight of visits crossing nodes while balancing the load of nodes.  The
+// load of an agent is 1 and that of a location is the weight of its visits,
+// approximating the agent and location phases' work.  Agents and locations
+// not in edges are assigned by uuid modulo num_nodes.
+//
+// This is a multilevel partitioner: the graph is repeatedly coarsened by
+// contracting heavy edges, the coarsest graph is partitioned greedily, and
+// the partition is refined by moving boundary vertices while projecting it
+// back to the original graph.
+std::unique_ptr<Partition> NewLocalityPartition(
+    absl::Span<const AgentLocationEdge> edges,
+    const LocalityPartitionOptions& options);
+
+struct PartitionStats {
+  // The fraction of visit weight sent across nodes.
+  double remote_visit_fraction = 0;
+  // The load of the most loaded node relative to the average node.
+  double max_load_ratio = 0;
+};
+
+// Evaluates a partition with the load model of NewLocalityPartition.
+PartitionStats GetPartitionStats(const Partition& partition,
+                                 absl::Span<const AgentLocationEdge> edges);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_LOCALITY_PARTITION_H_
@@ -0,0 +1,106 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/locality_partition.h"
+
+#include <random>
+#include <vector>
+
+#include "agent_based_epidemic_sim/core/partition.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+constexpr int kNumHouseholds = 1000;
+constexpr int kHouseholdSize = 3;
+constexpr int kNumBusinesses = 50;
+constexpr int kNumNodes = 4;
+
+// Each agent visits its household and a business, with business sizes skewed
+// towards a few large ones.  Households have uuids below kNumHouseholds.
+std::vector<AgentLocationEdge> Population() {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform;
+  std::vector<AgentLocationEdge> edges;
+  for (int64 agent = 0; agent < kNumHouseholds * kHouseholdSize; ++agent) {
+    const double u = uniform(rng);
+    const int64 business =
+        kNumHouseholds + static_cast<int64>(kNumBusinesses * u * u);
+    edges.push_back({.agent_uuid = agent,
+                     .location_uuid = agent / kHouseholdSize,
+                     .colocate = true});
+    edges.push_back({.agent_uuid = agent, .location_uuid = business});
+  }
+  return edges;
+}
+
+std::unique_ptr<Partition> LocalityPartition(
+    const std::vector<AgentLocationEdge>& edges) {
+  return NewLocalityPartition(edges, {.num_nodes = kNumNodes});
+}
+
+TEST(LocalityPartitionTest, ColocatesAgentsWithHouseholds) {
+  const std::vector<AgentLocationEdge> edges = Population();
+  auto partition = LocalityPartition(edges);
+  EXPECT_EQ(partition->num_nodes(), kNumNodes);
+  for (const AgentLocationEdge& edge : edges) {
+    if (!edge.colocate) continue;
+    EXPECT_EQ(partition->AgentNode(edge.agent_uuid),
+              partition->LocationNode(edge.location_uuid));
+  }
+}
+
+TEST(LocalityPartitionTest, ReducesRemoteVisitsWhileBalancingLoad) {
+  const std::vector<AgentLocationEdge> edges = Population();
+  const PartitionStats modulo =
+      GetPartitionStats(*NewUuidModuloPartition(kNumNodes), edges);
+  EXPECT_GT(modulo.remote_visit_fraction, 0.6);
+
+  const PartitionStats locality =
+      GetPartitionStats(*LocalityPartition(edges), edges);
+  EXPECT_LT(locality.remote_visit_fraction,
+            modulo.remote_visit_fraction / 3);
+  EXPECT_LE(locality.max_load_ratio, 1.05 + 1e-6);
+}
+
+TEST(LocalityPartitionTest, IsDeterministic) {
+  const std::vector<AgentLocationEdge> edges = Population();
+  auto first = LocalityPartition(edges);
+  auto second = LocalityPartition(edges);
+  for (const AgentLocationEdge& edge : edges) {
+    EXPECT_EQ(first->AgentNode(edge.agent_uuid),
+              second->AgentNode(edge.agent_uuid));
+    EXPECT_EQ(first->LocationNode(edge.location_uuid),
+              second->LocationNode(edge.location_uuid));
+  }
+}
+
+TEST(LocalityPartitionTest, AssignsUnknownUuidsByModulo) {
+  auto partition = LocalityPartition(Population());
+  const int64 unknown = 1000003;
+  EXPECT_EQ(partition->AgentNode(unknown), unknown % kNumNodes);
+  EXPECT_EQ(partition->LocationNode(unknown), unknown % kNumNodes);
+}
+
+TEST(LocalityPartitionTest, HandlesSingleNode) {
+  const std::vector<AgentLocationEdge> edges = Population();
+  auto partition = NewLocalityPartition(edges, {.num_nodes = 1});
+  const PartitionStats stats = GetPartitionStats(*partition, edges);
+  EXPECT_EQ(stats.remote_visit_fraction, 0);
+  EXPECT_DOUBLE_EQ(stats.max_load_ratio, 1);
+}
+
+}  // namespace
+}  // namespace abesim
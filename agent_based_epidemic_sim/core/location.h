@@ -19,6 +19,7 @@
 
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/core/observer.h"
 #include "agent_based_epidemic_sim/core/visit.h"
 
@@ -34,6 +35,10 @@ class Location {
   virtual void ProcessVisits(absl::Span<const Visit> visits,
                              Broker<InfectionOutcome>* infection_broker) = 0;
 
+  // Adds the memory held by the location to usage, under
+  // "locations/<part>".  The default adds nothing.
+  virtual void AddMemoryUsage(MemoryUsage* usage) const {}
+
   virtual ~Location() = default;
 };
 
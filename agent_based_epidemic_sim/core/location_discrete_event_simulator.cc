@@ -18,6 +18,7 @@
 
 #include "absl/random/random.h"
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
@@ -26,6 +27,11 @@ namespace {
 // TODO: Move  into an event message about visiting infectious agents.
 constexpr float kInfectivity = 1;
 
+ScratchMemoryCounter& ScratchMemory() {
+  static auto* const counter = new ScratchMemoryCounter("locations/scratch");
+  return *counter;
+}
+
 // Corresponds to the record of a visiting agent in a location.
 struct VisitNode {
   const Visit* visit;
@@ -164,6 +170,16 @@ void LocationDiscreteEventSimulator::ProcessVisits(
       active_visits.erase(event.node->pos);
     }
   }
+
+  // The visit nodes are only released by the next call.
+  if (!ScratchMemoryCounter::Enabled()) return;
+  thread_local ScratchMemoryCounter::ThreadBytes scratch(&ScratchMemory());
+  int64 scratch_bytes =
+      VectorMemoryUsage(events) + VectorMemoryUsage(visit_nodes);
+  for (const auto& node : visit_nodes) {
+    scratch_bytes += sizeof(VisitNode) + VectorMemoryUsage(node->contacts);
+  }
+  scratch.Set(scratch_bytes);
 }
 
 }  // namespace abesim
@@ -36,6 +36,10 @@ class LocationDiscreteEventSimulator : public Location {
   void ProcessVisits(absl::Span<const Visit> visits,
                      Broker<InfectionOutcome>* infection_broker) override;
 
+  void AddMemoryUsage(MemoryUsage* const usage) const override {
+    usage->Add("locations/objects", sizeof(*this));
+  }
+
  private:
   const int64 uuid_;
 };
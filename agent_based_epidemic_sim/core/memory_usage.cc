@@ -0,0 +1,87 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/memory_usage.h"
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+
+namespace abesim {
+namespace {
+
+ABSL_CONST_INIT absl::Mutex counters_mu(absl::kConstInit);
+
+std::vector<const ScratchMemoryCounter*>& Counters()
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(counters_mu) {
+  static auto* const counters = new std::vector<const ScratchMemoryCounter*>;
+  return *counters;
+}
+
+}  // namespace
+
+std::atomic<bool> ScratchMemoryCounter::enabled_{false};
+
+void MemoryUsage::Add(const absl::string_view subsystem,
+                      const int64 subsystem_bytes) {
+  auto iter = bytes.find(subsystem);
+  if (iter == bytes.end()) {
+    iter = bytes.emplace(std::string(subsystem), 0).first;
+  }
+  iter->second += subsystem_bytes;
+}
+
+int64 MemoryUsage::Total() const {
+  int64 total = 0;
+  for (const auto& [subsystem, subsystem_bytes] : bytes) {
+    total += subsystem_bytes;
+  }
+  return total;
+}
+
+ScratchMemoryCounter::ScratchMemoryCounter(const absl::string_view subsystem)
+    : subsystem_(subsystem) {
+  absl::MutexLock l(&counters_mu);
+  Counters().push_back(this);
+}
+
+void ScratchMemoryCounter::AddAll(MemoryUsage* const usage) {
+  absl::MutexLock l(&counters_mu);
+  for (const ScratchMemoryCounter* counter : Counters()) {
+    usage->Add(counter->subsystem_, counter->bytes_);
+  }
+}
+
+MemoryUsageWriter::MemoryUsageWriter(std::unique_ptr<file::FileWriter> file)
+    : csv_(std::move(file), "step,subsystem,bytes,bytes_per_agent") {}
+
+absl::Status MemoryUsageWriter::Write(const MemoryUsage& usage) {
+  std::string lines;
+  auto append = [&lines, &usage](absl::string_view subsystem,
+                                 const int64 bytes) {
+    absl::StrAppend(&lines, usage.step, ",", subsystem, ",", bytes, ",",
+                    usage.agents > 0 ? static_cast<double>(bytes) / usage.agents
+                                     : 0.0,
+                    "\n");
+  };
+  for (const auto& [subsystem, bytes] : usage.bytes) {
+    append(subsystem, bytes);
+  }
+  append("total", usage.Total());
+  return csv_.Write(lines);
+}
+
+absl::Status MemoryUsageWriter::Close() { return csv_.Close(); }
+
+}  // namespace abesim
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_MEMORY_USAGE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_MEMORY_USAGE_H_
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/util/csv_writer.h"
+
+namespace abesim {
+
+// The bytes held by each subsystem of a simulation at the end of a step, see
+// Simulation::SetMemoryUsageCallback.  Subsystem names are of the form
+// "<subsystem>/<part>", e.g. "agents/contacts", and parts don't overlap, so
+// that Total is the memory held by the simulation.
+//
+// Sizes are estimated from object sizes and container capacities, without
+// allocator overhead.  Objects that don't report their memory, such as
+// agents other than SEIRAgents, are only counted by their pointers.
+struct MemoryUsage {
+  int64 step = 0;
+  int64 agents = 0;
+  int64 locations = 0;
+  std::map<std::string, int64, std::less<>> bytes;
+
+  void Add(absl::string_view subsystem, int64 subsystem_bytes);
+  int64 Total() const;
+};
+
+template <typename T>
+int64 VectorMemoryUsage(const std::vector<T>& vector) {
+  return vector.capacity() * sizeof(T);
+}
+
+// For absl flat hash containers, which use a control byte per slot.
+template <typename Container>
+int64 HashContainerMemoryUsage(const Container& container) {
+  return container.capacity() * (sizeof(typename Container::value_type) + 1);
+}
+
+// Tracks the bytes held by the thread-local scratch buffers of a subsystem,
+// summed over threads.  Counters must never be destroyed; they are listed in a
+// global registry when constructed.  Scratch is only tracked once Enable has
+// been called, so that runs that don't report memory usage don't pay for it.
+//
+//   ScratchMemoryCounter& ScratchMemory() {
+//     static auto* const counter =
+//         new ScratchMemoryCounter("locations/scratch");
+//     return *counter;
+//   }
+//
+//   thread_local std::vector<Event> events;
+//   ... use events ...
+//   if (ScratchMemoryCounter::Enabled()) {
+//     thread_local ScratchMemoryCounter::ThreadBytes scratch(&ScratchMemory());
+//     scratch.Set(VectorMemoryUsage(events));
+//   }
+class ScratchMemoryCounter {
+ public:
+  explicit ScratchMemoryCounter(absl::string_view subsystem);
+
+  // The bytes held by a single thread, which are subtracted from the counter
+  // when the thread exits.
+  class ThreadBytes {
+   public:
+    explicit ThreadBytes(ScratchMemoryCounter* const counter)
+        : counter_(counter) {}
+    ~ThreadBytes() { Set(0); }
+
+    void Set(const int64 bytes) {
+      if (bytes == bytes_) return;
+      counter_->bytes_ += bytes - bytes_;
+      bytes_ = bytes;
+    }
+
+   private:
+    ScratchMemoryCounter* const counter_;
+    int64 bytes_ = 0;
+  };
+
+  // Turns on tracking for all counters.  Bytes used before are not counted.
+  static void Enable() { enabled_.store(true, std::memory_order_relaxed); }
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  // Adds the bytes of all counters to usage.
+  static void AddAll(MemoryUsage* usage);
+
+ private:
+  static std::atomic<bool> enabled_;
+
+  const std::string subsystem_;
+  std::atomic<int64> bytes_{0};
+};
+
+// Writes memory usage as CSV, one line per subsystem and a "total" line per
+// report.  bytes_per_agent divides by the number of agents of the simulation,
+// for extrapolating to larger populations.
+class MemoryUsageWriter {
+ public:
+  explicit MemoryUsageWriter(std::unique_ptr<file::FileWriter> file);
+
+  absl::Status Write(const MemoryUsage& usage);
+  // Must be called before destroying the object.
+  absl::Status Close();
+
+ private:
+  CsvWriter csv_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_MEMORY_USAGE_H_
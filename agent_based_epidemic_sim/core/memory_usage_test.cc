@@ -0,0 +1,98 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/memory_usage.h"
+
+#include <string>
+#include <thread>  // NOLINT: Open source only.
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+using testing::Pair;
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+int64 ScratchBytes(absl::string_view subsystem) {
+  MemoryUsage usage;
+  ScratchMemoryCounter::AddAll(&usage);
+  auto iter = usage.bytes.find(subsystem);
+  return iter == usage.bytes.end() ? -1 : iter->second;
+}
+
+TEST(MemoryUsageTest, AddsBytesBySubsystem) {
+  MemoryUsage usage;
+  usage.Add("agents/objects", 10);
+  usage.Add("brokers/queues", 5);
+  usage.Add("agents/objects", 20);
+  EXPECT_THAT(usage.bytes, ElementsAre(Pair("agents/objects", 30),
+                                       Pair("brokers/queues", 5)));
+  EXPECT_EQ(usage.Total(), 35);
+}
+
+TEST(MemoryUsageTest, ContainerSizesUseCapacity) {
+  std::vector<int64> vector;
+  vector.reserve(10);
+  vector.push_back(1);
+  EXPECT_EQ(VectorMemoryUsage(vector), 10 * sizeof(int64));
+}
+
+TEST(ScratchMemoryCounterTest, SumsThreadsUntilTheyExit) {
+  static auto* const counter = new ScratchMemoryCounter("test/scratch");
+  EXPECT_EQ(ScratchBytes("test/scratch"), 0);
+
+  ScratchMemoryCounter::ThreadBytes main_thread(counter);
+  main_thread.Set(100);
+  std::thread thread([]() {
+    ScratchMemoryCounter::ThreadBytes bytes(counter);
+    bytes.Set(10);
+    bytes.Set(20);
+    EXPECT_EQ(ScratchBytes("test/scratch"), 120);
+  });
+  thread.join();
+  EXPECT_EQ(ScratchBytes("test/scratch"), 100);
+}
+
+TEST(MemoryUsageWriterTest, WritesSubsystemsAndTotal) {
+  const std::string path = TestPath("memory_usage.csv");
+  MemoryUsageWriter writer(file::OpenOrDie(path));
+  MemoryUsage usage;
+  usage.step = 3;
+  usage.agents = 4;
+  usage.Add("agents/objects", 400);
+  usage.Add("brokers/queues", 100);
+  PANDEMIC_ASSERT_OK(writer.Write(usage));
+  PANDEMIC_ASSERT_OK(writer.Close());
+
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(path, &contents));
+  EXPECT_EQ(contents,
+            "step,subsystem,bytes,bytes_per_agent\n"
+            "3,agents/objects,400,100\n"
+            "3,brokers/queues,100,25\n"
+            "3,total,500,125\n");
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,560 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/message_coding.h"
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/raw_coding.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/util/block_compression.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+
+namespace abesim {
+namespace {
+
+// Flags in the first byte of a batch.
+enum BatchFlags : uint8 {
+  // The rest of the batch is the size of the body followed by the body
+  // compressed by CompressBlock.
+  kCompressed = 1,
+};
+
+void AppendSigned(const int64 value, std::string* const out) {
+  PutVarint64(ZigZagEncode(value), out);
+}
+
+bool ReadSigned(RawReader* const reader, int64* const value) {
+  uint64 zigzag;
+  if (!reader->ReadVarint(&zigzag)) return false;
+  *value = ZigZagDecode(zigzag);
+  return true;
+}
+
+// Codes the uuids of a field as differences to the previous message's.
+class UuidCoder {
+ public:
+  void Append(const int64 uuid, std::string* const out) {
+    const uint64 difference = static_cast<uint64>(uuid) - previous_;
+    PutVarint64(ZigZagEncode(static_cast<int64>(difference)), out);
+    previous_ = uuid;
+  }
+
+  bool Read(RawReader* const reader, int64* const uuid) {
+    uint64 zigzag;
+    if (!reader->ReadVarint(&zigzag)) return false;
+    previous_ += static_cast<uint64>(ZigZagDecode(zigzag));
+    *uuid = static_cast<int64>(previous_);
+    return true;
+  }
+
+ private:
+  uint64 previous_ = 0;
+};
+
+// The units times are coded in, coarsest first, down to the resolution of
+// absl::Duration.
+constexpr int kNumTimeUnits = 6;
+
+absl::Duration TimeUnit(const int unit) {
+  switch (unit) {
+    case 0:
+      return absl::Minutes(1);
+    case 1:
+      return absl::Seconds(1);
+    case 2:
+      return absl::Milliseconds(1);
+    case 3:
+      return absl::Microseconds(1);
+    case 4:
+      return absl::Nanoseconds(1);
+    default:
+      return absl::Nanoseconds(1) / 4;
+  }
+}
+
+// Codes times as multiples of a unit relative to a base, the earliest time of
+// the batch rounded down to a minute.  The encoder first fits the unit and
+// base to all times and durations of the batch.  Infinite values are coded
+// specially, and those too far from the base are copied as is.
+class TimeCoder {
+ public:
+  void Fit(const absl::Time time) {
+    if (time == absl::InfinitePast() || time == absl::InfiniteFuture()) return;
+    if (!has_min_ || time < min_) min_ = time;
+    has_min_ = true;
+    Fit(time - absl::UnixEpoch());
+  }
+
+  void Fit(const absl::Duration duration) {
+    if (duration == absl::InfiniteDuration() ||
+        duration == -absl::InfiniteDuration()) {
+      return;
+    }
+    while (unit_ + 1 < kNumTimeUnits &&
+           duration % TimeUnit(unit_) != absl::ZeroDuration()) {
+      ++unit_;
+    }
+  }
+
+  void AppendHeader(std::string* const out) {
+    int64 base_minutes = 0;
+    if (has_min_) {
+      absl::Duration remainder;
+      base_minutes = absl::IDivDuration(min_ - absl::UnixEpoch(),
+                                        absl::Minutes(1), &remainder);
+      if (remainder < absl::ZeroDuration()) --base_minutes;
+    }
+    PutVarint64(unit_, out);
+    AppendSigned(base_minutes, out);
+    SetBase(base_minutes);
+  }
+
+  bool ReadHeader(RawReader* const reader) {
+    uint64 unit;
+    int64 base_minutes;
+    if (!reader->ReadVarint(&unit) || unit >= kNumTimeUnits ||
+        !ReadSigned(reader, &base_minutes)) {
+      return false;
+    }
+    unit_ = unit;
+    SetBase(base_minutes);
+    return true;
+  }
+
+  // Times are coded as 0 and 1 for the infinite past and future, 2 for a
+  // copied time and the zigzag coded multiple of the unit plus 3 otherwise.
+  void Append(const absl::Time time, std::string* const out) {
+    uint64 units;
+    if (time == absl::InfinitePast()) {
+      PutVarint64(0, out);
+    } else if (time == absl::InfiniteFuture()) {
+      PutVarint64(1, out);
+    } else if (ToUnits(time - base_, 3, &units)) {
+      PutVarint64(units, out);
+    } else {
+      PutVarint64(2, out);
+      AppendRaw(time, out);
+    }
+  }
+
+  bool Read(RawReader* const reader, absl::Time* const time) {
+    uint64 code;
+    if (!reader->ReadVarint(&code)) return false;
+    switch (code) {
+      case 0:
+        *time = absl::InfinitePast();
+        return true;
+      case 1:
+        *time = absl::InfiniteFuture();
+        return true;
+      case 2:
+        return reader->Read(time);
+    }
+    *time = base_ + ZigZagDecode(code - 3) * TimeUnit(unit_);
+    return true;
+  }
+
+  // Durations are coded as 0 for a copied duration and the zigzag coded
+  // multiple of the unit plus 1 otherwise.
+  void Append(const absl::Duration duration, std::string* const out) {
+    uint64 units;
+    if (ToUnits(duration, 1, &units)) {
+      PutVarint64(units, out);
+    } else {
+      PutVarint64(0, out);
+      AppendRaw(duration, out);
+    }
+  }
+
+  bool Read(RawReader* const reader, absl::Duration* const duration) {
+    uint64 code;
+    if (!reader->ReadVarint(&code)) return false;
+    if (code == 0) return reader->Read(duration);
+    *duration = ZigZagDecode(code - 1) * TimeUnit(unit_);
+    return true;
+  }
+
+ private:
+  void SetBase(const int64 base_minutes) {
+    base_ = absl::UnixEpoch() + absl::Minutes(base_minutes);
+  }
+
+  // Returns the zigzag coded multiple of the unit plus offset, if duration is
+  // an exact multiple that fits.
+  bool ToUnits(const absl::Duration duration, const uint64 offset,
+               uint64* const units) const {
+    const absl::Duration unit = TimeUnit(unit_);
+    absl::Duration remainder;
+    const int64 multiple = absl::IDivDuration(duration, unit, &remainder);
+    if (remainder != absl::ZeroDuration() || multiple * unit != duration ||
+        ZigZagEncode(multiple) > ~uint64{0} - offset) {
+      return false;
+    }
+    *units = ZigZagEncode(multiple) + offset;
+    return true;
+  }
+
+  int unit_ = 0;
+  bool has_min_ = false;
+  absl::Time min_;
+  absl::Time base_;
+};
+
+// Codes recurring entries as indexes into a dictionary of the entries seen so
+// far, starting at 1.  New entries follow an index of 0.
+class DictionaryEncoder {
+ public:
+  void Append(const std::string& entry, std::string* const out) {
+    const auto inserted = indexes_.emplace(entry, indexes_.size() + 1);
+    if (inserted.second) {
+      PutVarint64(0, out);
+      out->append(entry);
+    } else {
+      PutVarint64(inserted.first->second, out);
+    }
+  }
+
+ private:
+  absl::flat_hash_map<std::string, uint64> indexes_;
+};
+
+template <typename Entry>
+class DictionaryDecoder {
+ public:
+  // Calls read_entry(entry) to read new entries.
+  template <typename ReadEntry>
+  bool Read(RawReader* const reader, const ReadEntry& read_entry,
+            Entry* const entry) {
+    uint64 index;
+    if (!reader->ReadVarint(&index)) return false;
+    if (index == 0) {
+      if (!read_entry(entry)) return false;
+      entries_.push_back(*entry);
+      return true;
+    }
+    if (index > entries_.size()) return false;
+    *entry = entries_[index - 1];
+    return true;
+  }
+
+ private:
+  std::vector<Entry> entries_;
+};
+
+// Batches start with their flags, followed by the number of messages, the
+// time coding header and the messages.
+std::string StartBatch(const size_t num_msgs, TimeCoder* const times) {
+  std::string batch(1, '\0');
+  PutVarint64(num_msgs, &batch);
+  times->AppendHeader(&batch);
+  return batch;
+}
+
+std::string FinishBatch(std::string batch,
+                        const MessageCodingOptions& options) {
+  if (!options.compress) return batch;
+  const absl::string_view body = absl::string_view(batch).substr(1);
+  std::string compressed(1, static_cast<char>(kCompressed));
+  PutVarint64(body.size(), &compressed);
+  const size_t block_start = compressed.size();
+  CompressBlock(body, &compressed);
+  return compressed.size() < batch.size() &&
+                 WithinCompressionRatio(body.size(),
+                                        compressed.size() - block_start)
+             ? compressed
+             : batch;
+}
+
+absl::Status InvalidBatch() {
+  return absl::InvalidArgumentError("Invalid message batch");
+}
+
+// Reads the number of messages and the time coding header, decompressing the
+// batch into buffer first if needed.  The reader points into data or buffer.
+bool ReadBatchHeader(absl::string_view data, std::string* const buffer,
+                     RawReader* const reader, uint64* const num_msgs,
+                     TimeCoder* const times) {
+  if (data.empty()) return false;
+  const uint8 flags = data.front();
+  data.remove_prefix(1);
+  if (flags & ~kCompressed) return false;
+  if (flags & kCompressed) {
+    uint64 size;
+    if (!GetVarint64(&data, &size) ||
+        !WithinCompressionRatio(size, data.size())) {
+      return false;
+    }
+    if (!DecompressBlock(data, size, buffer)) return false;
+    data = *buffer;
+  }
+  *reader = RawReader(data);
+  return reader->ReadVarint(num_msgs) && times->ReadHeader(reader);
+}
+
+void AppendFloats(const float a, const float b, std::string* const out) {
+  AppendRaw(a, out);
+  AppendRaw(b, out);
+}
+
+struct VisitHealth {
+  HealthState::State health_state;
+  float infectivity;
+  float symptom_factor;
+};
+
+struct ExposureFactors {
+  InfectionOutcomeProto::ExposureType exposure_type;
+  float infectivity;
+  float symptom_factor;
+};
+
+// Micro exposure counts are coded as a mask of the non-zero buckets followed
+// by their counts.
+void AppendMicroExposureCounts(
+    const std::array<uint8, kNumberMicroExposureBuckets>& counts,
+    std::string* const out) {
+  uint64 mask = 0;
+  for (int i = 0; i < kNumberMicroExposureBuckets; ++i) {
+    if (counts[i] != 0) mask |= uint64{1} << i;
+  }
+  PutVarint64(mask, out);
+  for (const uint8 count : counts) {
+    if (count != 0) out->push_back(static_cast<char>(count));
+  }
+}
+
+bool ReadMicroExposureCounts(
+    RawReader* const reader,
+    std::array<uint8, kNumberMicroExposureBuckets>* const counts) {
+  uint64 mask;
+  if (!reader->ReadVarint(&mask) ||
+      mask >> kNumberMicroExposureBuckets != 0) {
+    return false;
+  }
+  for (int i = 0; i < kNumberMicroExposureBuckets; ++i) {
+    (*counts)[i] = 0;
+    if ((mask >> i & 1) != 0 && !reader->Read(&(*counts)[i])) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::string EncodeMessages(const absl::Span<const Visit> visits,
+                           const MessageCodingOptions& options) {
+  TimeCoder times;
+  for (const Visit& visit : visits) {
+    times.Fit(visit.start_time);
+    times.Fit(visit.end_time);
+  }
+  std::string batch = StartBatch(visits.size(), &times);
+  UuidCoder location_uuids;
+  UuidCoder agent_uuids;
+  DictionaryEncoder health;
+  std::string entry;
+  for (const Visit& visit : visits) {
+    location_uuids.Append(visit.location_uuid, &batch);
+    agent_uuids.Append(visit.agent_uuid, &batch);
+    times.Append(visit.start_time, &batch);
+    times.Append(visit.end_time, &batch);
+    entry.clear();
+    PutVarint64(visit.health_state, &entry);
+    AppendFloats(visit.infectivity, visit.symptom_factor, &entry);
+    health.Append(entry, &batch);
+  }
+  return FinishBatch(std::move(batch), options);
+}
+
+std::string EncodeMessages(const absl::Span<const ContactReport> reports,
+                           const MessageCodingOptions& options) {
+  TimeCoder times;
+  for (const ContactReport& report : reports) {
+    times.Fit(report.test_result.time_requested);
+    times.Fit(report.test_result.time_received);
+  }
+  std::string batch = StartBatch(reports.size(), &times);
+  UuidCoder from_uuids;
+  UuidCoder to_uuids;
+  DictionaryEncoder test_results;
+  std::string entry;
+  for (const ContactReport& report : reports) {
+    from_uuids.Append(report.from_agent_uuid, &batch);
+    to_uuids.Append(report.to_agent_uuid, &batch);
+    const TestResult& result = report.test_result;
+    entry.clear();
+    times.Append(result.time_requested, &entry);
+    times.Append(result.time_received, &entry);
+    entry.push_back(result.needs_retry ? 1 : 0);
+    AppendRaw(result.probability, &entry);
+    test_results.Append(entry, &batch);
+  }
+  return FinishBatch(std::move(batch), options);
+}
+
+std::string EncodeMessages(const absl::Span<const InfectionOutcome> outcomes,
+                           const MessageCodingOptions& options) {
+  TimeCoder times;
+  for (const InfectionOutcome& outcome : outcomes) {
+    times.Fit(outcome.exposure.start_time);
+    times.Fit(outcome.exposure.duration);
+  }
+  std::string batch = StartBatch(outcomes.size(), &times);
+  UuidCoder agent_uuids;
+  UuidCoder source_uuids;
+  DictionaryEncoder factors;
+  std::string entry;
+  for (const InfectionOutcome& outcome : outcomes) {
+    const Exposure& exposure = outcome.exposure;
+    agent_uuids.Append(outcome.agent_uuid, &batch);
+    source_uuids.Append(outcome.source_uuid, &batch);
+    times.Append(exposure.start_time, &batch);
+    times.Append(exposure.duration, &batch);
+    AppendMicroExposureCounts(exposure.micro_exposure_counts, &batch);
+    entry.clear();
+    PutVarint64(outcome.exposure_type, &entry);
+    AppendFloats(exposure.infectivity, exposure.symptom_factor, &entry);
+    factors.Append(entry, &batch);
+  }
+  return FinishBatch(std::move(batch), options);
+}
+
+absl::Status DecodeMessages(const absl::string_view data,
+                            std::vector<Visit>* const msgs) {
+  msgs->clear();
+  std::string buffer;
+  RawReader reader(data);
+  uint64 num_msgs;
+  TimeCoder times;
+  if (!ReadBatchHeader(data, &buffer, &reader, &num_msgs, &times)) {
+    return InvalidBatch();
+  }
+  UuidCoder location_uuids;
+  UuidCoder agent_uuids;
+  DictionaryDecoder<VisitHealth> health;
+  auto read_health = [&reader](VisitHealth* const entry) {
+    uint64 health_state;
+    if (!reader.ReadVarint(&health_state)) return false;
+    entry->health_state = static_cast<HealthState::State>(health_state);
+    return reader.Read(&entry->infectivity) &&
+           reader.Read(&entry->symptom_factor);
+  };
+  for (uint64 i = 0; i < num_msgs; ++i) {
+    Visit visit;
+    VisitHealth entry;
+    if (!location_uuids.Read(&reader, &visit.location_uuid) ||
+        !agent_uuids.Read(&reader, &visit.agent_uuid) ||
+        !times.Read(&reader, &visit.start_time) ||
+        !times.Read(&reader, &visit.end_time) ||
+        !health.Read(&reader, read_health, &entry)) {
+      return InvalidBatch();
+    }
+    visit.health_state = entry.health_state;
+    visit.infectivity = entry.infectivity;
+    visit.symptom_factor = entry.symptom_factor;
+    msgs->push_back(visit);
+  }
+  if (!reader.empty()) return InvalidBatch();
+  return absl::OkStatus();
+}
+
+absl::Status DecodeMessages(const absl::string_view data,
+                            std::vector<ContactReport>* const msgs) {
+  msgs->clear();
+  std::string buffer;
+  RawReader reader(data);
+  uint64 num_msgs;
+  TimeCoder times;
+  if (!ReadBatchHeader(data, &buffer, &reader, &num_msgs, &times)) {
+    return InvalidBatch();
+  }
+  UuidCoder from_uuids;
+  UuidCoder to_uuids;
+  DictionaryDecoder<TestResult> test_results;
+  auto read_test_result = [&reader, &times](TestResult* const result) {
+    uint8 needs_retry;
+    if (!times.Read(&reader, &result->time_requested) ||
+        !times.Read(&reader, &result->time_received) ||
+        !reader.Read(&needs_retry) || needs_retry > 1) {
+      return false;
+    }
+    result->needs_retry = needs_retry == 1;
+    return reader.Read(&result->probability);
+  };
+  for (uint64 i = 0; i < num_msgs; ++i) {
+    ContactReport report;
+    if (!from_uuids.Read(&reader, &report.from_agent_uuid) ||
+        !to_uuids.Read(&reader, &report.to_agent_uuid) ||
+        !test_results.Read(&reader, read_test_result, &report.test_result)) {
+      return InvalidBatch();
+    }
+    msgs->push_back(report);
+  }
+  if (!reader.empty()) return InvalidBatch();
+  return absl::OkStatus();
+}
+
+absl::Status DecodeMessages(const absl::string_view data,
+                            std::vector<InfectionOutcome>* const msgs) {
+  msgs->clear();
+  std::string buffer;
+  RawReader reader(data);
+  uint64 num_msgs;
+  TimeCoder times;
+  if (!ReadBatchHeader(data, &buffer, &reader, &num_msgs, &times)) {
+    return InvalidBatch();
+  }
+  UuidCoder agent_uuids;
+  UuidCoder source_uuids;
+  DictionaryDecoder<ExposureFactors> factors;
+  auto read_factors = [&reader](ExposureFactors* const entry) {
+    uint64 exposure_type;
+    if (!reader.ReadVarint(&exposure_type)) return false;
+    entry->exposure_type =
+        static_cast<InfectionOutcomeProto::ExposureType>(exposure_type);
+    return reader.Read(&entry->infectivity) &&
+           reader.Read(&entry->symptom_factor);
+  };
+  for (uint64 i = 0; i < num_msgs; ++i) {
+    InfectionOutcome outcome;
+    Exposure& exposure = outcome.exposure;
+    ExposureFactors entry;
+    if (!agent_uuids.Read(&reader, &outcome.agent_uuid) ||
+        !source_uuids.Read(&reader, &outcome.source_uuid) ||
+        !times.Read(&reader, &exposure.start_time) ||
+        !times.Read(&reader, &exposure.duration) ||
+        !ReadMicroExposureCounts(&reader, &exposure.micro_exposure_counts) ||
+        !factors.Read(&reader, read_factors, &entry)) {
+      return InvalidBatch();
+    }
+    outcome.exposure_type = entry.exposure_type;
+    exposure.infectivity = entry.infectivity;
+    exposure.symptom_factor = entry.symptom_factor;
+    msgs->push_back(outcome);
+  }
+  if (!reader.empty()) return InvalidBatch();
+  return absl::OkStatus();
+}
+
+}  // namespace abesim
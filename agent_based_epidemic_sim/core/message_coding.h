@@ -0,0 +1,65 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_MESSAGE_CODING_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_MESSAGE_CODING_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+
+namespace abesim {
+
+// Compact encodings of the message batches exchanged between the nodes of a
+// distributed simulation.  Batches tend to be sorted by recipient and share
+// their times, so:
+//  - uuids are coded as varint differences to the previous message's,
+//  - times are coded relative to the batch's earliest time, in the coarsest
+//    unit from minutes down to the resolution of absl::Time that represents
+//    all of them,
+//  - recurring health states, exposure factors and test results are coded as
+//    indexes into a dictionary built up along the batch.
+// Decoding restores the messages exactly.  Floats, and times too far from the
+// rest, are copied as is, which requires all nodes to run the same binary.
+
+struct MessageCodingOptions {
+  // Whether to also compress encoded batches with a fast LZ77 block codec,
+  // trading encoding time for fewer bytes where bandwidth is scarce.
+  bool compress = false;
+};
+
+std::string EncodeMessages(absl::Span<const Visit> visits,
+                           const MessageCodingOptions& options = {});
+std::string EncodeMessages(absl::Span<const ContactReport> reports,
+                           const MessageCodingOptions& options = {});
+std::string EncodeMessages(absl::Span<const InfectionOutcome> outcomes,
+                           const MessageCodingOptions& options = {});
+
+// Replaces msgs with the messages of an encoded batch.
+absl::Status DecodeMessages(absl::string_view data, std::vector<Visit>* msgs);
+absl::Status DecodeMessages(absl::string_view data,
+                            std::vector<ContactReport>* msgs);
+absl::Status DecodeMessages(absl::string_view data,
+                            std::vector<InfectionOutcome>* msgs);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_MESSAGE_CODING_H_
@@ -0,0 +1,249 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/message_coding.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAreArray;
+
+const absl::Time kDay = absl::UnixEpoch() + absl::Hours(24 * 120);
+
+// Batches like those a node sends for a step.
+
+// Each agent visits its household, a workplace and its household again, at
+// times that divide the day by fractions like DurationSpecifiedVisitGenerator.
+std::vector<Visit> StepVisits(const int num_agents) {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> fraction(0.0f, 0.5f);
+  std::uniform_int_distribution<int64> workplace(0, 999);
+  std::vector<Visit> visits;
+  for (int64 i = 0; i < num_agents; ++i) {
+    const int64 agent_uuid = 100000 + 3 * i;
+    const bool infectious = i % 50 == 0;
+    const Visit visit = {
+        .agent_uuid = agent_uuid,
+        .health_state =
+            infectious ? HealthState::INFECTIOUS : HealthState::SUSCEPTIBLE,
+        .infectivity = infectious ? fraction(rng) : 0.0f,
+        .symptom_factor = infectious ? 0.5f : 0.0f};
+    const absl::Time leave = kDay + fraction(rng) * absl::Hours(24);
+    const absl::Time back = leave + fraction(rng) * absl::Hours(24);
+    const int64 household = agent_uuid / 4;
+    visits.push_back(visit);
+    visits.back().location_uuid = household;
+    visits.back().start_time = kDay;
+    visits.back().end_time = leave;
+    visits.push_back(visit);
+    visits.back().location_uuid = 50000 + workplace(rng);
+    visits.back().start_time = leave;
+    visits.back().end_time = back;
+    visits.push_back(visit);
+    visits.back().location_uuid = household;
+    visits.back().start_time = back;
+    visits.back().end_time = kDay + absl::Hours(24);
+  }
+  return visits;
+}
+
+// Locations expose their visitors to a few infectious agents each.
+std::vector<InfectionOutcome> StepOutcomes(const int num_outcomes) {
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<int64> agent(0, 99999);
+  std::uniform_int_distribution<int> minutes(1, 60);
+  std::uniform_int_distribution<int> bucket(0, kNumberMicroExposureBuckets - 1);
+  std::vector<InfectionOutcome> outcomes;
+  for (int i = 0; i < num_outcomes; ++i) {
+    const int source = i / 20;
+    InfectionOutcome outcome = {
+        .agent_uuid = 100000 + 3 * agent(rng),
+        .exposure = {.start_time = kDay + absl::Minutes(10 * source),
+                     .duration = absl::Minutes(minutes(rng)),
+                     .infectivity = 0.25f * (source % 4),
+                     .symptom_factor = 0.5f},
+        .exposure_type = InfectionOutcomeProto::CONTACT,
+        .source_uuid = 100000 + 150 * source};
+    outcome.exposure.micro_exposure_counts[bucket(rng)] = minutes(rng);
+    outcomes.push_back(outcome);
+  }
+  return outcomes;
+}
+
+// Agents with a positive test report it to their recent contacts.
+std::vector<ContactReport> StepReports(const int num_reports) {
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<int64> agent(0, 99999);
+  std::vector<ContactReport> reports;
+  for (int i = 0; i < num_reports; ++i) {
+    const int from = i / 10;
+    reports.push_back(
+        {.from_agent_uuid = 100000 + 3 * from,
+         .to_agent_uuid = 100000 + 3 * agent(rng),
+         .test_result = {.time_requested = kDay - absl::Hours(from % 3 + 1),
+                         .time_received = kDay,
+                         .needs_retry = false,
+                         .probability = 1.0f}});
+  }
+  return reports;
+}
+
+template <typename Msg>
+std::vector<Msg> RoundTrip(absl::Span<const Msg> msgs,
+                           const MessageCodingOptions& options) {
+  std::vector<Msg> decoded = {Msg()};
+  PANDEMIC_EXPECT_OK(DecodeMessages(EncodeMessages(msgs, options), &decoded));
+  return decoded;
+}
+
+TEST(MessageCodingTest, RoundTripsVisits) {
+  const std::vector<Visit> visits = StepVisits(100);
+  for (const bool compress : {false, true}) {
+    const std::vector<Visit> decoded =
+        RoundTrip<Visit>(visits, {.compress = compress});
+    EXPECT_THAT(decoded, ElementsAreArray(visits));
+    ASSERT_EQ(decoded.size(), visits.size());
+    for (int i = 0; i < visits.size(); ++i) {
+      EXPECT_EQ(decoded[i].symptom_factor, visits[i].symptom_factor);
+    }
+  }
+}
+
+TEST(MessageCodingTest, RoundTripsInfectionOutcomes) {
+  const std::vector<InfectionOutcome> outcomes = StepOutcomes(100);
+  for (const bool compress : {false, true}) {
+    const std::vector<InfectionOutcome> decoded =
+        RoundTrip<InfectionOutcome>(outcomes, {.compress = compress});
+    EXPECT_THAT(decoded, ElementsAreArray(outcomes));
+    ASSERT_EQ(decoded.size(), outcomes.size());
+    for (int i = 0; i < outcomes.size(); ++i) {
+      EXPECT_EQ(decoded[i].exposure.symptom_factor,
+                outcomes[i].exposure.symptom_factor);
+    }
+  }
+}
+
+TEST(MessageCodingTest, RoundTripsContactReports) {
+  const std::vector<ContactReport> reports = StepReports(100);
+  for (const bool compress : {false, true}) {
+    EXPECT_THAT(RoundTrip<ContactReport>(reports, {.compress = compress}),
+                ElementsAreArray(reports));
+  }
+}
+
+TEST(MessageCodingTest, RoundTripsExtremeValues) {
+  const std::vector<Visit> visits = {
+      {.location_uuid = kint64max,
+       .agent_uuid = kint64min,
+       .start_time = absl::InfinitePast(),
+       .end_time = absl::InfiniteFuture()},
+      {.location_uuid = kint64min,
+       .agent_uuid = kint64max,
+       .start_time = absl::UnixEpoch() - absl::Nanoseconds(1) / 4,
+       .end_time = absl::FromUnixSeconds(kint64max / 2)}};
+  EXPECT_THAT(RoundTrip<Visit>(visits, {}), ElementsAreArray(visits));
+  const std::vector<InfectionOutcome> outcomes = {
+      {.agent_uuid = -1,
+       .exposure = {.start_time = absl::InfiniteFuture(),
+                    .duration = absl::InfiniteDuration()},
+       .source_uuid = -1},
+      {.exposure = {.start_time = kDay,
+                    .duration = -absl::Seconds(1),
+                    .micro_exposure_counts = {1, 2, 3, 4, 5, 6, 7, 8, 9, 255}},
+       .exposure_type = InfectionOutcomeProto::LOCATION}};
+  EXPECT_THAT(RoundTrip<InfectionOutcome>(outcomes, {}),
+              ElementsAreArray(outcomes));
+}
+
+TEST(MessageCodingTest, RoundTripsEmptyBatches) {
+  EXPECT_TRUE(RoundTrip<Visit>({}, {}).empty());
+  EXPECT_TRUE(RoundTrip<ContactReport>({}, {.compress = true}).empty());
+}
+
+TEST(MessageCodingTest, RejectsCorruptBatches) {
+  const std::vector<Visit> visits = StepVisits(10);
+  for (const bool compress : {false, true}) {
+    const std::string data = EncodeMessages(visits, {.compress = compress});
+    std::vector<Visit> decoded;
+    for (int size = 0; size < data.size(); ++size) {
+      EXPECT_FALSE(
+          DecodeMessages(absl::string_view(data).substr(0, size), &decoded)
+              .ok());
+    }
+    EXPECT_FALSE(DecodeMessages(absl::StrCat(data, "x"), &decoded).ok());
+  }
+}
+
+TEST(MessageCodingTest, BoundsDecompressedSize) {
+  // Identical visits compress beyond the allowed ratio, so they are sent
+  // uncompressed.
+  const std::vector<Visit> visits(10000, StepVisits(1)[0]);
+  EXPECT_EQ(EncodeMessages(visits, {.compress = true})[0], '\0');
+  EXPECT_THAT(RoundTrip<Visit>(visits, {.compress = true}),
+              ElementsAreArray(visits));
+
+  // A compressed batch claiming 256 MiB: one literal byte repeated by a match.
+  constexpr uint64 kSize = uint64{1} << 28;
+  std::string data(1, '\x01');
+  PutVarint64(kSize, &data);
+  PutVarint64(1, &data);
+  data.push_back('a');
+  PutVarint64(1, &data);
+  PutVarint64(kSize - 5, &data);
+  std::vector<Visit> decoded;
+  EXPECT_FALSE(DecodeMessages(data, &decoded).ok());
+}
+
+// Records the bytes per message of raw, encoded and compressed batches.
+template <typename Msg>
+void MeasureBytesPerMessage(absl::string_view name,
+                            absl::Span<const Msg> msgs) {
+  const double raw = sizeof(Msg);
+  const double encoded = EncodeMessages(msgs).size() / double(msgs.size());
+  const double compressed =
+      EncodeMessages(msgs, {.compress = true}).size() / double(msgs.size());
+  testing::Test::RecordProperty(absl::StrCat(name, "_raw_bytes"),
+                                absl::StrCat(raw));
+  testing::Test::RecordProperty(absl::StrCat(name, "_encoded_bytes"),
+                                absl::StrCat(encoded));
+  testing::Test::RecordProperty(absl::StrCat(name, "_compressed_bytes"),
+                                absl::StrCat(compressed));
+  EXPECT_LT(encoded, raw / 2) << name;
+  EXPECT_LE(compressed, encoded) << name;
+}
+
+TEST(MessageCodingTest, MeasuresBytesPerMessage) {
+  MeasureBytesPerMessage<Visit>("visit", StepVisits(1000));
+  MeasureBytesPerMessage<InfectionOutcome>("outcome", StepOutcomes(1000));
+  MeasureBytesPerMessage<ContactReport>("report", StepReports(1000));
+}
+
+}  // namespace
+}  // namespace abesim
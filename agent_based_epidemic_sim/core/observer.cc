@@ -25,24 +25,45 @@ void ObserverManager::RemoveFactory(ObserverFactoryBase* factory) {
 }
 
 void ObserverManager::AggregateForTimestep(const Timestep& timestep) {
+  std::unique_ptr<Execution> execution;
+  if (executor_ != nullptr) execution = executor_->NewExecution();
+  for (auto& factory : factories_) {
+    factory->AggregatePartitions(timestep, execution.get());
+  }
+  if (execution != nullptr) execution->Wait();
   for (auto& factory : factories_) {
     factory->Aggregate(timestep);
   }
-  shards_.clear();
+  // Observers are re-attached on first use in the next timestep, which also
+  // picks up any factories added or removed in between.
+  for (Shard& shard : shards_) {
+    shard.attached = false;
+  }
 }
 
-ObserverShard* ObserverManager::MakeShard() {
-  shards_.push_back(absl::make_unique<ObserverShard>());
-  for (ObserverFactoryBase* factory : factories_) {
-    factory->MakeObserverForShard(shards_.back().get());
+void ObserverManager::AddMemoryUsage(MemoryUsage* const usage) const {
+  for (const ObserverFactoryBase* factory : factories_) {
+    factory->AddMemoryUsage(usage);
   }
-  return shards_.back().get();
 }
 
-void ObserverManager::RegisterObservers(ObserverShard* shard) {
-  for (auto* factory : factories_) {
-    factory->MakeObserverForShard(shard);
+ObserverShard* ObserverManager::GetShard(const int index) {
+  if (shards_.size() <= index) shards_.resize(index + 1);
+  Shard& shard = shards_[index];
+  if (shard.shard == nullptr) shard.shard = absl::make_unique<ObserverShard>();
+  if (!shard.attached) {
+    shard.shard->Clear();
+    for (ObserverFactoryBase* factory : factories_) {
+      factory->AttachObserverToShard(index, shard.shard.get());
+    }
+    shard.attached = true;
   }
+  return shard.shard.get();
+}
+
+void ObserverShard::Clear() {
+  agent_infection_observers_.clear();
+  location_visit_observers_.clear();
 }
 
 void ObserverShard::Observe(const Agent& agent,
@@ -17,13 +17,20 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_OBSERVER_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_OBSERVER_H_
 
+#include <algorithm>
 #include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_set.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/executor.h"
 
 // This file defines interfaces for observing the simulation for output and
 // recording of statistics.  Recording output from a simulation is a three step
@@ -34,7 +41,8 @@
 // Write a class that implements one or more of the obsever interfaces.  This is
 // the code that will actually look at data as the simulation progresses.
 // Simulators may create multiple instances of these observers for each timestep
-// of the simulation, but a single observer will only live for one timestep.
+// of the simulation.  By default a single observer will only live for one
+// timestep, but observers may opt in to being reused (see below).
 //
 // class LocationVisitHistogramObserver : public LocationVisitObserver {
 //  public:
@@ -91,7 +99,32 @@
 // threading model of the simulation they are observing. The methods of objects
 // deriving from one or more Observer interfaces will not be called concurrently
 // by multiple threads. Similarly ObserverFactory methods will not be called
-// concurrently by multiple threads.
+// concurrently by multiple threads, with the exception of AggregatePartition
+// which factories may opt in to (see below).
+//
+// Parallel aggregation:
+// Aggregating large observers (for instance per-agent maps) serially at the end
+// of every timestep can dominate the runtime of a step.  Factories may opt in
+// to parallel aggregation by returning a positive number of partitions from
+// AggregationPartitions.  The observations are then expected to be split into
+// that many disjoint partitions, for example by hashing the key of each
+// observation.  At the end of a timestep AggregatePartition is called once for
+// each partition, potentially concurrently from different threads, followed by
+// a single call to Aggregate which combines the partial results.
+//
+// Observer reuse:
+// By default observers are destroyed at the end of a timestep.  Factories may
+// opt in to reusing them by overriding ResetObserver, which is called after
+// Aggregate, in which case the same observer is handed to the same worker for
+// the following timestep.  Resetting should discard all observations while
+// retaining allocated capacity, so that observing a simulation in steady state
+// does not allocate.
+//
+// Memory usage:
+// Observers that define a public `int64 MemoryUsage() const` method, returning
+// the bytes they hold including sizeof(*this), are reported by it in memory
+// usage reports (see memory_usage.h).  Other observers are counted by their
+// size.
 
 namespace abesim {
 
@@ -122,17 +155,25 @@ class ObserverFactoryBase {
 
  private:
   friend class ObserverManager;
-  virtual void MakeObserverForShard(ObserverShard*) = 0;
+  // Registers the observer for the shard with the given index, creating it if
+  // it does not exist yet.
+  virtual void AttachObserverToShard(int index, ObserverShard* shard) = 0;
+  // Schedules AggregatePartition calls for all partitions on the given
+  // execution, or runs them inline if execution is nullptr.
+  virtual void AggregatePartitions(const Timestep& timestep,
+                                   Execution* execution) = 0;
   virtual void Aggregate(const Timestep& timestep) = 0;
+  virtual void AddMemoryUsage(MemoryUsage* usage) const = 0;
 };
 
 template <typename Observer>
 class ObserverFactory : public ObserverFactoryBase {
  public:
-  // Makes a new Observer instance.  Observers only live for a single timestep.
-  // Many observer instances may be produced for a given timestep, and all
-  // the observers that are produced will be passed to Aggregate at the end of
-  // the timestep.
+  // Makes a new Observer instance.  Observers only live for a single timestep
+  // unless ResetObserver is overridden, in which case they are reused for
+  // following timesteps.  Many observer instances may be used for a given
+  // timestep, and all of them will be passed to Aggregate at the end of the
+  // timestep.
   virtual std::unique_ptr<Observer> MakeObserver() const = 0;
 
   // Aggregates the data from many Observers.  This is called at the end of each
@@ -141,11 +182,44 @@ class ObserverFactory : public ObserverFactoryBase {
       const Timestep& timestep,
       absl::Span<std::unique_ptr<Observer> const> observers) = 0;
 
+  // The number of disjoint partitions the observations can be aggregated in.
+  // Returning 0 (the default) disables parallel aggregation.
+  virtual int AggregationPartitions() const { return 0; }
+
+  // Aggregates a single partition of the data from many Observers.  Called for
+  // every partition before Aggregate, potentially concurrently for different
+  // partitions.  Implementations must only access state belonging to the given
+  // partition.
+  virtual void AggregatePartition(
+      const Timestep& timestep, int partition,
+      absl::Span<std::unique_ptr<Observer> const> observers) {}
+
+  // Discards the observations of an observer after Aggregate so that it can be
+  // reused in the following timestep.  Returns false if the observer should be
+  // destroyed instead, which the default implementation does.
+  virtual bool ResetObserver(Observer* observer) const { return false; }
+
  private:
-  void MakeObserverForShard(ObserverShard* shard) override;
+  template <typename T, typename = void>
+  struct HasMemoryUsage : std::false_type {};
+  template <typename T>
+  struct HasMemoryUsage<
+      T, std::void_t<decltype(std::declval<const T&>().MemoryUsage())>>
+      : std::true_type {};
+
+  void AttachObserverToShard(int index, ObserverShard* shard) override;
+  void AggregatePartitions(const Timestep& timestep,
+                           Execution* execution) override;
   void Aggregate(const Timestep& timestep) override;
+  void AddMemoryUsage(MemoryUsage* usage) const override;
+  absl::Span<std::unique_ptr<Observer> const> ActiveObservers() const {
+    return absl::MakeConstSpan(observers_.data(), active_observers_);
+  }
 
+  // Observers indexed by shard.  Only the first active_observers_ entries have
+  // been used in the current timestep.
   std::vector<std::unique_ptr<Observer>> observers_;
+  int active_observers_ = 0;
 };
 
 // An ObserverShard is a view onto the set of observers being used in a
@@ -159,12 +233,21 @@ class ObserverShard : public AgentInfectionObserver,
   void Observe(const Location& location,
                absl::Span<const Visit> visits) override;
 
+  // Returns true if no observers are registered with this shard.
+  bool empty() const {
+    return agent_infection_observers_.empty() &&
+           location_visit_observers_.empty();
+  }
+
  private:
   template <typename Observer>
   friend class ObserverFactory;
 
+  friend class ObserverManager;
+
   template <typename Observer>
   void RegisterObserver(Observer* observer);
+  void Clear();
 
   std::vector<AgentInfectionObserver*> agent_infection_observers_;
   std::vector<LocationVisitObserver*> location_visit_observers_;
@@ -184,32 +267,83 @@ class ObserverManager {
   void AddFactory(ObserverFactoryBase* factory);
   // Removes an ObserverFactory.
   void RemoveFactory(ObserverFactoryBase* factory);
-  // Calls ObserverFactory::Aggregate for all added factories.
+  // Calls ObserverFactory::Aggregate for all added factories.  Partitioned
+  // aggregation is run on the executor set with SetExecutor, if any.
   void AggregateForTimestep(const Timestep& timestep);
-  // Make a new ObserverShard that can be used by a worker thread to report
-  // observations.  Note that the manager retains ownership and that the
-  // returned pointer will only be valid until the next call to
-  // AggregateTimestep.
-  ObserverShard* MakeShard();
+  // Sets an executor used to aggregate partitions in parallel.  If no executor
+  // is set partitions are aggregated serially in the calling thread.  The
+  // executor must outlive the manager.
+  void SetExecutor(Executor* executor) { executor_ = executor; }
+  // Adds the memory held by the observers of all factories to usage.
+  void AddMemoryUsage(MemoryUsage* usage) const;
+  // Returns the ObserverShard that the worker with the given index should use
+  // to report observations for the current timestep.  Shards are pinned to
+  // worker indices: a given index maps to the same shard, backed by the same
+  // reusable observers, on every timestep, and calling GetShard repeatedly
+  // within a timestep returns the same shard.  The manager retains ownership.
+  ObserverShard* GetShard(int index);
 
  private:
-  friend class ObserverShard;
-  void RegisterObservers(ObserverShard* shard);
+  struct Shard {
+    std::unique_ptr<ObserverShard> shard;
+    // Whether the factories' observers are attached for the current timestep.
+    bool attached = false;
+  };
 
   absl::flat_hash_set<ObserverFactoryBase*> factories_;
-  std::vector<std::unique_ptr<ObserverShard>> shards_;
+  std::vector<Shard> shards_;
+  Executor* executor_ = nullptr;
 };
 
+template <typename Observer>
+void ObserverFactory<Observer>::AggregatePartitions(const Timestep& timestep,
+                                                    Execution* execution) {
+  const int partitions = AggregationPartitions();
+  for (int partition = 0; partition < partitions; ++partition) {
+    if (execution == nullptr) {
+      AggregatePartition(timestep, partition, ActiveObservers());
+    } else {
+      execution->Add([this, &timestep, partition]() {
+        AggregatePartition(timestep, partition, ActiveObservers());
+      });
+    }
+  }
+}
+
 template <typename Observer>
 void ObserverFactory<Observer>::Aggregate(const Timestep& timestep) {
-  Aggregate(timestep, observers_);
-  observers_.clear();
+  Aggregate(timestep, ActiveObservers());
+  for (int i = 0; i < active_observers_; ++i) {
+    if (!ResetObserver(observers_[i].get())) observers_[i].reset();
+  }
+  active_observers_ = 0;
 }
 
 template <typename Observer>
-void ObserverFactory<Observer>::MakeObserverForShard(ObserverShard* shard) {
-  observers_.push_back(MakeObserver());
-  shard->RegisterObserver(observers_.back().get());
+void ObserverFactory<Observer>::AddMemoryUsage(MemoryUsage* const usage) const {
+  int64 bytes = VectorMemoryUsage(observers_);
+  for (const auto& observer : observers_) {
+    if (observer == nullptr) continue;
+    if constexpr (HasMemoryUsage<Observer>::value) {
+      bytes += observer->MemoryUsage();
+    } else {
+      bytes += sizeof(Observer);
+    }
+  }
+  usage->Add("observers/observers", bytes);
+}
+
+template <typename Observer>
+void ObserverFactory<Observer>::AttachObserverToShard(const int index,
+                                                      ObserverShard* shard) {
+  if (observers_.size() <= index) observers_.resize(index + 1);
+  // Shards below index that are not used this timestep still get an (empty)
+  // observer so that Aggregate never sees a null observer.
+  for (int i = active_observers_; i <= index; ++i) {
+    if (observers_[i] == nullptr) observers_[i] = MakeObserver();
+  }
+  active_observers_ = std::max(active_observers_, index + 1);
+  shard->RegisterObserver(observers_[index].get());
 }
 
 template <typename Observer>
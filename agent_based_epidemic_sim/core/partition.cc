@@ -0,0 +1,132 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/partition.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+int Lookup(const absl::flat_hash_map<int64, int>& moves, const int64 uuid,
+           const int base_node) {
+  auto iter = moves.find(uuid);
+  return iter == moves.end() ? base_node : iter->second;
+}
+
+void LookupAll(const absl::flat_hash_map<int64, int>& moves,
+               const absl::Span<const int64> uuids,
+               const absl::Span<int> nodes) {
+  if (moves.empty()) return;
+  for (int i = 0; i < uuids.size(); ++i) {
+    nodes[i] = Lookup(moves, uuids[i], nodes[i]);
+  }
+}
+
+void Move(const int base_node, const int64 uuid, const int node,
+          absl::flat_hash_map<int64, int>* const moves) {
+  if (node == base_node) {
+    moves->erase(uuid);
+  } else {
+    (*moves)[uuid] = node;
+  }
+}
+
+class UuidModuloPartition : public Partition {
+ public:
+  explicit UuidModuloPartition(const int num_nodes) : num_nodes_(num_nodes) {
+    CHECK_GT(num_nodes, 0);
+  }
+
+  int num_nodes() const override { return num_nodes_; }
+  int AgentNode(const int64 uuid) const override { return Node(uuid); }
+  int LocationNode(const int64 uuid) const override { return Node(uuid); }
+  void AgentNodes(const absl::Span<const int64> uuids,
+                  const absl::Span<int> nodes) const override {
+    Nodes(uuids, nodes);
+  }
+  void LocationNodes(const absl::Span<const int64> uuids,
+                     const absl::Span<int> nodes) const override {
+    Nodes(uuids, nodes);
+  }
+
+ private:
+  int Node(const int64 uuid) const {
+    const int64 node = uuid % num_nodes_;
+    return node < 0 ? node + num_nodes_ : node;
+  }
+  void Nodes(const absl::Span<const int64> uuids,
+             const absl::Span<int> nodes) const {
+    for (int i = 0; i < uuids.size(); ++i) {
+      nodes[i] = Node(uuids[i]);
+    }
+  }
+
+  const int num_nodes_;
+};
+
+}  // namespace
+
+void Partition::AgentNodes(const absl::Span<const int64> uuids,
+                           const absl::Span<int> nodes) const {
+  for (int i = 0; i < uuids.size(); ++i) {
+    nodes[i] = AgentNode(uuids[i]);
+  }
+}
+
+void Partition::LocationNodes(const absl::Span<const int64> uuids,
+                              const absl::Span<int> nodes) const {
+  for (int i = 0; i < uuids.size(); ++i) {
+    nodes[i] = LocationNode(uuids[i]);
+  }
+}
+
+std::unique_ptr<Partition> NewUuidModuloPartition(const int num_nodes) {
+  return absl::make_unique<UuidModuloPartition>(num_nodes);
+}
+
+int RoutingTable::AgentNode(const int64 uuid) const {
+  return Lookup(agent_moves_, uuid, base_->AgentNode(uuid));
+}
+
+int RoutingTable::LocationNode(const int64 uuid) const {
+  return Lookup(location_moves_, uuid, base_->LocationNode(uuid));
+}
+
+void RoutingTable::AgentNodes(const absl::Span<const int64> uuids,
+                              const absl::Span<int> nodes) const {
+  base_->AgentNodes(uuids, nodes);
+  LookupAll(agent_moves_, uuids, nodes);
+}
+
+void RoutingTable::LocationNodes(const absl::Span<const int64> uuids,
+                                 const absl::Span<int> nodes) const {
+  base_->LocationNodes(uuids, nodes);
+  LookupAll(location_moves_, uuids, nodes);
+}
+
+void RoutingTable::MoveAgent(const int64 uuid, const int node) {
+  DCHECK(node >= 0 && node < num_nodes());
+  Move(base_->AgentNode(uuid), uuid, node, &agent_moves_);
+}
+
+void RoutingTable::MoveLocation(const int64 uuid, const int node) {
+  DCHECK(node >= 0 && node < num_nodes());
+  Move(base_->LocationNode(uuid), uuid, node, &location_moves_);
+}
+
+}  // namespace abesim
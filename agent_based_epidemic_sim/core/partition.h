@@ -0,0 +1,83 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_PARTITION_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_PARTITION_H_
+
+#include <memory>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// A Partition assigns each agent and location of a distributed simulation to
+// the node that owns it.  Every node must use the same partition.  Agent and
+// location uuids are separate namespaces, so they are looked up separately.
+class Partition {
+ public:
+  virtual ~Partition() = default;
+
+  virtual int num_nodes() const = 0;
+  virtual int AgentNode(int64 uuid) const = 0;
+  virtual int LocationNode(int64 uuid) const = 0;
+
+  // Batch forms of the above, setting nodes[i] to the node of uuids[i].
+  virtual void AgentNodes(absl::Span<const int64> uuids,
+                          absl::Span<int> nodes) const;
+  virtual void LocationNodes(absl::Span<const int64> uuids,
+                             absl::Span<int> nodes) const;
+};
+
+// Assigns agents and locations to nodes by their uuid modulo num_nodes.
+std::unique_ptr<Partition> NewUuidModuloPartition(int num_nodes);
+
+// A RoutingTable is a Partition whose assignments change as ownership of
+// agents and locations moves between nodes while a simulation runs.  It
+// starts out as the base partition, which must outlive it.  Every node must
+// apply the same moves, and only between steps: lookups are not synchronized
+// with moves.
+class RoutingTable : public Partition {
+ public:
+  explicit RoutingTable(const Partition* base) : base_(base) {}
+
+  int num_nodes() const override { return base_->num_nodes(); }
+  int AgentNode(int64 uuid) const override;
+  int LocationNode(int64 uuid) const override;
+  void AgentNodes(absl::Span<const int64> uuids,
+                  absl::Span<int> nodes) const override;
+  void LocationNodes(absl::Span<const int64> uuids,
+                     absl::Span<int> nodes) const override;
+
+  void MoveAgent(int64 uuid, int node);
+  void MoveLocation(int64 uuid, int node);
+
+  // The number of agents and locations not on their node in the base
+  // partition.
+  int64 num_moved_agents() const { return agent_moves_.size(); }
+  int64 num_moved_locations() const { return location_moves_.size(); }
+
+ private:
+  const Partition* const base_;
+  // Only the assignments that differ from base_.
+  absl::flat_hash_map<int64, int> agent_moves_;
+  absl::flat_hash_map<int64, int> location_moves_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_PARTITION_H_
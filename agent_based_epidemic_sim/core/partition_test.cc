@@ -0,0 +1,77 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/partition.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+
+TEST(PartitionTest, AssignsUuidsModuloNodes) {
+  auto partition = NewUuidModuloPartition(3);
+  EXPECT_EQ(partition->num_nodes(), 3);
+  EXPECT_EQ(partition->AgentNode(7), 1);
+  EXPECT_EQ(partition->LocationNode(8), 2);
+  EXPECT_EQ(partition->AgentNode(-1), 2);
+}
+
+TEST(RoutingTableTest, StartsOutAsBasePartition) {
+  auto base = NewUuidModuloPartition(3);
+  RoutingTable table(base.get());
+  EXPECT_EQ(table.num_nodes(), 3);
+  for (int64 uuid = 0; uuid < 10; ++uuid) {
+    EXPECT_EQ(table.AgentNode(uuid), base->AgentNode(uuid));
+    EXPECT_EQ(table.LocationNode(uuid), base->LocationNode(uuid));
+  }
+}
+
+TEST(RoutingTableTest, MovesAgentsAndLocationsSeparately) {
+  auto base = NewUuidModuloPartition(3);
+  RoutingTable table(base.get());
+  table.MoveAgent(4, 2);
+  table.MoveLocation(5, 0);
+  EXPECT_EQ(table.AgentNode(4), 2);
+  EXPECT_EQ(table.LocationNode(4), 1);
+  EXPECT_EQ(table.AgentNode(5), 2);
+  EXPECT_EQ(table.LocationNode(5), 0);
+  EXPECT_EQ(table.num_moved_agents(), 1);
+  EXPECT_EQ(table.num_moved_locations(), 1);
+
+  const std::vector<int64> uuids = {3, 4, 5};
+  std::vector<int> nodes(uuids.size());
+  table.AgentNodes(uuids, absl::MakeSpan(nodes));
+  EXPECT_THAT(nodes, ElementsAre(0, 2, 2));
+  table.LocationNodes(uuids, absl::MakeSpan(nodes));
+  EXPECT_THAT(nodes, ElementsAre(0, 1, 0));
+}
+
+TEST(RoutingTableTest, MovingBackForgetsMove) {
+  auto base = NewUuidModuloPartition(3);
+  RoutingTable table(base.get());
+  table.MoveAgent(4, 2);
+  table.MoveAgent(4, 0);
+  EXPECT_EQ(table.AgentNode(4), 0);
+  table.MoveAgent(4, 1);
+  EXPECT_EQ(table.AgentNode(4), 1);
+  EXPECT_EQ(table.num_moved_agents(), 0);
+}
+
+}  // namespace
+}  // namespace abesim
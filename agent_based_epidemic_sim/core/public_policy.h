@@ -132,6 +132,17 @@ class PolicyGenerator {
  public:
   // Get a policy for the next worker.
   virtual const PublicPolicy* NextPolicy() = 0;
+
+  // Policies are identified by a tier, so that an agent that moves to another
+  // node of a distributed simulation keeps its policy.  PolicyTier returns
+  // the tier of a policy returned by NextPolicy, and TierPolicy the policy of
+  // a tier, or null for an unknown tier.  Generators that return a single
+  // policy have a single tier 0.
+  virtual int PolicyTier(const PublicPolicy* policy) const { return 0; }
+  virtual const PublicPolicy* TierPolicy(int tier) {
+    return tier == 0 ? NextPolicy() : nullptr;
+  }
+
   virtual ~PolicyGenerator() = default;
 };
 
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_RAW_CODING_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_RAW_CODING_H_
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+
+namespace abesim {
+
+// Encodes trivially copyable values as their bytes, for state that is handed
+// between the nodes of a distributed simulation.  Like raw message batches,
+// see core/message_coding.h, this requires all nodes to run the same binary.
+
+template <typename T>
+void AppendRaw(const T& value, std::string* const out) {
+  static_assert(std::is_trivially_copyable<T>::value, "");
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Appends the number of values followed by the values.
+template <typename T>
+void AppendRawSpan(const absl::Span<const T> values, std::string* const out) {
+  static_assert(std::is_trivially_copyable<T>::value, "");
+  AppendRaw<uint64>(values.size(), out);
+  out->append(reinterpret_cast<const char*>(values.data()),
+              values.size() * sizeof(T));
+}
+
+inline void AppendRawString(const absl::string_view value,
+                            std::string* const out) {
+  AppendRawSpan<char>(value, out);
+}
+
+// Reads values in the order they were appended.  Reads fail once the data is
+// exhausted, after which the reader remains empty.
+class RawReader {
+ public:
+  explicit RawReader(const absl::string_view data) : data_(data) {}
+
+  template <typename T>
+  bool Read(T* const value) {
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    if (data_.size() < sizeof(T)) return Fail();
+    std::memcpy(value, data_.data(), sizeof(T));
+    data_.remove_prefix(sizeof(T));
+    return true;
+  }
+
+  template <typename T>
+  bool ReadVector(std::vector<T>* const values) {
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    uint64 size;
+    if (!Read(&size) || data_.size() / sizeof(T) < size) return Fail();
+    values->resize(size);
+    std::memcpy(values->data(), data_.data(), size * sizeof(T));
+    data_.remove_prefix(size * sizeof(T));
+    return true;
+  }
+
+  // The returned view points into the data passed to the constructor.
+  bool ReadString(absl::string_view* const value) {
+    uint64 size;
+    return Read(&size) && ReadBytes(size, value);
+  }
+
+  // Reads a varint appended by PutVarint64, see util/varint.h.
+  bool ReadVarint(uint64* const value) {
+    return GetVarint64(&data_, value) || Fail();
+  }
+
+  // Reads the given number of bytes, which point into the data passed to the
+  // constructor.
+  bool ReadBytes(const uint64 size, absl::string_view* const value) {
+    if (data_.size() < size) return Fail();
+    *value = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return true;
+  }
+
+  bool empty() const { return data_.empty(); }
+
+ private:
+  bool Fail() {
+    data_ = absl::string_view();
+    return false;
+  }
+
+  absl::string_view data_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_RAW_CODING_H_
@@ -0,0 +1,99 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/raw_coding.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+
+struct Record {
+  int64 uuid;
+  absl::Time time;
+};
+
+TEST(RawCodingTest, RoundTripsValues) {
+  std::string data;
+  AppendRaw<int32>(-7, &data);
+  AppendRaw(Record{.uuid = 42, .time = absl::FromUnixSeconds(100)}, &data);
+  const std::vector<int64> uuids = {3, 1, 4};
+  AppendRawSpan<int64>(uuids, &data);
+  AppendRawString("state", &data);
+  AppendRawSpan<int64>({}, &data);
+
+  RawReader reader(data);
+  int32 i;
+  ASSERT_TRUE(reader.Read(&i));
+  EXPECT_EQ(i, -7);
+  Record record;
+  ASSERT_TRUE(reader.Read(&record));
+  EXPECT_EQ(record.uuid, 42);
+  EXPECT_EQ(record.time, absl::FromUnixSeconds(100));
+  std::vector<int64> read_uuids;
+  ASSERT_TRUE(reader.ReadVector(&read_uuids));
+  EXPECT_THAT(read_uuids, ElementsAre(3, 1, 4));
+  absl::string_view state;
+  ASSERT_TRUE(reader.ReadString(&state));
+  EXPECT_EQ(state, "state");
+  ASSERT_TRUE(reader.ReadVector(&read_uuids));
+  EXPECT_TRUE(read_uuids.empty());
+  EXPECT_TRUE(reader.empty());
+}
+
+TEST(RawCodingTest, RoundTripsVarints) {
+  const std::vector<uint64> values = {0, 1, 127, 128, 300, ~uint64{0}};
+  std::string data;
+  for (const uint64 value : values) PutVarint64(value, &data);
+  EXPECT_EQ(data.size(), 1 + 1 + 1 + 2 + 2 + 10);
+  data.append("xy");
+
+  RawReader reader(data);
+  for (const uint64 value : values) {
+    uint64 read;
+    ASSERT_TRUE(reader.ReadVarint(&read));
+    EXPECT_EQ(read, value);
+  }
+  absl::string_view bytes;
+  ASSERT_TRUE(reader.ReadBytes(2, &bytes));
+  EXPECT_EQ(bytes, "xy");
+  EXPECT_TRUE(reader.empty());
+  uint64 read;
+  EXPECT_FALSE(reader.ReadVarint(&read));
+}
+
+TEST(RawCodingTest, FailsOnTruncatedData) {
+  std::string data;
+  AppendRawSpan<int64>(std::vector<int64>{1, 2}, &data);
+  data.pop_back();
+  RawReader reader(data);
+  std::vector<int64> uuids;
+  EXPECT_FALSE(reader.ReadVector(&uuids));
+  EXPECT_TRUE(reader.empty());
+  int64 uuid;
+  EXPECT_FALSE(reader.Read(&uuid));
+}
+
+}  // namespace
+}  // namespace abesim
@@ -15,9 +15,16 @@
 #include "agent_based_epidemic_sim/core/seir_agent.h"
 
 #include <cmath>
+#include <iterator>
+#include <string>
+#include <vector>
 
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/constants.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
+#include "agent_based_epidemic_sim/core/raw_coding.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
@@ -111,7 +118,12 @@ void SEIRAgent::MaybeUpdateHealthTransitions(const Timestep& timestep) {
         !initial_infection_time_.has_value()) {
       initial_infection_time_ = original_transition_time;
     }
-    health_transitions_.push_back(next_health_transition_);
+    // Renewals of the current health state, such as recurrent SUSCEPTIBLE
+    // dwell times, are merged into the current transition.
+    if (next_health_transition_.health_state !=
+        health_transitions_.back().health_state) {
+      health_transitions_.push_back(next_health_transition_);
+    }
     next_health_transition_ =
         transition_model_->GetNextHealthTransition(next_health_transition_);
     absl::Duration health_state_duration =
@@ -125,6 +137,77 @@ void SEIRAgent::MaybeUpdateHealthTransitions(const Timestep& timestep) {
   }
 }
 
+void SEIRAgent::CompactHealthTransitions(const absl::Time horizon) {
+  // Without a log the dropped transitions would be lost.
+  if (health_transition_log_ == nullptr) return;
+  // Keeps the transition in effect at the horizon and all later ones.  The
+  // transitions are scanned in order rather than binary searched, as nothing
+  // guarantees that they are sorted by time, so compaction stops at the first
+  // transition after the horizon.
+  auto first_retained = health_transitions_.begin();
+  while (std::next(first_retained) != health_transitions_.end() &&
+         std::next(first_retained)->time <= horizon) {
+    ++first_retained;
+  }
+  if (first_retained == health_transitions_.begin()) return;
+  health_transition_log_->Append(
+      uuid_,
+      absl::MakeConstSpan(&*health_transitions_.begin(), &*first_retained));
+  health_transitions_.erase(health_transitions_.begin(), first_retained);
+}
+
+void SEIRAgent::AddMemoryUsage(MemoryUsage* const usage) const {
+  usage->Add("agents/objects", sizeof(*this));
+  usage->Add("agents/health_transitions",
+             VectorMemoryUsage(health_transitions_));
+  // List nodes hold two pointers besides the contact.
+  usage->Add("agents/contacts",
+             contacts_.size() * (sizeof(Contact) + 2 * sizeof(void*)) +
+                 HashContainerMemoryUsage(contact_set_));
+}
+
+void SEIRAgent::SaveState(std::string* const state) const {
+  AppendRawSpan<HealthTransition>(health_transitions_, state);
+  AppendRaw(next_health_transition_, state);
+  AppendRaw<bool>(initial_infection_time_.has_value(), state);
+  AppendRaw(initial_infection_time_.value_or(absl::InfinitePast()), state);
+  AppendRaw(contact_summary_, state);
+  AppendRaw(test_result_, state);
+  const std::vector<Contact> contacts(contacts_.begin(), contacts_.end());
+  AppendRawSpan<Contact>(contacts, state);
+}
+
+absl::Status SEIRAgent::RestoreState(const absl::string_view state) {
+  RawReader reader(state);
+  std::vector<HealthTransition> health_transitions;
+  HealthTransition next_health_transition;
+  bool infected;
+  absl::Time initial_infection_time;
+  ContactSummary contact_summary;
+  TestResult test_result;
+  std::vector<Contact> contacts;
+  if (!reader.ReadVector(&health_transitions) ||
+      !reader.Read(&next_health_transition) || !reader.Read(&infected) ||
+      !reader.Read(&initial_infection_time) ||
+      !reader.Read(&contact_summary) || !reader.Read(&test_result) ||
+      !reader.ReadVector(&contacts) || !reader.empty() ||
+      health_transitions.empty()) {
+    return absl::InvalidArgumentError("Invalid SEIRAgent state");
+  }
+  health_transitions_ = std::move(health_transitions);
+  next_health_transition_ = next_health_transition;
+  initial_infection_time_.reset();
+  if (infected) initial_infection_time_ = initial_infection_time;
+  contact_summary_ = contact_summary;
+  test_result_ = test_result;
+  contact_set_.clear();
+  contacts_.clear();
+  for (const Contact& contact : contacts) {
+    contact_set_.insert(contacts_.insert(contacts_.end(), contact));
+  }
+  return absl::OkStatus();
+}
+
 void SEIRAgent::ComputeVisits(const Timestep& timestep,
                               Broker<Visit>* visit_broker) const {
   thread_local std::vector<Visit> visits;
@@ -279,6 +362,11 @@ void SEIRAgent::ProcessInfectionOutcomes(
   }
   contact_summary_.retention_horizon = earliest_retained_contact_time;
   MaybeUpdateHealthTransitions(timestep);
+  // A pending retest may still look back to the time it was requested.
+  CompactHealthTransitions(test_result_.needs_retry
+                               ? std::min(earliest_retained_contact_time,
+                                          test_result_.time_requested)
+                               : earliest_retained_contact_time);
 }
 
 float SEIRAgent::CurrentInfectivity(const absl::Time& current_time) const {
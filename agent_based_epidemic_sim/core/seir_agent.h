@@ -18,8 +18,11 @@
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_SEIR_AGENT_H_
 
 #include <algorithm>
+#include <string>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/agent.h"
@@ -43,6 +46,16 @@ inline bool IsInfectedState(const HealthState::State& subject_health_state) {
                    subject_health_state) == kNotInfectedHealthStates.end();
 }
 
+// Receives the health transitions that SEIRAgents compact out of memory, in
+// chronological order per agent.  Must be thread safe, since agents are
+// processed concurrently.
+class HealthTransitionLog {
+ public:
+  virtual void Append(
+      int64 uuid, absl::Span<const HealthTransition> health_transitions) = 0;
+  virtual ~HealthTransitionLog() = default;
+};
+
 // An agent that implements a stochastic SEIR model.
 class SEIRAgent : public Agent {
  public:
@@ -85,11 +98,36 @@ class SEIRAgent : public Agent {
 
   TestResult CurrentTestResult() const override { return test_result_; }
 
+  // Returns the health transitions of the agent.  Transitions that do not
+  // change the health state are merged into their predecessor.  If a health
+  // transition log is set, transitions superseded before the contact retention
+  // horizon of the last processed timestep are moved to the log, except for
+  // the one in effect at the horizon.
   absl::Span<const HealthTransition> HealthTransitions() const override {
     return absl::Span<const HealthTransition>(health_transitions_.data(),
                                               health_transitions_.size());
   }
 
+  // The transition model and visit generator are counted by pointer only.
+  void AddMemoryUsage(MemoryUsage* usage) const override;
+
+  // Appends the state that changes as the agent is simulated, so that the
+  // agent can move to another node of a distributed simulation.  The models,
+  // visit generator and public policy are not included, as the receiving node
+  // builds those itself.
+  void SaveState(std::string* state) const;
+  // Replaces the state of the agent with one appended by SaveState.
+  absl::Status RestoreState(absl::string_view state);
+
+  const PublicPolicy* public_policy() const { return public_policy_; }
+
+  // Sets a log that receives the health transitions dropped from memory.
+  // Transitions are only dropped while a log is set.  Does not take ownership
+  // of log, which must outlive the agent.
+  void set_health_transition_log(HealthTransitionLog* log) {
+    health_transition_log_ = log;
+  }
+
   // For use in testing.
   HealthTransition NextHealthTransition() const {
     return next_health_transition_;
@@ -126,6 +164,9 @@ class SEIRAgent : public Agent {
 
   // Advances the health state transitions.
   void MaybeUpdateHealthTransitions(const Timestep& timestep);
+  // Moves the health transitions superseded before horizon to the health
+  // transition log, if any.
+  void CompactHealthTransitions(absl::Time horizon);
   // Splits visits on HealthTransition boundaries so that a unique HealthState
   // can be assigned to each visit.
   void SplitAndAssignHealthStates(std::vector<Visit>* visits) const;
@@ -146,9 +187,11 @@ class SEIRAgent : public Agent {
   const int64 uuid_;
   // The health state changes this agent has observed. Ordered in chronological
   // order. Note that the next pending state transition is stored in
-  // next_health_transition for ease of notation.
-  // TODO: Implement state persistence and clean up.
+  // next_health_transition for ease of notation.  Consecutive transitions
+  // always differ in health state, and only a bounded window is retained
+  // while a health transition log is set, see HealthTransitions().
   std::vector<HealthTransition> health_transitions_;
+  HealthTransitionLog* health_transition_log_ = nullptr;
   HealthTransition next_health_transition_;
   absl::optional<absl::Time> initial_infection_time_;
 
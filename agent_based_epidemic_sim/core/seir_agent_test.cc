@@ -14,15 +14,20 @@
 
 #include "agent_based_epidemic_sim/core/seir_agent.h"
 
+#include <string>
+
+#include "absl/status/status.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/broker.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/core/public_policy.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/core/transition_model.h"
 #include "agent_based_epidemic_sim/core/visit.h"
 #include "agent_based_epidemic_sim/core/visit_generator.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -30,6 +35,8 @@ namespace abesim {
 namespace {
 
 using testing::_;
+using testing::ElementsAre;
+using testing::ElementsAreArray;
 using testing::Eq;
 using testing::NotNull;
 using testing::Return;
@@ -84,6 +91,18 @@ class MockPublicPolicy : public PublicPolicy {
   MOCK_METHOD(absl::Duration, ContactRetentionDuration, (), (const, override));
 };
 
+class FakeHealthTransitionLog : public HealthTransitionLog {
+ public:
+  void Append(int64 uuid,
+              absl::Span<const HealthTransition> health_transitions) override {
+    for (const HealthTransition& health_transition : health_transitions) {
+      health_transitions_.push_back(health_transition);
+    }
+  }
+
+  std::vector<HealthTransition> health_transitions_;
+};
+
 InfectionOutcome InfectionOutcomeFromContact(const int64 agent_uuid,
                                              const Contact& contact) {
   return {
@@ -389,6 +408,21 @@ TEST(SEIRAgentTest, ProcessesInfectionOutcomesMultipleExposuresSameContact) {
   agent->ProcessInfectionOutcomes(timestep, infection_outcomes);
 }
 
+TEST(SEIRAgentTest, ReportsMemoryUsage) {
+  MockTransmissionModel transmission_model;
+  auto public_policy = NewNoOpPolicy();
+  auto agent = SEIRAgent::CreateSusceptible(
+      42LL, &transmission_model, absl::make_unique<MockTransitionModel>(),
+      absl::make_unique<MockVisitGenerator>(), public_policy.get());
+
+  MemoryUsage usage;
+  agent->AddMemoryUsage(&usage);
+  EXPECT_EQ(usage.bytes["agents/objects"], sizeof(SEIRAgent));
+  EXPECT_GE(usage.bytes["agents/health_transitions"],
+            sizeof(HealthTransition));
+  EXPECT_EQ(usage.bytes["agents/contacts"], 0);
+}
+
 TEST(SEIRAgentTest, ProcessInfectionOutcomesRejectsWrongUuid) {
   auto transition_model = absl::make_unique<MockTransitionModel>();
   auto visit_generator = absl::make_unique<MockVisitGenerator>();
@@ -826,5 +860,128 @@ TEST(SEIRAgentTest, UpdateContactReportsRejectsWrongUuid) {
                      "");
 }
 
+TEST(SEIRAgentTest, MergesAndCompactsHealthTransitions) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  EXPECT_CALL(*transition_model, GetNextHealthTransition)
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(86400LL),
+          .health_state = HealthState::INFECTIOUS}))
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(2LL * 86400LL),
+          .health_state = HealthState::RECOVERED}))
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(3LL * 86400LL),
+          .health_state = HealthState::RECOVERED}))
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(4LL * 86400LL),
+          .health_state = HealthState::RECOVERED}));
+  MockTransmissionModel transmission_model;
+  auto public_policy = NewNoOpPolicy();
+  FakeHealthTransitionLog log;
+  auto agent = SEIRAgent::Create(
+      42LL,
+      {.time = absl::UnixEpoch(), .health_state = HealthState::EXPOSED},
+      &transmission_model, std::move(transition_model),
+      absl::make_unique<MockVisitGenerator>(), public_policy.get());
+  agent->set_health_transition_log(&log);
+  for (int day = 0; day < 4; ++day) {
+    agent->ProcessInfectionOutcomes(
+        Timestep(absl::FromUnixSeconds(day * 86400LL), absl::Hours(24)), {});
+  }
+
+  // The RECOVERED renewal is merged, and with no contact retention only the
+  // transition in effect at the start of the last timestep is retained.
+  EXPECT_THAT(agent->HealthTransitions(),
+              ElementsAre(HealthTransition{
+                  .time = absl::FromUnixSeconds(2LL * 86400LL),
+                  .health_state = HealthState::RECOVERED}));
+  EXPECT_THAT(
+      log.health_transitions_,
+      ElementsAre(HealthTransition{.time = absl::InfinitePast(),
+                                   .health_state = HealthState::SUSCEPTIBLE},
+                  HealthTransition{.time = absl::UnixEpoch(),
+                                   .health_state = HealthState::EXPOSED},
+                  HealthTransition{.time = absl::FromUnixSeconds(86400LL),
+                                   .health_state = HealthState::INFECTIOUS}));
+  EXPECT_EQ(agent->CurrentHealthState(), HealthState::RECOVERED);
+}
+
+TEST(SEIRAgentTest, KeepsHealthTransitionsWithoutLog) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  EXPECT_CALL(*transition_model, GetNextHealthTransition)
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(86400LL),
+          .health_state = HealthState::INFECTIOUS}))
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(2LL * 86400LL),
+          .health_state = HealthState::RECOVERED}))
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(3LL * 86400LL),
+          .health_state = HealthState::RECOVERED}))
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(4LL * 86400LL),
+          .health_state = HealthState::RECOVERED}));
+  MockTransmissionModel transmission_model;
+  auto public_policy = NewNoOpPolicy();
+  auto agent = SEIRAgent::Create(
+      42LL,
+      {.time = absl::UnixEpoch(), .health_state = HealthState::EXPOSED},
+      &transmission_model, std::move(transition_model),
+      absl::make_unique<MockVisitGenerator>(), public_policy.get());
+  for (int day = 0; day < 4; ++day) {
+    agent->ProcessInfectionOutcomes(
+        Timestep(absl::FromUnixSeconds(day * 86400LL), absl::Hours(24)), {});
+  }
+
+  EXPECT_THAT(
+      agent->HealthTransitions(),
+      ElementsAre(HealthTransition{.time = absl::InfinitePast(),
+                                   .health_state = HealthState::SUSCEPTIBLE},
+                  HealthTransition{.time = absl::UnixEpoch(),
+                                   .health_state = HealthState::EXPOSED},
+                  HealthTransition{.time = absl::FromUnixSeconds(86400LL),
+                                   .health_state = HealthState::INFECTIOUS},
+                  HealthTransition{
+                      .time = absl::FromUnixSeconds(2LL * 86400LL),
+                      .health_state = HealthState::RECOVERED}));
+}
+
+TEST(SEIRAgentTest, RestoresSavedState) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  EXPECT_CALL(*transition_model, GetNextHealthTransition)
+      .WillOnce(Return(HealthTransition{
+          .time = absl::FromUnixSeconds(86400LL),
+          .health_state = HealthState::INFECTIOUS}));
+  MockTransmissionModel transmission_model;
+  auto public_policy = NewNoOpPolicy();
+  auto agent = SEIRAgent::Create(
+      42LL,
+      {.time = absl::UnixEpoch(), .health_state = HealthState::EXPOSED},
+      &transmission_model, std::move(transition_model),
+      absl::make_unique<MockVisitGenerator>(), public_policy.get());
+  const Contact contact = {
+      .other_uuid = 314LL,
+      .exposure = {.start_time = absl::FromUnixSeconds(3600LL),
+                   .duration = absl::Hours(1LL)}};
+  agent->ProcessInfectionOutcomes(Timestep(absl::UnixEpoch(), absl::Hours(24)),
+                                  {InfectionOutcomeFromContact(42LL, contact)});
+  std::string state;
+  agent->SaveState(&state);
+
+  auto restored = SEIRAgent::CreateSusceptible(
+      42LL, &transmission_model, absl::make_unique<MockTransitionModel>(),
+      absl::make_unique<MockVisitGenerator>(), public_policy.get());
+  PANDEMIC_ASSERT_OK(restored->RestoreState(state));
+  EXPECT_THAT(restored->HealthTransitions(),
+              ElementsAreArray(agent->HealthTransitions()));
+  EXPECT_EQ(restored->NextHealthTransition(), agent->NextHealthTransition());
+  EXPECT_EQ(restored->GetContactSummary(), agent->GetContactSummary());
+  EXPECT_EQ(restored->CurrentTestResult(), agent->CurrentTestResult());
+
+  state.pop_back();
+  EXPECT_EQ(restored->RestoreState(state).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
 }  // namespace
 }  // namespace abesim
@@ -16,20 +16,33 @@
 
 #include <algorithm>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/container/fixed_array.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
+#include "absl/status/status.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/broker.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/load_balancing.h"
 #include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/partition.h"
+#include "agent_based_epidemic_sim/core/raw_coding.h"
+#include "agent_based_epidemic_sim/core/step_metrics.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/port/executor.h"
 #include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/port/trace.h"
 
 namespace abesim {
 
@@ -42,9 +55,9 @@ auto CompareUuid = [](const auto& a, const auto& b) {
   return a->uuid() < b->uuid();
 };
 
-int GetDestId(const Visit& visit) { return visit.location_uuid; }
-int GetDestId(const InfectionOutcome& outcome) { return outcome.agent_uuid; }
-int GetDestId(const ContactReport& report) { return report.to_agent_uuid; }
+int64 GetDestId(const Visit& visit) { return visit.location_uuid; }
+int64 GetDestId(const InfectionOutcome& outcome) { return outcome.agent_uuid; }
+int64 GetDestId(const ContactReport& report) { return report.to_agent_uuid; }
 
 bool CompareDestId(const Visit& a, const Visit& b) {
   if (a.location_uuid != b.location_uuid) {
@@ -74,6 +87,24 @@ void SortByDest(absl::Span<Msg> msgs) {
             [](const Msg& a, const Msg& b) { return CompareDestId(a, b); });
 }
 
+// Adds the wall time of its scope to a duration.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(absl::Duration* const total)
+      : total_(total), start_(absl::Now()) {}
+  ~ScopedTimer() { *total_ += absl::Now() - start_; }
+
+ private:
+  absl::Duration* const total_;
+  const absl::Time start_;
+};
+
+template <typename Msg>
+BrokerMetrics MessageMetrics(const int64 messages) {
+  return {.messages = messages,
+          .bytes = messages * static_cast<int64>(sizeof(Msg))};
+}
+
 template <typename Msg>
 std::pair<absl::Span<const Msg>, absl::Span<Msg>> SplitMessages(
     int64 uuid, absl::Span<Msg> messages) {
@@ -99,15 +130,39 @@ class BaseSimulation : public Simulation {
   void Step(const int steps, absl::Duration step_duration) final {
     Timestep timestep(time_, step_duration);
     for (int step = 0; step < steps; ++step) {
+      StepMetrics metrics;
+      metrics.step = num_steps_++;
+      metrics.start_time = timestep.start_time();
+      const absl::Time step_start = absl::Now();
+      TraceSpan step_span(tracer_, "step", "simulation", "step", metrics.step);
+      absl::optional<TraceSpan> phase_span;
+      phase_span.emplace(tracer_, "agent_phase", "simulation");
       RunAgentPhase(
           [&timestep](const absl::Span<const std::unique_ptr<Agent>> agents,
                       absl::Span<InfectionOutcome> outcomes,
                       absl::Span<ContactReport> reports,
                       ObserverShard* const observer,
                       Broker<Visit>* const visit_broker,
-                      Broker<ContactReport>* const contact_report_broker) {
-            SortByDest(outcomes);
-            SortByDest(reports);
+                      Broker<ContactReport>* const contact_report_broker,
+                      WorkerMetrics* const worker) {
+            {
+              ScopedTimer timer(&worker->sort);
+              SortByDest(outcomes);
+              SortByDest(reports);
+            }
+            // Agents only change themselves, so observing the whole chunk
+            // before processing it is equivalent to observing each agent
+            // just before it, and takes two clock reads per chunk.
+            if (!observer->empty()) {
+              ScopedTimer timer(&worker->observe);
+              absl::Span<InfectionOutcome> unobserved = outcomes;
+              for (const auto& agent : agents) {
+                absl::Span<const InfectionOutcome> agent_outcomes;
+                std::tie(agent_outcomes, unobserved) =
+                    SplitMessages(agent->uuid(), unobserved);
+                observer->Observe(*agent, agent_outcomes);
+              }
+            }
             for (const auto& agent : agents) {
               absl::Span<const InfectionOutcome> agent_outcomes;
               std::tie(agent_outcomes, outcomes) =
@@ -115,43 +170,99 @@ class BaseSimulation : public Simulation {
               absl::Span<const ContactReport> agent_reports;
               std::tie(agent_reports, reports) =
                   SplitMessages(agent->uuid(), reports);
-              observer->Observe(*agent, agent_outcomes);
               agent->ProcessInfectionOutcomes(timestep, agent_outcomes);
               agent->UpdateContactReports(agent_reports, contact_report_broker);
               agent->ComputeVisits(timestep, visit_broker);
             }
             DCHECK(outcomes.empty()) << "Unprocessed InfectionOutcomes";
             DCHECK(reports.empty()) << "Unprocessed ContactReports";
-          });
+          },
+          &metrics.agent_phase);
+      phase_span.emplace(tracer_, "location_phase", "simulation");
       RunLocationPhase(
           [](const absl::Span<const std::unique_ptr<Location>> locations,
              absl::Span<Visit> visits, ObserverShard* const observer,
-             Broker<InfectionOutcome>* const broker) {
-            SortByDest(visits);
+             Broker<InfectionOutcome>* const broker,
+             WorkerMetrics* const worker) {
+            {
+              ScopedTimer timer(&worker->sort);
+              SortByDest(visits);
+            }
+            // As for agents, the chunk is observed before it is processed.
+            if (!observer->empty()) {
+              ScopedTimer timer(&worker->observe);
+              absl::Span<Visit> unobserved = visits;
+              for (const auto& location : locations) {
+                absl::Span<const Visit> location_visits;
+                std::tie(location_visits, unobserved) =
+                    SplitMessages(location->uuid(), unobserved);
+                observer->Observe(*location, location_visits);
+              }
+            }
             for (const auto& location : locations) {
               absl::Span<const Visit> location_visits;
               std::tie(location_visits, visits) =
                   SplitMessages(location->uuid(), visits);
-              observer->Observe(*location, location_visits);
               location->ProcessVisits(location_visits, broker);
             }
-          });
-      observer_manager_.AggregateForTimestep(timestep);
+          },
+          &metrics.location_phase);
+      phase_span.reset();
+      {
+        ScopedTimer timer(&metrics.aggregate_time);
+        TraceSpan span(tracer_, "aggregate", "simulation");
+        observer_manager_.AggregateForTimestep(timestep);
+      }
+      TakeBrokerMetrics(&metrics);
+      metrics.wall_time = absl::Now() - step_start;
+      if (step_metrics_callback_ != nullptr) step_metrics_callback_(metrics);
+      if (memory_usage_callback_ != nullptr &&
+          metrics.step % memory_usage_interval_ == 0) {
+        TraceSpan span(tracer_, "memory_usage", "simulation");
+        MemoryUsage usage;
+        usage.step = metrics.step;
+        AddMemoryUsage(&usage);
+        memory_usage_callback_(usage);
+      }
       timestep.Advance();
     }
     time_ = timestep.start_time();
   }
 
+  // The phase functions process a chunk of entities and the messages sent to
+  // them, adding the time spent sorting and observing to the worker's metrics.
   using AgentPhaseFn = std::function<void(
       absl::Span<const std::unique_ptr<Agent>>, absl::Span<InfectionOutcome>,
       absl::Span<ContactReport>, ObserverShard* observer, Broker<Visit>*,
-      Broker<ContactReport>*)>;
+      Broker<ContactReport>*, WorkerMetrics*)>;
   using LocationPhaseFn = std::function<void(
       absl::Span<const std::unique_ptr<Location>>, absl::Span<Visit>,
-      ObserverShard*, Broker<InfectionOutcome>*)>;
+      ObserverShard*, Broker<InfectionOutcome>*, WorkerMetrics*)>;
+
+  virtual void RunAgentPhase(const AgentPhaseFn& fn,
+                             PhaseMetrics* metrics) = 0;
+  virtual void RunLocationPhase(const LocationPhaseFn& fn,
+                                PhaseMetrics* metrics) = 0;
+  // Fills in the messages passed through the brokers since the last call.
+  virtual void TakeBrokerMetrics(StepMetrics* metrics) = 0;
+  // Adds the memory held by brokers and other state of the implementation.
+  virtual void AddImplementationMemoryUsage(MemoryUsage* usage) = 0;
 
-  virtual void RunAgentPhase(const AgentPhaseFn& fn) = 0;
-  virtual void RunLocationPhase(const LocationPhaseFn& fn) = 0;
+  void AddMemoryUsage(MemoryUsage* const usage) {
+    usage->agents = agents_.size();
+    usage->locations = locations_.size();
+    usage->Add("agents/pointers", VectorMemoryUsage(agents_));
+    for (const auto& agent : agents_) {
+      agent->AddMemoryUsage(usage);
+    }
+    usage->Add("locations/pointers", VectorMemoryUsage(locations_));
+    for (const auto& location : locations_) {
+      location->AddMemoryUsage(usage);
+    }
+    observer_manager_.AddMemoryUsage(usage);
+    AddImplementationMemoryUsage(usage);
+    ScratchMemoryCounter::AddAll(usage);
+  }
 
   void AddObserverFactory(ObserverFactoryBase* factory) override {
     observer_manager_.AddFactory(factory);
@@ -161,16 +272,43 @@ class BaseSimulation : public Simulation {
     observer_manager_.RemoveFactory(factory);
   }
 
+  void SetStepMetricsCallback(
+      std::function<void(const StepMetrics&)> callback) override {
+    step_metrics_callback_ = std::move(callback);
+  }
+
+  void SetTracer(Tracer* const tracer) override { tracer_ = tracer; }
+
+  void SetMemoryUsageCallback(
+      const int interval,
+      std::function<void(const MemoryUsage&)> callback) override {
+    memory_usage_interval_ = std::max(1, interval);
+    memory_usage_callback_ = std::move(callback);
+    if (memory_usage_callback_ != nullptr) ScratchMemoryCounter::Enable();
+  }
+
  protected:
   ObserverManager& GetObserverManager() { return observer_manager_; }
   absl::Span<const std::unique_ptr<Agent>> agents() { return agents_; }
   absl::Span<const std::unique_ptr<Location>> locations() { return locations_; }
+  Tracer* tracer() { return tracer_; }
+  // Agents and locations move between the nodes of distributed simulations,
+  // which must keep them sorted by uuid.
+  std::vector<std::unique_ptr<Agent>>* mutable_agents() { return &agents_; }
+  std::vector<std::unique_ptr<Location>>* mutable_locations() {
+    return &locations_;
+  }
 
  private:
   absl::Time time_;
   std::vector<std::unique_ptr<Agent>> agents_;
   std::vector<std::unique_ptr<Location>> locations_;
   class ObserverManager observer_manager_;
+  int64 num_steps_ = 0;
+  std::function<void(const StepMetrics&)> step_metrics_callback_;
+  Tracer* tracer_ = nullptr;
+  int memory_usage_interval_ = 1;
+  std::function<void(const MemoryUsage&)> memory_usage_callback_;
 };
 
 // A ConsumableBroker accumulates messages which can be consumed via the
@@ -196,16 +334,27 @@ class ConsumableBroker : public Broker<Msg> {
  public:
   void Send(const absl::Span<const Msg> msgs) override {
     send_.insert(send_.end(), msgs.begin(), msgs.end());
+    messages_ += msgs.size();
   }
   virtual std::unique_ptr<std::vector<Msg>, Deleter> Consume() {
     DCHECK(consume_.empty());
     consume_.swap(send_);
     return {&consume_, {this}};
   }
+  // Returns the metrics of the messages sent since the last call.
+  BrokerMetrics TakeMetrics() {
+    const BrokerMetrics metrics = MessageMetrics<Msg>(messages_);
+    messages_ = 0;
+    return metrics;
+  }
+  int64 MemoryUsage() const {
+    return VectorMemoryUsage(send_) + VectorMemoryUsage(consume_);
+  }
 
  private:
   std::vector<Msg> send_;
   std::vector<Msg> consume_;
+  int64 messages_ = 0;
 };
 
 // Serial implements a simulation that runs in a single thread.
@@ -215,19 +364,54 @@ class Serial : public BaseSimulation {
          std::vector<std::unique_ptr<Location>> locations)
       : BaseSimulation(start, std::move(agents), std::move(locations)) {}
 
-  void RunAgentPhase(const AgentPhaseFn& fn) override {
+  void RunAgentPhase(const AgentPhaseFn& fn,
+                     PhaseMetrics* const metrics) override {
+    const absl::Time start = absl::Now();
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
+    metrics->workers.resize(1);
     fn(agents(), absl::MakeSpan(*outcomes), absl::MakeSpan(*reports),
-       GetObserverManager().MakeShard(), &visit_broker_, &report_broker_);
+       GetObserverManager().GetShard(0), &visit_broker_, &report_broker_,
+       &metrics->workers[0]);
+    EndPhase(start, agents().size(), outcomes->size() + reports->size(),
+             metrics);
   }
-  void RunLocationPhase(const LocationPhaseFn& fn) override {
+  void RunLocationPhase(const LocationPhaseFn& fn,
+                        PhaseMetrics* const metrics) override {
+    const absl::Time start = absl::Now();
     auto visits = visit_broker_.Consume();
-    fn(locations(), absl::MakeSpan(*visits), GetObserverManager().MakeShard(),
-       &outcome_broker_);
+    metrics->workers.resize(1);
+    fn(locations(), absl::MakeSpan(*visits), GetObserverManager().GetShard(0),
+       &outcome_broker_, &metrics->workers[0]);
+    EndPhase(start, locations().size(), visits->size(), metrics);
+  }
+  void TakeBrokerMetrics(StepMetrics* const metrics) override {
+    metrics->visits = visit_broker_.TakeMetrics();
+    metrics->infection_outcomes = outcome_broker_.TakeMetrics();
+    metrics->contact_reports = report_broker_.TakeMetrics();
+  }
+
+  void AddImplementationMemoryUsage(MemoryUsage* const usage) override {
+    usage->Add("brokers/queues", visit_broker_.MemoryUsage() +
+                                     outcome_broker_.MemoryUsage() +
+                                     report_broker_.MemoryUsage());
   }
 
  private:
+  // The whole phase runs as a single chunk.
+  static void EndPhase(const absl::Time start, const int64 entities,
+                       const int64 messages, PhaseMetrics* const metrics) {
+    metrics->wall_time = absl::Now() - start;
+    WorkerMetrics& worker = metrics->workers[0];
+    worker.busy = metrics->wall_time;
+    worker.chunks = 1;
+    metrics->AddChunk({.chunk = 0,
+                       .worker = 0,
+                       .entities = entities,
+                       .messages = messages,
+                       .duration = metrics->wall_time});
+  }
+
   ConsumableBroker<InfectionOutcome> outcome_broker_;
   ConsumableBroker<Visit> visit_broker_;
   ConsumableBroker<ContactReport> report_broker_;
@@ -239,8 +423,14 @@ class Serial : public BaseSimulation {
 template <typename Entity>
 class Chunker {
  public:
-  explicit Chunker(const absl::Span<const std::unique_ptr<Entity>> entities)
-      : chunks_((entities.size() + kWorkChunkSize - 1) / kWorkChunkSize) {
+  explicit Chunker(const absl::Span<const std::unique_ptr<Entity>> entities) {
+    Reset(entities);
+  }
+
+  // Rebuilds the chunks after entities were added or removed.
+  void Reset(const absl::Span<const std::unique_ptr<Entity>> entities) {
+    chunks_.resize((entities.size() + kWorkChunkSize - 1) / kWorkChunkSize);
+    chunk_map_.clear();
     size_t idx = 0;
     for (int chunk = 0; chunk < chunks_.size(); ++chunk) {
       chunks_[chunk] = entities.subspan(idx, kWorkChunkSize);
@@ -260,9 +450,13 @@ class Chunker {
   absl::Span<const absl::Span<const std::unique_ptr<Entity>>> Chunks() const {
     return chunks_;
   }
+  int64 MemoryUsage() const {
+    return chunks_.size() * sizeof(chunks_[0]) +
+           HashContainerMemoryUsage(chunk_map_);
+  }
 
  private:
-  absl::FixedArray<absl::Span<const std::unique_ptr<Entity>>> chunks_;
+  std::vector<absl::Span<const std::unique_ptr<Entity>>> chunks_;
   absl::flat_hash_map<int64, int> chunk_map_;
 };
 
@@ -301,6 +495,7 @@ class WorkQueueBroker : public Broker<Msg> {
       send_[chunker_.Chunk(msg)].push_back(msg);
     }
     sent_msgs_ = true;
+    messages_ += msgs.size();
   }
   virtual std::unique_ptr<std::vector<std::vector<Msg>>, Deleter> Consume() {
     absl::MutexLock l(&mu_);
@@ -310,28 +505,105 @@ class WorkQueueBroker : public Broker<Msg> {
     consume_.swap(send_);
     return {&consume_, {this}};
   }
+  // Resizes the queues after the chunker was reset, and queues msgs again
+  // after they were consumed for that.  Nothing else may be queued.
+  void Rechunk(const absl::Span<const Msg> msgs) {
+    absl::MutexLock l(&mu_);
+    DCHECK(std::all_of(send_.begin(), send_.end(),
+                       [](const std::vector<Msg>& v) { return v.empty(); }));
+    DCHECK(std::all_of(consume_.begin(), consume_.end(),
+                       [](const std::vector<Msg>& v) { return v.empty(); }));
+    send_.resize(chunker_.Chunks().size());
+    consume_.resize(chunker_.Chunks().size());
+    for (const Msg& msg : msgs) {
+      send_[chunker_.Chunk(msg)].push_back(msg);
+    }
+    sent_msgs_ = !msgs.empty();
+  }
+  // Returns the metrics of the messages sent since the last call.
+  BrokerMetrics TakeMetrics() {
+    absl::MutexLock l(&mu_);
+    const BrokerMetrics metrics = MessageMetrics<Msg>(messages_);
+    messages_ = 0;
+    return metrics;
+  }
+  int64 MemoryUsage() {
+    absl::MutexLock l(&mu_);
+    int64 bytes = VectorMemoryUsage(send_) + VectorMemoryUsage(consume_);
+    for (const std::vector<Msg>& msgs : send_) {
+      bytes += VectorMemoryUsage(msgs);
+    }
+    for (const std::vector<Msg>& msgs : consume_) {
+      bytes += VectorMemoryUsage(msgs);
+    }
+    return bytes;
+  }
 
  private:
   const Chunker<Entity>& chunker_;
   absl::Mutex mu_;
   bool sent_msgs_ = false;
+  int64 messages_ ABSL_GUARDED_BY(mu_) = 0;
   std::vector<std::vector<Msg>> send_ ABSL_GUARDED_BY(mu_);
   std::vector<std::vector<Msg>> consume_ ABSL_GUARDED_BY(mu_);
 };
 
+// Collects the chunk metrics of a parallel phase.  Each worker only touches
+// its own entries, so no locking is needed.
+class ParallelPhaseMetrics {
+ public:
+  ParallelPhaseMetrics(const int num_workers, PhaseMetrics* const metrics)
+      : start_(absl::Now()), metrics_(metrics), worker_chunks_(num_workers) {
+    metrics_->workers.assign(num_workers, WorkerMetrics());
+  }
+
+  WorkerMetrics* worker(const int w) { return &metrics_->workers[w]; }
+  void AddChunk(const ChunkMetrics& chunk) {
+    WorkerMetrics& worker = metrics_->workers[chunk.worker];
+    worker.busy += chunk.duration;
+    ++worker.chunks;
+    worker_chunks_[chunk.worker].AddChunk(chunk);
+  }
+  void AddFlush(const int w, const absl::Duration duration) {
+    metrics_->workers[w].busy += duration;
+    metrics_->workers[w].flush += duration;
+  }
+  // Called once all workers are done.
+  void Finish() {
+    metrics_->wall_time = absl::Now() - start_;
+    for (WorkerMetrics& worker : metrics_->workers) {
+      worker.idle = std::max(absl::ZeroDuration(),
+                             metrics_->wall_time - worker.busy);
+    }
+    for (const PhaseMetrics& chunks : worker_chunks_) {
+      for (const ChunkMetrics& chunk : chunks.slowest_chunks) {
+        metrics_->AddChunk(chunk);
+      }
+    }
+  }
+
+ private:
+  const absl::Time start_;
+  PhaseMetrics* const metrics_;
+  absl::FixedArray<PhaseMetrics> worker_chunks_;
+};
+
 template <typename Worker>
 void ParallelAgentPhase(Executor& executor, ObserverManager& observer_manager,
                         const Chunker<Agent>& chunker,
                         std::vector<std::vector<InfectionOutcome>>& outcomes,
                         std::vector<std::vector<ContactReport>>& reports,
                         absl::FixedArray<Worker>& workers,
-                        const BaseSimulation::AgentPhaseFn& fn) {
+                        const BaseSimulation::AgentPhaseFn& fn,
+                        PhaseMetrics* const phase_metrics,
+                        Tracer* const tracer) {
+  ParallelPhaseMetrics metrics(workers.size(), phase_metrics);
   absl::Mutex mu;
   int next_chunk = 0;
 
   absl::FixedArray<ObserverShard*> observers(workers.size());
   for (int i = 0; i < workers.size(); ++i) {
-    observers[i] = observer_manager.MakeShard();
+    observers[i] = observer_manager.GetShard(i);
   }
 
   DCHECK_EQ(outcomes.size(), chunker.Chunks().size());
@@ -340,28 +612,50 @@ void ParallelAgentPhase(Executor& executor, ObserverManager& observer_manager,
   std::unique_ptr<Execution> exec = executor.NewExecution();
   for (int w = 0; w < workers.size(); ++w) {
     exec->Add([w, &workers, &outcomes, &reports, &chunker, &next_chunk, &mu,
-               &observers, &fn]() {
+               &observers, &fn, &metrics, tracer]() {
       auto& worker = workers[w];
       while (true) {
+        int chunk;
         absl::Span<InfectionOutcome> my_outcomes;
         absl::Span<ContactReport> my_reports;
         absl::Span<const std::unique_ptr<Agent>> my_agents;
         {
           absl::MutexLock l(&mu);
-          int chunk = next_chunk++;
+          chunk = next_chunk++;
           if (chunk >= chunker.Chunks().size()) break;
           my_agents = chunker.Chunks()[chunk];
           my_outcomes = absl::MakeSpan(outcomes[chunk]);
           my_reports = absl::MakeSpan(reports[chunk]);
         }
+        const absl::Time start = absl::Now();
         fn(my_agents, my_outcomes, my_reports, observers[w],
-           worker.visit_broker.get(), worker.report_broker.get());
+           worker.visit_broker.get(), worker.report_broker.get(),
+           metrics.worker(w));
+        const absl::Time end = absl::Now();
+        metrics.AddChunk(
+            {.chunk = chunk,
+             .worker = w,
+             .entities = static_cast<int64>(my_agents.size()),
+             .messages =
+                 static_cast<int64>(my_outcomes.size() + my_reports.size()),
+             .duration = end - start});
+        if (tracer != nullptr) {
+          tracer->AddSpan("agent_chunk", "simulation", start, end, "chunk",
+                          chunk);
+        }
       }
+      const absl::Time start = absl::Now();
       worker.visit_broker->Flush();
       worker.report_broker->Flush();
+      const absl::Time end = absl::Now();
+      metrics.AddFlush(w, end - start);
+      if (tracer != nullptr) {
+        tracer->AddSpan("flush", "simulation", start, end);
+      }
     });
   }
   exec->Wait();
+  metrics.Finish();
 }
 
 template <typename Worker>
@@ -370,36 +664,59 @@ void ParallelLocationPhase(Executor& executor,
                            const Chunker<Location>& chunker,
                            std::vector<std::vector<Visit>>& visits,
                            absl::FixedArray<Worker>& workers,
-                           const BaseSimulation::LocationPhaseFn& fn) {
+                           const BaseSimulation::LocationPhaseFn& fn,
+                           PhaseMetrics* const phase_metrics,
+                           Tracer* const tracer) {
+  ParallelPhaseMetrics metrics(workers.size(), phase_metrics);
   absl::Mutex mu;
   int next_chunk = 0;
 
   absl::FixedArray<ObserverShard*> observers(workers.size());
   for (int i = 0; i < workers.size(); ++i) {
-    observers[i] = observer_manager.MakeShard();
+    observers[i] = observer_manager.GetShard(i);
   }
 
   std::unique_ptr<Execution> exec = executor.NewExecution();
   for (int w = 0; w < workers.size(); ++w) {
     auto& worker = workers[w];
     exec->Add([w, &worker, &visits, &chunker, &next_chunk, &mu, &observers,
-               &fn]() {
+               &fn, &metrics, tracer]() {
       while (true) {
+        int chunk;
         absl::Span<Visit> my_visits;
         absl::Span<const std::unique_ptr<Location>> my_locations;
         {
           absl::MutexLock l(&mu);
-          int chunk = next_chunk++;
+          chunk = next_chunk++;
           if (chunk >= chunker.Chunks().size()) break;
           my_locations = chunker.Chunks()[chunk];
           my_visits = absl::MakeSpan(visits[chunk]);
         }
-        fn(my_locations, my_visits, observers[w], worker.outcome_broker.get());
+        const absl::Time start = absl::Now();
+        fn(my_locations, my_visits, observers[w], worker.outcome_broker.get(),
+           metrics.worker(w));
+        const absl::Time end = absl::Now();
+        metrics.AddChunk({.chunk = chunk,
+                          .worker = w,
+                          .entities = static_cast<int64>(my_locations.size()),
+                          .messages = static_cast<int64>(my_visits.size()),
+                          .duration = end - start});
+        if (tracer != nullptr) {
+          tracer->AddSpan("location_chunk", "simulation", start, end, "chunk",
+                          chunk);
+        }
       }
+      const absl::Time start = absl::Now();
       worker.outcome_broker->Flush();
+      const absl::Time end = absl::Now();
+      metrics.AddFlush(w, end - start);
+      if (tracer != nullptr) {
+        tracer->AddSpan("flush", "simulation", start, end);
+      }
     });
   }
   exec->Wait();
+  metrics.Finish();
 }
 
 // Parallel implements a simulation that runs in multiple threads.
@@ -417,6 +734,7 @@ class Parallel : public BaseSimulation {
         outcome_broker_(agent_chunker_),
         report_broker_(agent_chunker_),
         visit_broker_(location_chunker_) {
+    GetObserverManager().SetExecutor(executor_.get());
     for (int w = 0; w < num_workers; ++w) {
       agent_workers_[w].visit_broker =
           absl::make_unique<BufferingBroker<Visit>>(kPerThreadBrokerBuffer,
@@ -430,16 +748,47 @@ class Parallel : public BaseSimulation {
     }
   }
 
-  void RunAgentPhase(const AgentPhaseFn& fn) override {
+  void RunAgentPhase(const AgentPhaseFn& fn,
+                     PhaseMetrics* const metrics) override {
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
     ParallelAgentPhase(*executor_, GetObserverManager(), agent_chunker_,
-                       *outcomes, *reports, agent_workers_, fn);
+                       *outcomes, *reports, agent_workers_, fn, metrics,
+                       tracer());
   }
-  void RunLocationPhase(const LocationPhaseFn& fn) override {
+  void RunLocationPhase(const LocationPhaseFn& fn,
+                        PhaseMetrics* const metrics) override {
     auto visits = visit_broker_.Consume();
     ParallelLocationPhase(*executor_, GetObserverManager(), location_chunker_,
-                          *visits, location_workers_, fn);
+                          *visits, location_workers_, fn, metrics,
+                          tracer());
+  }
+  void TakeBrokerMetrics(StepMetrics* const metrics) override {
+    metrics->visits = visit_broker_.TakeMetrics();
+    metrics->infection_outcomes = outcome_broker_.TakeMetrics();
+    metrics->contact_reports = report_broker_.TakeMetrics();
+  }
+
+  void AddImplementationMemoryUsage(MemoryUsage* const usage) override {
+    usage->Add("brokers/queues", visit_broker_.MemoryUsage() +
+                                     outcome_broker_.MemoryUsage() +
+                                     report_broker_.MemoryUsage());
+    int64 worker_bytes = 0;
+    for (const AgentWorker& worker : agent_workers_) {
+      worker_bytes += worker.visit_broker->MemoryUsage() +
+                      worker.report_broker->MemoryUsage();
+    }
+    for (const LocationWorker& worker : location_workers_) {
+      worker_bytes += worker.outcome_broker->MemoryUsage();
+    }
+    usage->Add("brokers/worker_buffers", worker_bytes);
+    usage->Add("chunkers/agents", agent_chunker_.MemoryUsage());
+    usage->Add("chunkers/locations", location_chunker_.MemoryUsage());
+  }
+
+  void SetTracer(Tracer* const tracer) override {
+    BaseSimulation::SetTracer(tracer);
+    executor_->SetTracer(tracer);
   }
 
  private:
@@ -461,6 +810,28 @@ class Parallel : public BaseSimulation {
   WorkQueueBroker<Location, Visit> visit_broker_;
 };
 
+// Assigns entities to the transfers from the local node, taking them from
+// the end of the uuid order until each transfer's fraction of the total cost
+// is reached.  Returns the node each entity moves to, or -1 if it stays.
+std::vector<int> AssignMigrants(const absl::Span<const double> costs,
+                                const absl::Span<const LoadTransfer> transfers,
+                                const int local_node) {
+  double total_cost = 0;
+  for (const double cost : costs) total_cost += cost;
+  std::vector<int> nodes(costs.size(), -1);
+  int next = costs.size();
+  for (const LoadTransfer& transfer : transfers) {
+    if (transfer.from_node != local_node) continue;
+    double remaining = transfer.fraction * total_cost;
+    while (next > 0 && remaining >= costs[next - 1] / 2) {
+      --next;
+      nodes[next] = transfer.to_node;
+      remaining -= costs[next];
+    }
+  }
+  return nodes;
+}
+
 // DistributedParallel implements a simulation that runs in multiple threads and
 // interacts with distributed nodes also running simulations.
 class DistributedParallel : public BaseSimulation {
@@ -469,7 +840,8 @@ class DistributedParallel : public BaseSimulation {
                       std::vector<std::unique_ptr<Agent>> agents,
                       std::vector<std::unique_ptr<Location>> locations,
                       const int num_workers,
-                      DistributedManager* const distributed_manager)
+                      DistributedManager* const distributed_manager,
+                      const LoadBalancingOptions& load_balancing)
       : BaseSimulation(start, std::move(agents), std::move(locations)),
         executor_(NewExecutor(num_workers)),
         agent_chunker_(BaseSimulation::agents()),
@@ -479,7 +851,12 @@ class DistributedParallel : public BaseSimulation {
         outcome_broker_(agent_chunker_),
         report_broker_(agent_chunker_),
         visit_broker_(location_chunker_),
-        distributed_manager_(distributed_manager) {
+        distributed_manager_(distributed_manager),
+        load_balancing_(load_balancing) {
+    CHECK_GT(load_balancing_.interval, 0);
+    CHECK(load_balancing_.max_migration_fraction > 0 &&
+          load_balancing_.max_migration_fraction <= 1);
+    GetObserverManager().SetExecutor(executor_.get());
     for (int w = 0; w < num_workers; ++w) {
       agent_workers_[w].visit_broker =
           absl::make_unique<DistributingBroker<Visit>>(
@@ -497,6 +874,9 @@ class DistributedParallel : public BaseSimulation {
   }
 
   ~DistributedParallel() override {
+    // Messages still in flight are awaited so that all nodes end their phases
+    // before connections are closed.
+    AwaitPreviousStep();
     distributed_manager_->VisitMessenger()->SetReceiveBrokerForNextPhase(
         nullptr);
     distributed_manager_->ContactReportMessenger()
@@ -505,7 +885,18 @@ class DistributedParallel : public BaseSimulation {
         nullptr);
   }
 
-  void RunAgentPhase(const AgentPhaseFn& fn) override {
+  // Remote messages are flushed at the end of the phase producing them, but
+  // only awaited right before the phase consuming them, so that their
+  // transfer overlaps with local work.  Outcomes and contact reports of one
+  // step are awaited in the next, overlapping with the location phase and
+  // observer aggregation.
+  void RunAgentPhase(const AgentPhaseFn& fn,
+                     PhaseMetrics* const metrics) override {
+    {
+      ScopedTimer timer(&metrics->remote_time);
+      AwaitPreviousStep();
+      MaybeRebalance();
+    }
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
 
@@ -515,23 +906,296 @@ class DistributedParallel : public BaseSimulation {
         ->SetReceiveBrokerForNextPhase(&report_broker_);
 
     ParallelAgentPhase(*executor_, GetObserverManager(), agent_chunker_,
-                       *outcomes, *reports, agent_workers_, fn);
-    distributed_manager_->VisitMessenger()->FlushAndAwaitRemotes();
-    // TODO: We technically don't need to await remotes here, but we
-    // should flush.  Consider splitting the two functions and calling
-    // await remotes at the end of the location phase.
-    distributed_manager_->ContactReportMessenger()->FlushAndAwaitRemotes();
-  }
-  void RunLocationPhase(const LocationPhaseFn& fn) override {
+                       *outcomes, *reports, agent_workers_, fn, metrics,
+                       tracer());
+    agent_compute_time_ += metrics->wall_time;
+    {
+      ScopedTimer timer(&metrics->remote_time);
+      TraceSpan span(tracer(), "flush_remotes", "distributed");
+      distributed_manager_->VisitMessenger()->Flush();
+      distributed_manager_->ContactReportMessenger()->Flush();
+      awaiting_reports_ = true;
+    }
+    metrics->wall_time += metrics->remote_time;
+  }
+  void RunLocationPhase(const LocationPhaseFn& fn,
+                        PhaseMetrics* const metrics) override {
+    {
+      ScopedTimer timer(&metrics->remote_time);
+      TraceSpan span(tracer(), "await_visits", "distributed");
+      distributed_manager_->VisitMessenger()->AwaitRemotes();
+    }
     auto visits = visit_broker_.Consume();
+    if (load_balancing_enabled()) {
+      location_chunk_visits_.resize(visits->size());
+      for (int chunk = 0; chunk < visits->size(); ++chunk) {
+        location_chunk_visits_[chunk] = (*visits)[chunk].size();
+      }
+    }
     distributed_manager_->OutcomeMessenger()->SetReceiveBrokerForNextPhase(
         &outcome_broker_);
     ParallelLocationPhase(*executor_, GetObserverManager(), location_chunker_,
-                          *visits, location_workers_, fn);
-    distributed_manager_->OutcomeMessenger()->FlushAndAwaitRemotes();
+                          *visits, location_workers_, fn, metrics,
+                          tracer());
+    location_compute_time_ += metrics->wall_time;
+    ++measured_steps_;
+    {
+      ScopedTimer timer(&metrics->remote_time);
+      TraceSpan span(tracer(), "flush_remotes", "distributed");
+      distributed_manager_->OutcomeMessenger()->Flush();
+      awaiting_outcomes_ = true;
+    }
+    metrics->wall_time += metrics->remote_time;
+  }
+  void TakeBrokerMetrics(StepMetrics* const metrics) override {
+    metrics->visits = visit_broker_.TakeMetrics();
+    metrics->infection_outcomes = outcome_broker_.TakeMetrics();
+    metrics->contact_reports = report_broker_.TakeMetrics();
+    for (const AgentWorker& worker : agent_workers_) {
+      metrics->visits.remote_messages +=
+          worker.visit_broker->TakeRemoteMessageCount();
+      metrics->contact_reports.remote_messages +=
+          worker.report_broker->TakeRemoteMessageCount();
+    }
+    for (const LocationWorker& worker : location_workers_) {
+      metrics->infection_outcomes.remote_messages +=
+          worker.outcome_broker->TakeRemoteMessageCount();
+    }
+  }
+
+  void AddImplementationMemoryUsage(MemoryUsage* const usage) override {
+    usage->Add("brokers/queues", visit_broker_.MemoryUsage() +
+                                     outcome_broker_.MemoryUsage() +
+                                     report_broker_.MemoryUsage());
+    int64 worker_bytes = 0;
+    for (const AgentWorker& worker : agent_workers_) {
+      worker_bytes += worker.visit_broker->MemoryUsage() +
+                      worker.report_broker->MemoryUsage();
+    }
+    for (const LocationWorker& worker : location_workers_) {
+      worker_bytes += worker.outcome_broker->MemoryUsage();
+    }
+    usage->Add("brokers/worker_buffers", worker_bytes);
+    usage->Add("chunkers/agents", agent_chunker_.MemoryUsage());
+    usage->Add("chunkers/locations", location_chunker_.MemoryUsage());
+  }
+
+  void SetTracer(Tracer* const tracer) override {
+    BaseSimulation::SetTracer(tracer);
+    executor_->SetTracer(tracer);
   }
 
  private:
+  void AwaitPreviousStep() {
+    if (awaiting_reports_) {
+      TraceSpan span(tracer(), "await_contact_reports", "distributed");
+      distributed_manager_->ContactReportMessenger()->AwaitRemotes();
+      awaiting_reports_ = false;
+    }
+    if (awaiting_outcomes_) {
+      TraceSpan span(tracer(), "await_infection_outcomes", "distributed");
+      distributed_manager_->OutcomeMessenger()->AwaitRemotes();
+      awaiting_outcomes_ = false;
+    }
+  }
+
+  bool load_balancing_enabled() const {
+    return load_balancing_.migrator != nullptr &&
+           load_balancing_.routing_table != nullptr;
+  }
+
+  // Exchanges the compute time of all nodes since the last rebalancing every
+  // load_balancing_.interval steps, and moves agents and locations if they
+  // diverge too far.  Runs between steps, once all remote messages of the
+  // previous step are awaited and before any of this step are sent.
+  void MaybeRebalance() {
+    if (!load_balancing_enabled() ||
+        measured_steps_ < load_balancing_.interval) {
+      return;
+    }
+    TraceSpan span(tracer(), "rebalance", "distributed");
+    std::string load;
+    AppendRaw<double>(absl::ToDoubleSeconds(agent_compute_time_ +
+                                            location_compute_time_),
+                      &load);
+    const std::vector<std::string> node_loads = distributed_manager_->Exchange(
+        std::vector<std::string>(load_balancing_.routing_table->num_nodes(),
+                                 load));
+    std::vector<double> loads(node_loads.size());
+    for (int node = 0; node < loads.size(); ++node) {
+      RawReader reader(node_loads[node]);
+      CHECK(reader.Read(&loads[node])) << "Invalid load of node " << node;
+    }
+    const std::vector<LoadTransfer> transfers =
+        PlanLoadTransfers(loads, load_balancing_);
+    if (!transfers.empty()) Migrate(transfers);
+    agent_compute_time_ = absl::ZeroDuration();
+    location_compute_time_ = absl::ZeroDuration();
+    measured_steps_ = 0;
+  }
+
+  // Hands agents and locations over to other nodes as planned by transfers,
+  // along with the messages queued for the agents, and takes over those
+  // handed to the local node.
+  void Migrate(const absl::Span<const LoadTransfer> transfers) {
+    const int local_node = distributed_manager_->VisitMessenger()->local_node();
+    const int num_nodes = load_balancing_.routing_table->num_nodes();
+    std::vector<InfectionOutcome> outcomes = TakeQueued(&outcome_broker_);
+    std::vector<ContactReport> reports = TakeQueued(&report_broker_);
+
+    // Agents cost their queued messages, and locations the visits of their
+    // chunk in the last step, spread evenly.
+    absl::flat_hash_map<int64, int64> agent_messages;
+    for (const InfectionOutcome& outcome : outcomes) {
+      ++agent_messages[outcome.agent_uuid];
+    }
+    for (const ContactReport& report : reports) {
+      ++agent_messages[report.to_agent_uuid];
+    }
+    std::vector<double> agent_costs(agents().size());
+    for (int i = 0; i < agent_costs.size(); ++i) {
+      auto iter = agent_messages.find(agents()[i]->uuid());
+      agent_costs[i] = 1 + (iter == agent_messages.end() ? 0 : iter->second);
+    }
+    std::vector<double> location_costs(locations().size());
+    for (int i = 0; i < location_costs.size(); ++i) {
+      const int chunk = i / kWorkChunkSize;
+      const int64 chunk_size = location_chunker_.Chunks()[chunk].size();
+      location_costs[i] =
+          1 + (chunk < location_chunk_visits_.size()
+                   ? static_cast<double>(location_chunk_visits_[chunk]) /
+                         chunk_size
+                   : 0);
+    }
+
+    std::vector<MigrationBatch> batches(num_nodes);
+    std::vector<MigrationBatch::Move> agent_moves;
+    std::vector<MigrationBatch::Move> location_moves;
+    absl::flat_hash_map<int64, int> moved_agents;
+    const std::vector<int> agent_nodes =
+        AssignMigrants(agent_costs, transfers, local_node);
+    std::vector<std::unique_ptr<Agent>>& local_agents = *mutable_agents();
+    for (int i = 0; i < local_agents.size(); ++i) {
+      const int node = agent_nodes[i];
+      if (node < 0) continue;
+      const int64 uuid = local_agents[i]->uuid();
+      batches[node].agents.push_back(
+          {.uuid = uuid,
+           .state = load_balancing_.migrator->SaveAgent(*local_agents[i])});
+      agent_moves.push_back({.uuid = uuid, .node = node});
+      moved_agents[uuid] = node;
+      local_agents[i].reset();
+    }
+    const std::vector<int> location_nodes =
+        AssignMigrants(location_costs, transfers, local_node);
+    std::vector<std::unique_ptr<Location>>& local_locations =
+        *mutable_locations();
+    for (int i = 0; i < local_locations.size(); ++i) {
+      const int node = location_nodes[i];
+      if (node < 0) continue;
+      const int64 uuid = local_locations[i]->uuid();
+      batches[node].locations.push_back(
+          {.uuid = uuid,
+           .state =
+               load_balancing_.migrator->SaveLocation(*local_locations[i])});
+      location_moves.push_back({.uuid = uuid, .node = node});
+      local_locations[i].reset();
+    }
+    SplitMoved(moved_agents, &outcomes, &batches,
+               [](MigrationBatch& batch) { return &batch.outcomes; });
+    SplitMoved(moved_agents, &reports, &batches,
+               [](MigrationBatch& batch) { return &batch.reports; });
+
+    std::vector<std::string> outgoing(num_nodes);
+    for (int node = 0; node < num_nodes; ++node) {
+      if (node == local_node) continue;
+      batches[node].agent_moves = agent_moves;
+      batches[node].location_moves = location_moves;
+      outgoing[node] = EncodeMigrationBatch(batches[node]);
+    }
+    const std::vector<std::string> incoming =
+        distributed_manager_->Exchange(std::move(outgoing));
+
+    RoutingTable& routing_table = *load_balancing_.routing_table;
+    for (const MigrationBatch::Move& move : agent_moves) {
+      routing_table.MoveAgent(move.uuid, move.node);
+    }
+    for (const MigrationBatch::Move& move : location_moves) {
+      routing_table.MoveLocation(move.uuid, move.node);
+    }
+    local_agents.erase(
+        std::remove(local_agents.begin(), local_agents.end(), nullptr),
+        local_agents.end());
+    local_locations.erase(
+        std::remove(local_locations.begin(), local_locations.end(), nullptr),
+        local_locations.end());
+    for (int node = 0; node < num_nodes; ++node) {
+      if (node == local_node) continue;
+      auto batch = DecodeMigrationBatch(incoming[node]);
+      CHECK_EQ(absl::OkStatus(), batch.status()) << "from node " << node;
+      for (const MigrationBatch::Move& move : batch->agent_moves) {
+        routing_table.MoveAgent(move.uuid, move.node);
+      }
+      for (const MigrationBatch::Move& move : batch->location_moves) {
+        routing_table.MoveLocation(move.uuid, move.node);
+      }
+      for (const MigrationBatch::Entity& entity : batch->agents) {
+        auto agent =
+            load_balancing_.migrator->RestoreAgent(entity.uuid, entity.state);
+        CHECK_EQ(absl::OkStatus(), agent.status()) << "agent " << entity.uuid;
+        local_agents.push_back(std::move(agent).value());
+      }
+      for (const MigrationBatch::Entity& entity : batch->locations) {
+        auto location = load_balancing_.migrator->RestoreLocation(
+            entity.uuid, entity.state);
+        CHECK_EQ(absl::OkStatus(), location.status())
+            << "location " << entity.uuid;
+        local_locations.push_back(std::move(location).value());
+      }
+      outcomes.insert(outcomes.end(), batch->outcomes.begin(),
+                      batch->outcomes.end());
+      reports.insert(reports.end(), batch->reports.begin(),
+                     batch->reports.end());
+    }
+    std::sort(local_agents.begin(), local_agents.end(), CompareUuid);
+    std::sort(local_locations.begin(), local_locations.end(), CompareUuid);
+    agent_chunker_.Reset(agents());
+    location_chunker_.Reset(locations());
+    outcome_broker_.Rechunk(outcomes);
+    report_broker_.Rechunk(reports);
+    visit_broker_.Rechunk({});
+    location_chunk_visits_.clear();
+  }
+
+  template <typename Msg>
+  static std::vector<Msg> TakeQueued(WorkQueueBroker<Agent, Msg>* broker) {
+    std::vector<Msg> msgs;
+    auto queued = broker->Consume();
+    for (const std::vector<Msg>& chunk : *queued) {
+      msgs.insert(msgs.end(), chunk.begin(), chunk.end());
+    }
+    return msgs;
+  }
+
+  // Moves the messages for agents in moved to the batches of their new nodes.
+  template <typename Msg, typename BatchMessages>
+  static void SplitMoved(const absl::flat_hash_map<int64, int>& moved,
+                         std::vector<Msg>* const msgs,
+                         std::vector<MigrationBatch>* const batches,
+                         const BatchMessages& batch_messages) {
+    if (moved.empty()) return;
+    auto kept = msgs->begin();
+    for (const Msg& msg : *msgs) {
+      auto iter = moved.find(GetDestId(msg));
+      if (iter == moved.end()) {
+        *kept++ = msg;
+      } else {
+        batch_messages((*batches)[iter->second])->push_back(msg);
+      }
+    }
+    msgs->erase(kept, msgs->end());
+  }
+
   struct AgentWorker {
     std::unique_ptr<DistributingBroker<Visit>> visit_broker;
     std::unique_ptr<DistributingBroker<ContactReport>> report_broker;
@@ -549,6 +1213,17 @@ class DistributedParallel : public BaseSimulation {
   WorkQueueBroker<Agent, ContactReport> report_broker_;
   WorkQueueBroker<Location, Visit> visit_broker_;
   DistributedManager* const distributed_manager_;
+  // Whether the previous step's phases are flushed but not yet awaited.
+  bool awaiting_reports_ = false;
+  bool awaiting_outcomes_ = false;
+  const LoadBalancingOptions load_balancing_;
+  // The compute time of the phases, excluding waits for other nodes, over the
+  // steps since the last rebalancing.
+  absl::Duration agent_compute_time_;
+  absl::Duration location_compute_time_;
+  int measured_steps_ = 0;
+  // The visits processed by each location chunk in the last step.
+  std::vector<int64> location_chunk_visits_;
 };
 
 }  // namespace
@@ -572,9 +1247,19 @@ std::unique_ptr<Simulation> ParallelDistributedSimulation(
     std::vector<std::unique_ptr<Location>> locations,
     const int num_local_workers,
     DistributedManager* const distributed_manager) {
+  return ParallelDistributedSimulation(
+      start, std::move(agents), std::move(locations), num_local_workers,
+      distributed_manager, LoadBalancingOptions());
+}
+
+std::unique_ptr<Simulation> ParallelDistributedSimulation(
+    absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
+    std::vector<std::unique_ptr<Location>> locations,
+    const int num_local_workers, DistributedManager* const distributed_manager,
+    const LoadBalancingOptions& load_balancing) {
   return absl::make_unique<DistributedParallel>(
       start, std::move(agents), std::move(locations), num_local_workers,
-      distributed_manager);
+      distributed_manager, load_balancing);
 }
 
 }  // namespace abesim
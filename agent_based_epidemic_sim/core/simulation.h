@@ -17,10 +17,16 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_SIMULATION_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_SIMULATION_H_
 
+#include <functional>
+
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/distributed.h"
+#include "agent_based_epidemic_sim/core/load_balancing.h"
 #include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/step_metrics.h"
+#include "agent_based_epidemic_sim/port/trace.h"
 
 namespace abesim {
 
@@ -45,6 +51,26 @@ class Simulation {
   // factory.
   virtual void RemoveObserverFactory(ObserverFactoryBase* factory) = 0;
 
+  // Sets a callback that is passed the performance metrics of each step as
+  // the step ends, see step_metrics.h.  The metrics are only valid during the
+  // call.
+  virtual void SetStepMetricsCallback(
+      std::function<void(const StepMetrics&)> callback) = 0;
+
+  // Records the phases of each step, the chunks of work done by each worker
+  // thread, broker flushes and waits for remote nodes in tracer, which may be
+  // null to stop tracing.  The tracer must outlive the simulation or be unset
+  // before it is destroyed.
+  virtual void SetTracer(Tracer* tracer) = 0;
+
+  // Sets a callback that is passed the memory held by the simulation at the
+  // end of the first step and of every interval steps after it, see
+  // memory_usage.h.  Accounting visits every agent and location, so interval
+  // should be large for big populations.  Setting a callback also enables
+  // ScratchMemoryCounter tracking for the rest of the process.
+  virtual void SetMemoryUsageCallback(
+      int interval, std::function<void(const MemoryUsage&)> callback) = 0;
+
   virtual ~Simulation() = default;
 };
 
@@ -64,6 +90,14 @@ std::unique_ptr<Simulation> ParallelDistributedSimulation(
     std::vector<std::unique_ptr<Location>> locations, int num_local_workers,
     DistributedManager* distributed_manager);
 
+// As above, moving agents and locations between nodes as their loads diverge,
+// see core/load_balancing.h.
+std::unique_ptr<Simulation> ParallelDistributedSimulation(
+    absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
+    std::vector<std::unique_ptr<Location>> locations, int num_local_workers,
+    DistributedManager* distributed_manager,
+    const LoadBalancingOptions& load_balancing);
+
 }  // namespace abesim
 
 #endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_SIMULATION_H_
@@ -14,15 +14,32 @@
 
 #include "agent_based_epidemic_sim/core/simulation.h"
 
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/load_balancing.h"
 #include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/memory_usage.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/partition.h"
+#include "agent_based_epidemic_sim/core/raw_coding.h"
+#include "agent_based_epidemic_sim/core/socket_distributed_manager.h"
+#include "agent_based_epidemic_sim/core/step_metrics.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+#include "agent_based_epidemic_sim/port/trace.h"
 #include "gtest/gtest.h"
 
 namespace abesim {
@@ -116,6 +133,24 @@ class FakeAgent : public Agent {
     return {};
   }
 
+  // The last timestep is the only state kept across steps.
+  std::string SaveState() const {
+    std::string state;
+    if (last_timestep_ != nullptr) {
+      AppendRaw(last_timestep_->start_time(), &state);
+      AppendRaw(last_timestep_->duration(), &state);
+    }
+    return state;
+  }
+  void RestoreState(const absl::string_view state) {
+    if (state.empty()) return;
+    RawReader reader(state);
+    absl::Time start_time;
+    absl::Duration duration;
+    ASSERT_TRUE(reader.Read(&start_time) && reader.Read(&duration));
+    last_timestep_ = absl::make_unique<Timestep>(start_time, duration);
+  }
+
  private:
   std::unique_ptr<Timestep> last_timestep_;
   int64 uuid_;
@@ -171,7 +206,10 @@ class FakeObserver : public AgentInfectionObserver,
 
  private:
   friend class FakeObserverFactory;
+  friend class PartitionedObserverFactory;
+  friend class ResettableObserverFactory;
 
+ protected:
   absl::flat_hash_map<int64, PerAgent> agent_stats_;
   absl::flat_hash_map<int64, PerLocation> location_stats_;
 };
@@ -214,6 +252,98 @@ class FakeObserverFactory : public ObserverFactory<FakeObserver> {
   absl::flat_hash_map<int64, PerLocation> location_stats_;
 };
 
+// Counts agent observations per partition of agent uuids, aggregating each
+// partition separately.
+class PartitionedObserverFactory : public ObserverFactory<FakeObserver> {
+ public:
+  static constexpr int kPartitions = 4;
+
+  std::unique_ptr<FakeObserver> MakeObserver() const override {
+    return absl::make_unique<FakeObserver>();
+  }
+  int AggregationPartitions() const override { return kPartitions; }
+  void AggregatePartition(
+      const Timestep& timestep, const int partition,
+      absl::Span<std::unique_ptr<FakeObserver> const> observers) override {
+    for (auto& observer : observers) {
+      for (auto iter : observer->agent_stats_) {
+        if (iter.first % kPartitions != partition) continue;
+        partition_observations_[partition] += iter.second.observations;
+      }
+    }
+  }
+  void Aggregate(
+      const Timestep& timestep,
+      absl::Span<std::unique_ptr<FakeObserver> const> observers) override {
+    aggregations_++;
+  }
+
+  void CheckResults() {
+    EXPECT_EQ(aggregations_, kNumSteps);
+    for (int i = 0; i < kPartitions; ++i) {
+      EXPECT_EQ(partition_observations_[i],
+                kNumSteps * kNumAgents / kPartitions);
+    }
+  }
+
+ private:
+  int aggregations_ = 0;
+  std::array<int, kPartitions> partition_observations_ = {};
+};
+
+// A FakeObserver that is reused across timesteps.
+class ResettableObserver : public FakeObserver {
+ public:
+  void Reset() {
+    agent_stats_.clear();
+    location_stats_.clear();
+  }
+};
+
+// Counts observations while checking that each shard's observer is created
+// once and reused for all following timesteps.
+class ResettableObserverFactory : public ObserverFactory<ResettableObserver> {
+ public:
+  std::unique_ptr<ResettableObserver> MakeObserver() const override {
+    observers_made_++;
+    return absl::make_unique<ResettableObserver>();
+  }
+  bool ResetObserver(ResettableObserver* observer) const override {
+    observer->Reset();
+    return true;
+  }
+  void Aggregate(const Timestep& timestep,
+                 absl::Span<std::unique_ptr<ResettableObserver> const>
+                     observers) override {
+    for (auto& observer : observers) {
+      observers_seen_.insert(observer.get());
+      for (auto iter : observer->agent_stats_) {
+        agent_observations_[iter.first] += iter.second.observations;
+      }
+      for (auto iter : observer->location_stats_) {
+        location_observations_[iter.first] += iter.second.observations;
+      }
+    }
+  }
+
+  void CheckResults(const int shards) {
+    EXPECT_EQ(observers_made_, shards);
+    EXPECT_EQ(observers_seen_.size(), shards);
+    for (int i = 0; i < kNumAgents; ++i) {
+      EXPECT_EQ(agent_observations_[i], kNumSteps);
+    }
+    for (int i = 0; i < kNumLocations; ++i) {
+      EXPECT_EQ(location_observations_[i], kNumSteps);
+    }
+  }
+
+ private:
+  mutable int observers_made_ = 0;
+  absl::flat_hash_set<const ResettableObserver*> observers_seen_;
+  absl::flat_hash_map<int64, int> agent_observations_;
+  absl::flat_hash_map<int64, int> location_observations_;
+};
+
 using SimBuilder = std::function<std::unique_ptr<Simulation>(
     absl::Time start, std::vector<std::unique_ptr<Agent>>,
     std::vector<std::unique_ptr<Location>>)>;
@@ -332,8 +462,308 @@ TEST(SimulationTest, AllAgentsAndLocationsAreProcessedInParallelWithObserver) {
   observer_factory.CheckResults();
 }
 
-// TODO: Add a test for DistributedParallelSimulation using a mock
-// DistributedManager.  Currently I'm relying on the stubby test.
+TEST(SimulationTest, ObserverPartitionsAreAggregatedSerially) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto sim = BuildSimulator(SerialSimulation, &outcomes, &visits, &reports);
+  PartitionedObserverFactory observer_factory;
+  sim->AddObserverFactory(&observer_factory);
+  sim->Step(kNumSteps, absl::Hours(24));
+  observer_factory.CheckResults();
+}
+
+TEST(SimulationTest, ObserverPartitionsAreAggregatedInParallel) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  };
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  PartitionedObserverFactory observer_factory;
+  sim->AddObserverFactory(&observer_factory);
+  sim->Step(kNumSteps, absl::Hours(24));
+  observer_factory.CheckResults();
+}
+
+TEST(SimulationTest, ResettableObserversAreReusedSerially) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto sim = BuildSimulator(SerialSimulation, &outcomes, &visits, &reports);
+  ResettableObserverFactory observer_factory;
+  sim->AddObserverFactory(&observer_factory);
+  sim->Step(kNumSteps, absl::Hours(24));
+  observer_factory.CheckResults(/*shards=*/1);
+}
+
+TEST(SimulationTest, ResettableObserversAreReusedInParallel) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  };
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  ResettableObserverFactory observer_factory;
+  sim->AddObserverFactory(&observer_factory);
+  sim->Step(kNumSteps, absl::Hours(24));
+  observer_factory.CheckResults(/*shards=*/3);
+}
+
+void CheckStepMetrics(SimBuilder builder, const int workers) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  std::vector<StepMetrics> steps;
+  sim->SetStepMetricsCallback(
+      [&steps](const StepMetrics& metrics) { steps.push_back(metrics); });
+  sim->Step(kNumSteps, absl::Hours(24));
+  ASSERT_EQ(steps.size(), kNumSteps);
+  for (int step = 0; step < kNumSteps; ++step) {
+    const StepMetrics& metrics = steps[step];
+    EXPECT_EQ(metrics.step, step);
+    EXPECT_EQ(metrics.start_time, absl::UnixEpoch() + step * absl::Hours(24));
+    EXPECT_EQ(metrics.visits.messages, kNumAgents * kVisitsPerAgent);
+    EXPECT_EQ(metrics.visits.bytes,
+              kNumAgents * kVisitsPerAgent * sizeof(Visit));
+    EXPECT_EQ(metrics.visits.remote_messages, 0);
+    for (const PhaseMetrics* phase :
+         {&metrics.agent_phase, &metrics.location_phase}) {
+      EXPECT_EQ(phase->workers.size(), workers);
+      EXPECT_GE(phase->Total().chunks, 1);
+      EXPECT_FALSE(phase->slowest_chunks.empty());
+      EXPECT_LE(phase->wall_time, metrics.wall_time);
+    }
+  }
+}
+
+TEST(SimulationTest, StepMetricsAreReportedSerially) {
+  CheckStepMetrics(SerialSimulation, /*workers=*/1);
+}
+
+TEST(SimulationTest, StepMetricsAreReportedInParallel) {
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  };
+  CheckStepMetrics(builder, /*workers=*/3);
+}
+
+TEST(SimulationTest, ParallelStepsAreTraced) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  };
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  Tracer tracer;
+  sim->SetTracer(&tracer);
+  int64 chunks = 0;
+  sim->SetStepMetricsCallback([&chunks](const StepMetrics& metrics) {
+    chunks += metrics.agent_phase.Total().chunks +
+              metrics.location_phase.Total().chunks;
+  });
+  sim->Step(kNumSteps, absl::Hours(24));
+  // Steps after the tracer is unset are not recorded.
+  sim->SetTracer(nullptr);
+  sim->SetStepMetricsCallback(nullptr);
+  sim->Step(1, absl::Hours(24));
+
+  const std::string path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "simulation_trace.json");
+  auto file = file::OpenOrDie(path);
+  ASSERT_TRUE(tracer.Write(file.get()).ok());
+  ASSERT_TRUE(file->Close().ok());
+  std::string trace;
+  ASSERT_TRUE(file::GetContents(path, &trace).ok());
+  auto count = [&trace](absl::string_view name) {
+    int count = 0;
+    const std::string needle = absl::StrCat("{\"name\":\"", name, "\"");
+    for (size_t pos = trace.find(needle); pos != std::string::npos;
+         pos = trace.find(needle, pos + 1)) {
+      ++count;
+    }
+    return count;
+  };
+  EXPECT_EQ(count("step"), kNumSteps);
+  EXPECT_EQ(count("agent_phase"), kNumSteps);
+  EXPECT_EQ(count("location_phase"), kNumSteps);
+  EXPECT_EQ(count("aggregate"), kNumSteps);
+  EXPECT_EQ(count("agent_chunk") + count("location_chunk"), chunks);
+  EXPECT_EQ(count("flush"), 2 * 3 * kNumSteps);
+  EXPECT_EQ(count("task"), 2 * 3 * kNumSteps);
+}
+
+void CheckMemoryUsage(SimBuilder builder) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  FakeObserverFactory observer_factory;
+  sim->AddObserverFactory(&observer_factory);
+  std::vector<MemoryUsage> reported;
+  sim->SetMemoryUsageCallback(
+      /*interval=*/2,
+      [&reported](const MemoryUsage& usage) { reported.push_back(usage); });
+  sim->Step(kNumSteps, absl::Hours(24));
+  ASSERT_EQ(reported.size(), (kNumSteps + 1) / 2);
+  for (int i = 0; i < reported.size(); ++i) {
+    const MemoryUsage& usage = reported[i];
+    EXPECT_EQ(usage.step, 2 * i);
+    EXPECT_EQ(usage.agents, kNumAgents);
+    EXPECT_EQ(usage.locations, kNumLocations);
+    EXPECT_GE(usage.bytes.at("agents/pointers"),
+              kNumAgents * sizeof(std::unique_ptr<Agent>));
+    // Outcomes and contact reports for the next step are queued.
+    EXPECT_GE(usage.bytes.at("brokers/queues"),
+              kNumAgents * kVisitsPerAgent * sizeof(InfectionOutcome));
+    EXPECT_GT(usage.bytes.at("observers/observers"), 0);
+  }
+}
+
+TEST(SimulationTest, MemoryUsageIsReportedSerially) {
+  CheckMemoryUsage(SerialSimulation);
+}
+
+TEST(SimulationTest, MemoryUsageIsReportedInParallel) {
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  };
+  CheckMemoryUsage(builder);
+}
+
+class FakeMigrator : public Migrator {
+ public:
+  FakeMigrator(OutcomeMap* outcomes, VisitMap* visits, ReportMap* reports)
+      : outcomes_(outcomes), visits_(visits), reports_(reports) {}
+
+  std::string SaveAgent(const Agent& agent) override {
+    return static_cast<const FakeAgent&>(agent).SaveState();
+  }
+  std::string SaveLocation(const Location& location) override { return ""; }
+  StatusOr<std::unique_ptr<Agent>> RestoreAgent(
+      const int64 uuid, const absl::string_view state) override {
+    auto agent = absl::make_unique<FakeAgent>(uuid, outcomes_, reports_);
+    agent->RestoreState(state);
+    return std::unique_ptr<Agent>(std::move(agent));
+  }
+  StatusOr<std::unique_ptr<Location>> RestoreLocation(
+      const int64 uuid, const absl::string_view state) override {
+    return std::unique_ptr<Location>(
+        absl::make_unique<FakeLocation>(uuid, visits_));
+  }
+
+ private:
+  OutcomeMap* const outcomes_;
+  VisitMap* const visits_;
+  ReportMap* const reports_;
+};
+
+// Places three quarters of agents and locations on node 0, and splits the
+// rest between the other nodes.
+class SkewedPartition : public Partition {
+ public:
+  int num_nodes() const override { return 3; }
+  int AgentNode(const int64 uuid) const override { return Node(uuid); }
+  int LocationNode(const int64 uuid) const override { return Node(uuid); }
+
+ private:
+  static int Node(const int64 uuid) {
+    return uuid < kNumAgents * 3 / 4 ? 0 : 1 + uuid % 2;
+  }
+};
+
+// Runs each node of a distributed simulation in its own thread, with nodes
+// owning the agents and locations assigned to them by partition.  If
+// routing_tables is set, the nodes rebalance their load and route messages
+// by their own table of routing_tables, which must start out as partition.
+void RunDistributedSimulation(
+    absl::string_view name, const Partition& partition,
+    OutcomeMap* const outcomes, VisitMap* const visits,
+    ReportMap* const reports,
+    std::vector<std::unique_ptr<RoutingTable>>* const routing_tables =
+        nullptr) {
+  std::vector<std::string> addresses;
+  for (int node = 0; node < partition.num_nodes(); ++node) {
+    addresses.push_back(absl::StrCat("unix:", getenv("TEST_TMPDIR"), "/",
+                                     name, node, ".sock"));
+  }
+  std::vector<std::thread> nodes;
+  for (int node = 0; node < partition.num_nodes(); ++node) {
+    nodes.emplace_back([&, node] {
+      RoutingTable* const routing_table =
+          routing_tables != nullptr ? (*routing_tables)[node].get() : nullptr;
+      FakeMigrator migrator(outcomes, visits, reports);
+      auto manager = NewSocketDistributedManager(
+          {.node = node, .addresses = addresses},
+          routing_table != nullptr ? routing_table : &partition);
+      PANDEMIC_ASSERT_OK(manager.status());
+      std::vector<std::unique_ptr<Agent>> agents;
+      for (int i = 0; i < kNumAgents; ++i) {
+        if (partition.AgentNode(i) != node) continue;
+        agents.push_back(absl::make_unique<FakeAgent>(i, outcomes, reports));
+      }
+      std::vector<std::unique_ptr<Location>> locations;
+      for (int i = 0; i < kNumLocations; ++i) {
+        if (partition.LocationNode(i) != node) continue;
+        locations.push_back(absl::make_unique<FakeLocation>(i, visits));
+      }
+      auto sim = ParallelDistributedSimulation(
+          absl::UnixEpoch(), std::move(agents), std::move(locations), 2,
+          manager->get(),
+          {.migrator = routing_table != nullptr ? &migrator : nullptr,
+           .routing_table = routing_table,
+           .max_imbalance = 1.1f});
+      sim->Step(kNumSteps, absl::Hours(24));
+    });
+  }
+  for (std::thread& node : nodes) node.join();
+}
+
+TEST(SimulationTest, AllAgentsAndLocationsAreProcessedDistributed) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto partition = NewUuidModuloPartition(3);
+  RunDistributedSimulation("distributed", *partition, &outcomes, &visits,
+                           &reports);
+  CheckSimulatorResults(outcomes, visits, reports);
+}
+
+TEST(SimulationTest, AllAgentsAndLocationsAreProcessedWhileRebalancing) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  SkewedPartition partition;
+  std::vector<std::unique_ptr<RoutingTable>> routing_tables;
+  for (int node = 0; node < partition.num_nodes(); ++node) {
+    routing_tables.push_back(absl::make_unique<RoutingTable>(&partition));
+  }
+  RunDistributedSimulation("rebalancing", partition, &outcomes, &visits,
+                           &reports, &routing_tables);
+  CheckSimulatorResults(outcomes, visits, reports);
+  EXPECT_GT(routing_tables[0]->num_moved_agents(), 0);
+  EXPECT_GT(routing_tables[0]->num_moved_locations(), 0);
+  // All nodes agree on the owner of every agent and location.
+  for (int node = 1; node < partition.num_nodes(); ++node) {
+    for (int64 uuid = 0; uuid < kNumAgents; ++uuid) {
+      EXPECT_EQ(routing_tables[node]->AgentNode(uuid),
+                routing_tables[0]->AgentNode(uuid));
+    }
+    for (int64 uuid = 0; uuid < kNumLocations; ++uuid) {
+      EXPECT_EQ(routing_tables[node]->LocationNode(uuid),
+                routing_tables[0]->LocationNode(uuid));
+    }
+  }
+}
 
 }  // namespace
 }  // namespace abesim
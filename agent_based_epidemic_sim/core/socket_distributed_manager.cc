@@ -0,0 +1,601 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/socket_distributed_manager.h"
+
+#include <deque>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/message_coding.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/port/socket.h"
+
+namespace abesim {
+namespace {
+
+// The streams of messages exchanged between nodes.
+enum Stream : uint32 {
+  kVisits = 0,
+  kContactReports = 1,
+  kInfectionOutcomes = 2,
+  // Data exchanged between steps, see DistributedManager::Exchange.
+  kControl = 3,
+};
+
+enum FrameKind : uint32 {
+  // Followed by count messages, or count bytes on the control stream.
+  kData = 0,
+  // Marks the end of the sender's messages for the phase.
+  kEndOfPhase = 1,
+  // Followed by count bytes of a batch encoded by core/message_coding.h.
+  kEncodedData = 2,
+};
+
+// Every frame starts with a header.  Messages are trivially copyable and raw
+// ones are sent as is, which requires all nodes to run the same binary.
+struct FrameHeader {
+  uint32 stream;
+  uint32 kind;
+  uint32 phase;
+  uint32 count;
+};
+
+// Frames are bounded so that a corrupt header can't make the receiver
+// allocate arbitrary amounts of memory.
+constexpr uint32 kMaxFrameBytes = 1 << 30;
+
+// Fails frames with more than kMaxFrameBytes of items of the given size.
+absl::Status CheckFrameSize(const FrameHeader& header, const size_t item_size) {
+  if (header.count <= kMaxFrameBytes / item_size) return absl::OkStatus();
+  return absl::InternalError(absl::StrCat("Frame of ", header.count,
+                                          " items of ", item_size,
+                                          " bytes exceeds ", kMaxFrameBytes,
+                                          " bytes"));
+}
+
+static_assert(std::is_trivially_copyable<Visit>::value, "");
+static_assert(std::is_trivially_copyable<ContactReport>::value, "");
+static_assert(std::is_trivially_copyable<InfectionOutcome>::value, "");
+
+int64 DestinationUuid(const Visit& visit) { return visit.location_uuid; }
+int64 DestinationUuid(const ContactReport& report) {
+  return report.to_agent_uuid;
+}
+int64 DestinationUuid(const InfectionOutcome& outcome) {
+  return outcome.agent_uuid;
+}
+
+// Visits are destined for locations, other messages for agents.
+template <typename Msg>
+constexpr bool kDestinedForLocation = std::is_same<Msg, Visit>::value;
+
+template <typename Msg>
+int DestinationNode(const Partition& partition, const Msg& msg) {
+  return kDestinedForLocation<Msg>
+             ? partition.LocationNode(DestinationUuid(msg))
+             : partition.AgentNode(DestinationUuid(msg));
+}
+
+template <typename Msg>
+void DestinationNodes(const Partition& partition, absl::Span<const Msg> msgs,
+                      absl::Span<int> nodes) {
+  thread_local std::vector<int64> uuids;
+  uuids.resize(msgs.size());
+  for (int i = 0; i < msgs.size(); ++i) {
+    uuids[i] = DestinationUuid(msgs[i]);
+  }
+  if (kDestinedForLocation<Msg>) {
+    partition.LocationNodes(uuids, nodes);
+  } else {
+    partition.AgentNodes(uuids, nodes);
+  }
+}
+
+struct Peer {
+  int node;
+  std::unique_ptr<Socket> socket;
+  // Serializes frames written by different threads.
+  absl::Mutex write_mu;
+};
+
+// The connections of the local node, shared by its messengers.
+struct Network {
+  Network(const int node, const Partition* const partition,
+          const MessageEncoding encoding)
+      : node(node),
+        partition(partition),
+        encoding(encoding),
+        peers(partition->num_nodes()),
+        peer_status(partition->num_nodes()) {}
+
+  int num_nodes() const { return peers.size(); }
+
+  // Writes a frame to the given node.  Failures are recorded in peer_status.
+  void WriteFrame(const int to_node, const FrameHeader& header,
+                  const void* const data, const size_t size) {
+    // Also guards the uint32 counts of headers against truncation.
+    CHECK_LE(size, kMaxFrameBytes) << "Frame too large for node " << to_node;
+    Peer* const peer = peers[to_node].get();
+    absl::Status status;
+    {
+      absl::MutexLock l(&peer->write_mu);
+      status = peer->socket->Write(&header, sizeof(header));
+      if (status.ok() && size > 0) status = peer->socket->Write(data, size);
+    }
+    if (!status.ok()) Fail(to_node, status);
+  }
+
+  // Marks the connection to a node as closed, which is only an error if more
+  // messages were expected from it.
+  void Fail(const int peer_node, const absl::Status& status) {
+    absl::MutexLock l(&mu);
+    if (!peer_status[peer_node].ok()) return;
+    peer_status[peer_node] = status;
+  }
+
+  const int node;
+  const Partition* const partition;
+  const MessageEncoding encoding;
+  // Indexed by node, null for the local node.
+  std::vector<std::unique_ptr<Peer>> peers;
+
+  // Guards the state of all messengers.
+  absl::Mutex mu;
+  std::vector<absl::Status> peer_status ABSL_GUARDED_BY(mu);
+};
+
+// Receiving side of a messenger, called from the peers' receiver threads.
+class StreamReceiver {
+ public:
+  virtual ~StreamReceiver() = default;
+  virtual absl::Status ReadData(int node, Socket* socket,
+                                const FrameHeader& header) = 0;
+  // Phases end in order, so only the sending node is needed.
+  virtual void ReceiveEndOfPhase(int node) = 0;
+};
+
+template <typename Msg>
+class SocketMessenger : public DistributedMessenger<Msg>,
+                        public StreamReceiver {
+ public:
+  SocketMessenger(const Stream stream, Network* const network)
+      : stream_(stream),
+        network_(network),
+        ends_received_(network->num_nodes(), 0) {}
+
+  bool IsMessageRemote(const Msg& msg) const override {
+    return DestinationNode(*network_->partition, msg) != network_->node;
+  }
+
+  int num_nodes() const override { return network_->num_nodes(); }
+  int local_node() const override { return network_->node; }
+
+  void DestinationNodes(absl::Span<const Msg> msgs,
+                        absl::Span<int> nodes) const override {
+    abesim::DestinationNodes(*network_->partition, msgs, nodes);
+  }
+
+  // Sends one frame per destination node.
+  void Send(absl::Span<const Msg> msgs) override {
+    if (msgs.empty()) return;
+    const uint32 phase = SendPhase();
+    std::vector<int> nodes(msgs.size());
+    DestinationNodes(msgs, absl::MakeSpan(nodes));
+    std::vector<std::vector<Msg>> batches(network_->num_nodes());
+    for (int i = 0; i < msgs.size(); ++i) {
+      batches[nodes[i]].push_back(msgs[i]);
+    }
+    for (int node = 0; node < batches.size(); ++node) {
+      if (!batches[node].empty()) WriteToNode(node, phase, batches[node]);
+    }
+  }
+
+  // Batches from a DistributingBroker are sent without copying.
+  void SendToNode(const int node, absl::Span<const Msg> msgs) override {
+    if (msgs.empty()) return;
+    WriteToNode(node, SendPhase(), msgs);
+  }
+
+  void SetReceiveBrokerForNextPhase(Broker<Msg>* const broker) override {
+    std::vector<std::vector<Msg>> batches;
+    {
+      absl::MutexLock l(&network_->mu);
+      broker_ = broker;
+      if (broker_ == nullptr) return;
+      auto stashed = stash_.find(receive_phase_);
+      if (stashed == stash_.end()) return;
+      batches = std::move(stashed->second);
+      stash_.erase(stashed);
+      ++deliveries_;
+    }
+    for (const std::vector<Msg>& batch : batches) {
+      broker->Send(batch);
+    }
+    absl::MutexLock l(&network_->mu);
+    --deliveries_;
+  }
+
+  void Flush() override {
+    uint32 phase;
+    {
+      absl::MutexLock l(&network_->mu);
+      phase = send_phase_++;
+    }
+    for (int node = 0; node < network_->num_nodes(); ++node) {
+      if (node == network_->node) continue;
+      network_->WriteFrame(node,
+                           {.stream = stream_,
+                            .kind = kEndOfPhase,
+                            .phase = phase,
+                            .count = 0},
+                           nullptr, 0);
+    }
+  }
+
+  void AwaitRemotes() override {
+    absl::MutexLock l(&network_->mu);
+    network_->mu.Await(absl::Condition(this, &SocketMessenger::PhaseDone));
+    for (int node = 0; node < network_->num_nodes(); ++node) {
+      if (node != network_->node && ends_received_[node] <= receive_phase_) {
+        LOG(FATAL) << "Lost connection to node " << node << ": "
+                   << network_->peer_status[node];
+      }
+    }
+    broker_ = nullptr;
+    ++receive_phase_;
+  }
+
+  absl::Status ReadData(const int node, Socket* const socket,
+                        const FrameHeader& header) override {
+    std::vector<Msg> msgs;
+    if (header.kind == kEncodedData) {
+      absl::Status status = CheckFrameSize(header, 1);
+      if (!status.ok()) return status;
+      std::string data(header.count, '\0');
+      status = socket->Read(&data[0], data.size());
+      if (!status.ok()) return status;
+      status = DecodeMessages(data, &msgs);
+      if (!status.ok()) return status;
+    } else if (header.kind == kData) {
+      absl::Status status = CheckFrameSize(header, sizeof(Msg));
+      if (!status.ok()) return status;
+      msgs.resize(header.count);
+      status = socket->Read(msgs.data(), header.count * sizeof(Msg));
+      if (!status.ok()) return status;
+    } else {
+      return absl::InternalError(
+          absl::StrCat("Unexpected frame kind ", header.kind));
+    }
+    Deliver(header.phase, std::move(msgs));
+    return absl::OkStatus();
+  }
+
+  void ReceiveEndOfPhase(const int node) override {
+    absl::MutexLock l(&network_->mu);
+    ++ends_received_[node];
+  }
+
+ private:
+  uint32 SendPhase() {
+    absl::MutexLock l(&network_->mu);
+    return send_phase_;
+  }
+
+  void WriteToNode(const int node, const uint32 phase,
+                   absl::Span<const Msg> msgs) {
+    if (node == network_->node) {
+      Deliver(phase, std::vector<Msg>(msgs.begin(), msgs.end()));
+      return;
+    }
+    if (network_->encoding == MessageEncoding::kRaw) {
+      network_->WriteFrame(node,
+                           {.stream = stream_,
+                            .kind = kData,
+                            .phase = phase,
+                            .count = static_cast<uint32>(msgs.size())},
+                           msgs.data(), msgs.size() * sizeof(Msg));
+      return;
+    }
+    const std::string data = EncodeMessages(
+        msgs,
+        {.compress = network_->encoding == MessageEncoding::kCompressed});
+    network_->WriteFrame(node,
+                         {.stream = stream_,
+                          .kind = kEncodedData,
+                          .phase = phase,
+                          .count = static_cast<uint32>(data.size())},
+                         data.data(), data.size());
+  }
+
+  // True once all other nodes ended the awaited phase, or once a node that
+  // has not closes its connection, and no messages are being delivered.
+  bool PhaseDone() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(network_->mu) {
+    if (deliveries_ > 0) return false;
+    bool done = true;
+    for (int node = 0; node < network_->num_nodes(); ++node) {
+      if (node == network_->node || ends_received_[node] > receive_phase_) {
+        continue;
+      }
+      if (!network_->peer_status[node].ok()) return true;
+      done = false;
+    }
+    return done;
+  }
+
+  // Messages for the current phase go straight to the receiving broker, but
+  // faster nodes may already send messages for a following phase.  The
+  // broker is called without holding the lock, so that receivers and
+  // messengers don't wait for each other's deliveries.
+  void Deliver(const uint32 phase, std::vector<Msg> msgs) {
+    Broker<Msg>* broker;
+    {
+      absl::MutexLock l(&network_->mu);
+      if (phase != receive_phase_ || broker_ == nullptr) {
+        stash_[phase].push_back(std::move(msgs));
+        return;
+      }
+      broker = broker_;
+      ++deliveries_;
+    }
+    broker->Send(msgs);
+    absl::MutexLock l(&network_->mu);
+    --deliveries_;
+  }
+
+  const Stream stream_;
+  Network* const network_;
+  // The phase stamped on sent messages, and the phase received messages are
+  // delivered to broker_ for.  Sending runs ahead when awaits are deferred.
+  uint32 send_phase_ ABSL_GUARDED_BY(network_->mu) = 0;
+  uint32 receive_phase_ ABSL_GUARDED_BY(network_->mu) = 0;
+  Broker<Msg>* broker_ ABSL_GUARDED_BY(network_->mu) = nullptr;
+  // The number of calls to broker_ in progress, which AwaitRemotes waits for
+  // before unsetting it.
+  int deliveries_ ABSL_GUARDED_BY(network_->mu) = 0;
+  absl::flat_hash_map<uint32, std::vector<std::vector<Msg>>> stash_
+      ABSL_GUARDED_BY(network_->mu);
+  // The number of phases each node has ended.
+  std::vector<uint32> ends_received_ ABSL_GUARDED_BY(network_->mu);
+};
+
+// Every node sends a single frame to every other node per exchange, and frames
+// from one node arrive in order, so each node's frames are simply queued.
+class ControlChannel : public StreamReceiver {
+ public:
+  explicit ControlChannel(Network* const network)
+      : network_(network), received_(network->num_nodes()) {}
+
+  std::vector<std::string> Exchange(std::vector<std::string> outgoing) {
+    CHECK_EQ(outgoing.size(), network_->num_nodes());
+    for (int node = 0; node < network_->num_nodes(); ++node) {
+      if (node == network_->node) continue;
+      network_->WriteFrame(
+          node,
+          {.stream = kControl,
+           .kind = kData,
+           .phase = 0,
+           .count = static_cast<uint32>(outgoing[node].size())},
+          outgoing[node].data(), outgoing[node].size());
+    }
+    std::vector<std::string> incoming(network_->num_nodes());
+    incoming[network_->node] = std::move(outgoing[network_->node]);
+    absl::MutexLock l(&network_->mu);
+    network_->mu.Await(absl::Condition(this, &ControlChannel::AllReceived));
+    for (int node = 0; node < network_->num_nodes(); ++node) {
+      if (node == network_->node) continue;
+      if (received_[node].empty()) {
+        LOG(FATAL) << "Lost connection to node " << node << ": "
+                   << network_->peer_status[node];
+      }
+      incoming[node] = std::move(received_[node].front());
+      received_[node].pop_front();
+    }
+    return incoming;
+  }
+
+  absl::Status ReadData(const int node, Socket* const socket,
+                        const FrameHeader& header) override {
+    if (header.kind != kData) {
+      return absl::InternalError(
+          absl::StrCat("Unexpected frame kind ", header.kind));
+    }
+    absl::Status status = CheckFrameSize(header, 1);
+    if (!status.ok()) return status;
+    std::string data(header.count, '\0');
+    status = socket->Read(&data[0], header.count);
+    if (!status.ok()) return status;
+    absl::MutexLock l(&network_->mu);
+    received_[node].push_back(std::move(data));
+    return absl::OkStatus();
+  }
+
+  void ReceiveEndOfPhase(const int node) override {
+    LOG(DFATAL) << "Unexpected end of phase on the control stream from node "
+                << node;
+  }
+
+ private:
+  // True once every other node's data arrived, or its connection closed.
+  bool AllReceived() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(network_->mu) {
+    for (int node = 0; node < network_->num_nodes(); ++node) {
+      if (node == network_->node || !received_[node].empty()) continue;
+      if (network_->peer_status[node].ok()) return false;
+    }
+    return true;
+  }
+
+  Network* const network_;
+  // Indexed by node.
+  std::vector<std::deque<std::string>> received_ ABSL_GUARDED_BY(network_->mu);
+};
+
+class SocketDistributedManager : public DistributedManager {
+ public:
+  SocketDistributedManager(const int node, const Partition* const partition,
+                           const MessageEncoding encoding)
+      : network_(node, partition, encoding),
+        visit_messenger_(kVisits, &network_),
+        report_messenger_(kContactReports, &network_),
+        outcome_messenger_(kInfectionOutcomes, &network_),
+        control_channel_(&network_) {}
+
+  ~SocketDistributedManager() override {
+    for (auto& peer : network_.peers) {
+      if (peer != nullptr) peer->socket->Shutdown();
+    }
+    for (std::thread& receiver : receivers_) {
+      receiver.join();
+    }
+  }
+
+  absl::Status Connect(const SocketDistributedManagerOptions& options) {
+    const int node = options.node;
+    auto listener = SocketListener::Listen(options.addresses[node]);
+    if (!listener.ok()) return listener.status();
+    // Each node connects to the nodes before it and identifies itself.
+    for (int peer_node = 0; peer_node < node; ++peer_node) {
+      auto socket = Socket::Connect(options.addresses[peer_node],
+                                    options.connect_timeout);
+      if (!socket.ok()) return socket.status();
+      const uint32 id = node;
+      absl::Status status = (*socket)->Write(&id, sizeof(id));
+      if (!status.ok()) return status;
+      AddPeer(peer_node, *std::move(socket));
+    }
+    for (int accepted = node + 1; accepted < options.addresses.size();
+         ++accepted) {
+      auto socket = (*listener)->Accept();
+      if (!socket.ok()) return socket.status();
+      uint32 id;
+      absl::Status status = (*socket)->Read(&id, sizeof(id));
+      if (!status.ok()) return status;
+      if (id <= node || id >= options.addresses.size() ||
+          network_.peers[id] != nullptr) {
+        return absl::InternalError(
+            absl::StrCat("Unexpected connection from node ", id));
+      }
+      AddPeer(id, *std::move(socket));
+    }
+    for (auto& peer : network_.peers) {
+      if (peer == nullptr) continue;
+      Peer* const receiving = peer.get();
+      receivers_.emplace_back([this, receiving] { Receive(receiving); });
+    }
+    return absl::OkStatus();
+  }
+
+  DistributedMessenger<Visit>* VisitMessenger() override {
+    return &visit_messenger_;
+  }
+  DistributedMessenger<ContactReport>* ContactReportMessenger() override {
+    return &report_messenger_;
+  }
+  DistributedMessenger<InfectionOutcome>* OutcomeMessenger() override {
+    return &outcome_messenger_;
+  }
+
+  std::vector<std::string> Exchange(
+      std::vector<std::string> outgoing) override {
+    return control_channel_.Exchange(std::move(outgoing));
+  }
+
+ private:
+  void AddPeer(const int node, std::unique_ptr<Socket> socket) {
+    auto peer = absl::make_unique<Peer>();
+    peer->node = node;
+    peer->socket = std::move(socket);
+    network_.peers[node] = std::move(peer);
+  }
+
+  StreamReceiver* Receiver(const uint32 stream) {
+    switch (stream) {
+      case kVisits:
+        return &visit_messenger_;
+      case kContactReports:
+        return &report_messenger_;
+      case kInfectionOutcomes:
+        return &outcome_messenger_;
+      case kControl:
+        return &control_channel_;
+    }
+    return nullptr;
+  }
+
+  // Reads frames from a peer until its connection is closed.
+  void Receive(Peer* const peer) {
+    while (true) {
+      FrameHeader header;
+      absl::Status status = peer->socket->Read(&header, sizeof(header));
+      if (status.ok()) {
+        StreamReceiver* const receiver = Receiver(header.stream);
+        if (receiver == nullptr) {
+          status = absl::InternalError(
+              absl::StrCat("Unknown stream ", header.stream));
+        } else if (header.kind == kEndOfPhase) {
+          receiver->ReceiveEndOfPhase(peer->node);
+        } else {
+          status = receiver->ReadData(peer->node, peer->socket.get(), header);
+        }
+      }
+      if (!status.ok()) {
+        network_.Fail(peer->node, status);
+        return;
+      }
+    }
+  }
+
+  Network network_;
+  SocketMessenger<Visit> visit_messenger_;
+  SocketMessenger<ContactReport> report_messenger_;
+  SocketMessenger<InfectionOutcome> outcome_messenger_;
+  ControlChannel control_channel_;
+  std::vector<std::thread> receivers_;
+};
+
+}  // namespace
+
+StatusOr<std::unique_ptr<DistributedManager>> NewSocketDistributedManager(
+    const SocketDistributedManagerOptions& options,
+    const Partition* const partition) {
+  if (options.addresses.size() != partition->num_nodes()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Got ", options.addresses.size(), " addresses for ",
+                     partition->num_nodes(), " nodes"));
+  }
+  if (options.node < 0 || options.node >= partition->num_nodes()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid node ", options.node));
+  }
+  auto manager = absl::make_unique<SocketDistributedManager>(
+      options.node, partition, options.message_encoding);
+  absl::Status status = manager->Connect(options);
+  if (!status.ok()) return status;
+  return std::unique_ptr<DistributedManager>(std::move(manager));
+}
+
+}  // namespace abesim
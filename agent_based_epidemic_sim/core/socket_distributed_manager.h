@@ -0,0 +1,67 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_SOCKET_DISTRIBUTED_MANAGER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_SOCKET_DISTRIBUTED_MANAGER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/distributed.h"
+#include "agent_based_epidemic_sim/core/partition.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+namespace abesim {
+
+// How message batches are sent between nodes.
+enum class MessageEncoding {
+  // As is, which takes no encoding time but the most bytes.
+  kRaw,
+  // Encoded compactly, see core/message_coding.h.
+  kCompact,
+  // Encoded compactly and block compressed.
+  kCompressed,
+};
+
+struct SocketDistributedManagerOptions {
+  // The node run by this process, an index into addresses.
+  int node = 0;
+  // The addresses all nodes listen on, see port/socket.h.
+  std::vector<std::string> addresses;
+  // How long to wait for the other nodes to start listening.
+  absl::Duration connect_timeout = absl::Minutes(1);
+  // How this node sends messages.  Nodes read messages in any encoding.
+  MessageEncoding message_encoding = MessageEncoding::kCompact;
+};
+
+// Returns a DistributedManager that exchanges messages with the other nodes of
+// a simulation over sockets, one connection per pair of nodes.  Messages are
+// routed to the node owning their recipient according to partition, which
+// must outlive the manager.  Blocks until all nodes are connected.
+//
+// Each call to Flush ends a phase of the messenger's stream by sending an end
+// of phase marker to every other node, and AwaitRemotes waits for theirs.  All
+// nodes must therefore step their simulations the same number of times.
+// Losing a connection during an awaited phase or an exchange is fatal.
+StatusOr<std::unique_ptr<DistributedManager>> NewSocketDistributedManager(
+    const SocketDistributedManagerOptions& options,
+    const Partition* partition);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_SOCKET_DISTRIBUTED_MANAGER_H_
@@ -0,0 +1,247 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/socket_distributed_manager.h"
+
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/partition.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::UnorderedElementsAreArray;
+
+constexpr int kNumNodes = 3;
+constexpr int kNumLocations = 30;
+constexpr int kNumPhases = 3;
+
+template <typename Msg>
+class CollectingBroker : public Broker<Msg> {
+ public:
+  void Send(absl::Span<const Msg> msgs) override {
+    absl::MutexLock l(&mu_);
+    msgs_.insert(msgs_.end(), msgs.begin(), msgs.end());
+  }
+  std::vector<Msg> Take() {
+    absl::MutexLock l(&mu_);
+    return std::move(msgs_);
+  }
+
+ private:
+  absl::Mutex mu_;
+  std::vector<Msg> msgs_;
+};
+
+std::vector<std::string> Addresses(absl::string_view name) {
+  std::vector<std::string> addresses;
+  for (int node = 0; node < kNumNodes; ++node) {
+    addresses.push_back(absl::StrCat("unix:", getenv("TEST_TMPDIR"), "/",
+                                     name, node, ".sock"));
+  }
+  return addresses;
+}
+
+// Visits sent by a node in a phase, identified by their agent uuid.
+std::vector<Visit> NodeVisits(const int node, const int phase) {
+  std::vector<Visit> visits;
+  for (int location = 0; location < kNumLocations; ++location) {
+    visits.push_back({.location_uuid = location,
+                      .agent_uuid = 100 * phase + node});
+  }
+  return visits;
+}
+
+std::vector<int64> ExpectedAgents(const int node, const int phase) {
+  std::vector<int64> agents;
+  for (int location = node; location < kNumLocations; location += kNumNodes) {
+    for (int from_node = 0; from_node < kNumNodes; ++from_node) {
+      if (from_node != node) agents.push_back(100 * phase + from_node);
+    }
+  }
+  return agents;
+}
+
+void RunNode(const int node, const std::vector<std::string>& addresses,
+             const MessageEncoding encoding = MessageEncoding::kCompact) {
+  auto partition = NewUuidModuloPartition(kNumNodes);
+  auto manager = NewSocketDistributedManager(
+      {.node = node, .addresses = addresses, .message_encoding = encoding},
+      partition.get());
+  PANDEMIC_ASSERT_OK(manager.status());
+  DistributedMessenger<Visit>* const messenger = (*manager)->VisitMessenger();
+  CollectingBroker<Visit> received;
+  for (int phase = 0; phase < kNumPhases; ++phase) {
+    // Faster nodes send visits for this phase before the broker is set.
+    if (node == 0) absl::SleepFor(absl::Milliseconds(10));
+    messenger->SetReceiveBrokerForNextPhase(&received);
+    std::vector<Visit> remote;
+    for (const Visit& visit : NodeVisits(node, phase)) {
+      if (messenger->IsMessageRemote(visit)) {
+        remote.push_back(visit);
+      } else {
+        EXPECT_EQ(visit.location_uuid % kNumNodes, node);
+      }
+    }
+    // Send in small batches to interleave frames from different threads.
+    for (int i = 0; i < remote.size(); i += 4) {
+      messenger->Send(absl::MakeConstSpan(remote).subspan(i, 4));
+    }
+    messenger->FlushAndAwaitRemotes();
+    std::vector<int64> agents;
+    for (const Visit& visit : received.Take()) {
+      EXPECT_EQ(visit.location_uuid % kNumNodes, node);
+      agents.push_back(visit.agent_uuid);
+    }
+    EXPECT_THAT(agents,
+                UnorderedElementsAreArray(ExpectedAgents(node, phase)));
+  }
+  // The other streams are independent of visits.
+  DistributedMessenger<InfectionOutcome>* const outcomes =
+      (*manager)->OutcomeMessenger();
+  CollectingBroker<InfectionOutcome> received_outcomes;
+  outcomes->SetReceiveBrokerForNextPhase(&received_outcomes);
+  const int next_node = (node + 1) % kNumNodes;
+  outcomes->Send({{.agent_uuid = next_node}});
+  outcomes->FlushAndAwaitRemotes();
+  std::vector<InfectionOutcome> got = received_outcomes.Take();
+  ASSERT_EQ(got.size(), 1);
+  EXPECT_EQ(got[0].agent_uuid, node);
+}
+
+TEST(SocketDistributedManagerTest, RoutesMessagesToOwningNodes) {
+  const std::vector<std::string> addresses = Addresses("routes");
+  std::vector<std::thread> nodes;
+  for (int node = 0; node < kNumNodes; ++node) {
+    nodes.emplace_back([node, &addresses] { RunNode(node, addresses); });
+  }
+  for (std::thread& node : nodes) node.join();
+}
+
+TEST(SocketDistributedManagerTest, ReadsMessagesInEveryEncoding) {
+  const std::vector<std::string> addresses = Addresses("encodings");
+  const MessageEncoding encodings[kNumNodes] = {MessageEncoding::kRaw,
+                                                MessageEncoding::kCompact,
+                                                MessageEncoding::kCompressed};
+  std::vector<std::thread> nodes;
+  for (int node = 0; node < kNumNodes; ++node) {
+    nodes.emplace_back([node, &addresses, &encodings] {
+      RunNode(node, addresses, encodings[node]);
+    });
+  }
+  for (std::thread& node : nodes) node.join();
+}
+
+// Sends a report to the next node in each of two phases before awaiting
+// either of them.
+void RunDeferredNode(const int node,
+                     const std::vector<std::string>& addresses) {
+  auto partition = NewUuidModuloPartition(kNumNodes);
+  auto manager = NewSocketDistributedManager(
+      {.node = node, .addresses = addresses}, partition.get());
+  PANDEMIC_ASSERT_OK(manager.status());
+  DistributedMessenger<ContactReport>* const messenger =
+      (*manager)->ContactReportMessenger();
+  const int next_node = (node + 1) % kNumNodes;
+  for (int phase = 0; phase < 2; ++phase) {
+    messenger->Send({{.from_agent_uuid = phase, .to_agent_uuid = next_node}});
+    messenger->Flush();
+  }
+  for (int phase = 0; phase < 2; ++phase) {
+    CollectingBroker<ContactReport> received;
+    messenger->SetReceiveBrokerForNextPhase(&received);
+    messenger->AwaitRemotes();
+    std::vector<ContactReport> reports = received.Take();
+    ASSERT_EQ(reports.size(), 1);
+    EXPECT_EQ(reports[0].from_agent_uuid, phase);
+    EXPECT_EQ(reports[0].to_agent_uuid, node);
+  }
+}
+
+TEST(SocketDistributedManagerTest, KeepsPhasesApartWhenAwaitsAreDeferred) {
+  const std::vector<std::string> addresses = Addresses("deferred");
+  std::vector<std::thread> nodes;
+  for (int node = 0; node < kNumNodes; ++node) {
+    nodes.emplace_back(
+        [node, &addresses] { RunDeferredNode(node, addresses); });
+  }
+  for (std::thread& node : nodes) node.join();
+}
+
+// Exchanges data naming the sending and receiving node in two rounds, the
+// second of which sends nothing to the next node.
+void RunExchangingNode(const int node,
+                       const std::vector<std::string>& addresses) {
+  auto partition = NewUuidModuloPartition(kNumNodes);
+  auto manager = NewSocketDistributedManager(
+      {.node = node, .addresses = addresses}, partition.get());
+  PANDEMIC_ASSERT_OK(manager.status());
+  for (int round = 0; round < 2; ++round) {
+    std::vector<std::string> outgoing;
+    for (int to_node = 0; to_node < kNumNodes; ++to_node) {
+      outgoing.push_back(absl::StrCat(round, ":", node, "->", to_node));
+    }
+    if (round == 1) outgoing[(node + 1) % kNumNodes].clear();
+    const std::vector<std::string> incoming =
+        (*manager)->Exchange(std::move(outgoing));
+    ASSERT_EQ(incoming.size(), kNumNodes);
+    for (int from_node = 0; from_node < kNumNodes; ++from_node) {
+      if (round == 1 && (from_node + 1) % kNumNodes == node) {
+        EXPECT_EQ(incoming[from_node], "");
+      } else {
+        EXPECT_EQ(incoming[from_node],
+                  absl::StrCat(round, ":", from_node, "->", node));
+      }
+    }
+  }
+}
+
+TEST(SocketDistributedManagerTest, ExchangesDataBetweenAllNodes) {
+  const std::vector<std::string> addresses = Addresses("exchange");
+  std::vector<std::thread> nodes;
+  for (int node = 0; node < kNumNodes; ++node) {
+    nodes.emplace_back(
+        [node, &addresses] { RunExchangingNode(node, addresses); });
+  }
+  for (std::thread& node : nodes) node.join();
+}
+
+TEST(SocketDistributedManagerTest, RejectsInvalidOptions) {
+  auto partition = NewUuidModuloPartition(kNumNodes);
+  EXPECT_EQ(NewSocketDistributedManager({.node = 0, .addresses = {"unix:a"}},
+                                        partition.get())
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(NewSocketDistributedManager(
+                {.node = kNumNodes, .addresses = Addresses("invalid")},
+                partition.get())
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace abesim
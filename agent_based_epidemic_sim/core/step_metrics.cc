@@ -0,0 +1,113 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/step_metrics.h"
+
+#include <algorithm>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+
+namespace abesim {
+namespace {
+
+constexpr char kHeader[] =
+    "step,start_time,wall_seconds,aggregate_seconds,"
+    "agent_seconds,agent_remote_seconds,agent_busy_seconds,"
+    "agent_idle_seconds,agent_max_busy_seconds,agent_sort_seconds,"
+    "agent_observe_seconds,agent_flush_seconds,agent_chunks,"
+    "agent_slowest_chunk_seconds,"
+    "location_seconds,location_remote_seconds,location_busy_seconds,"
+    "location_idle_seconds,location_max_busy_seconds,location_sort_seconds,"
+    "location_observe_seconds,location_flush_seconds,location_chunks,"
+    "location_slowest_chunk_seconds,"
+    "visits,visit_bytes,remote_visits,"
+    "infection_outcomes,infection_outcome_bytes,remote_infection_outcomes,"
+    "contact_reports,contact_report_bytes,remote_contact_reports";
+
+void AppendPhase(const PhaseMetrics& phase, std::vector<std::string>* fields) {
+  const WorkerMetrics total = phase.Total();
+  absl::Duration max_busy;
+  for (const WorkerMetrics& worker : phase.workers) {
+    max_busy = std::max(max_busy, worker.busy);
+  }
+  for (const absl::Duration duration :
+       {phase.wall_time, phase.remote_time, total.busy, total.idle, max_busy,
+        total.sort, total.observe, total.flush}) {
+    fields->push_back(absl::StrCat(absl::ToDoubleSeconds(duration)));
+  }
+  fields->push_back(absl::StrCat(total.chunks));
+  fields->push_back(absl::StrCat(
+      phase.slowest_chunks.empty()
+          ? 0
+          : absl::ToDoubleSeconds(phase.slowest_chunks[0].duration)));
+}
+
+void AppendBroker(const BrokerMetrics& broker,
+                  std::vector<std::string>* fields) {
+  fields->push_back(absl::StrCat(broker.messages));
+  fields->push_back(absl::StrCat(broker.bytes));
+  fields->push_back(absl::StrCat(broker.remote_messages));
+}
+
+}  // namespace
+
+WorkerMetrics PhaseMetrics::Total() const {
+  WorkerMetrics total;
+  for (const WorkerMetrics& worker : workers) {
+    total.busy += worker.busy;
+    total.idle += worker.idle;
+    total.sort += worker.sort;
+    total.observe += worker.observe;
+    total.flush += worker.flush;
+    total.chunks += worker.chunks;
+  }
+  return total;
+}
+
+void PhaseMetrics::AddChunk(const ChunkMetrics& chunk) {
+  auto slower = [](const ChunkMetrics& a, const ChunkMetrics& b) {
+    return a.duration > b.duration;
+  };
+  if (slowest_chunks.size() == kNumSlowestChunks) {
+    if (!slower(chunk, slowest_chunks.back())) return;
+    slowest_chunks.pop_back();
+  }
+  slowest_chunks.insert(std::upper_bound(slowest_chunks.begin(),
+                                         slowest_chunks.end(), chunk, slower),
+                        chunk);
+}
+
+StepMetricsWriter::StepMetricsWriter(std::unique_ptr<file::FileWriter> file)
+    : csv_(std::move(file), kHeader) {}
+
+absl::Status StepMetricsWriter::Write(const StepMetrics& metrics) {
+  std::vector<std::string> fields = {
+      absl::StrCat(metrics.step),
+      absl::FormatTime(absl::RFC3339_sec, metrics.start_time,
+                       absl::UTCTimeZone()),
+      absl::StrCat(absl::ToDoubleSeconds(metrics.wall_time)),
+      absl::StrCat(absl::ToDoubleSeconds(metrics.aggregate_time))};
+  AppendPhase(metrics.agent_phase, &fields);
+  AppendPhase(metrics.location_phase, &fields);
+  AppendBroker(metrics.visits, &fields);
+  AppendBroker(metrics.infection_outcomes, &fields);
+  AppendBroker(metrics.contact_reports, &fields);
+  return csv_.Write(absl::StrCat(absl::StrJoin(fields, ","), "\n"));
+}
+
+absl::Status StepMetricsWriter::Close() { return csv_.Close(); }
+
+}  // namespace abesim
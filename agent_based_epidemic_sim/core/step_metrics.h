@@ -0,0 +1,119 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_METRICS_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_METRICS_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/util/csv_writer.h"
+
+namespace abesim {
+
+// Performance metrics of a simulation step, see
+// Simulation::SetStepMetricsCallback.  Simulations always collect them, at the
+// cost of a few clock reads per chunk of work.
+
+// The work of one worker thread during a phase.
+struct WorkerMetrics {
+  // busy + idle is the wall time of the phase.  Idle time is spent waiting for
+  // work to be scheduled and for the other workers to finish.
+  absl::Duration busy;
+  absl::Duration idle;
+  // Parts of busy: sorting messages by destination, observer callbacks and
+  // flushing the worker's brokers.
+  absl::Duration sort;
+  absl::Duration observe;
+  absl::Duration flush;
+  int64 chunks = 0;
+};
+
+// A chunk of agents or locations processed by a worker.
+struct ChunkMetrics {
+  int64 chunk = 0;
+  int worker = 0;
+  int64 entities = 0;
+  // The messages the chunk consumed.
+  int64 messages = 0;
+  absl::Duration duration;
+};
+
+// The number of slowest chunks kept per phase.
+constexpr int kNumSlowestChunks = 8;
+
+struct PhaseMetrics {
+  absl::Duration wall_time;
+  // For distributed simulations, the part of wall_time spent flushing messages
+  // to and awaiting messages from remote nodes once the workers are done.
+  absl::Duration remote_time;
+  std::vector<WorkerMetrics> workers;
+  // The slowest chunks of the phase, slowest first.
+  std::vector<ChunkMetrics> slowest_chunks;
+
+  // Sums over workers.
+  WorkerMetrics Total() const;
+  // Adds a chunk to slowest_chunks if it is among the kNumSlowestChunks
+  // slowest.
+  void AddChunk(const ChunkMetrics& chunk);
+};
+
+// The messages received through a broker during a step.
+struct BrokerMetrics {
+  // Messages received for local processing, and their size in memory.
+  int64 messages = 0;
+  int64 bytes = 0;
+  // Messages sent to remote nodes by distributed simulations.
+  int64 remote_messages = 0;
+};
+
+struct StepMetrics {
+  // The index of the step since the simulation started, and its simulated
+  // start time.
+  int64 step = 0;
+  absl::Time start_time;
+  absl::Duration wall_time;
+  PhaseMetrics agent_phase;
+  PhaseMetrics location_phase;
+  // ObserverManager::AggregateForTimestep at the end of the step.
+  absl::Duration aggregate_time;
+  BrokerMetrics visits;
+  BrokerMetrics infection_outcomes;
+  BrokerMetrics contact_reports;
+};
+
+// Writes step metrics as CSV, one line per step, with worker metrics summed
+// over workers.  The largest worker busy time and the slowest chunk of each
+// phase are included to show load imbalance.
+class StepMetricsWriter {
+ public:
+  explicit StepMetricsWriter(std::unique_ptr<file::FileWriter> file);
+
+  absl::Status Write(const StepMetrics& metrics);
+  // Must be called before destroying the object.
+  absl::Status Close();
+
+ private:
+  CsvWriter csv_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_STEP_METRICS_H_
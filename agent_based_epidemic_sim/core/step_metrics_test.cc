@@ -0,0 +1,106 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/step_metrics.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+TEST(PhaseMetricsTest, KeepsSlowestChunksInOrder) {
+  PhaseMetrics phase;
+  for (int i = 0; i < 2 * kNumSlowestChunks; ++i) {
+    // Durations alternate between short and long so that the slowest chunks
+    // arrive out of order.
+    const int millis = i % 2 == 0 ? i : 100 + i;
+    phase.AddChunk({.chunk = i, .duration = absl::Milliseconds(millis)});
+  }
+  ASSERT_EQ(phase.slowest_chunks.size(), kNumSlowestChunks);
+  for (int i = 0; i < kNumSlowestChunks; ++i) {
+    EXPECT_EQ(phase.slowest_chunks[i].chunk,
+              2 * kNumSlowestChunks - 1 - 2 * i);
+  }
+  phase.AddChunk({.chunk = 100, .duration = absl::Milliseconds(1)});
+  EXPECT_EQ(phase.slowest_chunks.back().chunk, 1);
+}
+
+TEST(PhaseMetricsTest, TotalSumsWorkers) {
+  PhaseMetrics phase;
+  phase.workers = {{.busy = absl::Seconds(1), .chunks = 2},
+                   {.busy = absl::Seconds(2), .flush = absl::Seconds(1),
+                    .chunks = 3}};
+  const WorkerMetrics total = phase.Total();
+  EXPECT_EQ(total.busy, absl::Seconds(3));
+  EXPECT_EQ(total.flush, absl::Seconds(1));
+  EXPECT_EQ(total.chunks, 5);
+}
+
+TEST(StepMetricsWriterTest, WritesOneLinePerStep) {
+  const std::string path = TestPath("step_metrics.csv");
+  StepMetricsWriter writer(file::OpenOrDie(path));
+  for (int step = 0; step < 2; ++step) {
+    StepMetrics metrics;
+    metrics.step = step;
+    metrics.start_time = absl::FromUnixSeconds(86400 * step);
+    metrics.wall_time = absl::Seconds(2);
+    metrics.agent_phase.workers = {{.busy = absl::Seconds(1), .chunks = 4}};
+    metrics.agent_phase.AddChunk({.duration = absl::Milliseconds(500)});
+    metrics.visits = {.messages = 10, .bytes = 80, .remote_messages = 3};
+    PANDEMIC_ASSERT_OK(writer.Write(metrics));
+  }
+  PANDEMIC_ASSERT_OK(writer.Close());
+
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(path, &contents));
+  const std::vector<std::string> lines =
+      absl::StrSplit(contents, '\n', absl::SkipEmpty());
+  ASSERT_EQ(lines.size(), 3);
+  const std::vector<std::string> header = absl::StrSplit(lines[0], ',');
+  const std::vector<std::string> fields = absl::StrSplit(lines[2], ',');
+  ASSERT_EQ(fields.size(), header.size());
+  auto field = [&header, &fields](absl::string_view name) {
+    for (int i = 0; i < header.size(); ++i) {
+      if (header[i] == name) return fields[i];
+    }
+    return std::string();
+  };
+  EXPECT_EQ(field("step"), "1");
+  EXPECT_EQ(field("start_time"), "1970-01-02T00:00:00+00:00");
+  EXPECT_EQ(field("wall_seconds"), "2");
+  EXPECT_EQ(field("agent_busy_seconds"), "1");
+  EXPECT_EQ(field("agent_max_busy_seconds"), "1");
+  EXPECT_EQ(field("agent_chunks"), "4");
+  EXPECT_EQ(field("agent_slowest_chunk_seconds"), "0.5");
+  EXPECT_EQ(field("location_chunks"), "0");
+  EXPECT_EQ(field("visits"), "10");
+  EXPECT_EQ(field("visit_bytes"), "80");
+  EXPECT_EQ(field("remote_visits"), "3");
+}
+
+}  // namespace
+}  // namespace abesim
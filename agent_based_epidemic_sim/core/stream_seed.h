@@ -0,0 +1,42 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_STREAM_SEED_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_STREAM_SEED_H_
+
+#include <array>
+#include <random>
+
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// Derives the seed of one of several independent random streams of a part of
+// a seeded computation, such as a region or partition of a synthesized
+// population, so that the draws of one stream do not shift those of another.
+inline uint64 StreamSeed(const uint64 seed, const int part, const int stream) {
+  std::seed_seq seed_seq = {static_cast<uint32>(seed),
+                            static_cast<uint32>(seed >> 32),
+                            static_cast<uint32>(part),
+                            static_cast<uint32>(stream)};
+  std::array<uint32, 2> words;
+  seed_seq.generate(words.begin(), words.end());
+  return static_cast<uint64>(words[0]) << 32 | words[1];
+}
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_STREAM_SEED_H_
@@ -23,4 +23,8 @@ int64 ShardedGlobalIdUuidGenerator::GenerateUuid() const {
   return static_cast<int64>(uuid_shard_) << 48 | (local_id++);
 }
 
+int64 ShardedSequentialUuidGenerator::GenerateUuid() const {
+  return static_cast<int64>(uuid_shard_) << 48 | (local_id_++);
+}
+
 }  // namespace abesim
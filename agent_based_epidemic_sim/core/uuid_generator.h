@@ -36,6 +36,32 @@ class ShardedGlobalIdUuidGenerator : public UuidGenerator {
  private:
   const int16 uuid_shard_;
 };
+
+// Generates uuids from a counter of its own rather than a process-wide one, so
+// that the uuids only depend on the order of calls to this generator.  Not
+// thread safe; concurrent users should each have a generator with a distinct
+// shard.
+class ShardedSequentialUuidGenerator : public UuidGenerator {
+ public:
+  explicit ShardedSequentialUuidGenerator(int16 uuid_shard)
+      : uuid_shard_(uuid_shard) {}
+  int64 GenerateUuid() const override;
+
+ private:
+  const int16 uuid_shard_;
+  mutable uint32 local_id_ = 0;
+};
+
+// Generates consecutive uuids starting at first_uuid, for callers that assign
+// disjoint ranges of uuids up front.  Not thread safe.
+class SequentialUuidGenerator : public UuidGenerator {
+ public:
+  explicit SequentialUuidGenerator(int64 first_uuid) : next_uuid_(first_uuid) {}
+  int64 GenerateUuid() const override { return next_uuid_++; }
+
+ private:
+  mutable int64 next_uuid_;
+};
 }  // namespace abesim
 
 #endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_UUID_GENERATOR_H_
@@ -17,7 +17,9 @@
 #include <thread>  // NOLINT: Open source only.
 
 #include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
+#include "agent_based_epidemic_sim/port/trace.h"
 
 namespace abesim {
 namespace {
@@ -26,6 +28,7 @@ class StdThreadExecutor : public Executor {
  public:
   explicit StdThreadExecutor(int workers);
   std::unique_ptr<Execution> NewExecution() override;
+  void SetTracer(Tracer* tracer) override;
 
   ~StdThreadExecutor() override;
 
@@ -37,20 +40,26 @@ class StdThreadExecutor : public Executor {
   bool Ready() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
   std::vector<std::thread> threads_;
   bool done_ GUARDED_BY(mu_) = false;
+  Tracer* tracer_ GUARDED_BY(mu_) = nullptr;
   std::vector<std::function<void()> > work_ GUARDED_BY(mu_);
 };
 
 class StdThreadExecution : public Execution {
  public:
-  explicit StdThreadExecution(StdThreadExecutor& executor)
-      : executor_(executor) {}
+  StdThreadExecution(StdThreadExecutor& executor, Tracer* const tracer)
+      : executor_(executor), tracer_(tracer) {}
   void Add(std::function<void()> fn) override {
     {
       absl::MutexLock l(&mu_);
       started_++;
     }
     executor_.Add([this, fn]() {
-      fn();
+      {
+        // Recorded before the task counts as finished, so that the span is
+        // complete once Wait returns.
+        TraceSpan span(tracer_, "task", "executor");
+        fn();
+      }
       {
         absl::MutexLock l(&mu_);
         finished_++;
@@ -58,12 +67,14 @@ class StdThreadExecution : public Execution {
     });
   }
   void Wait() override {
+    TraceSpan span(tracer_, "wait", "executor");
     mu_.LockWhen(absl::Condition(this, &StdThreadExecution::AllFinished));
     mu_.Unlock();
   }
 
  private:
   StdThreadExecutor& executor_;
+  Tracer* const tracer_;
   absl::Mutex mu_;
   bool AllFinished() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
     return started_ == finished_;
@@ -74,7 +85,8 @@ class StdThreadExecution : public Execution {
 
 StdThreadExecutor::StdThreadExecutor(const int workers) {
   for (int i = 0; i < workers; ++i) {
-    threads_.push_back(std::thread([this]() {
+    threads_.push_back(std::thread([this, i]() {
+      SetTraceThreadName(absl::StrCat("executor worker ", i));
       while (true) {
         mu_.LockWhen(absl::Condition(this, &StdThreadExecutor::Ready));
         if (done_) {
@@ -108,7 +120,13 @@ void StdThreadExecutor::Add(std::function<void()> fn) {
 }
 
 std::unique_ptr<Execution> StdThreadExecutor::NewExecution() {
-  return absl::make_unique<StdThreadExecution>(*this);
+  absl::MutexLock l(&mu_);
+  return absl::make_unique<StdThreadExecution>(*this, tracer_);
+}
+
+void StdThreadExecutor::SetTracer(Tracer* const tracer) {
+  absl::MutexLock l(&mu_);
+  tracer_ = tracer;
 }
 
 }  // namespace
@@ -20,6 +20,8 @@
 #include <functional>
 #include <memory>
 
+#include "agent_based_epidemic_sim/port/trace.h"
+
 namespace abesim {
 
 // An Execution allows for running functions in multiple threads.
@@ -40,6 +42,11 @@ class Executor {
  public:
   // Create a new execution.
   virtual std::unique_ptr<Execution> NewExecution() = 0;
+  // Record the functions run by the executor and the waits for executions to
+  // finish in tracer, which may be null to stop tracing.  Only affects
+  // executions created afterwards, and must not be called concurrently with
+  // running executions.
+  virtual void SetTracer(Tracer* tracer) {}
 
   virtual ~Executor() = default;
 };
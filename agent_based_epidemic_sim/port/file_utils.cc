@@ -14,11 +14,16 @@
 
 #include "agent_based_epidemic_sim/port/file_utils.h"
 
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <thread>  // NOLINT: Open source only.
+#include <utility>
+#include <vector>
 
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
@@ -48,6 +53,142 @@ class FileWriterImpl : public FileWriter {
  private:
   std::ofstream ofstream_;
 };
+
+// Batches writes into large buffers that are written to file by a background
+// thread.  Filled buffers are recycled once written.  All methods other than
+// the background thread's must be called from a single thread.
+class AsyncFileWriterImpl : public FileWriter {
+ public:
+  AsyncFileWriterImpl(std::ofstream ofstream, const AsyncWriterOptions& options)
+      : options_(options),
+        ofstream_(std::move(ofstream)),
+        thread_([this]() { FlushLoop(); }) {
+    current_.reserve(options_.buffer_size);
+  }
+
+  ~AsyncFileWriterImpl() override {
+    if (!closed_) Close().IgnoreError();
+  }
+
+  absl::Status WriteString(absl::string_view content) override {
+    if (closed_) return ClosedError();
+    current_.append(content.data(), content.size());
+    if (current_.size() < options_.buffer_size) return absl::OkStatus();
+    return Enqueue(std::exchange(current_, TakeFreeBuffer()));
+  }
+
+  absl::Status WriteBuffer(std::string buffer) override {
+    if (closed_) return ClosedError();
+    if (current_.size() + buffer.size() <= options_.buffer_size) {
+      current_.append(buffer);
+      return absl::OkStatus();
+    }
+    if (!current_.empty()) {
+      absl::Status status = Enqueue(std::exchange(current_, TakeFreeBuffer()));
+      if (!status.ok()) return status;
+    }
+    return Enqueue(std::move(buffer));
+  }
+
+  absl::Status Close() override {
+    if (closed_) return ClosedError();
+    closed_ = true;
+    if (!current_.empty()) Enqueue(std::move(current_)).IgnoreError();
+    {
+      absl::MutexLock l(&mu_);
+      closing_ = true;
+    }
+    thread_.join();
+    ofstream_.close();
+    absl::MutexLock l(&mu_);
+    if (ofstream_.fail()) {
+      status_.Update(
+          absl::Status(absl::StatusCode::kUnknown, "Failed to close."));
+    }
+    return status_;
+  }
+
+ private:
+  static absl::Status ClosedError() {
+    return absl::Status(absl::StatusCode::kFailedPrecondition,
+                        "Writer is closed.");
+  }
+
+  bool CanEnqueue() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return pending_.size() < options_.max_pending_buffers;
+  }
+  bool HasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return closing_ || !pending_.empty();
+  }
+
+  // Hands a buffer to the background thread, blocking while too many buffers
+  // are pending.  Returns the first error encountered so far.
+  absl::Status Enqueue(std::string buffer) ABSL_LOCKS_EXCLUDED(mu_) {
+    mu_.LockWhen(absl::Condition(this, &AsyncFileWriterImpl::CanEnqueue));
+    pending_.push_back(std::move(buffer));
+    absl::Status status = status_;
+    mu_.Unlock();
+    return status;
+  }
+
+  std::string TakeFreeBuffer() ABSL_LOCKS_EXCLUDED(mu_) {
+    std::string buffer;
+    {
+      absl::MutexLock l(&mu_);
+      if (!free_.empty()) {
+        buffer = std::move(free_.back());
+        free_.pop_back();
+      }
+    }
+    buffer.reserve(options_.buffer_size);
+    return buffer;
+  }
+
+  void FlushLoop() ABSL_LOCKS_EXCLUDED(mu_) {
+    while (true) {
+      mu_.LockWhen(absl::Condition(this, &AsyncFileWriterImpl::HasWork));
+      if (pending_.empty()) {
+        mu_.Unlock();
+        return;
+      }
+      std::string buffer = std::move(pending_.front());
+      pending_.pop_front();
+      // Once a write has failed later buffers are dropped, so the file never
+      // contains data past a gap.
+      const bool failed = !status_.ok();
+      mu_.Unlock();
+
+      absl::Status status;
+      if (!failed && !ofstream_.write(buffer.data(), buffer.size())) {
+        status =
+            absl::Status(absl::StatusCode::kUnavailable, "Failed to write.");
+      }
+      buffer.clear();
+
+      absl::MutexLock l(&mu_);
+      status_.Update(status);
+      // Oversized buffers handed over by WriteBuffer are not kept around.
+      if (free_.size() < options_.max_pending_buffers &&
+          buffer.capacity() <= 2 * options_.buffer_size) {
+        free_.push_back(std::move(buffer));
+      }
+    }
+  }
+
+  const AsyncWriterOptions options_;
+  // Only used by the background thread until it is joined in Close.
+  std::ofstream ofstream_;
+  std::string current_;
+  bool closed_ = false;
+
+  absl::Mutex mu_;
+  std::deque<std::string> pending_ ABSL_GUARDED_BY(mu_);
+  std::vector<std::string> free_ ABSL_GUARDED_BY(mu_);
+  bool closing_ ABSL_GUARDED_BY(mu_) = false;
+  absl::Status status_ ABSL_GUARDED_BY(mu_);
+
+  std::thread thread_;
+};
 }  // namespace
 
 std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name) {
@@ -57,6 +198,14 @@ std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name) {
   return absl::make_unique<FileWriterImpl>(std::move(ofstream));
 }
 
+std::unique_ptr<FileWriter> OpenAsyncOrDie(absl::string_view file_name,
+                                           const AsyncWriterOptions& options) {
+  CHECK(!std::filesystem::exists(file_name))
+      << "File already exists: " << file_name;
+  std::ofstream ofstream((std::string(file_name)), std::ios::binary);
+  return absl::make_unique<AsyncFileWriterImpl>(std::move(ofstream), options);
+}
+
 absl::Status GetContents(absl::string_view file_name, std::string* output) {
   std::ifstream input_file((std::string(file_name)));
   if (input_file.good()) {
@@ -72,5 +221,18 @@ absl::Status GetContents(absl::string_view file_name, std::string* output) {
   }
 }
 
+absl::Status SetContents(absl::string_view file_name,
+                         const absl::string_view contents) {
+  std::ofstream output_file(std::string(file_name),
+                            std::ios::binary | std::ios::trunc);
+  output_file << contents;
+  output_file.close();
+  if (!output_file) {
+    return absl::UnavailableError(
+        absl::StrCat("Failed to write file: ", file_name));
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace file
 }  // namespace abesim
@@ -17,6 +17,10 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_PORT_FILE_UTILS_H_
 #define AGENT_BASED_EPIDEMIC_SIM_PORT_FILE_UTILS_H_
 
+#include <cstddef>
+#include <memory>
+#include <string>
+
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
@@ -30,6 +34,11 @@ class FileWriter {
   virtual ~FileWriter() = default;
   // Writes a string to file.
   virtual absl::Status WriteString(absl::string_view content) = 0;
+  // Writes a whole buffer to file, taking ownership of it.  Implementations
+  // may write the buffer asynchronously without copying it.
+  virtual absl::Status WriteBuffer(std::string buffer) {
+    return WriteString(buffer);
+  }
   // Must be called before destroying the object.
   virtual absl::Status Close() = 0;
 };
@@ -37,9 +46,30 @@ class FileWriter {
 // Opens a file for writing. Crashes if the file already exists.
 std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name);
 
+struct AsyncWriterOptions {
+  // Writes are batched into in-memory buffers of this size before being
+  // handed to the background thread.
+  size_t buffer_size = 1 << 20;
+  // The maximum number of filled buffers waiting to be written.  Writers block
+  // once this many buffers are pending, which bounds memory use to roughly
+  // 2 * max_pending_buffers * buffer_size.
+  int max_pending_buffers = 4;
+};
+
+// Opens a file for writing on a background thread.  Crashes if the file
+// already exists.  Writes only fail early if an earlier buffer failed to be
+// written; errors are otherwise reported by Close, which blocks until all
+// buffers are written.
+std::unique_ptr<FileWriter> OpenAsyncOrDie(
+    absl::string_view file_name, const AsyncWriterOptions& options = {});
+
 // Gets the contents of a file.
 absl::Status GetContents(absl::string_view file_name, std::string* output);
 
+// Replaces the contents of a file, creating it if it does not exist.
+absl::Status SetContents(absl::string_view file_name,
+                         absl::string_view contents);
+
 }  // namespace file
 }  // namespace abesim
 
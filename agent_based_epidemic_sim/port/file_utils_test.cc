@@ -0,0 +1,88 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/port/file_utils.h"
+
+#include <cstdlib>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace file {
+namespace {
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(std::getenv("TEST_TMPDIR"), "/", name);
+}
+
+TEST(AsyncFileWriterTest, WritesAllContentsInOrder) {
+  constexpr size_t kBufferSize = 64;
+  const std::string path = TestPath("async_in_order.txt");
+  auto writer = OpenAsyncOrDie(
+      path, {.buffer_size = kBufferSize, .max_pending_buffers = 2});
+  std::string expected;
+  for (int i = 0; i < 1000; ++i) {
+    const std::string line = absl::StrCat(i, "\n");
+    if (i % 10 == 0) {
+      PANDEMIC_ASSERT_OK(writer->WriteBuffer(line));
+    } else {
+      PANDEMIC_ASSERT_OK(writer->WriteString(line));
+    }
+    expected += line;
+  }
+  // Larger than a single buffer, handed over without copying.
+  const std::string large(16 * kBufferSize, 'x');
+  PANDEMIC_ASSERT_OK(writer->WriteBuffer(large));
+  expected += large;
+  PANDEMIC_ASSERT_OK(writer->Close());
+
+  std::string contents;
+  PANDEMIC_ASSERT_OK(GetContents(path, &contents));
+  EXPECT_EQ(contents, expected);
+}
+
+TEST(AsyncFileWriterTest, WriteAfterCloseFails) {
+  auto writer = OpenAsyncOrDie(TestPath("async_closed.txt"));
+  PANDEMIC_ASSERT_OK(writer->WriteString("data"));
+  PANDEMIC_ASSERT_OK(writer->Close());
+  EXPECT_EQ(writer->WriteString("more").code(),
+            absl::StatusCode::kFailedPrecondition);
+  EXPECT_EQ(writer->Close().code(), absl::StatusCode::kFailedPrecondition);
+}
+
+TEST(AsyncFileWriterTest, CloseReportsWriteErrors) {
+  auto writer = OpenAsyncOrDie(TestPath("missing_directory/async.txt"));
+  // Failures are only reported once the background thread has written.
+  writer->WriteString("data").IgnoreError();
+  EXPECT_FALSE(writer->Close().ok());
+}
+
+TEST(FileUtilsTest, SetContentsOverwrites) {
+  const std::string path = TestPath("set_contents.txt");
+  PANDEMIC_ASSERT_OK(SetContents(path, "first contents"));
+  PANDEMIC_ASSERT_OK(SetContents(path, "second"));
+  std::string contents;
+  PANDEMIC_ASSERT_OK(GetContents(path, &contents));
+  EXPECT_EQ(contents, "second");
+  EXPECT_FALSE(SetContents(TestPath("missing_directory/set.txt"), "").ok());
+}
+
+}  // namespace
+}  // namespace file
+}  // namespace abesim
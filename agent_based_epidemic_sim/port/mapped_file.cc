@@ -0,0 +1,74 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/port/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+
+namespace abesim {
+namespace file {
+namespace {
+
+absl::Status ErrnoError(absl::string_view operation,
+                        absl::string_view file_name) {
+  return absl::Status(absl::StatusCode::kUnavailable,
+                      absl::StrCat("Failed to ", operation, " ", file_name,
+                                   ": errno ", errno));
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<MappedFile>> MappedFile::Open(
+    absl::string_view file_name) {
+  const std::string path(file_name);
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return ErrnoError("open", file_name);
+  struct stat stat_buffer;
+  if (fstat(fd, &stat_buffer) != 0) {
+    const absl::Status status = ErrnoError("stat", file_name);
+    close(fd);
+    return status;
+  }
+  const size_t size = stat_buffer.st_size;
+  // Empty files cannot be mapped.
+  void* data = nullptr;
+  if (size > 0) {
+    data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      const absl::Status status = ErrnoError("map", file_name);
+      close(fd);
+      return status;
+    }
+  }
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  return absl::WrapUnique(new MappedFile(static_cast<const char*>(data), size));
+}
+
+MappedFile::~MappedFile() {
+  if (size_ > 0) munmap(const_cast<char*>(data_), size_);
+}
+
+}  // namespace file
+}  // namespace abesim
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_PORT_MAPPED_FILE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_PORT_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <memory>
+
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+namespace abesim {
+namespace file {
+
+// A read-only memory mapping of a whole file.  The contents are paged in on
+// access, so opening a file is cheap regardless of its size.  The mapping
+// starts at a page boundary, so offsets into the contents that are aligned for
+// a type are aligned in memory as well.
+class MappedFile {
+ public:
+  static StatusOr<std::unique_ptr<MappedFile>> Open(
+      absl::string_view file_name);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  absl::string_view contents() const { return {data_, size_}; }
+
+ private:
+  MappedFile(const char* data, size_t size) : data_(data), size_(size) {}
+
+  const char* const data_;
+  const size_t size_;
+};
+
+}  // namespace file
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_PORT_MAPPED_FILE_H_
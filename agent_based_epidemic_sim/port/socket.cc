@@ -0,0 +1,237 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/port/socket.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+
+namespace abesim {
+namespace {
+
+constexpr absl::string_view kUnixPrefix = "unix:";
+
+absl::Status ErrnoError(absl::string_view operation,
+                        absl::string_view address) {
+  return absl::Status(absl::StatusCode::kUnavailable,
+                      absl::StrCat("Failed to ", operation, " ", address,
+                                   ": errno ", errno));
+}
+
+// A resolved socket address.
+struct Address {
+  int family;
+  sockaddr_storage storage;
+  socklen_t length;
+  std::string unix_path;
+
+  const sockaddr* sockaddr_ptr() const {
+    return reinterpret_cast<const sockaddr*>(&storage);
+  }
+};
+
+StatusOr<Address> ResolveAddress(absl::string_view address) {
+  Address result;
+  memset(&result.storage, 0, sizeof(result.storage));
+  if (absl::StartsWith(address, kUnixPrefix)) {
+    result.unix_path = std::string(address.substr(kUnixPrefix.size()));
+    sockaddr_un* const un = reinterpret_cast<sockaddr_un*>(&result.storage);
+    if (result.unix_path.empty() ||
+        result.unix_path.size() >= sizeof(un->sun_path)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid unix socket path: ", address));
+    }
+    result.family = AF_UNIX;
+    un->sun_family = AF_UNIX;
+    memcpy(un->sun_path, result.unix_path.data(), result.unix_path.size());
+    result.length = sizeof(sockaddr_un);
+    return result;
+  }
+  const size_t colon = address.rfind(':');
+  int port;
+  if (colon == absl::string_view::npos ||
+      !absl::SimpleAtoi(address.substr(colon + 1), &port) || port < 0 ||
+      port > 65535) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid socket address: ", address));
+  }
+  const std::string host(address.substr(0, colon));
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* info = nullptr;
+  const int error =
+      getaddrinfo(host.empty() ? nullptr : host.c_str(),
+                  absl::StrCat(port).c_str(), &hints, &info);
+  if (error != 0 || info == nullptr) {
+    return absl::Status(absl::StatusCode::kUnavailable,
+                        absl::StrCat("Failed to resolve ", address, ": ",
+                                     gai_strerror(error)));
+  }
+  result.family = info->ai_family;
+  memcpy(&result.storage, info->ai_addr, info->ai_addrlen);
+  result.length = info->ai_addrlen;
+  freeaddrinfo(info);
+  return result;
+}
+
+// Small messages are sent immediately rather than waiting for more data.
+void SetNoDelay(const int fd, const int family) {
+  if (family == AF_UNIX) return;
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<Socket>> Socket::Connect(
+    const absl::string_view address, const absl::Duration timeout) {
+  auto resolved = ResolveAddress(address);
+  if (!resolved.ok()) return resolved.status();
+  const absl::Time deadline = absl::Now() + timeout;
+  absl::Duration backoff = absl::Milliseconds(1);
+  while (true) {
+    const int fd = socket(resolved->family, SOCK_STREAM, 0);
+    if (fd < 0) return ErrnoError("create socket for", address);
+    if (connect(fd, resolved->sockaddr_ptr(), resolved->length) == 0) {
+      SetNoDelay(fd, resolved->family);
+      return absl::WrapUnique(new Socket(fd));
+    }
+    const absl::Status status = ErrnoError("connect to", address);
+    const bool retry = errno == ECONNREFUSED || errno == ENOENT;
+    close(fd);
+    if (!retry || absl::Now() + backoff > deadline) return status;
+    absl::SleepFor(backoff);
+    backoff = std::min(2 * backoff, absl::Milliseconds(100));
+  }
+}
+
+Socket::~Socket() { close(fd_); }
+
+absl::Status Socket::Write(const void* const data, const size_t size) {
+  const char* next = static_cast<const char*>(data);
+  size_t remaining = size;
+  while (remaining > 0) {
+    const ssize_t written = send(fd_, next, remaining, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return ErrnoError("write to", "socket");
+    }
+    next += written;
+    remaining -= written;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Socket::Read(void* const data, const size_t size) {
+  char* next = static_cast<char*>(data);
+  size_t remaining = size;
+  while (remaining > 0) {
+    const ssize_t read = recv(fd_, next, remaining, 0);
+    if (read < 0) {
+      if (errno == EINTR) continue;
+      return ErrnoError("read from", "socket");
+    }
+    if (read == 0) {
+      return absl::OutOfRangeError("Socket closed by peer");
+    }
+    next += read;
+    remaining -= read;
+  }
+  return absl::OkStatus();
+}
+
+void Socket::Shutdown() { shutdown(fd_, SHUT_RDWR); }
+
+StatusOr<std::unique_ptr<SocketListener>> SocketListener::Listen(
+    const absl::string_view address) {
+  auto resolved = ResolveAddress(address);
+  if (!resolved.ok()) return resolved.status();
+  const int fd = socket(resolved->family, SOCK_STREAM, 0);
+  if (fd < 0) return ErrnoError("create socket for", address);
+  if (resolved->family == AF_UNIX) {
+    unlink(resolved->unix_path.c_str());
+  } else {
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  }
+  if (bind(fd, resolved->sockaddr_ptr(), resolved->length) != 0) {
+    const absl::Status status = ErrnoError("bind", address);
+    close(fd);
+    return status;
+  }
+  if (listen(fd, SOMAXCONN) != 0) {
+    const absl::Status status = ErrnoError("listen on", address);
+    close(fd);
+    return status;
+  }
+  std::string bound_address(address);
+  if (resolved->family != AF_UNIX) {
+    sockaddr_storage storage;
+    socklen_t length = sizeof(storage);
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&storage), &length) !=
+        0) {
+      const absl::Status status = ErrnoError("get name of", address);
+      close(fd);
+      return status;
+    }
+    const int port =
+        storage.ss_family == AF_INET6
+            ? ntohs(reinterpret_cast<sockaddr_in6*>(&storage)->sin6_port)
+            : ntohs(reinterpret_cast<sockaddr_in*>(&storage)->sin_port);
+    bound_address = absl::StrCat(
+        address.substr(0, address.rfind(':')), ":", port);
+  }
+  return absl::WrapUnique(
+      new SocketListener(fd, std::move(bound_address), resolved->unix_path));
+}
+
+SocketListener::~SocketListener() {
+  close(fd_);
+  if (!unix_path_.empty()) unlink(unix_path_.c_str());
+}
+
+StatusOr<std::unique_ptr<Socket>> SocketListener::Accept() {
+  while (true) {
+    const int fd = accept(fd_, nullptr, nullptr);
+    if (fd >= 0) {
+      sockaddr_storage storage;
+      socklen_t length = sizeof(storage);
+      if (getsockname(fd, reinterpret_cast<sockaddr*>(&storage), &length) ==
+          0) {
+        SetNoDelay(fd, storage.ss_family);
+      }
+      return absl::WrapUnique(new Socket(fd));
+    }
+    if (errno != EINTR) return ErrnoError("accept on", address_);
+  }
+}
+
+}  // namespace abesim
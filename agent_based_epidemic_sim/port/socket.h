@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_PORT_SOCKET_H_
+#define AGENT_BASED_EPIDEMIC_SIM_PORT_SOCKET_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+namespace abesim {
+
+// Stream sockets for communicating between processes.  Addresses are either
+// "<host>:<port>" for TCP or "unix:<path>" for Unix domain sockets.
+
+// A connected socket.  Reads and writes block until done, and may be used from
+// different threads, but concurrent writes (or reads) must be serialized by
+// the caller.
+class Socket {
+ public:
+  // Connects to a listening socket, retrying until timeout to give the listener
+  // time to start.
+  static StatusOr<std::unique_ptr<Socket>> Connect(absl::string_view address,
+                                                   absl::Duration timeout);
+
+  Socket(const Socket&) = delete;
+  Socket& operator=(const Socket&) = delete;
+  ~Socket();
+
+  absl::Status Write(const void* data, size_t size);
+  // Returns OutOfRange if the peer closed the connection before size bytes
+  // were read.
+  absl::Status Read(void* data, size_t size);
+  // Unblocks pending reads and fails further reads and writes.
+  void Shutdown();
+
+ private:
+  friend class SocketListener;
+  explicit Socket(int fd) : fd_(fd) {}
+
+  const int fd_;
+};
+
+// A socket listening for connections.
+class SocketListener {
+ public:
+  // For Unix domain sockets an existing file at the path is replaced.  A TCP
+  // port of 0 picks a free port, see address().
+  static StatusOr<std::unique_ptr<SocketListener>> Listen(
+      absl::string_view address);
+
+  SocketListener(const SocketListener&) = delete;
+  SocketListener& operator=(const SocketListener&) = delete;
+  ~SocketListener();
+
+  StatusOr<std::unique_ptr<Socket>> Accept();
+
+  // The address connections can be made to.
+  const std::string& address() const { return address_; }
+
+ private:
+  SocketListener(int fd, std::string address, std::string unix_path)
+      : fd_(fd),
+        address_(std::move(address)),
+        unix_path_(std::move(unix_path)) {}
+
+  const int fd_;
+  const std::string address_;
+  // Removed when the listener is destroyed.
+  const std::string unix_path_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_PORT_SOCKET_H_
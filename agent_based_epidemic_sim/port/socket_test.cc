@@ -0,0 +1,99 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/port/socket.h"
+
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+void CheckRoundTrip(const std::string& listen_address) {
+  auto listener = SocketListener::Listen(listen_address);
+  PANDEMIC_ASSERT_OK(listener.status());
+  const std::string address = (*listener)->address();
+
+  std::thread client([&address] {
+    auto socket = Socket::Connect(address, absl::Seconds(10));
+    PANDEMIC_ASSERT_OK(socket.status());
+    const std::string request = "ping";
+    PANDEMIC_EXPECT_OK((*socket)->Write(request.data(), request.size()));
+    std::string response(4, '\0');
+    PANDEMIC_EXPECT_OK((*socket)->Read(&response[0], response.size()));
+    EXPECT_EQ(response, "pong");
+  });
+
+  auto socket = (*listener)->Accept();
+  PANDEMIC_ASSERT_OK(socket.status());
+  std::string request(4, '\0');
+  PANDEMIC_EXPECT_OK((*socket)->Read(&request[0], request.size()));
+  EXPECT_EQ(request, "ping");
+  PANDEMIC_EXPECT_OK((*socket)->Write("pong", 4));
+  client.join();
+
+  // The client has closed its end.
+  char byte;
+  EXPECT_EQ((*socket)->Read(&byte, 1).code(), absl::StatusCode::kOutOfRange);
+}
+
+TEST(SocketTest, RoundTripsOverUnixSocket) {
+  CheckRoundTrip(absl::StrCat("unix:", TestPath("round_trip.sock")));
+}
+
+TEST(SocketTest, RoundTripsOverTcp) {
+  // Port 0 picks a free port.
+  CheckRoundTrip("localhost:0");
+}
+
+TEST(SocketTest, ConnectWaitsForListener) {
+  const std::string address = absl::StrCat("unix:", TestPath("late.sock"));
+  std::thread server([&address] {
+    absl::SleepFor(absl::Milliseconds(50));
+    auto listener = SocketListener::Listen(address);
+    PANDEMIC_ASSERT_OK(listener.status());
+    auto socket = (*listener)->Accept();
+    PANDEMIC_EXPECT_OK(socket.status());
+  });
+  auto socket = Socket::Connect(address, absl::Seconds(10));
+  PANDEMIC_EXPECT_OK(socket.status());
+  server.join();
+}
+
+TEST(SocketTest, ConnectTimesOut) {
+  auto socket = Socket::Connect(
+      absl::StrCat("unix:", TestPath("missing.sock")), absl::Milliseconds(10));
+  EXPECT_EQ(socket.status().code(), absl::StatusCode::kUnavailable);
+}
+
+TEST(SocketTest, RejectsInvalidAddresses) {
+  EXPECT_EQ(SocketListener::Listen("no_port").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(SocketListener::Listen("localhost:99999").status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(SocketListener::Listen("unix:").status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,133 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/port/trace.h"
+
+#include <atomic>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "agent_based_epidemic_sim/util/json.h"
+
+namespace abesim {
+namespace {
+
+// Traces are written in pieces of about this size.
+constexpr int kWriteBufferSize = 1 << 20;
+
+std::atomic<uint64> next_tracer_id{1};
+
+// The name given to the calling thread by SetTraceThreadName.
+std::string& DefaultThreadName() {
+  static thread_local std::string name;
+  return name;
+}
+
+}  // namespace
+
+Tracer::Tracer(const int process_id)
+    : id_(next_tracer_id++), process_id_(process_id), origin_(absl::Now()) {}
+
+Tracer::ThreadBuffer* Tracer::GetThreadBuffer() {
+  // Caches the buffer of the last tracer used by this thread.  Tracer ids are
+  // never reused, so a stale entry can't match a new tracer.
+  static thread_local uint64 cached_id = 0;
+  static thread_local ThreadBuffer* cached_buffer = nullptr;
+  if (cached_id == id_) return cached_buffer;
+
+  const std::thread::id owner = std::this_thread::get_id();
+  absl::MutexLock l(&mu_);
+  ThreadBuffer* buffer = nullptr;
+  for (const auto& candidate : buffers_) {
+    if (candidate->owner == owner) {
+      buffer = candidate.get();
+      break;
+    }
+  }
+  if (buffer == nullptr) {
+    buffers_.push_back(absl::make_unique<ThreadBuffer>());
+    buffer = buffers_.back().get();
+    buffer->owner = owner;
+    buffer->thread_id = buffers_.size() - 1;
+    buffer->thread_name = DefaultThreadName();
+  }
+  cached_id = id_;
+  cached_buffer = buffer;
+  return buffer;
+}
+
+void Tracer::AddSpan(const char* const name, const char* const category,
+                     const absl::Time start, const absl::Time end,
+                     const char* const arg_name, const int64 arg) {
+  GetThreadBuffer()->events.push_back({.name = name,
+                                       .category = category,
+                                       .start = start,
+                                       .duration = end - start,
+                                       .arg_name = arg_name,
+                                       .arg = arg});
+}
+
+void Tracer::SetThreadName(const absl::string_view name) {
+  GetThreadBuffer()->thread_name = std::string(name);
+}
+
+void SetTraceThreadName(const absl::string_view name) {
+  DefaultThreadName() = std::string(name);
+}
+
+absl::Status Tracer::Write(file::FileWriter* const file) const {
+  absl::MutexLock l(&mu_);
+  std::string buffer = absl::StrFormat(
+      "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+      "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+      "\"args\":{\"name\":\"process %d\"}}",
+      process_id_, process_id_);
+  absl::Status status;
+  for (const auto& thread : buffers_) {
+    if (!thread->thread_name.empty()) {
+      absl::StrAppendFormat(&buffer,
+                            ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                            "\"pid\":%d,\"tid\":%d,\"args\":{\"name\":%s}}",
+                            process_id_, thread->thread_id,
+                            JsonString(thread->thread_name));
+    }
+    for (const Event& event : thread->events) {
+      // Complete events ("ph":"X") with timestamps in microseconds since the
+      // tracer was created.
+      absl::StrAppendFormat(
+          &buffer,
+          ",\n{\"name\":%s,\"cat\":%s,\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+          "\"pid\":%d,\"tid\":%d",
+          JsonString(event.name), JsonString(event.category),
+          absl::ToDoubleMicroseconds(event.start - origin_),
+          absl::ToDoubleMicroseconds(event.duration), process_id_,
+          thread->thread_id);
+      if (event.arg_name != nullptr) {
+        absl::StrAppend(&buffer, ",\"args\":{", JsonString(event.arg_name),
+                        ":", event.arg, "}");
+      }
+      buffer.push_back('}');
+      if (buffer.size() >= kWriteBufferSize) {
+        status.Update(file->WriteString(buffer));
+        buffer.clear();
+      }
+    }
+  }
+  buffer.append("\n]}\n");
+  status.Update(file->WriteString(buffer));
+  return status;
+}
+
+}  // namespace abesim
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_PORT_TRACE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_PORT_TRACE_H_
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT: Open source only.
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+
+namespace abesim {
+
+// A Tracer records spans of work on the threads that perform them and writes
+// them in the Chrome trace event format, which chrome://tracing and Perfetto
+// (ui.perfetto.dev) display as one timeline per thread.
+//
+// Each thread appends to its own buffer, so recording a span takes no locks
+// once the thread has recorded its first span.  The buffers are only read by
+// Write, which must not be called concurrently with recording.
+class Tracer {
+ public:
+  // process_id identifies the process in the trace, e.g. the node of a
+  // distributed simulation, so that the traces of several processes can be
+  // concatenated.
+  explicit Tracer(int process_id = 0);
+
+  // Records a span on the calling thread.  name, category and arg_name must
+  // outlive the tracer, e.g. be string literals.  arg_name, if not null, names
+  // an integer argument shown with the span.
+  void AddSpan(const char* name, const char* category, absl::Time start,
+               absl::Time end, const char* arg_name = nullptr,
+               int64 arg = 0);
+
+  // Names the calling thread in the trace.  Threads that don't call this are
+  // named by SetTraceThreadName, if at all.
+  void SetThreadName(absl::string_view name);
+
+  // Writes the spans recorded so far as a JSON trace.
+  absl::Status Write(file::FileWriter* file) const;
+
+ private:
+  struct Event {
+    const char* name;
+    const char* category;
+    absl::Time start;
+    absl::Duration duration;
+    const char* arg_name;
+    int64 arg;
+  };
+  struct ThreadBuffer {
+    std::thread::id owner;
+    int thread_id;
+    std::string thread_name;
+    std::vector<Event> events;
+  };
+
+  ThreadBuffer* GetThreadBuffer();
+
+  const uint64 id_;
+  const int process_id_;
+  const absl::Time origin_;
+  mutable absl::Mutex mu_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_ ABSL_GUARDED_BY(mu_);
+};
+
+// Names the calling thread in every tracer it records spans in afterwards.
+// Long-lived threads, e.g. executor workers, call this once when they start.
+void SetTraceThreadName(absl::string_view name);
+
+// Records a span from its construction to its destruction, if tracer is not
+// null.
+class TraceSpan {
+ public:
+  TraceSpan(Tracer* tracer, const char* name, const char* category,
+            const char* arg_name = nullptr, int64 arg = 0)
+      : tracer_(tracer),
+        name_(name),
+        category_(category),
+        arg_name_(arg_name),
+        arg_(arg),
+        start_(tracer != nullptr ? absl::Now() : absl::InfinitePast()) {}
+  ~TraceSpan() {
+    if (tracer_ != nullptr) {
+      tracer_->AddSpan(name_, category_, start_, absl::Now(), arg_name_, arg_);
+    }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  Tracer* const tracer_;
+  const char* const name_;
+  const char* const category_;
+  const char* const arg_name_;
+  const int64 arg_;
+  const absl::Time start_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_PORT_TRACE_H_
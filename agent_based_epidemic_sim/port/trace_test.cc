@@ -0,0 +1,103 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/port/trace.h"
+
+#include <string>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::HasSubstr;
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+std::string WriteTrace(const Tracer& tracer, absl::string_view name) {
+  const std::string path = TestPath(name);
+  auto file = file::OpenOrDie(path);
+  PANDEMIC_EXPECT_OK(tracer.Write(file.get()));
+  PANDEMIC_EXPECT_OK(file->Close());
+  std::string contents;
+  PANDEMIC_EXPECT_OK(file::GetContents(path, &contents));
+  return contents;
+}
+
+int CountSpans(absl::string_view trace, absl::string_view name) {
+  int count = 0;
+  for (absl::string_view line : absl::StrSplit(trace, '\n')) {
+    if (absl::StrContains(line, absl::StrCat("\"name\":\"", name, "\"")) &&
+        absl::StrContains(line, "\"ph\":\"X\"")) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+TEST(TracerTest, WritesSpansAsTraceEvents) {
+  Tracer tracer(/*process_id=*/3);
+  tracer.SetThreadName("main \"thread\"");
+  const absl::Time start = absl::Now();
+  tracer.AddSpan("chunk", "simulation", start, start + absl::Milliseconds(2),
+                 "chunk", 7);
+  { TraceSpan span(&tracer, "scoped", "simulation"); }
+  { TraceSpan span(nullptr, "ignored", "simulation"); }
+
+  const std::string trace = WriteTrace(tracer, "trace.json");
+  EXPECT_TRUE(absl::StartsWith(trace, "{\"displayTimeUnit\":\"ms\""));
+  EXPECT_TRUE(absl::EndsWith(trace, "]}\n"));
+  EXPECT_THAT(trace, HasSubstr("\"args\":{\"name\":\"main \\\"thread\\\"\"}"));
+  EXPECT_THAT(trace, HasSubstr("\"dur\":2000.000,\"pid\":3,\"tid\":0,"
+                               "\"args\":{\"chunk\":7}"));
+  EXPECT_EQ(CountSpans(trace, "chunk"), 1);
+  EXPECT_EQ(CountSpans(trace, "scoped"), 1);
+  EXPECT_EQ(CountSpans(trace, "ignored"), 0);
+}
+
+TEST(TracerTest, RecordsExecutorThreads) {
+  constexpr int kThreads = 4;
+  constexpr int kTasks = 100;
+  Tracer tracer;
+  auto executor = NewExecutor(kThreads);
+  executor->SetTracer(&tracer);
+  auto execution = executor->NewExecution();
+  for (int i = 0; i < kTasks; ++i) {
+    execution->Add([&tracer, i]() {
+      TraceSpan span(&tracer, "work", "test", "task", i);
+    });
+  }
+  execution->Wait();
+  executor->SetTracer(nullptr);
+  executor->NewExecution()->Wait();
+
+  const std::string trace = WriteTrace(tracer, "executor_trace.json");
+  EXPECT_EQ(CountSpans(trace, "work"), kTasks);
+  EXPECT_EQ(CountSpans(trace, "task"), kTasks);
+  EXPECT_EQ(CountSpans(trace, "wait"), 1);
+  EXPECT_THAT(trace, HasSubstr("\"args\":{\"name\":\"executor worker "));
+}
+
+}  // namespace
+}  // namespace abesim
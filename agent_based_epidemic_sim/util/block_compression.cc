@@ -0,0 +1,101 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "agent_based_epidemic_sim/util/block_compression.h"
+
+#include <cstring>
+#include <vector>
+
+#include "agent_based_epidemic_sim/util/varint.h"
+
+namespace abesim {
+namespace {
+
+constexpr int kMinMatch = 4;
+constexpr int kMatchHashBits = 12;
+
+uint32 MatchHash(const char* const bytes) {
+  uint32 value;
+  std::memcpy(&value, bytes, sizeof(value));
+  return (value * 2654435761u) >> (32 - kMatchHashBits);
+}
+
+void AppendLiterals(const absl::string_view block, const size_t begin,
+                    const size_t end, std::string* const out) {
+  PutVarint64(end - begin, out);
+  out->append(block.data() + begin, end - begin);
+}
+
+}  // namespace
+
+void CompressBlock(const absl::string_view block, std::string* const out) {
+  // The last position plus 1 of each hashed prefix, 0 if none.
+  std::vector<size_t> last_positions(1 << kMatchHashBits, 0);
+  size_t literals = 0;
+  size_t pos = 0;
+  while (pos + kMinMatch <= block.size()) {
+    size_t& last_position = last_positions[MatchHash(block.data() + pos)];
+    const size_t candidate = last_position;
+    last_position = pos + 1;
+    if (candidate == 0 ||
+        std::memcmp(block.data() + candidate - 1, block.data() + pos,
+                    kMinMatch) != 0) {
+      ++pos;
+      continue;
+    }
+    const size_t match = candidate - 1;
+    size_t length = kMinMatch;
+    while (pos + length < block.size() &&
+           block[match + length] == block[pos + length]) {
+      ++length;
+    }
+    AppendLiterals(block, literals, pos, out);
+    PutVarint64(pos - match, out);
+    PutVarint64(length - kMinMatch, out);
+    pos += length;
+    literals = pos;
+  }
+  AppendLiterals(block, literals, block.size(), out);
+}
+
+bool DecompressBlock(absl::string_view compressed, const uint64 size,
+                     std::string* const block) {
+  block->clear();
+  while (true) {
+    uint64 num_literals;
+    if (!GetVarint64(&compressed, &num_literals) ||
+        num_literals > size - block->size() ||
+        num_literals > compressed.size()) {
+      return false;
+    }
+    block->append(compressed.data(), num_literals);
+    compressed.remove_prefix(num_literals);
+    if (compressed.empty()) return block->size() == size;
+    uint64 offset;
+    uint64 length;
+    if (!GetVarint64(&compressed, &offset) ||
+        !GetVarint64(&compressed, &length) || offset == 0 ||
+        offset > block->size() || size - block->size() < kMinMatch ||
+        length > size - block->size() - kMinMatch) {
+      return false;
+    }
+    // Matches may overlap the bytes they produce.
+    for (uint64 i = 0; i < length + kMinMatch; ++i) {
+      block->push_back((*block)[block->size() - offset]);
+    }
+  }
+}
+
+}  // namespace abesim
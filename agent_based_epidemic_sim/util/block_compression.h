@@ -0,0 +1,59 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_UTIL_BLOCK_COMPRESSION_H_
+#define AGENT_BASED_EPIDEMIC_SIM_UTIL_BLOCK_COMPRESSION_H_
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+// A greedy LZ77 block codec in the spirit of LZ4, used for message batches and
+// columnar file blocks.  A compressed block is a sequence of literal runs,
+// each followed by a match copying earlier output unless it ends the block.
+// Runs are a varint length followed by the literals, matches a varint offset
+// followed by the varint length beyond the minimum match length.  The size of
+// the uncompressed block is not part of the compressed form and must be
+// stored alongside it.
+
+namespace abesim {
+
+// Compressed blocks are only decompressed up to this ratio, so that corrupt
+// or hostile input can't make a reader allocate far more memory than the
+// block it was given.
+constexpr uint64 kMaxCompressionRatio = 256;
+
+// True if a compressed block of compressed_size bytes may decompress to size
+// bytes.
+inline bool WithinCompressionRatio(const uint64 size,
+                                   const uint64 compressed_size) {
+  return size / kMaxCompressionRatio <= compressed_size;
+}
+
+// Appends the compressed form of block to out.
+void CompressBlock(absl::string_view block, std::string* out);
+
+// Replaces the contents of block with the decompression of compressed.
+// Returns false if compressed is corrupt or does not decompress to exactly
+// size bytes.
+bool DecompressBlock(absl::string_view compressed, uint64 size,
+                     std::string* block);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_UTIL_BLOCK_COMPRESSION_H_
@@ -0,0 +1,85 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "agent_based_epidemic_sim/util/block_compression.h"
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+std::string Compress(const absl::string_view block) {
+  std::string compressed;
+  CompressBlock(block, &compressed);
+  return compressed;
+}
+
+TEST(BlockCompressionTest, RoundTripsCompressibleBlocks) {
+  std::string block;
+  for (int i = 0; i < 100; ++i) block.append("abcdefgh");
+  const std::string compressed = Compress(block);
+  EXPECT_LT(compressed.size(), block.size() / 10);
+  std::string decompressed;
+  ASSERT_TRUE(DecompressBlock(compressed, block.size(), &decompressed));
+  EXPECT_EQ(decompressed, block);
+}
+
+TEST(BlockCompressionTest, RoundTripsIncompressibleBlocks) {
+  for (const absl::string_view block : {"", "abc", "abcdefghijklmnop"}) {
+    const std::string compressed = Compress(block);
+    EXPECT_GT(compressed.size(), block.size());
+    std::string decompressed = "stale";
+    ASSERT_TRUE(DecompressBlock(compressed, block.size(), &decompressed));
+    EXPECT_EQ(decompressed, block);
+  }
+}
+
+TEST(BlockCompressionTest, RoundTripsOverlappingMatches) {
+  const std::string block = std::string(1000, 'x') + "y";
+  std::string decompressed;
+  ASSERT_TRUE(DecompressBlock(Compress(block), block.size(), &decompressed));
+  EXPECT_EQ(decompressed, block);
+}
+
+TEST(BlockCompressionTest, RejectsCorruptBlocks) {
+  const std::string block = std::string(100, 'x');
+  const std::string compressed = Compress(block);
+  std::string decompressed;
+  EXPECT_FALSE(DecompressBlock(compressed, block.size() - 1, &decompressed));
+  EXPECT_FALSE(DecompressBlock(compressed, block.size() + 1, &decompressed));
+  EXPECT_FALSE(DecompressBlock(
+      absl::string_view(compressed).substr(0, compressed.size() - 1),
+      block.size(), &decompressed));
+  EXPECT_FALSE(DecompressBlock("", 0, &decompressed));
+  // A match reaching back before the start of the block.
+  std::string bad_offset;
+  PutVarint64(1, &bad_offset);
+  bad_offset.push_back('x');
+  PutVarint64(2, &bad_offset);
+  PutVarint64(0, &bad_offset);
+  EXPECT_FALSE(DecompressBlock(bad_offset, 5, &decompressed));
+}
+
+TEST(BlockCompressionTest, BoundsCompressionRatio) {
+  EXPECT_TRUE(WithinCompressionRatio(kMaxCompressionRatio, 1));
+  EXPECT_FALSE(WithinCompressionRatio(2 * kMaxCompressionRatio, 1));
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,386 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/util/columnar_file.h"
+
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/util/block_compression.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+
+namespace abesim {
+namespace {
+
+constexpr absl::string_view kMagic = "ABESCOL2";
+constexpr int kFixed64Size = 8;
+constexpr int kMaxVarint64Size = 10;
+
+// How a block is stored, recorded in its index entry.
+enum BlockCodec : uint8 {
+  kUncompressed = 0,
+  // Compressed by CompressBlock.
+  kCompressed = 1,
+};
+
+void PutFixed64(uint64 value, std::string* dst) {
+  for (int i = 0; i < kFixed64Size; ++i) {
+    dst->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+uint64 GetFixed64(absl::string_view input) {
+  uint64 value = 0;
+  for (int i = 0; i < kFixed64Size; ++i) {
+    value |= static_cast<uint64>(static_cast<uint8>(input[i])) << (8 * i);
+  }
+  return value;
+}
+
+absl::Status CorruptError(absl::string_view what) {
+  return absl::Status(absl::StatusCode::kDataLoss,
+                      absl::StrCat("Corrupt columnar file: ", what));
+}
+
+int64 EncodeDuration(absl::Duration value) {
+  // Saturates to kint64min/kint64max for infinite durations.
+  return absl::ToInt64Microseconds(value);
+}
+
+std::string EncodeBlock(const ColumnType type,
+                        const std::vector<int64>& values) {
+  std::string block;
+  if (type == ColumnType::kFloat) {
+    for (const int64 value : values) {
+      for (int i = 0; i < 4; ++i) {
+        block.push_back(static_cast<char>(value >> (8 * i)));
+      }
+    }
+    return block;
+  }
+  int64 previous = 0;
+  for (const int64 value : values) {
+    // Wrapping subtraction, undone by a wrapping addition when decoding.
+    const uint64 delta =
+        static_cast<uint64>(value) - static_cast<uint64>(previous);
+    PutVarint64(ZigZagEncode(static_cast<int64>(delta)), &block);
+    previous = value;
+  }
+  return block;
+}
+
+absl::Status DecodeBlock(const ColumnType type, absl::string_view block,
+                         const int64 rows, std::vector<int64>* values) {
+  values->clear();
+  // Every value takes at least one byte, which bounds the row count before
+  // anything is allocated for it.
+  if (rows < 0 || static_cast<uint64>(rows) > block.size()) {
+    return CorruptError("row count");
+  }
+  values->reserve(rows);
+  if (type == ColumnType::kFloat) {
+    if (block.size() != 4 * static_cast<size_t>(rows)) {
+      return CorruptError("float block size");
+    }
+    for (int64 row = 0; row < rows; ++row) {
+      uint32 bits = 0;
+      for (int i = 0; i < 4; ++i) {
+        bits |= static_cast<uint32>(static_cast<uint8>(block[4 * row + i]))
+                << (8 * i);
+      }
+      values->push_back(bits);
+    }
+    return absl::OkStatus();
+  }
+  uint64 previous = 0;
+  for (int64 row = 0; row < rows; ++row) {
+    uint64 encoded;
+    if (!GetVarint64(&block, &encoded)) return CorruptError("truncated block");
+    previous += static_cast<uint64>(ZigZagDecode(encoded));
+    values->push_back(static_cast<int64>(previous));
+  }
+  if (!block.empty()) return CorruptError("trailing block data");
+  return absl::OkStatus();
+}
+
+std::string FormatValue(const ColumnType type, const int64 value) {
+  switch (type) {
+    case ColumnType::kInt64:
+      return absl::StrCat(value);
+    case ColumnType::kFloat:
+      return absl::StrCat(DecodeColumnarFloat(value));
+    case ColumnType::kTime:
+      return absl::FormatTime(DecodeColumnarTime(value));
+    case ColumnType::kDuration:
+      return absl::FormatDuration(DecodeColumnarDuration(value));
+  }
+  return "";
+}
+
+}  // namespace
+
+float DecodeColumnarFloat(const int64 value) {
+  const uint32 bits = static_cast<uint32>(value);
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+absl::Time DecodeColumnarTime(const int64 value) {
+  if (value == kint64max) return absl::InfiniteFuture();
+  if (value == kint64min) return absl::InfinitePast();
+  return absl::FromUnixMicros(value);
+}
+
+absl::Duration DecodeColumnarDuration(const int64 value) {
+  if (value == kint64max) return absl::InfiniteDuration();
+  if (value == kint64min) return -absl::InfiniteDuration();
+  return absl::Microseconds(value);
+}
+
+ColumnarWriter::ColumnarWriter(file::FileWriter* const file,
+                               std::vector<ColumnSpec> columns,
+                               const int rows_per_group)
+    : file_(file),
+      columns_(std::move(columns)),
+      rows_per_group_(rows_per_group),
+      values_(columns_.size()) {
+  CHECK_LE(rows_per_group_, kMaxRowsPerGroup);
+  for (auto& values : values_) {
+    values.reserve(rows_per_group_);
+  }
+}
+
+void ColumnarWriter::AppendFloat(const int column, const float value) {
+  uint32 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  Append(column, ColumnType::kFloat, bits);
+}
+
+void ColumnarWriter::AppendTime(const int column, const absl::Time value) {
+  Append(column, ColumnType::kTime,
+         EncodeDuration(value - absl::UnixEpoch()));
+}
+
+void ColumnarWriter::AppendDuration(const int column,
+                                    const absl::Duration value) {
+  Append(column, ColumnType::kDuration, EncodeDuration(value));
+}
+
+absl::Status ColumnarWriter::EndRow() {
+  ++rows_;
+  for (const auto& values : values_) {
+    DCHECK_EQ(values.size(), rows_);
+  }
+  if (rows_ < rows_per_group_) return absl::OkStatus();
+  return FlushRowGroup();
+}
+
+absl::Status ColumnarWriter::FlushRowGroup() {
+  if (rows_ == 0) return absl::OkStatus();
+  absl::Status status;
+  if (offset_ == 0) {
+    status.Update(file_->WriteString(kMagic));
+    offset_ = kMagic.size();
+  }
+  PutVarint64(rows_, &row_group_index_);
+  for (int column = 0; column < columns_.size(); ++column) {
+    std::string block = EncodeBlock(columns_[column].type, values_[column]);
+    const uint64 encoded_size = block.size();
+    std::string compressed;
+    CompressBlock(block, &compressed);
+    const bool compress = compressed.size() < block.size();
+    if (compress) block = std::move(compressed);
+    PutVarint64(offset_, &row_group_index_);
+    PutVarint64(block.size(), &row_group_index_);
+    row_group_index_.push_back(
+        static_cast<char>(compress ? kCompressed : kUncompressed));
+    PutVarint64(encoded_size, &row_group_index_);
+    offset_ += block.size();
+    status.Update(file_->WriteBuffer(std::move(block)));
+    values_[column].clear();
+  }
+  ++row_groups_;
+  rows_ = 0;
+  return status;
+}
+
+absl::Status ColumnarWriter::Finish() {
+  DCHECK(!finished_);
+  finished_ = true;
+  absl::Status status = FlushRowGroup();
+  if (offset_ == 0) {
+    status.Update(file_->WriteString(kMagic));
+  }
+  std::string footer;
+  PutVarint64(columns_.size(), &footer);
+  for (const ColumnSpec& column : columns_) {
+    PutVarint64(column.name.size(), &footer);
+    footer.append(column.name);
+    PutVarint64(static_cast<uint64>(column.type), &footer);
+  }
+  PutVarint64(row_groups_, &footer);
+  footer.append(row_group_index_);
+  const uint64 footer_size = footer.size();
+  PutFixed64(footer_size, &footer);
+  footer.append(kMagic.data(), kMagic.size());
+  status.Update(file_->WriteBuffer(std::move(footer)));
+  return status;
+}
+
+StatusOr<std::unique_ptr<ColumnarReader>> ColumnarReader::Open(
+    absl::string_view file_name) {
+  std::string contents;
+  absl::Status status = file::GetContents(file_name, &contents);
+  if (!status.ok()) return status;
+  return FromContents(std::move(contents));
+}
+
+StatusOr<std::unique_ptr<ColumnarReader>> ColumnarReader::FromContents(
+    std::string contents) {
+  auto reader = absl::WrapUnique(new ColumnarReader());
+  reader->contents_ = std::move(contents);
+  absl::Status status = reader->Parse();
+  if (!status.ok()) return status;
+  return reader;
+}
+
+absl::Status ColumnarReader::Parse() {
+  const absl::string_view contents = contents_;
+  const size_t trailer_size = kFixed64Size + kMagic.size();
+  if (contents.size() < kMagic.size() + trailer_size ||
+      contents.substr(0, kMagic.size()) != kMagic ||
+      contents.substr(contents.size() - kMagic.size()) != kMagic) {
+    return CorruptError("bad magic");
+  }
+  const uint64 footer_size =
+      GetFixed64(contents.substr(contents.size() - trailer_size));
+  if (footer_size > contents.size() - kMagic.size() - trailer_size) {
+    return CorruptError("bad footer size");
+  }
+  const uint64 data_end = contents.size() - trailer_size - footer_size;
+  absl::string_view footer = contents.substr(data_end, footer_size);
+
+  uint64 column_count;
+  if (!GetVarint64(&footer, &column_count)) return CorruptError("footer");
+  for (uint64 i = 0; i < column_count; ++i) {
+    uint64 name_size, type;
+    if (!GetVarint64(&footer, &name_size) || footer.size() < name_size) {
+      return CorruptError("column name");
+    }
+    ColumnSpec column;
+    column.name = std::string(footer.substr(0, name_size));
+    footer.remove_prefix(name_size);
+    if (!GetVarint64(&footer, &type) ||
+        type > static_cast<uint64>(ColumnType::kDuration)) {
+      return CorruptError("column type");
+    }
+    column.type = static_cast<ColumnType>(type);
+    columns_.push_back(std::move(column));
+  }
+
+  uint64 row_group_count;
+  if (!GetVarint64(&footer, &row_group_count)) return CorruptError("footer");
+  for (uint64 i = 0; i < row_group_count; ++i) {
+    RowGroup row_group;
+    uint64 rows;
+    if (!GetVarint64(&footer, &rows)) return CorruptError("row group");
+    row_group.rows = rows;
+    for (uint64 column = 0; column < column_count; ++column) {
+      Block block;
+      if (!GetVarint64(&footer, &block.offset) ||
+          !GetVarint64(&footer, &block.size) ||
+          block.offset < kMagic.size() || block.offset > data_end ||
+          block.size > data_end - block.offset || footer.empty()) {
+        return CorruptError("block index");
+      }
+      block.codec = static_cast<uint8>(footer.front());
+      footer.remove_prefix(1);
+      if (!GetVarint64(&footer, &block.encoded_size)) {
+        return CorruptError("block index");
+      }
+      if (block.codec > kCompressed ||
+          (block.codec == kUncompressed && block.encoded_size != block.size)) {
+        return CorruptError("block codec");
+      }
+      row_group.blocks.push_back(block);
+    }
+    num_rows_ += row_group.rows;
+    row_groups_.push_back(std::move(row_group));
+  }
+  if (!footer.empty()) return CorruptError("trailing footer data");
+  return absl::OkStatus();
+}
+
+absl::Status ColumnarReader::ReadColumn(const int row_group, const int column,
+                                        std::vector<int64>* values) const {
+  if (row_group < 0 || row_group >= row_groups_.size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Row group out of range: ", row_group));
+  }
+  if (column < 0 || column >= columns_.size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Column out of range: ", column));
+  }
+  const RowGroup& group = row_groups_[row_group];
+  const Block& block = group.blocks[column];
+  absl::string_view data =
+      absl::string_view(contents_).substr(block.offset, block.size);
+  // No value takes more than a varint, which with the row count bounds the
+  // memory needed to decompress the block.
+  if (group.rows < 0 || group.rows > kMaxRowsPerGroup ||
+      block.encoded_size > static_cast<uint64>(kMaxVarint64Size * group.rows)) {
+    return CorruptError("row count");
+  }
+  std::string decompressed;
+  if (block.codec == kCompressed) {
+    if (!DecompressBlock(data, block.encoded_size, &decompressed)) {
+      return CorruptError("compressed block");
+    }
+    data = decompressed;
+  }
+  return DecodeBlock(columns_[column].type, data, group.rows, values);
+}
+
+absl::Status ColumnarReader::WriteCsv(file::FileWriter* const output) const {
+  std::string buffer;
+  for (int column = 0; column < columns_.size(); ++column) {
+    absl::StrAppend(&buffer, column == 0 ? "" : ",", columns_[column].name);
+  }
+  buffer += "\n";
+  absl::Status status;
+  std::vector<std::vector<int64>> values(columns_.size());
+  for (int row_group = 0; row_group < row_groups_.size(); ++row_group) {
+    for (int column = 0; column < columns_.size(); ++column) {
+      absl::Status read = ReadColumn(row_group, column, &values[column]);
+      if (!read.ok()) return read;
+    }
+    for (int64 row = 0; row < row_groups_[row_group].rows; ++row) {
+      for (int column = 0; column < columns_.size(); ++column) {
+        absl::StrAppend(&buffer, column == 0 ? "" : ",",
+                        FormatValue(columns_[column].type,
+                                    values[column][row]));
+      }
+      buffer += "\n";
+    }
+    status.Update(output->WriteBuffer(std::move(buffer)));
+    buffer.clear();
+  }
+  status.Update(output->WriteBuffer(std::move(buffer)));
+  return status;
+}
+
+}  // namespace abesim
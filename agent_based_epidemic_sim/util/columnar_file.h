@@ -0,0 +1,162 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_UTIL_COLUMNAR_FILE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_UTIL_COLUMNAR_FILE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/port/statusor.h"
+
+// A simple self-describing columnar file format for large tables of numbers,
+// such as the learning output of a simulation.  Rows are grouped into row
+// groups and every column of a row group is stored as a separately encoded
+// block:
+//   - int64, time and duration columns are stored as zigzag varint deltas
+//     between consecutive values.  Times and durations have microsecond
+//     resolution and infinite values are preserved.
+//   - float columns are stored as raw little endian IEEE 754 values.
+// Encoded blocks are then compressed with CompressBlock, see
+// block_compression.h, and stored compressed only if that makes them smaller.
+//
+// File layout:
+//   magic                 "ABESCOL2"
+//   block*                one block per column per row group
+//   footer
+//   footer size           little endian uint64
+//   magic                 "ABESCOL2"
+// The footer holds the schema followed by an index of all row groups:
+//   varint column count, then per column: varint name size, name, varint type
+//   varint row group count, then per row group: varint row count, and per
+//   column: varint block offset, varint block size, codec byte (0 for none,
+//   1 for CompressBlock), varint encoded block size
+
+namespace abesim {
+
+enum class ColumnType { kInt64 = 0, kFloat = 1, kTime = 2, kDuration = 3 };
+
+// Row groups hold at most this many rows, which bounds the memory needed to
+// decompress a block.
+constexpr int64 kMaxRowsPerGroup = 1 << 20;
+
+struct ColumnSpec {
+  std::string name;
+  ColumnType type;
+};
+
+// Writes rows of a fixed schema to a file in the columnar format.  Values are
+// appended column by column and each row is completed with EndRow.
+class ColumnarWriter {
+ public:
+  static constexpr int kDefaultRowsPerGroup = 1 << 16;
+
+  // Does not take ownership of file, which must outlive the writer.
+  // rows_per_group must be at most kMaxRowsPerGroup.
+  ColumnarWriter(file::FileWriter* file, std::vector<ColumnSpec> columns,
+                 int rows_per_group = kDefaultRowsPerGroup);
+
+  void AppendInt64(int column, int64 value) {
+    Append(column, ColumnType::kInt64, value);
+  }
+  void AppendFloat(int column, float value);
+  void AppendTime(int column, absl::Time value);
+  void AppendDuration(int column, absl::Duration value);
+
+  // Completes a row.  Every column must have received exactly one value.
+  absl::Status EndRow();
+  // Writes any buffered rows and the footer.  The file is not closed.
+  absl::Status Finish();
+
+ private:
+  void Append(int column, ColumnType type, int64 value) {
+    DCHECK(columns_[column].type == type) << columns_[column].name;
+    values_[column].push_back(value);
+  }
+  absl::Status FlushRowGroup();
+
+  file::FileWriter* const file_;
+  const std::vector<ColumnSpec> columns_;
+  const int rows_per_group_;
+  // Values of the current row group, encoded as int64, one vector per column.
+  std::vector<std::vector<int64>> values_;
+  int rows_ = 0;
+  uint64 offset_ = 0;
+  int row_groups_ = 0;
+  // The row group entries of the footer.
+  std::string row_group_index_;
+  bool finished_ = false;
+};
+
+// Reads a file written by ColumnarWriter.
+class ColumnarReader {
+ public:
+  static StatusOr<std::unique_ptr<ColumnarReader>> Open(
+      absl::string_view file_name);
+  static StatusOr<std::unique_ptr<ColumnarReader>> FromContents(
+      std::string contents);
+
+  const std::vector<ColumnSpec>& columns() const { return columns_; }
+  int num_row_groups() const { return row_groups_.size(); }
+  int64 num_rows() const { return num_rows_; }
+
+  // Decodes the values of one column of a row group.  Values are returned in
+  // their int64 encoding, see the Decode functions below.  Returns
+  // InvalidArgument for out of range indices and DataLoss for corrupt blocks.
+  absl::Status ReadColumn(int row_group, int column,
+                          std::vector<int64>* values) const;
+
+  // Writes the table as CSV, starting with a header of the column names.
+  absl::Status WriteCsv(file::FileWriter* output) const;
+
+ private:
+  struct Block {
+    uint64 offset;
+    uint64 size;
+    uint8 codec;
+    // The size of the block before compression.
+    uint64 encoded_size;
+  };
+  struct RowGroup {
+    int64 rows;
+    // The block of each column.
+    std::vector<Block> blocks;
+  };
+
+  ColumnarReader() = default;
+  absl::Status Parse();
+
+  std::string contents_;
+  std::vector<ColumnSpec> columns_;
+  std::vector<RowGroup> row_groups_;
+  int64 num_rows_ = 0;
+};
+
+// Convert values read by ColumnarReader::ReadColumn to their column type.
+float DecodeColumnarFloat(int64 value);
+absl::Time DecodeColumnarTime(int64 value);
+absl::Duration DecodeColumnarDuration(int64 value);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_UTIL_COLUMNAR_FILE_H_
@@ -0,0 +1,262 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/util/columnar_file.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/util/varint.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+
+class MemFileWriterImpl : public file::FileWriter {
+ public:
+  explicit MemFileWriterImpl(std::string* output) : output_(output) {}
+
+  absl::Status WriteString(absl::string_view content) override {
+    absl::StrAppend(output_, content);
+    return absl::OkStatus();
+  }
+
+  absl::Status Close() override { return absl::OkStatus(); }
+
+ private:
+  std::string* output_;
+};
+
+std::vector<ColumnSpec> TestColumns() {
+  return {{"uuid", ColumnType::kInt64},
+          {"infectivity", ColumnType::kFloat},
+          {"time", ColumnType::kTime},
+          {"duration", ColumnType::kDuration}};
+}
+
+TEST(ColumnarFileTest, RoundTripsValuesAcrossRowGroups) {
+  std::string contents;
+  MemFileWriterImpl file(&contents);
+  ColumnarWriter writer(&file, TestColumns(), /*rows_per_group=*/3);
+  const std::vector<int64> uuids = {5, -3, kint64max, kint64min, 0, 7, 42};
+  for (int i = 0; i < uuids.size(); ++i) {
+    writer.AppendInt64(0, uuids[i]);
+    writer.AppendFloat(1, 0.25f * i);
+    writer.AppendTime(2, i == 0 ? absl::InfiniteFuture()
+                                : absl::FromUnixSeconds(1000 * i));
+    writer.AppendDuration(3, absl::Minutes(i));
+    PANDEMIC_ASSERT_OK(writer.EndRow());
+  }
+  PANDEMIC_ASSERT_OK(writer.Finish());
+
+  auto reader_or = ColumnarReader::FromContents(contents);
+  PANDEMIC_ASSERT_OK(reader_or.status());
+  const ColumnarReader& reader = *reader_or.value();
+  EXPECT_EQ(reader.num_rows(), uuids.size());
+  EXPECT_EQ(reader.num_row_groups(), 3);
+  ASSERT_EQ(reader.columns().size(), 4);
+  EXPECT_EQ(reader.columns()[2].name, "time");
+  EXPECT_EQ(reader.columns()[2].type, ColumnType::kTime);
+
+  std::vector<int64> all_uuids;
+  std::vector<int64> values;
+  for (int row_group = 0; row_group < reader.num_row_groups(); ++row_group) {
+    PANDEMIC_ASSERT_OK(reader.ReadColumn(row_group, 0, &values));
+    all_uuids.insert(all_uuids.end(), values.begin(), values.end());
+  }
+  EXPECT_EQ(all_uuids, uuids);
+
+  PANDEMIC_ASSERT_OK(reader.ReadColumn(0, 1, &values));
+  EXPECT_EQ(DecodeColumnarFloat(values[2]), 0.5f);
+  PANDEMIC_ASSERT_OK(reader.ReadColumn(0, 2, &values));
+  EXPECT_EQ(DecodeColumnarTime(values[0]), absl::InfiniteFuture());
+  EXPECT_EQ(DecodeColumnarTime(values[1]), absl::FromUnixSeconds(1000));
+  PANDEMIC_ASSERT_OK(reader.ReadColumn(2, 3, &values));
+  EXPECT_THAT(values, ElementsAre(absl::ToInt64Microseconds(absl::Minutes(6))));
+}
+
+// Returns a file of a single float column with the given number of rows, whose
+// values are all equal if repeated and all different otherwise.
+std::string WriteFloats(const int rows, const bool repeated) {
+  std::string contents;
+  MemFileWriterImpl file(&contents);
+  ColumnarWriter writer(&file, {{"value", ColumnType::kFloat}});
+  for (int i = 0; i < rows; ++i) {
+    writer.AppendFloat(0, repeated ? 0.25f : static_cast<float>(i) + 0.5f);
+    EXPECT_TRUE(writer.EndRow().ok());
+  }
+  EXPECT_TRUE(writer.Finish().ok());
+  return contents;
+}
+
+std::vector<float> ReadFloats(const std::string& contents) {
+  auto reader = ColumnarReader::FromContents(contents);
+  EXPECT_TRUE(reader.ok()) << reader.status();
+  std::vector<float> floats;
+  std::vector<int64> values;
+  for (int row_group = 0; row_group < reader.value()->num_row_groups();
+       ++row_group) {
+    EXPECT_TRUE(reader.value()->ReadColumn(row_group, 0, &values).ok());
+    for (const int64 value : values) {
+      floats.push_back(DecodeColumnarFloat(value));
+    }
+  }
+  return floats;
+}
+
+TEST(ColumnarFileTest, RoundTripsCompressedBlocks) {
+  constexpr int kRows = 1000;
+  const std::string contents = WriteFloats(kRows, /*repeated=*/true);
+  // Raw float blocks take four bytes per row.
+  EXPECT_LT(contents.size(), kRows);
+  EXPECT_THAT(ReadFloats(contents),
+              testing::AllOf(testing::SizeIs(kRows), testing::Each(0.25f)));
+}
+
+TEST(ColumnarFileTest, RoundTripsUncompressedBlocks) {
+  constexpr int kRows = 3;
+  const std::string contents = WriteFloats(kRows, /*repeated=*/false);
+  // Too short to compress, so the block is stored as is.
+  EXPECT_GT(contents.size(), 4 * kRows);
+  EXPECT_THAT(ReadFloats(contents), ElementsAre(0.5f, 1.5f, 2.5f));
+}
+
+TEST(ColumnarFileTest, DetectsCorruptCompressedBlocks) {
+  std::string contents = WriteFloats(1000, /*repeated=*/true);
+  // The first compressed block starts right after the magic with the length
+  // of its first literal run, which now overruns the block.
+  contents[8] = static_cast<char>(0x7f);
+  auto reader = ColumnarReader::FromContents(contents);
+  PANDEMIC_ASSERT_OK(reader.status());
+  std::vector<int64> values;
+  EXPECT_EQ(reader.value()->ReadColumn(0, 0, &values).code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST(ColumnarFileTest, WritesCsv) {
+  std::string contents;
+  MemFileWriterImpl file(&contents);
+  ColumnarWriter writer(&file, TestColumns());
+  for (int i = 0; i < 2; ++i) {
+    writer.AppendInt64(0, i);
+    writer.AppendFloat(1, 0.5f);
+    writer.AppendTime(2, absl::UnixEpoch() + absl::Hours(i));
+    writer.AppendDuration(3, absl::Minutes(30));
+    PANDEMIC_ASSERT_OK(writer.EndRow());
+  }
+  PANDEMIC_ASSERT_OK(writer.Finish());
+
+  auto reader = ColumnarReader::FromContents(contents);
+  PANDEMIC_ASSERT_OK(reader.status());
+  std::string csv;
+  MemFileWriterImpl csv_file(&csv);
+  PANDEMIC_ASSERT_OK(reader.value()->WriteCsv(&csv_file));
+  EXPECT_EQ(csv, absl::StrCat(
+                     "uuid,infectivity,time,duration\n", "0,0.5,",
+                     absl::FormatTime(absl::UnixEpoch()), ",30m\n", "1,0.5,",
+                     absl::FormatTime(absl::UnixEpoch() + absl::Hours(1)),
+                     ",30m\n"));
+}
+
+TEST(ColumnarFileTest, EmptyTable) {
+  std::string contents;
+  MemFileWriterImpl file(&contents);
+  ColumnarWriter writer(&file, TestColumns());
+  PANDEMIC_ASSERT_OK(writer.Finish());
+
+  auto reader = ColumnarReader::FromContents(contents);
+  PANDEMIC_ASSERT_OK(reader.status());
+  EXPECT_EQ(reader.value()->num_rows(), 0);
+  EXPECT_EQ(reader.value()->columns().size(), 4);
+}
+
+TEST(ColumnarFileTest, DetectsCorruption) {
+  std::string contents;
+  MemFileWriterImpl file(&contents);
+  ColumnarWriter writer(&file, TestColumns());
+  writer.AppendInt64(0, 1);
+  writer.AppendFloat(1, 1.0f);
+  writer.AppendTime(2, absl::UnixEpoch());
+  writer.AppendDuration(3, absl::ZeroDuration());
+  PANDEMIC_ASSERT_OK(writer.EndRow());
+  PANDEMIC_ASSERT_OK(writer.Finish());
+
+  EXPECT_EQ(ColumnarReader::FromContents(contents.substr(1)).status().code(),
+            absl::StatusCode::kDataLoss);
+  EXPECT_EQ(ColumnarReader::FromContents(
+                contents.substr(0, contents.size() - 1))
+                .status()
+                .code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST(ColumnarFileTest, DetectsCorruptRowCount) {
+  // A single float column whose row group claims far more rows than its
+  // four byte block holds.
+  const std::string magic = "ABESCOL2";
+  std::string footer;
+  PutVarint64(1, &footer);
+  PutVarint64(1, &footer);
+  footer.append("f");
+  PutVarint64(static_cast<uint64>(ColumnType::kFloat), &footer);
+  PutVarint64(1, &footer);
+  PutVarint64(uint64{1} << 62, &footer);
+  PutVarint64(magic.size(), &footer);
+  PutVarint64(4, &footer);
+  footer.push_back('\0');  // Uncompressed.
+  PutVarint64(4, &footer);
+  std::string contents = magic + std::string(4, '\0') + footer;
+  for (int i = 0; i < 8; ++i) {
+    contents.push_back(static_cast<char>(footer.size() >> (8 * i)));
+  }
+  contents.append(magic);
+
+  auto reader = ColumnarReader::FromContents(contents);
+  PANDEMIC_ASSERT_OK(reader.status());
+  std::vector<int64> values;
+  EXPECT_EQ(reader.value()->ReadColumn(0, 0, &values).code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST(ColumnarFileTest, ReadColumnRejectsOutOfRangeIndices) {
+  std::string contents;
+  MemFileWriterImpl file(&contents);
+  ColumnarWriter writer(&file, TestColumns());
+  writer.AppendInt64(0, 1);
+  writer.AppendFloat(1, 1.0f);
+  writer.AppendTime(2, absl::UnixEpoch());
+  writer.AppendDuration(3, absl::ZeroDuration());
+  PANDEMIC_ASSERT_OK(writer.EndRow());
+  PANDEMIC_ASSERT_OK(writer.Finish());
+
+  auto reader = ColumnarReader::FromContents(contents);
+  PANDEMIC_ASSERT_OK(reader.status());
+  std::vector<int64> values;
+  EXPECT_EQ(reader.value()->ReadColumn(1, 0, &values).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(reader.value()->ReadColumn(-1, 0, &values).code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(reader.value()->ReadColumn(0, 4, &values).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace abesim
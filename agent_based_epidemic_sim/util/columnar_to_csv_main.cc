@@ -0,0 +1,43 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Converts a columnar learning output file to CSV.
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/util/columnar_file.h"
+
+ABSL_FLAG(std::string, input_path, "", "Path of the columnar file to read.");
+ABSL_FLAG(std::string, output_path, "", "Path of the CSV file to write.");
+
+namespace abesim {
+
+int Main() {
+  auto reader = ColumnarReader::Open(absl::GetFlag(FLAGS_input_path));
+  CHECK_EQ(absl::OkStatus(), reader.status());
+  auto output = file::OpenAsyncOrDie(absl::GetFlag(FLAGS_output_path));
+  CHECK_EQ(absl::OkStatus(), reader.value()->WriteCsv(output.get()));
+  CHECK_EQ(absl::OkStatus(), output->Close());
+  return 0;
+}
+
+}  // namespace abesim
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+  return abesim::Main();
+}
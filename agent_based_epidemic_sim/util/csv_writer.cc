@@ -0,0 +1,38 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/util/csv_writer.h"
+
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+
+namespace abesim {
+
+CsvWriter::CsvWriter(std::unique_ptr<file::FileWriter> file,
+                     absl::string_view header)
+    : file_(std::move(file)),
+      status_(file_->WriteString(absl::StrCat(header, "\n"))) {}
+
+absl::Status CsvWriter::Write(absl::string_view lines) {
+  status_.Update(file_->WriteString(lines));
+  return status_;
+}
+
+absl::Status CsvWriter::Close() {
+  status_.Update(file_->Close());
+  return status_;
+}
+
+}  // namespace abesim
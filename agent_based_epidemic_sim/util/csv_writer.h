@@ -0,0 +1,48 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_UTIL_CSV_WRITER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_UTIL_CSV_WRITER_H_
+
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+
+namespace abesim {
+
+// Writes a CSV file of a header line followed by rows.  The first error is
+// kept and returned by every later call, so callers may only check the status
+// of Close.
+class CsvWriter {
+ public:
+  // Writes header, without its trailing newline, as the first line.
+  CsvWriter(std::unique_ptr<file::FileWriter> file, absl::string_view header);
+
+  // Appends lines, each ending in a newline.
+  absl::Status Write(absl::string_view lines);
+  // Must be called before destroying the object.
+  absl::Status Close();
+
+ private:
+  std::unique_ptr<file::FileWriter> file_;
+  absl::Status status_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_UTIL_CSV_WRITER_H_
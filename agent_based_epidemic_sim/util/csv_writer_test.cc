@@ -0,0 +1,41 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/util/csv_writer.h"
+
+#include <cstdlib>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+TEST(CsvWriterTest, WritesHeaderAndLines) {
+  const std::string path = absl::StrCat(getenv("TEST_TMPDIR"), "/", "out.csv");
+  CsvWriter writer(file::OpenOrDie(path), "a,b");
+  PANDEMIC_EXPECT_OK(writer.Write("1,2\n"));
+  PANDEMIC_EXPECT_OK(writer.Write("3,4\n5,6\n"));
+  PANDEMIC_ASSERT_OK(writer.Close());
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(path, &contents));
+  EXPECT_EQ(contents, "a,b\n1,2\n3,4\n5,6\n");
+}
+
+}  // namespace
+}  // namespace abesim
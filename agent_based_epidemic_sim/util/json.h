@@ -0,0 +1,48 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_UTIL_JSON_H_
+#define AGENT_BASED_EPIDEMIC_SIM_UTIL_JSON_H_
+
+#include <string>
+
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+
+namespace abesim {
+
+// Returns value as a quoted JSON string.  Quotes, backslashes and control
+// characters are escaped; other bytes, including UTF-8, are copied as is.
+inline std::string JsonString(absl::string_view value) {
+  std::string escaped = "\"";
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      absl::StrAppendFormat(&escaped, "\\u%04x",
+                            static_cast<unsigned char>(c));
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  escaped.push_back('"');
+  return escaped;
+}
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_UTIL_JSON_H_
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_UTIL_VARINT_H_
+#define AGENT_BASED_EPIDEMIC_SIM_UTIL_VARINT_H_
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// Appends value to dst as a little-endian base 128 varint.
+inline void PutVarint64(uint64 value, std::string* dst) {
+  while (value >= 0x80) {
+    dst->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  dst->push_back(static_cast<char>(value));
+}
+
+// Reads a varint from the front of input and advances input past it.  Returns
+// false if input does not start with a complete varint.
+inline bool GetVarint64(absl::string_view* input, uint64* value) {
+  uint64 result = 0;
+  for (int shift = 0; shift < 64 && !input->empty(); shift += 7) {
+    const uint8 byte = static_cast<uint8>(input->front());
+    input->remove_prefix(1);
+    result |= static_cast<uint64>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Maps signed integers to unsigned ones so that values of small magnitude,
+// positive or negative, have short varint encodings.
+inline uint64 ZigZagEncode(int64 value) {
+  return (static_cast<uint64>(value) << 1) ^ static_cast<uint64>(value >> 63);
+}
+inline int64 ZigZagDecode(uint64 value) {
+  return static_cast<int64>(value >> 1) ^ -static_cast<int64>(value & 1);
+}
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_UTIL_VARINT_H_